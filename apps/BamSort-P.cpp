@@ -61,7 +61,7 @@ namespace mpi = boost::mpi;
 
 class _BamSortOptions : public OptionsBaseInterface {
 public:
-	_BamSortOptions() : unmappedReads(), unmappedReadPairs(), keepUnmappedPairedRead(true), numPartitions(0) {
+	_BamSortOptions() : unmappedReads(), unmappedReadPairs(), keepUnmappedPairedRead(true), numPartitions(0), maxMemory(0) {
 	}
 	virtual ~_BamSortOptions() {}
 	std::string &getUnmappedReads() {
@@ -82,6 +82,9 @@ public:
 	int &getNumPartitions() {
 		return numPartitions;
 	}
+	int &getMaxMemory() {
+		return maxMemory;
+	}
 	void _resetDefaults() {
 		GeneralOptions::_resetDefaults();
 		GeneralOptions::getOptions().getDebug() = 0;
@@ -97,7 +100,8 @@ public:
 				("unmapped-read-pairs", po::value<std::string>()->default_value(unmappedReadPairs), "gzipped file to place unmapped read Pairs Fastqs (can be same as --unmapped-reads)")
 				("unmapped-reads", po::value<std::string>()->default_value(unmappedReads), "gzipped file to place unmapped reads Fastqs (can be same as --unmapped-read-pairs)")
 				("keep-unmapped-paired-read", po::value<bool>()->default_value(keepUnmappedPairedRead), "if unmapped-read-pairs file is specified, keep an unmapped read in the bam if its pair is mapped")
-				("num-partitions", po::value<int>()->default_value(numPartitions), "The number of alignment-index partitions to merge. Input bams expected to come ordered grouped by in batches of num-partitions where each group has the exact same read counts in the exact same order");
+				("num-partitions", po::value<int>()->default_value(numPartitions), "The number of alignment-index partitions to merge. Input bams expected to come ordered grouped by in batches of num-partitions where each group has the exact same read counts in the exact same order")
+				("max-memory", po::value<int>()->default_value(maxMemory), "if set, the MB of reads each rank may hold in memory. Sorted runs are spilled to --temp-dir and merged into the output");
 		desc.add(opts);
 
 		GeneralOptions::_setOptions(desc, p);
@@ -114,6 +118,7 @@ public:
 		setOpt("output-bam", outputBam);
 		setOpt2("input-bams", inputBams);
 		setOpt("num-partitions", numPartitions);
+		setOpt("max-memory", maxMemory);
 
 		if (outputBam.empty())
 			setOptionsErrorMsg("You must specify at least the outputBam");
@@ -121,6 +126,12 @@ public:
 		if (inputBams.empty())
 			setOptionsErrorMsg("You must specify at least one input bam");
 
+		if (maxMemory < 0)
+			setOptionsErrorMsg("--max-memory must not be negative");
+
+		if (maxMemory > 0 && numPartitions > 1)
+			setOptionsErrorMsg("--max-memory can not be used with --num-partitions");
+
 		if (unmappedReads.empty() && !unmappedReadPairs.empty()) {
 			unmappedReads = unmappedReadPairs;
 		}
@@ -138,9 +149,109 @@ private:
 	std::string unmappedReadPairs;
 	bool keepUnmappedPairedRead;
 	int numPartitions;
+	int maxMemory;
 };
 typedef OptionsBaseTemplate< _BamSortOptions > BamSortOptions;
 
+// The gzipped fastq files that unmapped reads are purged to.
+// They are written as .tmp files and renamed by close()
+class UnmappedReadFiles {
+public:
+	typedef boost::shared_ptr< ScopedMPIFile > FilePtr;
+	UnmappedReadFiles(const mpi::communicator &_world, std::string _unmappedReadPairFile, std::string _unmappedReadsFile, bool _keepUnmappedPairedRead)
+	: world(_world), unmappedReadPairFile(_unmappedReadPairFile), unmappedReadsFile(_unmappedReadsFile),
+	  tmpFile(unmappedReadPairFile + ".tmp"), tmpFile2(unmappedReadsFile + ".tmp"), keepUnmappedPairedRead(_keepUnmappedPairedRead) {
+		if (!isEnabled())
+			return;
+		if (world.rank() == 0) {
+			unlink(tmpFile.c_str());
+			unlink(tmpFile2.c_str());
+		}
+		world.barrier();
+		if (!unmappedReadPairFile.empty() && unmappedReadPairFile.compare("/dev/null") != 0)
+			pairedReads.reset(new ScopedMPIFile(world, tmpFile));
+		if (!unmappedReadsFile.empty() && unmappedReadsFile.compare("/dev/null") != 0) {
+			if (pairedReads.get() != NULL && tmpFile.compare(tmpFile2) == 0)
+				singleReads = pairedReads;
+			else
+				singleReads.reset(new ScopedMPIFile(world, tmpFile2));
+		}
+	}
+	~UnmappedReadFiles() {
+		close();
+	}
+	bool isEnabled() const {
+		return !unmappedReadPairFile.empty() || !unmappedReadsFile.empty();
+	}
+
+	// collective. moves the unmapped reads out of reads and appends them to the files
+	// returns true if reads is left with NULL entries to collapse
+	bool purge(BamVector &reads) {
+		bool needsCollapse = false;
+		BamVector unmappedReadSingles, unmappedReadPairs, unmappedPairedReads;
+
+		SamUtils::splitUnmapped(reads, unmappedReadSingles, unmappedReadPairs, unmappedPairedReads, keepUnmappedPairedRead);
+		if (!unmappedReadSingles.empty() || !unmappedReadPairs.empty() || (!keepUnmappedPairedRead && !unmappedPairedReads.empty())) {
+			needsCollapse = true;
+		}
+		LOG_VERBOSE(1, "Purging unmapped read pairs: " << unmappedReadPairs.size());
+		if (pairedReads.get() != NULL) {
+			LOG_VERBOSE(1, "Writing unmappedReadPairs " << unmappedReadPairs.size() << " to " << unmappedReadPairFile << " (" << tmpFile << ")");
+
+			SamUtils::writeFastqGz(world, unmappedReadPairs, *pairedReads, true);
+			world.barrier();
+		}
+		assert(unmappedReadPairs.empty());
+
+		LOG_VERBOSE(1, "Purging unmapped read singles: " << unmappedPairedReads.size() << " and " << unmappedReadSingles.size());
+
+		if (singleReads.get() != NULL) {
+			LOG_VERBOSE(1, "Writing unmappedPairedReads " << unmappedPairedReads.size() << " to " << unmappedReadsFile << " (" << tmpFile2 << ")");
+
+			SamUtils::writeFastqGz(world, unmappedPairedReads, *singleReads, !keepUnmappedPairedRead);
+
+			LOG_VERBOSE(1, "Writing unmappedReadSingles " << unmappedReadSingles.size() << " to " << unmappedReadsFile << " (" << tmpFile2 << ")");
+
+			SamUtils::writeFastqGz(world, unmappedReadSingles, *singleReads, true);
+			world.barrier();
+		}
+		assert(unmappedReadSingles.empty());
+		assert(keepUnmappedPairedRead || unmappedPairedReads.empty());
+
+		BamManager::destroyOrRecycleBamVector(unmappedReadSingles);
+		BamManager::destroyOrRecycleBamVector(unmappedReadPairs);
+		if (keepUnmappedPairedRead) {
+			unmappedPairedReads.clear();
+		} else {
+			BamManager::destroyOrRecycleBamVector(unmappedPairedReads);
+		}
+		return needsCollapse;
+	}
+
+	// collective
+	void close() {
+		if (!isEnabled())
+			return;
+		singleReads.reset();
+		pairedReads.reset();
+		if (world.rank() == 0) {
+			unlink(unmappedReadsFile.c_str());
+			unlink(unmappedReadPairFile.c_str());
+			rename(tmpFile.c_str(), unmappedReadPairFile.c_str());
+			if (tmpFile.compare(tmpFile2) != 0) {
+				rename(tmpFile2.c_str(), unmappedReadsFile.c_str());
+			}
+		}
+		unmappedReadPairFile.clear();
+		unmappedReadsFile.clear();
+	}
+private:
+	mpi::communicator world;
+	std::string unmappedReadPairFile, unmappedReadsFile, tmpFile, tmpFile2;
+	bool keepUnmappedPairedRead;
+	FilePtr pairedReads, singleReads;
+};
+
 int main(int argc, char **argv)
 {
 	ScopedMPIComm< BamSortOptions > world(argc, argv);
@@ -175,6 +286,43 @@ int main(int argc, char **argv)
 		if (world.rank() == 0)
 			unlink(outputBamTmp.c_str());
 		world.barrier();
+
+		bool keepUnmappedPairedRead = BamSortOptions::getOptions().getKeepUnmappedPairedRead();
+		UnmappedReadFiles unmappedReadFiles(world, BamSortOptions::getOptions().getUnmappedReadPairs(),
+				BamSortOptions::getOptions().getUnmappedReads(), keepUnmappedPairedRead);
+		int64_t maxMemory = (int64_t) BamSortOptions::getOptions().getMaxMemory() * 1024 * 1024;
+
+		if (maxMemory > 0) {
+			LOG_VERBOSE_GATHER(1, "Reading and spilling sorted runs of input files");
+			SamUtils::MPIExternalSortBam sortem(world, maxMemory);
+			std::vector<samfile_t*> fps;
+			std::vector<long> myEnds;
+			bool needsBalance;
+			header = BamStreamUtils::openBamFiles(world, inputBams, fps, myEnds, needsBalance);
+			int myMore = 1, ourMore = 1;
+			while (ourMore != 0) {
+				myMore = BamStreamUtils::readBamFiles(fps, myEnds, reads, sortem.getBatchBytes(), header) ? 1 : 0;
+				if (unmappedReadFiles.isEnabled() && unmappedReadFiles.purge(reads))
+					SamUtils::collapseVector(reads);
+				sortem.addRun(reads);
+				MPI_Allreduce(&myMore, &ourMore, 1, MPI_INT, MPI_LOR, world);
+			}
+			unmappedReadFiles.close();
+
+			LOG_VERBOSE_GATHER(1, "Merging sorted runs");
+			sortem.sortGlobal(outputBamTmp, header.get());
+			world.barrier();
+			if (world.rank() == 0) {
+				unlink(outputBam.c_str());
+				rename(outputBamTmp.c_str(), outputBam.c_str());
+			}
+			header.reset();
+
+			BamManager::clearRecycledReads();
+			LOG_VERBOSE_GATHER(1, "Finished");
+
+			return 0;
+		}
 	
 		LOG_VERBOSE_GATHER(1, "Reading input files");
 		if (partitions > 1) {
@@ -193,73 +341,15 @@ int main(int argc, char **argv)
 			header = BamStreamUtils::readBamFile(world, inputBams, reads);
 		}
 	
-		bool needsCollapse = false;
-		bool keepUnmappedPairedRead = BamSortOptions::getOptions().getKeepUnmappedPairedRead();
-		std::string unmappedReadPairFile = BamSortOptions::getOptions().getUnmappedReadPairs();
-		std::string unmappedReadsFile  = BamSortOptions::getOptions().getUnmappedReads();
-		BamVector unmappedReadSingles, unmappedReadPairs, unmappedPairedReads;
-		if (!unmappedReadPairFile.empty() || !unmappedReadsFile.empty()) {
-
-			std::string tmpFile(unmappedReadPairFile + ".tmp");
-			std::string tmpFile2(unmappedReadsFile + ".tmp");
-			if (world.rank() == 0) {
-				unlink(tmpFile.c_str());
-				unlink(tmpFile2.c_str());
+		if (unmappedReadFiles.isEnabled()) {
+			bool needsCollapse = unmappedReadFiles.purge(reads);
+			unmappedReadFiles.close();
+
+			if (needsCollapse) {
+				LOG_DEBUG(1, "Collapsing read vector");
+				long removed = SamUtils::collapseVector(reads);
+				LOG_DEBUG(1, "Collapsed: " << removed);
 			}
-			world.barrier();
-
-			SamUtils::splitUnmapped(reads, unmappedReadSingles, unmappedReadPairs, unmappedPairedReads, keepUnmappedPairedRead);
-			if (!unmappedReadSingles.empty() || !unmappedReadPairs.empty() || (!keepUnmappedPairedRead && !unmappedPairedReads.empty())) {
-				needsCollapse = true;
-			}
-			LOG_VERBOSE(1, "Purging unmapped read pairs: " << unmappedReadPairs.size());
-			if (!unmappedReadPairFile.empty() && unmappedReadPairFile.compare("/dev/null") != 0) {
-				LOG_VERBOSE(1, "Writing unmappedReadPairs " << unmappedReadPairs.size() << " to " << unmappedReadPairFile << " (" << tmpFile << ")");
-
-				ScopedMPIFile pairedReads(world, tmpFile);
-				SamUtils::writeFastqGz(world, unmappedReadPairs, pairedReads, true);
-				world.barrier();
-			}
-			assert(unmappedReadPairs.empty());
-
-			LOG_VERBOSE(1, "Purging unmapped read singles: " << unmappedPairedReads.size() << " and " << unmappedReadSingles.size());
-
-			if (!unmappedReadsFile.empty() && unmappedReadsFile.compare("/dev/null") != 0) {
-				LOG_VERBOSE(1, "Writing unmappedPairedReads " << unmappedPairedReads.size() << " to " << unmappedReadsFile << " (" << tmpFile2 << ")");
-
-				ScopedMPIFile singleReads(world, tmpFile2);
-				SamUtils::writeFastqGz(world, unmappedPairedReads, singleReads, !keepUnmappedPairedRead);
-
-				LOG_VERBOSE(1, "Writing unmappedReadSingles " << unmappedReadSingles.size() << " to " << unmappedReadsFile << " (" << tmpFile2 << ")");
-
-				SamUtils::writeFastqGz(world, unmappedReadSingles, singleReads, true);
-				world.barrier();
-			}
-			assert(unmappedReadSingles.empty());
-			assert(keepUnmappedPairedRead || unmappedPairedReads.empty());
-
-			if (world.rank() == 0) {
-				unlink(unmappedReadsFile.c_str());
-				unlink(unmappedReadPairFile.c_str());
-				rename(tmpFile.c_str(), unmappedReadPairFile.c_str());
-				if (tmpFile.compare(tmpFile2) != 0) {
-					rename(tmpFile2.c_str(), unmappedReadsFile.c_str());
-				}
-			}
-
-		}
-
-		if (needsCollapse) {
-			LOG_DEBUG(1, "Collapsing read vector");
-			long removed = SamUtils::collapseVector(reads);
-			LOG_DEBUG(1, "Collapsed: " << removed);			
-		}
-		BamManager::destroyOrRecycleBamVector(unmappedReadSingles);
-		BamManager::destroyOrRecycleBamVector(unmappedReadPairs);
-		if (keepUnmappedPairedRead) {
-			unmappedPairedReads.clear();
-		} else {
-			BamManager::destroyOrRecycleBamVector(unmappedPairedReads);
 		}
 	
 		{
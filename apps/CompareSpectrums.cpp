@@ -48,6 +48,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 *****************/
 
 #include <iostream>
+#include <sys/mman.h>
 #include <boost/foreach.hpp>
 #define foreach BOOST_FOREACH
 
@@ -56,6 +57,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 #include "Kmer.h"
 #include "KmerSpectrum.h"
 #include "KmerReadUtils.h"
+#include "MmapTempFile.h"
 #include "Options.h"
 #include "Utils.h"
 #include "Log.h"
@@ -72,7 +74,7 @@ class _CS_Options : public OptionsBaseInterface {
 	// cache of variables (for inline lookup and defaults)
 
 public:
-	_CS_Options() : referenceFiles(), circularReference(false), perRead(false) {}
+	_CS_Options() : referenceFiles(), circularReference(false), perRead(false), referenceKmerMmap(), inputKmerMmap() {}
 	virtual ~_CS_Options() {}
 
 	void _resetDefaults() {
@@ -97,7 +99,11 @@ public:
 
 					 ("circular-reference", po::value<bool>()->default_value(circularReference), "if set, reference file should be treated as circular")
 
-					 ("per-read", po::value<bool>()->default_value(perRead), "if set, each read in readset1 will be compared to the entire readset2 separately");
+					 ("per-read", po::value<bool>()->default_value(perRead), "if set, each read in readset1 will be compared to the entire readset2 separately")
+
+					 ("reference-kmer-mmap", po::value<string>(), "instead of reference-file(s), compare the kmer spectrum saved by FilterReads --save-kmer-mmap with this name")
+
+					 ("input-kmer-mmap", po::value<string>(), "instead of input-file(s), compare the kmer spectrum saved by FilterReads --save-kmer-mmap with this name");
 
 
 		desc.add(opts);
@@ -110,6 +116,12 @@ public:
 		setOpt2("reference-file", referenceFiles);
 		setOpt("circular-reference", circularReference);
 		setOpt("per-read", perRead);
+		setOpt("reference-kmer-mmap", referenceKmerMmap);
+		setOpt("input-kmer-mmap", inputKmerMmap);
+		if (referenceKmerMmap.empty() != inputKmerMmap.empty()) {
+			setOptionsErrorMsg("Please specify both --reference-kmer-mmap and --input-kmer-mmap to compare saved spectrums");
+			ret = false;
+		}
 
 		ret &= GeneralOptions::_parseOptions(vm);
 		ret &= KmerBaseOptions::_parseOptions(vm);
@@ -126,10 +138,17 @@ public:
 	bool &getPerRead() {
 		return perRead;
 	}
+	string &getReferenceKmerMmap() {
+		return referenceKmerMmap;
+	}
+	string &getInputKmerMmap() {
+		return inputKmerMmap;
+	}
 
 private:
 	FileListType referenceFiles;
 	bool circularReference, perRead;
+	string referenceKmerMmap, inputKmerMmap;
 
 };
 
@@ -161,6 +180,178 @@ static NumbersVector countCommonKmers(KmerSolidMap &m1, KmerSolidMap &m2) {
 	return ret;
 }
 
+// A read-only view of a kmer spectrum saved by FilterReads --save-kmer-mmap
+// each of the solid, weak and singleton maps is striped by kmer hash into a power of 2 buckets,
+// and stored bucket by bucket, so kmers from the same hash stripe of two spectrums can be
+// joined without hashing or random I/O, even when the spectrums have different bucket counts
+class SavedSpectrum {
+public:
+	typedef TrackingDataWithDirection DataType;
+	typedef KmerMap<DataType> MapType;
+	typedef KmerMapByKmerArrayPair<TrackingDataSingleton> SingletonMapType;
+	typedef MapType::NumberType NumberType;
+
+	class KmerCount {
+	public:
+		const Kmer *kmer;
+		unsigned long count;
+		KmerCount(const Kmer &_kmer, unsigned long _count) : kmer(&_kmer), count(_count) {}
+		bool operator<(const KmerCount &other) const {
+			return kmer->compare(*other.kmer) < 0;
+		}
+	};
+	typedef std::vector<KmerCount> KmerCounts;
+
+	SavedSpectrum(string mmapFilename) {
+		_open(mmapFilename + "-solid", false);
+		_open(mmapFilename, false);
+		_open(mmapFilename + "-singleton", true);
+		if (_mmaps.empty())
+			LOG_THROW("Terribly sorry but there were no kmer spectrum mmap files at: " << mmapFilename << "*\n\tCan not continue");
+	}
+
+	NumberType getMinNumBuckets() const {
+		NumberType minBuckets = _numBuckets[0];
+		for(unsigned int i = 1; i < _numBuckets.size(); i++)
+			minBuckets = std::min(minBuckets, _numBuckets[i]);
+		return minBuckets;
+	}
+
+	// sets the kmers, sorted, from all buckets in hash stripe 'group' of numGroups (a power of 2 no larger than any map)
+	void getGroup(NumberType group, NumberType numGroups, KmerCounts &kmerCounts) const {
+		kmerCounts.clear();
+		bool isSorted = true;
+		int nonEmpty = 0;
+		for(unsigned int mapIdx = 0; mapIdx < _mmaps.size(); mapIdx++) {
+			for(NumberType bucketIdx = group; bucketIdx < _numBuckets[mapIdx]; bucketIdx += numGroups) {
+				const void *src = _mmaps[mapIdx].data() + _offsets[mapIdx][bucketIdx];
+				unsigned long oldSize = kmerCounts.size();
+				if (_isSingleton[mapIdx])
+					isSorted &= _append(SingletonMapType::BucketType::restore(src), kmerCounts);
+				else
+					isSorted &= _append(MapType::BucketType::restore(src), kmerCounts);
+				if (kmerCounts.size() > oldSize)
+					nonEmpty++;
+			}
+		}
+		if (!isSorted || nonEmpty > 1)
+			std::sort(kmerCounts.begin(), kmerCounts.end());
+	}
+
+private:
+	void _open(string filename, bool isSingleton) {
+		Kmernator::MmapFile mmap = MmapTempFile::openMmap(filename);
+		if (!mmap.is_open() || mmap.size() == 0)
+			return;
+		madvise(const_cast<char*>(mmap.data()), mmap.size(), MADV_SEQUENTIAL);
+		NumberType numBuckets, mask, *offsets;
+		MapType::_getMmapSizes(mmap.data(), numBuckets, mask, offsets);
+		LOG_VERBOSE(1, "Opened saved kmer map " << filename << " with " << numBuckets << " buckets");
+		_mmaps.push_back(mmap);
+		_numBuckets.push_back(numBuckets);
+		_offsets.push_back(offsets);
+		_isSingleton.push_back(isSingleton);
+	}
+
+	template<typename BucketType>
+	static bool _append(const BucketType &bucket, KmerCounts &kmerCounts) {
+		for(typename BucketType::IndexType i = 0; i < bucket.size(); i++)
+			kmerCounts.push_back(KmerCount(bucket.get(i), bucket.valueAt(i).getCount()));
+		return bucket.isSorted();
+	}
+
+	Kmernator::MmapFileVector _mmaps;
+	std::vector<NumberType> _numBuckets;
+	std::vector<const NumberType *> _offsets;
+	std::vector<bool> _isSingleton;
+};
+
+// the common and total kmers and counts of two spectrums, and the log2 binned depths of the common kmers
+class SpectrumComparison {
+public:
+	static const int DEPTH_BINS = 32;
+
+	SpectrumComparison() : size1(0), size2(0), common(DEPTH_BINS * DEPTH_BINS, 0), counts(5, 0) {}
+
+	void add(unsigned long count1, unsigned long count2) {
+		if (count1 > 0) {
+			size1++;
+			counts[3] += count1;
+		}
+		if (count2 > 0) {
+			size2++;
+			counts[4] += count2;
+		}
+		if (count1 > 0 && count2 > 0) {
+			counts[0]++;
+			counts[1] += count1;
+			counts[2] += count2;
+			common[getBin(count1) * DEPTH_BINS + getBin(count2)]++;
+		}
+	}
+	SpectrumComparison &operator+=(const SpectrumComparison &other) {
+		size1 += other.size1;
+		size2 += other.size2;
+		for(unsigned int i = 0; i < common.size(); i++)
+			common[i] += other.common[i];
+		for(unsigned int i = 0; i < counts.size(); i++)
+			counts[i] += other.counts[i];
+		return *this;
+	}
+	static int getBin(unsigned long count) {
+		int bin = 0;
+		while (count >>= 1)
+			bin++;
+		return std::min(bin, DEPTH_BINS - 1);
+	}
+
+	unsigned long size1, size2;
+	NumbersVector common; // DEPTH_BINS x DEPTH_BINS of common kmers by depth bin in set 1 and set 2
+	NumbersVector counts; // as returned by countCommonKmers
+};
+
+// merge-joins two sorted stripes, summing duplicate kmers within a spectrum
+static void joinSortedKmers(const SavedSpectrum::KmerCounts &a, const SavedSpectrum::KmerCounts &b, SpectrumComparison &comparison) {
+	SavedSpectrum::KmerCounts::const_iterator itA = a.begin(), itB = b.begin();
+	while (itA != a.end() || itB != b.end()) {
+		int cmp = (itA == a.end()) ? 1 : (itB == b.end()) ? -1 : itA->kmer->compare(*itB->kmer);
+		unsigned long countA = 0, countB = 0;
+		if (cmp <= 0) {
+			const Kmer &kmer = *itA->kmer;
+			for( ; itA != a.end() && itA->kmer->compare(kmer) == 0; itA++)
+				countA += itA->count;
+		}
+		if (cmp >= 0) {
+			const Kmer &kmer = *itB->kmer;
+			for( ; itB != b.end() && itB->kmer->compare(kmer) == 0; itB++)
+				countB += itB->count;
+		}
+		comparison.add(countA, countB);
+	}
+}
+
+static SpectrumComparison compareSavedSpectrums(const SavedSpectrum &spectrum1, const SavedSpectrum &spectrum2) {
+	long numGroups = std::min(spectrum1.getMinNumBuckets(), spectrum2.getMinNumBuckets());
+	LOG_VERBOSE(1, "Joining saved spectrums over " << numGroups << " hash stripes");
+	SpectrumComparison comparison;
+	#pragma omp parallel
+	{
+		SpectrumComparison myComparison;
+		SavedSpectrum::KmerCounts a, b;
+		#pragma omp for schedule(static)
+		for(long group = 0; group < numGroups; group++) {
+			spectrum1.getGroup(group, numGroups, a);
+			spectrum2.getGroup(group, numGroups, b);
+			joinSortedKmers(a, b, myComparison);
+		}
+		#pragma omp critical (compareSavedSpectrums)
+		comparison += myComparison;
+	}
+	return comparison;
+}
+
+void outputCommon(std::ostream &os, unsigned long size1, unsigned long size2, const NumbersVector &common, std::string label = "");
+void outputDepthCorrelation(std::ostream &os, const SpectrumComparison &comparison);
 void evaluate(std::ostream &os, KS &ks1, KS &ks2, std::string label = "");
 void evaluatePerRead(std::ostream &os, KS &ks1, KS &ks2, ReadSet &readSet1);
 
@@ -179,6 +370,19 @@ int main(int argc, char *argv[]) {
 
 
 	KmerSizer::set(KmerBaseOptions::getOptions().getKmerSize());
+
+	if (!CS_Options::getOptions().getReferenceKmerMmap().empty()) {
+		SavedSpectrum spectrum1(CS_Options::getOptions().getReferenceKmerMmap());
+		SavedSpectrum spectrum2(CS_Options::getOptions().getInputKmerMmap());
+		SpectrumComparison comparison = compareSavedSpectrums(spectrum1, spectrum2);
+
+		*outPtr << endl;
+		*outPtr << "Set 1\tSet 2\tCommon\t%Uniq1\t%Tot1\t%Uniq2\t%Tot2\n";
+		outputCommon(*outPtr, comparison.size1, comparison.size2, comparison.counts);
+		outputDepthCorrelation(*outPtr, comparison);
+		return 0;
+	}
+
 	OptionsBaseInterface::FileListType &fileList1 = CS_Options::getOptions().getReferenceFiles();
 	OptionsBaseInterface::FileListType &fileList2 = Options::getOptions().getInputFiles();
 
@@ -229,17 +433,29 @@ void evaluate(std::ostream &os, KS &ks1, KS &ks2, std::string label) {
 
 	NumbersVector common = countCommonKmers(m1, m2);
 
-	// TODO fix check common to iterater through same-bucketed KmerMaps in sorted order (fast)
 	// TODO if perRead1, iterate through common matches and output non-zero % matches
 
-	os << m1.size() << '\t' << m2.size() << '\t' << common[0] << '\t'
-			<< setprecision(4) << (common[0] * 100.0) / m1.size() << '\t'
+	outputCommon(os, m1.size(), m2.size(), common, label);
+}
+void outputCommon(std::ostream &os, unsigned long size1, unsigned long size2, const NumbersVector &common, std::string label) {
+	os << size1 << '\t' << size2 << '\t' << common[0] << '\t'
+			<< setprecision(4) << (common[0] * 100.0) / size1 << '\t'
 			<< (common[1] * 100.0 / common[3]) << "\t" << (common[0]
-			                                                      * 100.0) / m2.size() << "\t" << (common[2] * 100.0 / common[4])
+			                                                      * 100.0) / size2 << "\t" << (common[2] * 100.0 / common[4])
 			                                                      << '\t' << label
 			                                                      << endl;
 
 }
+void outputDepthCorrelation(std::ostream &os, const SpectrumComparison &comparison) {
+	os << endl;
+	os << "Depth1\tDepth2\tCommon\n";
+	for(int i = 0; i < SpectrumComparison::DEPTH_BINS; i++)
+		for(int j = 0; j < SpectrumComparison::DEPTH_BINS; j++) {
+			unsigned long count = comparison.common[i * SpectrumComparison::DEPTH_BINS + j];
+			if (count > 0)
+				os << (1ul << i) << '\t' << (1ul << j) << '\t' << count << '\n';
+		}
+}
 void evaluatePerRead(std::ostream &os, KS &ks1, KS &ks2, ReadSet &readSet1) {
 	for(ReadSet::ReadSetSizeType readIdx = 0; readIdx < readSet1.getSize(); readIdx++ ) {
 
@@ -62,6 +62,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 #include "Cap3.h"
 #include "Newbler.h"
 #include "KmerMatch.h"
+#include "MinimizerMatch.h"
 #include "MatcherInterface.h"
 
 using namespace std;
@@ -86,10 +87,12 @@ public:
 	void _resetDefaults() {
 		NewblerOptions::_resetDefaults();
 		Cap3Options::_resetDefaults();
+		ExternalAssemblerOptions::_resetDefaults();
 		ContigExtenderBaseOptions::_resetDefaults();
 		MatcherInterfaceOptions::_resetDefaults();
 		VmatchOptions::_resetDefaults();
 		KmerMatchOptions::_resetDefaults();
+		MinimizerMatchOptions::_resetDefaults();
 		KmerBaseOptions::_resetDefaults();
 		KmerSpectrumOptions::_resetDefaults();
 		MPIOptions::_resetDefaults();
@@ -127,12 +130,14 @@ public:
 
 		MatcherInterfaceOptions::_setOptions(desc,p);
 		KmerMatchOptions::_setOptions(desc,p);
+		MinimizerMatchOptions::_setOptions(desc,p);
 		KmerBaseOptions::_setOptions(desc,p);
 		KmerSpectrumOptions::_setOptions(desc,p);
 		VmatchOptions::_setOptions(desc,p);
 		ContigExtenderBaseOptions::_setOptions(desc,p);
 		NewblerOptions::_setOptions(desc, p);
 		Cap3Options::_setOptions(desc,p);
+		ExternalAssemblerOptions::_setOptions(desc,p);
 		MPIOptions::_setOptions(desc,p);
 		FilterKnownOdditiesOptions::_setOptions(desc,p);
 		GeneralOptions::_setOptions(desc,p);
@@ -144,12 +149,14 @@ public:
 		ret &= GeneralOptions::_parseOptions(vm);
 		ret &= MatcherInterfaceOptions::_parseOptions(vm);
 		ret &= KmerMatchOptions::_parseOptions(vm);
+		ret &= MinimizerMatchOptions::_parseOptions(vm);
 		ret &= KmerBaseOptions::_parseOptions(vm);
 		ret &= KmerSpectrumOptions::_parseOptions(vm);
 		ret &= VmatchOptions::_parseOptions(vm);
 		ret &= ContigExtenderBaseOptions::_parseOptions(vm);
 		ret &= NewblerOptions::_parseOptions(vm);
 		ret &= Cap3Options::_parseOptions(vm);
+		ret &= ExternalAssemblerOptions::_parseOptions(vm);
 		ret &= MPIOptions::_parseOptions(vm);
 		ret &= FilterKnownOdditiesOptions::_parseOptions(vm);
 
@@ -168,6 +175,12 @@ public:
 		if (GeneralOptions::getOptions().getInputFiles().empty()) {
 			setOptionsErrorMsg("You must specify at least one --input-file");
 		}
+		// the KmerMatch spectrum (of KmerMapGoogleSparse) can not be stored in a checkpoint
+		bool isKmerMatch = KmerBaseOptions::getOptions().getKmerSize() > 0 && MinimizerMatchOptions::getOptions().getMinimizerWindow() <= 0;
+		if (isKmerMatch && (MPIOptions::getOptions().getCheckpointReads() > 0 || !MPIOptions::getOptions().getResumeFrom().empty())) {
+			setOptionsErrorMsg("--checkpoint-reads and --resume-from are not supported when matching by kmers");
+			ret = false;
+		}
 
 		return ret;
 	}
@@ -274,6 +287,54 @@ std::string extendContigsWithContigExtender(ReadSet & contigs,
 	return extendLog.str();
 }
 
+std::string extendContigsWithLocalDeBruijn(ReadSet & contigs,
+		ReadSet::ReadSetVector &contigReadSet, ReadSet & changedContigs,
+		ReadSet & finalContigs, SequenceLengthType minKmerSize,
+		double minimumCoverage, SequenceLengthType maxKmerSize,
+		SequenceLengthType maxExtend, SequenceLengthType kmerStep) {
+
+	long numContigs = contigs.getSize();
+	std::vector< Read > newReads(numContigs);
+	std::vector< std::string > extendLogs(numContigs);
+
+	// each contig owns its extender, so contigs extend independently and are collected in order
+	#pragma omp parallel for schedule(dynamic)
+	for (long i = 0; i < numContigs; i++) {
+		const Read &oldRead = contigs.getRead(i);
+		ReadSet::ReadSetSizeType poolSize = contigReadSet[i].getSize();
+		std::string::size_type leftTotal = 0, rightTotal = 0;
+		std::stringstream extendLog;
+		double extTime = MPI_Wtime();
+		if (poolSize > minimumCoverage) {
+			LOG_VERBOSE_OPTIONAL(2, true, "native-Extending " << oldRead.getName() << " with " << poolSize << " pool of reads");
+			LocalDeBruijnExtender extender(contigReadSet[i], minKmerSize, maxKmerSize, kmerStep);
+			std::string fasta = extender.extend(oldRead.getFasta(), maxExtend, leftTotal, rightTotal);
+			if (leftTotal + rightTotal > 0)
+				newReads[i] = Read(ContigExtender<KS>::getNewName(oldRead.getName(), leftTotal, rightTotal), fasta, std::string(fasta.length(), Read::REF_QUAL), "");
+		}
+		extTime = MPI_Wtime() - extTime;
+		if (leftTotal + rightTotal > 0) {
+			extendLog << std::endl << "Native Extended " << oldRead.getName() << " "
+					<< (leftTotal + rightTotal) << " bases to " << newReads[i].getLength() << ": "
+					<< newReads[i].getName() << " with " << poolSize
+					<< " reads in the pool, in " << extTime << " sec";
+		} else {
+			extendLog << std::endl << "Did not extend " << oldRead.getName() << " with " << poolSize << " reads in the pool, in " << extTime << " sec";
+		}
+		extendLogs[i] = extendLog.str();
+	}
+
+	std::string extendLog;
+	for (long i = 0; i < numContigs; i++) {
+		if (newReads[i].getLength() > 0)
+			changedContigs.append(newReads[i]);
+		else
+			finalContigs.append(contigs.getRead(i));
+		extendLog += extendLogs[i];
+	}
+	return extendLog;
+}
+
 void finishLongContigs(long maxContigLength, ReadSet &changedContigs, ReadSet &finalContigs) {
 	ReadSet keepContigs;
 	for(long i = 0; i < (long) changedContigs.getSize(); i++) {
@@ -324,6 +385,10 @@ std::string runPartialBatch(mpi::communicator world, boost::shared_ptr< MatcherI
 		for(int i = 0; i < numThreads; i++) {
 				extendLogs[i] = newblerInstances[i].extendContigs(contigs, contigReadSet, changedContigs, finalContigs, minimumCoverage, i, numThreads);
 		}
+	} else if (ContigExtenderBaseOptions::getOptions().getNativeExtender()) {
+		extendLog = extendContigsWithLocalDeBruijn(contigs, contigReadSet,
+				changedContigs, finalContigs,
+				minKmerSize, minimumCoverage, maxKmerSize, maxExtend, kmerStep);
 	} else {
 		extendLog = extendContigsWithContigExtender(contigs, contigReadSet,
 				changedContigs, finalContigs,
@@ -340,6 +405,9 @@ int main(int argc, char *argv[]) {
 
 	ForkDaemon::initialize();
 
+	// start the assembler workers while this process is still small and before MPI_Init
+	ExternalAssemblerWorkerPool::initialize(argc, argv);
+
 	ScopedMPIComm< DistributedNucleatingAssemblerOptions > world(argc, argv);
 
 	Cleanup::prepare();
@@ -392,6 +460,8 @@ int main(int argc, char *argv[]) {
 		boost::shared_ptr< MatcherInterface > matcher;
 		if (KmerBaseOptions::getOptions().getKmerSize() == 0) {
 			matcher.reset( new Vmatch(world, UniqueName::generateHashName(inputFiles), reads) );
+		} else if (MinimizerMatchOptions::getOptions().getMinimizerWindow() > 0) {
+			matcher.reset( new MinimizerMatch(world, reads) );
 		} else {
 			matcher.reset( new KmerMatch(world, reads) );
 		}
@@ -533,6 +603,7 @@ int main(int argc, char *argv[]) {
 
 		LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Finished");
 
+		ExternalAssemblerWorkerPool::finalize();
 		ForkDaemon::finalize();
 
 	} catch (std::exception &e) {
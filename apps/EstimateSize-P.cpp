@@ -74,7 +74,9 @@ class _MPIEstimateSizeOptions: public OptionsBaseInterface {
 public:
 	_MPIEstimateSizeOptions() :
 		samplePartitions(50),
-		maxSampleFraction(0.05) {
+		maxSampleFraction(0.05),
+		convergenceTolerance(0.01),
+		maxErrorRate(0.5) {
 	}
 	~_MPIEstimateSizeOptions() {
 	}
@@ -85,6 +87,12 @@ public:
 	double &getMaxSampleFraction() {
 		return maxSampleFraction;
 	}
+	double &getConvergenceTolerance() {
+		return convergenceTolerance;
+	}
+	double &getMaxErrorRate() {
+		return maxErrorRate;
+	}
 	void _resetDefaults() {
 		MPIOptions::_resetDefaults();
 		KmerBaseOptions::_resetDefaults();
@@ -111,10 +119,12 @@ public:
 
 						("max-sample-fraction", po::value<double>()->default_value(maxSampleFraction), "The maximum amount of data to read")
 
+						("convergence-tolerance", po::value<double>()->default_value(convergenceTolerance), "Stop reading once the last 3 genome size estimates agree within this fraction (0 to always read max-sample-fraction)")
+
+						("max-error-rate", po::value<double>()->default_value(maxErrorRate), "The maximum kmer error rate of the model. Do not trust an estimate near this rate unless the data is *really* bad")
 
 						;
 		desc.add(opts);
-		KmerSpectrumOptions::_setOptions(desc, p);
 
 		MPIOptions::_setOptions(desc, p);
 		GeneralOptions::_setOptions(desc, p);
@@ -130,16 +140,44 @@ public:
 
 		setOpt("sample-partitions", samplePartitions);
 		setOpt("max-sample-fraction", maxSampleFraction);
+		setOpt("convergence-tolerance", convergenceTolerance);
+		setOpt("max-error-rate", maxErrorRate);
+		if (maxErrorRate <= 0.0 || maxErrorRate > 1.0) {
+			setOptionsErrorMsg("--max-error-rate must be > 0 and <= 1");
+			ret = false;
+		}
+		// the spectrum (of KmerMapGoogleSparse) can not be stored in a checkpoint
+		if (MPIOptions::getOptions().getCheckpointReads() > 0 || !MPIOptions::getOptions().getResumeFrom().empty()) {
+			setOptionsErrorMsg("--checkpoint-reads and --resume-from are not supported by EstimateSize-P");
+			ret = false;
+		}
 
 		return ret;
 	}
 protected:
 	long samplePartitions;
 	double maxSampleFraction;
+	double convergenceTolerance;
+	double maxErrorRate;
 
 };
 typedef OptionsBaseTemplate< _MPIEstimateSizeOptions > MPIEstimateSizeOptions;
 
+// one streaming pass over all of the input, in partitions chunks per rank, without building a spectrum
+KmerCardinality estimateKmerCardinality(mpi::communicator &world, OptionsBaseInterface::FileListType &inputs, long partitions) {
+	KmerCardinality cardinality;
+	CountMinSketch repeats(KmerCardinality::getSketchBytes(), 4);
+	for (long iter = 0; iter < partitions; iter++) {
+		ReadSet reads;
+		reads.appendAllFiles(inputs, world.rank()*partitions + iter, world.size()*partitions);
+		setGlobalReadSetConstants(world, reads);
+		cardinality.addReads(reads, repeats);
+		LOG_VERBOSE_OPTIONAL(2, world.rank() == 0, "Sketched partition " << iter << " of " << partitions);
+	}
+	KS::reduceKmerCardinality(world, cardinality);
+	return cardinality;
+}
+
 
 int main(int argc, char *argv[]) {
 
@@ -157,7 +195,23 @@ int main(int argc, char *argv[]) {
 
 		long partitions = MPIEstimateSizeOptions::getOptions().getSamplePartitions();
 		double maxFraction = MPIEstimateSizeOptions::getOptions().getMaxSampleFraction();
+		double tolerance = MPIEstimateSizeOptions::getOptions().getConvergenceTolerance();
+		double maxErrorRate = MPIEstimateSizeOptions::getOptions().getMaxErrorRate();
 		assert(maxFraction < 1.0);
+
+		if (KmerBaseOptions::getOptions().getKmerSize() > 0 && KmerSpectrumOptions::getOptions().getCardinalitySketchMB() > 0) {
+			KmerCardinality cardinality = estimateKmerCardinality(world, inputs, partitions);
+			if (world.rank() == 0) {
+				LOG_VERBOSE_OPTIONAL(1, true, "Estimated distinct kmers: " << cardinality.getDistinct() << " (+/- " << cardinality.distinct.getStandardError() * 100.0 << "%)");
+				// each rank counts repeats on its own, so kmers repeated only across ranks are missed
+				LOG_VERBOSE_OPTIONAL(1, true, "Estimated solid kmers: " << cardinality.getSolid() << (world.size() > 1 ? " (a lower bound)" : ""));
+				LOG_VERBOSE_OPTIONAL(1, true, "Total raw kmers: " << cardinality.rawKmers);
+			}
+			world.barrier();
+			LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Finished");
+			return 0;
+		}
+
 		double fraction = 0.0;
 		long totalPartitions = (long) partitions / maxFraction;
 
@@ -165,6 +219,8 @@ int main(int argc, char *argv[]) {
 		unsigned long totalBases = 0;
 		long rawKmers = 0;
 		KS spectrum(world, 0);
+		KS::SizeTracker reducedSizeTracker;
+		std::vector<double> genomeSizes;
 		for (long iter = 0 ; iter < partitions && fraction < maxFraction; iter++) {
 			fraction += (double) 1. / (double) totalPartitions;
 	
@@ -175,6 +231,9 @@ int main(int argc, char *argv[]) {
 			setGlobalReadSetConstants(world, reads);
 	
 			unsigned long counts[3], totalCounts[3];
+			counts[0] = reads.getSize();
+			counts[1] = 0;
+			counts[2] = reads.getBaseCount();
 	
 			mpi::all_reduce(world, (unsigned long*) counts, 3, (unsigned long*) totalCounts, std::plus<unsigned long>());
 			totalReads += totalCounts[0];
@@ -196,6 +255,30 @@ int main(int argc, char *argv[]) {
 					std::string hist = h.toString();
 					LOG_DEBUG_OPTIONAL(1, world.rank() == 0, "Collective Kmer Histogram\n" << hist);
 				}
+
+				if (tolerance > 0.0) {
+					// stop sampling once the genome size estimate is stable
+					reducedSizeTracker = spectrum.reduceSizeTracker(world);
+					int converged = 0;
+					if (world.rank() == 0) {
+						KS::SizeTracker::GrowthModel model = reducedSizeTracker.fitGrowthModel(maxErrorRate);
+						LOG_VERBOSE_OPTIONAL(1, true, "Iteration " << iter << " estimate " << model.toString());
+						if (model.converged && model.errorRate < maxErrorRate)
+							genomeSizes.push_back(model.genomeSize);
+						else
+							genomeSizes.clear();
+						if (genomeSizes.size() >= 3) {
+							double minSize = *std::min_element(genomeSizes.end() - 3, genomeSizes.end());
+							double maxSize = *std::max_element(genomeSizes.end() - 3, genomeSizes.end());
+							converged = (maxSize - minSize) <= tolerance * maxSize ? 1 : 0;
+						}
+					}
+					mpi::broadcast(world, converged, 0);
+					if (converged) {
+						LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Genome size estimate converged after reading " << fraction*100 << "%");
+						break;
+					}
+				}
 			}
 	
 		}
@@ -203,71 +286,37 @@ int main(int argc, char *argv[]) {
 		std::string hist = spectrum.getHistogram(false);
 		LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Collective Kmer Histogram\n" << hist);
 	
-		KS::SizeTracker reducedSizeTracker = spectrum.reduceSizeTracker(world);
-		std::string reducedSizeTrackerFile = outputFilename;
-		if (reducedSizeTrackerFile.empty()) {
-			reducedSizeTrackerFile = UniqueName::generateUniqueName("tmp-estimateSize");
-		}
+		reducedSizeTracker = spectrum.reduceSizeTracker(world);
 		float errorRate = TrackingData::getErrorRate();
 		LOG_DEBUG_OPTIONAL(1, true, "Kmer error rate: " << errorRate);
 		float commonErrorRate = 0.0;
 		MPI_Reduce(&errorRate, &commonErrorRate, 1, MPI_FLOAT, MPI_SUM, 0, world);
 		commonErrorRate /= (float) world.size();
 		if (world.rank() == 0) {
-			{
-				LOG_VERBOSE_OPTIONAL(1, true, "Writing size tracking file to:" << reducedSizeTrackerFile);
-				LOG_DEBUG_OPTIONAL(1, true, "SizeTracker:\n" << reducedSizeTracker.toString());
-				OfstreamMap ofm(reducedSizeTrackerFile, "");
+			LOG_DEBUG_OPTIONAL(1, true, "SizeTracker:\n" << reducedSizeTracker.toString());
+			if (!outputFilename.empty()) {
+				LOG_VERBOSE_OPTIONAL(1, true, "Writing size tracking file to:" << outputFilename);
+				OfstreamMap ofm(outputFilename, "");
 				ofm.getOfstream("") << reducedSizeTracker.toString();
 			}
-			std::string basePath = FileUtils::getBasePath(argv[0]);
-			std::stringstream cmdss;
-			cmdss << "Rscript " << basePath << "/EstimateSize.R " << reducedSizeTrackerFile; // << " " << (commonErrorRate*1.25);
-			std::string command = cmdss.str();
-	
-			if (!FileUtils::getBasePath("Rscript").empty() || basePath.empty()) {
-	
-				LOG_DEBUG_OPTIONAL(1, true, "Executing: " << command);
-				IPipestream ipipe(command);
-				double errorRate = 0.0, genomeSize = 0.0;
-				bool readValues = false;
-				while (ipipe.good() && !ipipe.eof()) {
-					std::string line;
-					std::getline(ipipe, line);
-					LOG_DEBUG_OPTIONAL(2, true, "Read: " << line);
-					if (line.find("errorRate") != std::string::npos) {
-						LOG_DEBUG_OPTIONAL(2, true, "Found headers in: " << line);
-						readValues = true;
-						continue;
-					}
-					if (readValues) {
-						readValues = false;
-						LOG_DEBUG_OPTIONAL(2, true, "Reading errorRate and GenomeSize from " << line);
-						std::stringstream ss;
-						ss << line;
-						ss >> errorRate;
-						ss >> genomeSize;
-					}
-				}
-				LOG_VERBOSE_OPTIONAL(1, true, "Estimated Kmer-quality errorRate: " << commonErrorRate);
-				LOG_VERBOSE_OPTIONAL(1, true, "Distributed readCount: " << totalReads);
-				LOG_VERBOSE_OPTIONAL(1, true, "Estimated fractionRead: " << fraction);
-				LOG_VERBOSE_OPTIONAL(1, true, "Estimated errorRate: " << errorRate);
-				LOG_VERBOSE_OPTIONAL(1, true, "Estimated genomeSize: " << genomeSize);
-	
-				ipipe.close();
-	
-				double totalRawKmers = reducedSizeTracker.getLastElement().rawKmers / fraction;
-				double estimatedUniqueKmers = totalRawKmers * errorRate + genomeSize;
-				LOG_VERBOSE_OPTIONAL(1, true, "Estimated totalRawKmers: " << totalRawKmers);
-				LOG_VERBOSE_OPTIONAL(1, true, "Estimated totalUniqueKmers: " << estimatedUniqueKmers);
-				if (reducedSizeTrackerFile.compare(outputFilename) != 0) {
-					LOG_DEBUG_OPTIONAL(1, true, "Removing temporary size tracking file: " << reducedSizeTrackerFile);
-					unlink(reducedSizeTrackerFile.c_str());
-				}
-			} else {
-				LOG_ERROR(1, "Could not find Rscript or EstimateSize.R.  To get the coefficients, please run '" << command << "'");
+
+			KS::SizeTracker::GrowthModel model = reducedSizeTracker.fitGrowthModel(maxErrorRate);
+			if (model.errorRate >= maxErrorRate) {
+				LOG_WARN(1, "The estimated errorRate reached --max-error-rate, do not trust this estimate: " << model.toString());
+			} else if (!model.converged) {
+				LOG_WARN(1, "The genome size model did not converge: " << model.toString());
 			}
+
+			LOG_VERBOSE_OPTIONAL(1, true, "Estimated Kmer-quality errorRate: " << commonErrorRate);
+			LOG_VERBOSE_OPTIONAL(1, true, "Distributed readCount: " << totalReads);
+			LOG_VERBOSE_OPTIONAL(1, true, "Estimated fractionRead: " << fraction);
+			LOG_VERBOSE_OPTIONAL(1, true, "Estimated errorRate: " << model.errorRate);
+			LOG_VERBOSE_OPTIONAL(1, true, "Estimated genomeSize: " << model.genomeSize);
+
+			double totalRawKmers = reducedSizeTracker.getLastElement().rawKmers / fraction;
+			double estimatedUniqueKmers = model.predictAsymptote(totalRawKmers);
+			LOG_VERBOSE_OPTIONAL(1, true, "Estimated totalRawKmers: " << totalRawKmers);
+			LOG_VERBOSE_OPTIONAL(1, true, "Estimated totalUniqueKmers: " << estimatedUniqueKmers);
 		}
 	
 		LOG_DEBUG(2, "Clearing spectrum");
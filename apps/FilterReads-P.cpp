@@ -60,6 +60,7 @@ typedef KmerMapByKmerArrayPair< DataType > MapType;
 typedef KmerMapByKmerArrayPair< SDataType > SMapType;
 typedef DistributedKmerSpectrum<MapType, MapType, SMapType> KS;
 typedef DistributedReadSelector< MapType > RS;
+typedef DistributedReadCorrector< MapType > RC;
 
 class _MPIFilterReadsOptions : public OptionsBaseInterface {
 public:
@@ -94,6 +95,10 @@ public:
 			KmerSpectrumOptions::getOptions().getSaveKmerMmap() = false;
 			KmerSpectrumOptions::getOptions().getLoadKmerMmap().clear();
 		}
+		if (ReadSelectorOptions::getOptions().getNormalizationMethod() == "STREAMING") {
+			setOptionsErrorMsg("--normalization-method STREAMING is a single pass over the input and is only supported by FilterReads");
+			ret = false;
+		}
 		return ret;
 	}
 };
@@ -103,11 +108,19 @@ template<typename KS, typename RS>
 void BuildSpectrumAndFilter(ScopedMPIComm< MPIFilterReadsOptions > &world, ReadSet &reads, std::string &outputFilename, boost::shared_ptr< KS > subtractingSpectrum = NULL)
 {
 	long rawKmers = 0;
+	KmerCardinality cardinality;
+	bool useCardinality = KmerSpectrumOptions::getOptions().getCardinalitySketchMB() > 0;
 	if(KmerBaseOptions::getOptions().getKmerSize() > 0){
-		rawKmers = KS::estimateRawKmers(world, reads);
+		if (useCardinality) {
+			cardinality = KS::estimateKmerCardinality(world, reads);
+			LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Estimated kmer cardinality: " << cardinality.toString());
+		} else {
+			rawKmers = KS::estimateRawKmers(world, reads);
+		}
 	}
 	unsigned int minDepth = KmerSpectrumOptions::getOptions().getMinDepth();
-	KS spectrum(world, rawKmers);
+	boost::shared_ptr< KS > spectrumPtr( useCardinality ? new KS(world, cardinality) : new KS(world, rawKmers) );
+	KS &spectrum = *spectrumPtr;
 	Kmernator::MmapFileVector spectrumMmaps;
 	if (KmerBaseOptions::getOptions().getKmerSize() > 0 && !KmerSpectrumOptions::getOptions().getLoadKmerMmap().empty()) {
 		spectrum.restoreMmap(KmerSpectrumOptions::getOptions().getLoadKmerMmap());
@@ -176,6 +189,12 @@ void BuildSpectrumAndFilter(ScopedMPIComm< MPIFilterReadsOptions > &world, ReadS
 			spectrum.optimize(true);
 		}
 	}
+	if (KmerBaseOptions::getOptions().getKmerSize() > 0 && ReadCorrectorOptions::getOptions().getCorrectReads()) {
+		LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Correcting reads with solid kmer depth: " << minDepth);
+		RC corrector(world, reads, spectrum.weak, minDepth);
+		corrector.correctReads();
+		LOG_DEBUG_GATHER(1, MemoryUtils::getMemoryUsage());
+	}
 	if (!outputFilename.empty()) {
 		if (KmerBaseOptions::getOptions().getKmerSize() > 0) {
 			LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Trimming reads with minDepth: " << minDepth);
@@ -266,12 +285,6 @@ int main(int argc, char *argv[]) {
 
 	Cleanup::prepare();
 
-	if (ReadSelectorOptions::getOptions().getMaxKmerDepth() > 0 && ReadSelectorOptions::getOptions().getNormalizationMethod() == "OPTIMAL" && world.size() > 1) {
-		if (Logger::isMaster())
-			LOG_WARN(1, "Setting --normalization-method to RANDOM, as Distributed version does not support 'OPTIMAL' option");
-		ReadSelectorOptions::getOptions().getNormalizationMethod() = "RANDOM";
-	}
-
 	MemoryUtils::getMemoryUsage();
 	std::string outputFilename = Options::getOptions().getOutputFile();
 
@@ -92,6 +92,26 @@ int main(int argc, char *argv[]) {
 	ReadSet reads;
 
 	try {
+		if (ReadSelectorOptions::getOptions().getNormalizationMethod() == "STREAMING") {
+			if (FilterKnownOdditiesOptions::getOptions().getSkipArtifactFilter() == 0 || DuplicateFragmentFilterOptions::getOptions().getDeDupMode() > 0)
+				LOG_WARN(1, "--normalization-method STREAMING does not load the reads, so the artifact and duplicate fragment filters are not applied");
+			if (ReadCorrectorOptions::getOptions().getCorrectReads())
+				LOG_WARN(1, "--normalization-method STREAMING does not build the kmer spectrum, so --correct-reads is not applied");
+			if (!outputFilename.empty()) {
+				string suffix;
+				if (ReadSelectorOptions::getOptions().getSeparateOutputs()) {
+					outputFilename += "-MaxDepth" + boost::lexical_cast<std::string>(ReadSelectorOptions::getOptions().getMaxKmerDepth());
+					suffix = FormatOutput::getDefaultSuffix();
+				}
+				StreamingReadSelector selector(ReadSelectorOptions::getOptions().getMaxKmerDepth(), ReadSelectorOptions::getOptions().getMinReadLength(), ReadSelectorOptions::getOptions().getBothPairs());
+				OfstreamMap ofmap(outputFilename, suffix);
+				selector.selectReads(ofmap);
+			}
+			LOG_VERBOSE(1, "Finished");
+			LOG_DEBUG(1, MemoryUtils::getMemoryUsage());
+			return 0;
+		}
+
 		OptionsBaseInterface::FileListType &inputs = Options::getOptions().getInputFiles();
 		LOG_VERBOSE(1, "Reading Input Files");
 		reads.appendAllFiles(inputs);
@@ -130,13 +150,25 @@ int main(int argc, char *argv[]) {
 			spectrum.restoreMmap(KmerSpectrumOptions::getOptions().getLoadKmerMmap());
 		} else if (KmerBaseOptions::getOptions().getKmerSize() > 0) {
 
-			long rawKmers = KS::estimateRawKmers(reads);
-			LOG_DEBUG(1, "targeting " << rawKmers << " raw kmers for reads ");
+			unsigned int numParts = KmerSpectrumOptions::getOptions().getBuildPartitions();
+			unsigned long maxMemoryBytes = (unsigned long) KmerSpectrumOptions::getOptions().getMaxMemory() * 1024ul * 1024ul;
+			bool planPartitions = maxMemoryBytes > 0 && numParts == 0;
+			if (KmerSpectrumOptions::getOptions().getCardinalitySketchMB() > 0 || planPartitions) {
+				KmerCardinality cardinality = KmerCardinality::estimate(reads);
+				LOG_VERBOSE(1, "Estimated kmer cardinality: " << cardinality.toString());
 
-			spectrum = KS(rawKmers);
+				spectrum = KS(cardinality);
+				if (planPartitions)
+					numParts = spectrum.planBuildPartitions(cardinality, maxMemoryBytes);
+			} else {
+				long rawKmers = KS::estimateRawKmers(reads);
+				LOG_DEBUG(1, "targeting " << rawKmers << " raw kmers for reads ");
+
+				spectrum = KS(rawKmers);
+			}
 			LOG_DEBUG(1, MemoryUtils::getMemoryUsage());
 
-			spectrumMmaps = spectrum.buildKmerSpectrumInParts(reads, KmerSpectrumOptions::getOptions().getBuildPartitions(), outputFilename.empty() ? "" : outputFilename + "-mmap");
+			spectrumMmaps = spectrum.buildKmerSpectrumInParts(reads, numParts, outputFilename.empty() ? "" : outputFilename + "-mmap", maxMemoryBytes);
 			spectrum.optimize();
 			spectrum.trackSpectrum(true);
 			std::string sizeHistoryFile = FilterReadsBaseOptions::getOptions().getSizeHistoryFile();
@@ -184,6 +216,13 @@ int main(int argc, char *argv[]) {
 			}
 		}
 
+		if (KmerBaseOptions::getOptions().getKmerSize() > 0 && ReadCorrectorOptions::getOptions().getCorrectReads()) {
+			LOG_VERBOSE(1, "Correcting reads with solid kmer depth: " << minDepth);
+			ReadCorrector< MapType > corrector(reads, spectrum.weak, minDepth);
+			corrector.correctReads();
+			LOG_DEBUG(1, MemoryUtils::getMemoryUsage());
+		}
+
 
 		if (!outputFilename.empty()) {
 
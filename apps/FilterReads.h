@@ -60,6 +60,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 #include "ReadSet.h"
 #include "FilterKnownOddities.h"
 #include "DuplicateFragmentFilter.h"
+#include "ReadCorrector.h"
 #include "Kmer.h"
 #include "KmerSpectrum.h"
 #include "ReadSelector.h"
@@ -97,6 +98,7 @@ public:
 		ReadSelectorOptions::_resetDefaults();
 		FilterKnownOdditiesOptions::_resetDefaults();
 		DuplicateFragmentFilterOptions::_resetDefaults();
+		ReadCorrectorOptions::_resetDefaults();
 	}
 	void _setOptions(po::options_description &desc, po::positional_options_description &p) {
 		// set options specific to this program
@@ -117,6 +119,7 @@ public:
 		ReadSelectorOptions::_setOptions(desc, p);
 		FilterKnownOdditiesOptions::_setOptions(desc,p);
 		DuplicateFragmentFilterOptions::_setOptions(desc, p);
+		ReadCorrectorOptions::_setOptions(desc, p);
 	}
 	bool _parseOptions( po::variables_map &vm) {
 
@@ -128,6 +131,7 @@ public:
 		ret &= ReadSelectorOptions::_parseOptions(vm);
 		ret &= FilterKnownOdditiesOptions::_parseOptions(vm);
 		ret &= DuplicateFragmentFilterOptions::_parseOptions(vm);
+		ret &= ReadCorrectorOptions::_parseOptions(vm);
 
 		setOpt("histogram-file", histogramFile);
 		setOpt("size-history-file", sizeHistoryFile);
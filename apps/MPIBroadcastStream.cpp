@@ -72,25 +72,38 @@ int main(int argc, char **argv)
 		int rank,size;
 		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 		MPI_Comm_size(MPI_COMM_WORLD, &size);
-		if (argc != 3) {
+		if (argc != 3 && argc != 4) {
 			if (rank == 0)
-				std::cerr << "Usage: mpirun MPIBroadcastStream input.file output.file[.rank]\n\tThis will create n copies of the input.file\n\n";
+				std::cerr << "Usage: mpirun MPIBroadcastStream input.file output.file[.rank] [chunkKB]\n\tThis will create n copies of the input.file\n\tsent down a tree of ranks in chunks of chunkKB (default 1024)\n\n";
 			MPI_Finalize();
 			exit(1);
 		}
+		int chunkSize = 1024 * 1024;
+		if (argc == 4)
+			chunkSize = atoi(argv[3]) * 1024;
 
 		std::ifstream ifs(argv[1]);
 		std::string output(argv[2]);
 		output += "." + boost::lexical_cast<std::string>(rank);
 		LOG_VERBOSE_GATHER(1, "Copying " << argv[1] << " to " << output);
+		double startTime = MPI_Wtime();
+		long bytes;
 		{
 			std::ofstream os(output.c_str());
-			int root = 0;
-			BroadcastOstream bcastos(world, root, os);
-	
-			if (rank == root)
-				boost::iostreams::copy(ifs, bcastos);
+			{
+				int root = 0;
+				BroadcastOstream bcastos(world, root, os, chunkSize);
+
+				if (rank == root)
+					boost::iostreams::copy(ifs, bcastos);
+			}
+			bytes = os.tellp();
 		}
+		double seconds = MPI_Wtime() - startTime, maxSeconds;
+		MPI_Reduce(&seconds, &maxSeconds, 1, MPI_DOUBLE, MPI_MAX, 0, world);
+		LOG_VERBOSE_OPTIONAL(1, rank == 0, "Copied " << bytes << " bytes to " << size << " ranks in " << maxSeconds << " s: "
+				<< (maxSeconds > 0.0 ? bytes / maxSeconds / 1048576.0 : 0.0) << " MB/s per rank, "
+				<< (maxSeconds > 0.0 ? bytes / maxSeconds / 1048576.0 * size : 0.0) << " MB/s total");
 		LOG_VERBOSE_OPTIONAL(1, true, "Done");
 	} catch (std::exception &e) {
 		LOG_ERROR(1, "MPIBroadcastStream threw an exception! Aborting...\n\t" << e.what());
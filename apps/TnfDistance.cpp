@@ -52,6 +52,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 #include <cstring>
 #include <cmath>
 #include <algorithm>
+#include <map>
 
 #include "config.h"
 #include "Options.h"
@@ -85,6 +86,9 @@ public:
 		window2Step(1000),
 		maxSamples(MAX_I64),
 		clusterThresholdDistance(.175),
+		clusterLshTables(0),
+		clusterLshProjections(8),
+		clusterLshSamples(1000),
 		referenceFiles(),
 		distanceFormula(DistanceFormula::EUCLIDEAN) {}
 	virtual ~_TnfDistanceBaseOptions() {}
@@ -126,6 +130,15 @@ public:
 	float &getClusterThreshold() {
 		return clusterThresholdDistance;
 	}
+	int &getClusterLshTables() {
+		return clusterLshTables;
+	}
+	int &getClusterLshProjections() {
+		return clusterLshProjections;
+	}
+	long &getClusterLshSamples() {
+		return clusterLshSamples;
+	}
 
 	enum DistanceFormula::Enum &getDistanceFormula() {
 		return distanceFormula;
@@ -173,6 +186,12 @@ public:
 
 				("cluster-threshold-distance", po::value<float>()->default_value(clusterThresholdDistance), "Euclidean distance threshold for clusters")
 
+				("cluster-lsh-tables", po::value<int>()->default_value(clusterLshTables), "if >0 then cluster approximately, only comparing sequences that share a bucket in one of this many locality sensitive hash tables, instead of all-vs-all")
+
+				("cluster-lsh-projections", po::value<int>()->default_value(clusterLshProjections), "number of random projections hashed together in each cluster-lsh-table (more is more selective)")
+
+				("cluster-lsh-samples", po::value<long>()->default_value(clusterLshSamples), "number of sampled sequences to also cluster exactly, to report the pairwise agreement of the approximate clustering")
+
 				("distance-formula", po::value<int>()->default_value(distanceFormula), "0 - Euclidean, 1 - Spearman")
 
 				;
@@ -204,6 +223,13 @@ public:
 		setOpt("max-samples", maxSamples);
 		setOpt("cluster-file", clusterFile);
 		setOpt("cluster-threshold-distance", clusterThresholdDistance);
+		setOpt("cluster-lsh-tables", clusterLshTables);
+		setOpt("cluster-lsh-projections", clusterLshProjections);
+		setOpt("cluster-lsh-samples", clusterLshSamples);
+		if (clusterLshTables > 0 && clusterLshProjections <= 0) {
+			setOptionsErrorMsg("Invalid --cluster-lsh-projections.  Please choose a positive number");
+			ret = false;
+		}
 		setOpt2("reference-file", referenceFiles);
 		int df;
 		setOpt("distance-formula", df);
@@ -224,6 +250,8 @@ private:
 	int windowSize, windowStep, window2Size, window2Step;
 	long maxSamples;
 	float clusterThresholdDistance;
+	int clusterLshTables, clusterLshProjections;
+	long clusterLshSamples;
 	FileListType referenceFiles;
 	DistanceFormula::Enum distanceFormula;
 
@@ -267,6 +295,8 @@ public:
 	static KM stdMap;
 	static long stdSize;
 	static DistanceFormula::Enum distanceFormula;
+	static int kmerSize;
+	static vector<int> codeIndexes; // 2-bit kmer code -> index of its least complement in tnfValues
 
 	static void init(int kmerSize, DistanceFormula::Enum df = DistanceFormula::EUCLIDEAN) {
 		distanceFormula = df;
@@ -291,6 +321,49 @@ public:
 
 		stdSize = stdMap.size();
 		LOG_DEBUG(1, "Found " << stdSize << " unique " << kmerSize << "-mers");
+
+		TNF::kmerSize = kmerSize;
+		buildCodeIndexes();
+	}
+	static void buildCodeIndexes() {
+		std::map<std::string, int> stdIndexes;
+		int i = 0;
+		for(KM::Iterator it = stdMap.begin(); it != stdMap.end(); it++)
+			stdIndexes[it->key().toFasta()] = i++;
+
+		TEMP_KMER(kmer);
+		TEMP_KMER(lc);
+		long numCodes = 1L << (2 * kmerSize);
+		codeIndexes.resize(numCodes);
+		std::string fasta(kmerSize, 'A');
+		for(long code = 0; code < numCodes; code++) {
+			for(int j = 0; j < kmerSize; j++)
+				fasta[j] = TwoBitSequence::uncompressBase((code >> (2 * (kmerSize - 1 - j))) & 3);
+			kmer.set(fasta);
+			kmer.buildLeastComplement(lc);
+			assert(stdIndexes.find(lc.toFasta()) != stdIndexes.end());
+			codeIndexes[code] = stdIndexes[lc.toFasta()];
+		}
+	}
+	// the tnfValues index of the kmer starting at each position of fasta, or -1 if it spans a non-ACGT base
+	static void getKmerIndexes(const std::string &fasta, vector<int> &indexes) {
+		long length = fasta.length();
+		indexes.assign(std::max(0L, length - kmerSize + 1), -1);
+		long mask = (1L << (2 * kmerSize)) - 1, code = 0;
+		int valid = 0;
+		for(long pos = 0; pos < length; pos++) {
+			long base;
+			switch(fasta[pos]) {
+			case 'A': base = 0; break;
+			case 'C': base = 1; break;
+			case 'G': base = 2; break;
+			case 'T': base = 3; break;
+			default: valid = 0; continue;
+			}
+			code = ((code << 2) | base) & mask;
+			if (++valid >= kmerSize)
+				indexes[pos - kmerSize + 1] = codeIndexes[code];
+		}
 	}
 	static std::string toHeader() {
 		assert(stdSize > 0);
@@ -320,6 +393,11 @@ public:
 		buildLength();
 		setRankVector();
 	}
+	TNF(const Vector &counts) : tnfValues(counts), rvector(NULL), length(1.0) {
+		assert((long) counts.size() == stdSize);
+		buildLength();
+		setRankVector();
+	}
 	TNF &operator=(const TNF &copy) {
 		if (this == &copy)
 			return *this;
@@ -358,6 +436,9 @@ public:
 		assert(rvector != NULL);
 		return *rvector;
 	}
+	const Vector &getValues() const {
+		return tnfValues;
+	}
 	TNF &operator*(float factor) {
 		for(unsigned int i = 0; i < tnfValues.size(); i++) {
 			tnfValues[i] *= factor;
@@ -457,8 +538,132 @@ public:
 KM TNF::stdMap(2112); // initialize room for hexamers
 long TNF::stdSize = 0;
 DistanceFormula::Enum TNF::distanceFormula;
+int TNF::kmerSize = 0;
+vector<int> TNF::codeIndexes;
 
 typedef std::vector<TNF> TNFS;
+typedef vector<float> DVector;
+typedef vector< DVector > DMatrix;
+
+// TNF vectors as rows of one contiguous, zero padded float matrix, prepared for the distance formula:
+// unit length TNFs for Euclidean, or mean centered ranks with their squared norms for Spearman.
+// Distances are accumulated over LANES independent sums so the compiler can vectorize them,
+// and the lower triangle is computed in TILE_SIZE column tiles over all threads.
+class TNFMatrix {
+public:
+	static const long LANES = 8;
+	static const long TILE_SIZE = 64;
+
+	TNFMatrix(const TNFS &tnfs = TNFS()) : _size(tnfs.size()), _stride((TNF::stdSize + LANES - 1) / LANES * LANES) {
+		_values.resize(_size * _stride, 0.0);
+		_norms.resize(_size, 0.0);
+		bool isSpearman = TNF::distanceFormula == DistanceFormula::SPEARMAN;
+		float mean = (TNF::stdSize + 1) / 2; // as RankVector::getSpearmanDistance
+#pragma omp parallel for
+		for(long i = 0; i < _size; i++) {
+			float *row = &_values[i * _stride];
+			const TNF::Vector &values = tnfs[i].getValues();
+			if (isSpearman) {
+				TNF::RVector ranks(values);
+				for(long k = 0; k < TNF::stdSize; k++)
+					row[k] = ranks[k] - mean;
+				_norms[i] = _dot(row, row, _stride);
+			} else {
+				float length = tnfs[i].getLength();
+				for(long k = 0; k < TNF::stdSize; k++)
+					row[k] = values[k] / length;
+			}
+		}
+	}
+	long size() const {
+		return _size;
+	}
+	long getStride() const {
+		return _stride;
+	}
+	const float *getRow(long i) const {
+		return &_values[i * _stride];
+	}
+	// scales row i to unit length, so both formulas become Euclidean distances between unit rows
+	float getUnitScale(long i) const {
+		if (TNF::distanceFormula == DistanceFormula::SPEARMAN)
+			return _norms[i] > 0.0 ? 1.0 / sqrt(_norms[i]) : 0.0;
+		else
+			return 1.0;
+	}
+	// the distance between unit rows equivalent to the formula's distance
+	static float getUnitDistance(float distance) {
+		if (TNF::distanceFormula == DistanceFormula::SPEARMAN)
+			return 2.0 * sqrt(std::max(0.0f, distance)); // |a-b|^2 = 2 - 2 * correlation = 4 * distance
+		else
+			return distance;
+	}
+	float getDistance(long i, long j) const {
+		return getDistance(i, *this, j);
+	}
+	float getDistance(long i, const TNFMatrix &other, long j) const {
+		assert(_stride == other._stride);
+		const float *a = &_values[i * _stride], *b = &other._values[j * _stride];
+		if (TNF::distanceFormula == DistanceFormula::SPEARMAN) {
+			float dist = _dot(a, b, _stride) / sqrt(_norms[i] * other._norms[j]);
+			return (1 - dist) / 2;
+		} else {
+			return sqrt(_sumSquaredDifference(a, b, _stride));
+		}
+	}
+
+	// fills rows[i-begin][j] with the distance between rows i and j, for all j < i in [begin, end)
+	void getLowerTriangleRows(long begin, long end, DMatrix &rows) const {
+		assert(begin <= end && end <= _size);
+		rows.resize(end - begin);
+		for(long i = begin; i < end; i++)
+			rows[i - begin].resize(i);
+		long tileSize = TILE_SIZE, numTiles = (end + tileSize - 1) / tileSize;
+#pragma omp parallel for schedule(dynamic,1)
+		for(long tile = 0; tile < numTiles; tile++) {
+			long tileBegin = tile * tileSize, tileEnd = std::min(end, tileBegin + tileSize);
+			for(long i = std::max(begin, tileBegin + 1); i < end; i++) {
+				DVector &row = rows[i - begin];
+				for(long j = tileBegin; j < tileEnd && j < i; j++)
+					row[j] = getDistance(i, j);
+			}
+		}
+	}
+
+private:
+	static float _sumSquaredDifference(const float *a, const float *b, long n) {
+		float sums[LANES];
+		for(long l = 0; l < LANES; l++)
+			sums[l] = 0.0;
+		for(long k = 0; k < n; k += LANES) {
+			for(long l = 0; l < LANES; l++) {
+				float d = a[k+l] - b[k+l];
+				sums[l] += d * d;
+			}
+		}
+		float sum = 0.0;
+		for(long l = 0; l < LANES; l++)
+			sum += sums[l];
+		return sum;
+	}
+	static float _dot(const float *a, const float *b, long n) {
+		float sums[LANES];
+		for(long l = 0; l < LANES; l++)
+			sums[l] = 0.0;
+		for(long k = 0; k < n; k += LANES) {
+			for(long l = 0; l < LANES; l++)
+				sums[l] += a[k+l] * b[k+l];
+		}
+		float sum = 0.0;
+		for(long l = 0; l < LANES; l++)
+			sum += sums[l];
+		return sum;
+	}
+
+	long _size, _stride;
+	vector<float> _values;
+	vector<float> _norms;
+};
 TNFS buildTnfs(const ReadSet &reads) {
 	TNFS tnfs;
 	long size = reads.getSize();
@@ -483,24 +688,50 @@ TNFS buildTnfs(const ReadSet &reads) {
 	return tnfs;
 }
 
-void shredReadByWindow(const Read &read, ReadSet &shrededReads, long window, long step) {
-	string fullFasta = read.getFasta();
-	long length = fullFasta.length();
+// TNFs of each window of a sequence, at the same offsets shredding it would produce,
+// sliding a single count vector by step kmers at a time rather than recounting every window
+void buildIntraTNFs(const Read &read, long window, long step, TNFS &tnfs) {
+	vector<int> indexes;
+	TNF::getKmerIndexes(read.getFasta(), indexes);
+	long length = read.getLength(), kmersPerWindow = window - TNF::kmerSize + 1;
+	TNF::Vector counts(TNF::stdSize, 0);
+	long first = 0, last = 0; // the window's kmers currently counted: [first, last)
 	for(long i = 0 ; i < length - window; i+= step) {
-		string fasta = fullFasta.substr(i, window);
-		Read newRead(read.getName() + ":" + boost::lexical_cast<string>(i) + "-" + boost::lexical_cast<string>(i+fasta.length()), fasta, string(fasta.length(), Kmernator::PRINT_REF_QUAL), "");
-		shrededReads.append(newRead);
+		long end = std::max(i, i + kmersPerWindow);
+		if (i >= last) {
+			counts.assign(TNF::stdSize, 0);
+			first = last = i;
+		}
+		for( ; first < i; first++)
+			if (indexes[first] >= 0)
+				counts[indexes[first]]--;
+		for( ; last < end; last++)
+			if (indexes[last] >= 0)
+				counts[indexes[last]]++;
+		tnfs.push_back(TNF(counts));
 	}
 }
 
-TNFS buildIntraTNFs(const ReadSet &reads) {
-	return buildTnfs(reads);
+TNFS buildIntraTNFs(const Read &read, long window, long step) {
+	TNFS tnfs;
+	buildIntraTNFs(read, window, step, tnfs);
+	return tnfs;
 }
 
-TNFS buildIntraTNFs(const Read &read, long window, long step) {
-	ReadSet reads;
-	shredReadByWindow(read, reads, window, step);
-	return buildIntraTNFs(reads);
+// window TNFs of a list of reads, concatenated in order
+TNFS buildIntraTNFs(const ReadSet &reads, const vector<ReadSet::ReadSetSizeType> &readIdxs, long window, long step) {
+	long size = readIdxs.size();
+	vector<TNFS> readTnfs(size);
+#pragma omp parallel for schedule(dynamic,1)
+	for(long i = 0; i < size; i++)
+		buildIntraTNFs(reads.getRead(readIdxs[i]), window, step, readTnfs[i]);
+
+	TNFS tnfs;
+	for(long i = 0; i < size; i++) {
+		tnfs.insert(tnfs.end(), readTnfs[i].begin(), readTnfs[i].end());
+		TNFS().swap(readTnfs[i]);
+	}
+	return tnfs;
 }
 // use this to remove TNFs that are missing too much of the expected or required data.
 void purgeShortTNFS(TNFS &tnfs, int minimumCount) {
@@ -548,6 +779,7 @@ Results calculateDistances(const TNF &refTnf, const ReadSet &reads, const TNFS &
 	Results results;
 	long size = reads.getSize();
 	results.resize(size);
+	TNFMatrix refMatrix(TNFS(1, refTnf)), matrix(tnfs);
 
 #pragma omp parallel for
 	for(long readIdx = 0; readIdx < size; readIdx++) {
@@ -556,18 +788,17 @@ Results calculateDistances(const TNF &refTnf, const ReadSet &reads, const TNFS &
 		Read read = reads.getRead(readIdx);
 		string name = read.getName();
 
-		float dist = refTnf.getDistance(tnfs[readIdx]);
+		float dist = refMatrix.getDistance(0, matrix, readIdx);
 		if (dist <= 0.20) {
-			string fullFasta = read.getFasta();
-			long len = fullFasta.length();
+			long len = read.getLength();
 			int divs = 5;
-			TNFS intraTnfs = buildIntraTNFs(read,len/divs, len/divs);
+			TNFMatrix intraMatrix(buildIntraTNFs(read,len/divs, len/divs));
 
 			stringstream ss;
 			ss.precision(3);
 			ss << name;
-			for(long i = 0 ; i < (long) intraTnfs.size() ; i++) {
-				float distPart = refTnf.getDistance(intraTnfs[i]);
+			for(long i = 0 ; i < intraMatrix.size() ; i++) {
+				float distPart = refMatrix.getDistance(0, intraMatrix, i);
 				ss << "\t" << fixed << distPart;
 			}
 			name = ss.str();
@@ -581,8 +812,6 @@ Results calculateDistances(const TNF &refTNF, const ReadSet &reads) {
 }
 
 
-typedef vector<float> DVector;
-typedef vector< DVector > DMatrix;
 class MinVecOper {
 public:
 	bool operator()( const DVector::iterator &a, const DVector::iterator &b) const {
@@ -590,6 +819,344 @@ public:
 	}
 } mvo;
 
+typedef vector< vector< long > > Clusters;
+
+// Exact threshold clustering: repeatedly merges the two closest clusters, summing their TNFs,
+// until no two clusters are within the threshold.  Returns the clusters as indexes into the TNFS
+Clusters buildExactClusters(const TNFS &tnfs, float clusterThreshold) {
+	bool debug = Log::isDebug(1);
+	long size = tnfs.size();
+
+	DMatrix distMatrix;
+	distMatrix.resize( size );
+	Clusters clusters;
+	clusters.resize( size );
+
+	//TODO optimize this and the the while loop (use LT, and directed updates to minVec)
+	vector< DVector::iterator > minVec;
+	minVec.resize( size );
+
+	TNFMatrix(tnfs).getLowerTriangleRows(0, size, distMatrix);
+	for(long i = 0; i < size; i++) {
+		clusters[i].push_back( i );
+		DVector &vect = distMatrix[i];
+		vect.push_back(clusterThreshold+1.0);
+		minVec[i] = std::min_element( vect.begin(), vect.end() );
+	}
+
+	LOG_VERBOSE(1, "Finished dist matrix");
+	if (debug) {
+		ostream &debugOut = Log::Debug("DistMatrix");
+		for(long i = 0 ; i < size ; i++) {
+			debugOut << "distMatrix: " << i;
+			for(long j = 0 ; j <= i ; j++)
+				debugOut << "\t" << distMatrix[i][j];
+			debugOut << std::endl;
+		}
+	}
+
+
+	TNFS tnfs2 = TNFS(tnfs);
+
+	while( !minVec.empty() ) {
+		// set the thresholds for each remaining read
+
+		vector< DVector::iterator >::iterator minElem = std::min_element(minVec.begin(), minVec.end(), mvo);
+		if (**minElem > clusterThreshold)
+			break;
+		LOG_DEBUG(1, **minElem );
+
+		unsigned long tgtj = minElem - minVec.begin();
+		unsigned long tgti = *minElem - distMatrix[tgtj].begin();
+
+		unsigned long lastIdx = minVec.size() - 1;
+		if (debug) {
+			ostream &debugOut = Log::Debug("MinValue");
+			for(unsigned long i2 = 0 ; i2 < minVec.size(); i2++) {
+				unsigned long j = (i2 <= tgti) ? i2 : tgti;
+				unsigned long i = (i2 <= tgti) ? tgti : i2;
+
+				debugOut << distMatrix[i][j] << "\t";
+			}
+			debugOut << endl;
+		}
+		clusters[tgti].insert( clusters[tgti].end(), clusters[tgtj].begin(), clusters[tgtj].end() );
+		clusters[tgtj].clear();
+		LOG_VERBOSE(1, "Cluster merged " << tgti << " with " << tgtj << " " << **minElem);
+		tnfs2[tgti] = tnfs2[tgti] + tnfs2[tgtj];
+
+		// remove tgtj from vectors and matrix (1 row and 1 column);
+		std::swap(minVec[tgtj], minVec[lastIdx]); minVec.pop_back();
+		std::swap(clusters[tgtj], clusters[lastIdx]); clusters.pop_back();
+		std::swap(distMatrix[tgtj], distMatrix[lastIdx]); distMatrix.pop_back();
+		std::swap(tnfs2[tgtj], tnfs2[lastIdx]); tnfs2.pop_back();
+
+		for(unsigned long i = tgtj + 1; i < minVec.size(); i++) {
+			float dist = distMatrix[tgtj][i];
+			distMatrix[i][tgtj] = dist;
+
+			if (*minVec[i] > dist) {
+				minVec[i] = distMatrix[i].begin() + tgtj;
+			}
+		}
+		distMatrix[tgtj].resize(tgtj+1);
+		distMatrix[tgtj][tgtj] = clusterThreshold + 1.0;
+		minVec[tgtj] = std::min_element( distMatrix[tgtj].begin(), distMatrix[tgtj].end() );
+
+		// update row & column tgti and affected minVects
+		for(unsigned long i = 0 ; i < minVec.size(); i++) {
+			if (i == tgti)
+				distMatrix[tgti][tgti] = clusterThreshold+1.0;
+			else {
+				float dist = tnfs2[tgti].getDistance(tnfs2[i]);
+				if (i < tgti) {
+					distMatrix[tgti][i] = dist;
+				} else {
+					distMatrix[i][tgti] = dist;
+					if (*minVec[i] > dist) {
+						minVec[i] = distMatrix[i].begin() + tgti;
+					}
+				}
+			}
+		}
+		minVec[tgti] = std::min_element( distMatrix[tgti].begin(), distMatrix[tgti].end() );
+
+	}
+
+	Clusters nonEmpty;
+	for(unsigned long i = 0 ; i < clusters.size(); i++)
+		if (!clusters[i].empty())
+			nonEmpty.push_back(clusters[i]);
+	return nonEmpty;
+}
+
+// the cluster of each of size sequences
+vector< long > getClusterIds(const Clusters &clusters, long size) {
+	vector< long > clusterIds(size, -1);
+	for(long c = 0; c < (long) clusters.size(); c++)
+		for(long k = 0; k < (long) clusters[c].size(); k++)
+			clusterIds[ clusters[c][k] ] = c;
+	return clusterIds;
+}
+
+// Pairwise agreement of an approximate clustering with the exact clustering of the same sequences:
+// precision is the fraction of approximately co-clustered pairs that are co-clustered exactly,
+// recall the fraction of exactly co-clustered pairs that are co-clustered approximately,
+// and the Rand index the fraction of all pairs on which both agree
+class ClusterAgreement {
+public:
+	double precision, recall, randIndex;
+
+	ClusterAgreement(const vector< long > &exactIds, const vector< long > &approximateIds) : precision(1.0), recall(1.0), randIndex(1.0) {
+		assert(exactIds.size() == approximateIds.size());
+		long size = exactIds.size();
+		long both = 0, exactOnly = 0, approximateOnly = 0, pairs = size * (size - 1) / 2;
+#pragma omp parallel for schedule(dynamic,64) reduction(+:both,exactOnly,approximateOnly)
+		for(long i = 0; i < size; i++) {
+			for(long j = 0; j < i; j++) {
+				bool exact = exactIds[i] == exactIds[j], approximate = approximateIds[i] == approximateIds[j];
+				if (exact && approximate)
+					both++;
+				else if (exact)
+					exactOnly++;
+				else if (approximate)
+					approximateOnly++;
+			}
+		}
+		if (both + approximateOnly > 0)
+			precision = (double) both / (both + approximateOnly);
+		if (both + exactOnly > 0)
+			recall = (double) both / (both + exactOnly);
+		if (pairs > 0)
+			randIndex = 1.0 - (double) (exactOnly + approximateOnly) / pairs;
+		LOG_DEBUG(1, "ClusterAgreement(): " << size << " sequences " << both << " pairs co-clustered by both, " << exactOnly << " only exactly and " << approximateOnly << " only approximately");
+	}
+};
+
+// Approximate threshold clustering of TNFs through p-stable locality sensitive hashing.
+// Each of numTables tables concatenates numProjections quantized random Gaussian projections of the
+// unit rows, with a bucket width of 4x the threshold, so only sequences sharing a bucket are compared.
+// Oversized buckets are compared along a window of MAX_BUCKET_NEIGHBORS, keeping the work near linear.
+// Edges within the threshold are then merged closest first, as the exact clustering does, as long as
+// the summed TNFs of the two clusters are still within the threshold of each other.  The summed TNFs
+// of the merged clusters are hashed again, and merged, until no more clusters are within the threshold.
+class TNFLSHClusters {
+public:
+	static const long MAX_BUCKET_NEIGHBORS = 32;
+	class Edge {
+	public:
+		float distance;
+		long i, j;
+		Edge(float _distance = 0.0, long _i = 0, long _j = 0) : distance(_distance), i(_i), j(_j) {}
+		bool operator<(const Edge &other) const {
+			return distance < other.distance || (distance == other.distance && (i < other.i || (i == other.i && j < other.j)));
+		}
+		bool operator==(const Edge &other) const {
+			return i == other.i && j == other.j;
+		}
+	};
+	typedef vector< Edge > Edges;
+	typedef std::pair< uint64_t, long > BucketEntry;
+
+	TNFLSHClusters(const TNFS &tnfs, float threshold, int numTables, int numProjections)
+	: _matrix(tnfs), _threshold(threshold), _numTables(numTables), _numProjections(numProjections), _clusterIds(tnfs.size()) {
+		long size = tnfs.size();
+		for(long i = 0; i < size; i++)
+			_clusterIds[i] = i;
+		_findEdges(_matrix, _edges);
+
+		TNFS sums(tnfs);
+		Edges roundEdges;
+		Edges *edges = &_edges;
+		for(int round = 0; ; round++) {
+			vector< long > parents;
+			long merged = _merge(*edges, sums, parents);
+			LOG_DEBUG(1, "TNFLSHClusters(): round " << round << " merged " << merged << " of " << sums.size() << " clusters over " << edges->size() << " edges");
+			if (merged == 0)
+				break;
+
+			// collapse each merged cluster into its summed TNF
+			vector< long > newIds(sums.size(), -1);
+			TNFS newSums;
+			newSums.reserve(sums.size() - merged);
+			for(long c = 0; c < (long) sums.size(); c++) {
+				if (parents[c] == c) {
+					newIds[c] = newSums.size();
+					newSums.push_back(sums[c]);
+				}
+			}
+			for(long i = 0; i < size; i++)
+				_clusterIds[i] = newIds[getRoot(parents, _clusterIds[i])];
+			sums.swap(newSums);
+
+			Edges().swap(roundEdges);
+			_findEdges(TNFMatrix(sums), roundEdges);
+			edges = &roundEdges;
+		}
+	}
+
+	static long getRoot(vector< long > &parents, long i) {
+		while (parents[i] != i) {
+			parents[i] = parents[parents[i]];
+			i = parents[i];
+		}
+		return i;
+	}
+	long getNumEdges() const {
+		return _edges.size();
+	}
+
+	// the clusters (as indexes into the TNFS), ordered by their first member
+	Clusters getClusters() const {
+		long size = _clusterIds.size();
+		Clusters clusters(size);
+		for(long i = 0; i < size; i++)
+			clusters[_clusterIds[i]].push_back(i);
+		Clusters nonEmpty;
+		for(long i = 0; i < size; i++)
+			if (!clusters[i].empty())
+				nonEmpty.push_back(clusters[i]);
+		return nonEmpty;
+	}
+
+	const vector< long > &getClusterIds() const {
+		return _clusterIds;
+	}
+
+private:
+	void _findEdges(const TNFMatrix &matrix, Edges &edges) const {
+		long size = matrix.size(), stride = matrix.getStride();
+		float bucketWidth = 4.0 * TNFMatrix::getUnitDistance(_threshold);
+		if (bucketWidth <= 0.0)
+			bucketWidth = 1.0;
+
+		// a fixed seed keeps the clusters reproducible
+		boost::random::mt19937 gen(4);
+		boost::random::normal_distribution<float> normal;
+		boost::random::uniform_01<float> uniform;
+		long numProjectionRows = (long) _numTables * _numProjections;
+		vector< float > projections(numProjectionRows * stride, 0.0), offsets(numProjectionRows);
+		for(long p = 0; p < numProjectionRows; p++) {
+			for(long k = 0; k < TNF::stdSize; k++)
+				projections[p * stride + k] = normal(gen);
+			offsets[p] = uniform(gen) * bucketWidth;
+		}
+
+		int numThreads = omp_get_max_threads();
+		vector< Edges > threadEdges(numThreads);
+		vector< BucketEntry > buckets(size);
+		for(int table = 0; table < _numTables; table++) {
+#pragma omp parallel for
+			for(long i = 0; i < size; i++) {
+				const float *row = matrix.getRow(i);
+				float scale = matrix.getUnitScale(i);
+				uint64_t key = 0;
+				for(int p = 0; p < _numProjections; p++) {
+					long projectionRow = (long) table * _numProjections + p;
+					const float *projection = &projections[projectionRow * stride];
+					float dot = 0.0;
+					for(long k = 0; k < stride; k++)
+						dot += row[k] * projection[k];
+					long slot = (long) floor((dot * scale + offsets[projectionRow]) / bucketWidth);
+					boost::hash_combine(key, slot);
+				}
+				buckets[i] = BucketEntry(key, i);
+			}
+			std::sort(buckets.begin(), buckets.end());
+
+			long maxNeighbors = MAX_BUCKET_NEIGHBORS;
+#pragma omp parallel for schedule(dynamic,1024)
+			for(long a = 0; a < size; a++) {
+				Edges &myEdges = threadEdges[omp_get_thread_num()];
+				for(long b = a + 1; b < size && b <= a + maxNeighbors && buckets[b].first == buckets[a].first; b++) {
+					long i = std::min(buckets[a].second, buckets[b].second), j = std::max(buckets[a].second, buckets[b].second);
+					float dist = matrix.getDistance(i, j);
+					if (dist <= _threshold)
+						myEdges.push_back(Edge(dist, i, j));
+				}
+			}
+		}
+		for(int t = 0; t < numThreads; t++) {
+			edges.insert(edges.end(), threadEdges[t].begin(), threadEdges[t].end());
+			Edges().swap(threadEdges[t]);
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+	}
+
+	// merges along the sorted edges, summing the TNFs into the root of each cluster
+	long _merge(const Edges &edges, TNFS &sums, vector< long > &parents) const {
+		long size = sums.size();
+		parents.resize(size);
+		for(long i = 0; i < size; i++)
+			parents[i] = i;
+		long merged = 0;
+		for(Edges::const_iterator it = edges.begin(); it != edges.end(); it++) {
+			long rooti = getRoot(parents, it->i), rootj = getRoot(parents, it->j);
+			if (rooti == rootj)
+				continue;
+			if (rooti != it->i || rootj != it->j) {
+				if (sums[rooti].getDistance(sums[rootj]) > _threshold)
+					continue;
+			}
+			if (rootj < rooti)
+				std::swap(rooti, rootj);
+			sums[rooti] = sums[rooti] + sums[rootj];
+			parents[rootj] = rooti;
+			merged++;
+		}
+		for(long i = 0; i < size; i++)
+			getRoot(parents, i);
+		return merged;
+	}
+
+	TNFMatrix _matrix;
+	float _threshold;
+	int _numTables, _numProjections;
+	vector< long > _clusterIds;
+	Edges _edges;
+};
+
 typedef GenericHistogram<float, long> GH;
 
 int main(int argc, char *argv[]) {
@@ -651,14 +1218,22 @@ int main(int argc, char *argv[]) {
 		LOG_VERBOSE(1, "Outputting Lower Triangle of inter-TNF distances between inputs sequences.");
 		OfstreamMap om(interFile, "");
 		ostream &os = om.getOfstream("");
-		for(ReadSet::ReadSetSizeType readIdxi = 0; readIdxi < reads.getSize(); readIdxi++) {
-			os << reads.getRead(readIdxi).getName();
-			for(ReadSet::ReadSetSizeType readIdxj = 0; readIdxj < readIdxi; readIdxj++) { // LT matrix only
-				float dist = readTnfs[readIdxi].getDistance(readTnfs[readIdxj]);
-				os << "\t" << dist;
+		TNFMatrix matrix(readTnfs);
+		long size = matrix.size(), rowBlock = TNFMatrix::TILE_SIZE * omp_get_max_threads();
+		DMatrix rows;
+		for(long begin = 0; begin < size; begin += rowBlock) {
+			// compute a block of LT rows in parallel, then stream them out
+			long end = std::min(size, begin + rowBlock);
+			matrix.getLowerTriangleRows(begin, end, rows);
+			for(long readIdxi = begin; readIdxi < end; readIdxi++) {
+				os << reads.getRead(readIdxi).getName();
+				DVector &row = rows[readIdxi - begin];
+				for(long readIdxj = 0; readIdxj < readIdxi; readIdxj++) // LT matrix only
+					os << "\t" << row[readIdxj];
+				os << "\n";
 			}
-			os << endl;
 		}
+		os.flush();
 	}
 
 	string intraInterFile = TnfDistanceBaseOptions::getOptions().getIntraInterFile();
@@ -682,6 +1257,9 @@ int main(int argc, char *argv[]) {
 		assert(interTnfs.size() == inputs.size());
 		TNFS wholeTnfs;
 		wholeTnfs.resize( interTnfs.size() );
+		std::vector< TNFMatrix > interMatrices, interMatrices2;
+		interMatrices.resize( interTnfs.size() );
+		interMatrices2.resize( interTnfs.size() );
 
 		LOG_VERBOSE(1, "Creating intra cluster TNF distance histogram for " << interTnfs.size() << " different sets.");
 		LOG_DEBUG(1, MemoryUtils::getMemoryUsage());
@@ -704,14 +1282,11 @@ int main(int argc, char *argv[]) {
 			}
 		}
 
-		ReadSet shrededReads, shrededReads2;
+		vector<ReadSet::ReadSetSizeType> fileReadIdxs;
 		int thisFileIdx = 0;
 		for(ReadSet::ReadSetSizeType readIdx = 0; readIdx < reads.getSize(); readIdx++) {
 			assert(thisFileIdx == reads.getReadFileNum(readIdx) - 1);
-			Read read = reads.getRead(readIdx);
-			shredReadByWindow(read, shrededReads, window, step);
-			if (window != window2)
-				shredReadByWindow(read, shrededReads2, window2, step2);
+			fileReadIdxs.push_back(readIdx);
 
 			int nextFileIdx = reads.getReadFileNum(readIdx+1) - 1;
 			wholeTnfs[ thisFileIdx ] = wholeTnfs[ thisFileIdx ] + readTnfs[ readIdx ];
@@ -719,25 +1294,33 @@ int main(int argc, char *argv[]) {
 			// process the intra
 			if (readIdx+1 == reads.getSize() || thisFileIdx != nextFileIdx) {
 
-				LOG_VERBOSE(1, "Creating intra cluster TNFs for fileNum: " << thisFileIdx << " with " << shrededReads.getSize() << " shreded reads (readIdx: " << readIdx << ")");
+				LOG_VERBOSE(1, "Creating intra cluster TNFs for fileNum: " << thisFileIdx << " over " << fileReadIdxs.size() << " reads (readIdx: " << readIdx << ")");
 				LOG_DEBUG(1, MemoryUtils::getMemoryUsage());
 
 				assert(thisFileIdx < (int) interTnfs.size());
-				interTnfs[thisFileIdx] = buildIntraTNFs(shrededReads);
+				interTnfs[thisFileIdx] = buildIntraTNFs(reads, fileReadIdxs, window, step);
+				LOG_VERBOSE(1, "Window TNFS: " << interTnfs[thisFileIdx].size());
 				purgeShortTNFS(interTnfs[thisFileIdx], window*3/4);
 				if (window != window2) {
-					interTnfs2[thisFileIdx] = buildIntraTNFs(shrededReads2);
+					interTnfs2[thisFileIdx] = buildIntraTNFs(reads, fileReadIdxs, window2, step2);
+					LOG_VERBOSE(1, "Window2 TNFS: " << interTnfs2[thisFileIdx].size());
 					purgeShortTNFS(interTnfs2[thisFileIdx], window2*3/4);
-					LOG_VERBOSE(1, "Window2 TNFS: " << shrededReads2.getSize() << " shreded reads");
 				}
-				TNFS &intraTnfs = interTnfs[thisFileIdx];
+				// keep only the distance matrices of the windows
+				interMatrices[thisFileIdx] = TNFMatrix(interTnfs[thisFileIdx]);
+				interMatrices2[thisFileIdx] = TNFMatrix(interTnfs2[thisFileIdx]);
+				TNFS().swap(interTnfs[thisFileIdx]);
+				TNFS().swap(interTnfs2[thisFileIdx]);
+
+				TNFMatrix &intraTnfs = interMatrices[thisFileIdx];
 				long intraTnfsSize = intraTnfs.size();
 				if (intraTnfsSize > 1) {
+					TNFMatrix wholeMatrix(TNFS(1, wholeTnfs[thisFileIdx]));
 
 
 #pragma omp parallel for
 					for(long i = 0 ; i < (long) intraTnfsSize; i++) {
-						float dist = wholeTnfs[thisFileIdx].getDistance(intraTnfs[i]);
+						float dist = wholeMatrix.getDistance(0, intraTnfs, i);
 						intraVsWholeHist.observe(dist);
 					}
 
@@ -750,9 +1333,9 @@ int main(int argc, char *argv[]) {
 						if (numSamples < (long) maxIntraSamples) {
 							// calculate everything
 #pragma omp parallel for schedule(dynamic,1)
-							for(long i = 0 ; i < (long) intraTnfs.size(); i++) {
+							for(long i = 0 ; i < intraTnfsSize; i++) {
 								for(long j = 0 ; j < i ; j++) { // lower triangle only
-									float dist = intraTnfs[i].getDistance(intraTnfs[j]);
+									float dist = intraTnfs.getDistance(i, j);
 									intraHist.observe(dist);
 									if (dataPtr[omp_get_thread_num()] != NULL)
 										*dataPtr[omp_get_thread_num()] << dist << "\t1\t0\n";
@@ -766,7 +1349,7 @@ int main(int argc, char *argv[]) {
 							for(long k = 0; k < (long) maxIntraSamples; k++) {
 								long x,y, indexSample = randGen[omp_get_thread_num()].getRand() % numSamples;
 								lt.getXY(indexSample, x, y);
-								float dist = intraTnfs[x].getDistance(intraTnfs[y]);
+								float dist = intraTnfs.getDistance(x, y);
 								intraHist.observe(dist);
 								if (dataPtr[omp_get_thread_num()] != NULL)
 									*dataPtr[omp_get_thread_num()] << dist << "\t1\t0\n";
@@ -774,7 +1357,7 @@ int main(int argc, char *argv[]) {
 						}
 
 					} else { // different sized windows...
-						TNFS &intraTnfs2 = interTnfs2[thisFileIdx];
+						TNFMatrix &intraTnfs2 = interMatrices2[thisFileIdx];
 						long intraTnfsSize2 = intraTnfs2.size();
 						numSamples = intraTnfsSize * intraTnfsSize2;
 
@@ -784,7 +1367,7 @@ int main(int argc, char *argv[]) {
 #pragma omp parallel for schedule(dynamic,1)
 							for(long i = 0 ; i < (long) intraTnfsSize; i++) {
 								for(long j = 0 ; j < intraTnfsSize2 ; j++) {
-									float dist = intraTnfs[i].getDistance(intraTnfs2[j]);
+									float dist = intraTnfs.getDistance(i, intraTnfs2, j);
 									intraHist.observe(dist);
 									if (dataPtr[omp_get_thread_num()] != NULL)
 										*dataPtr[omp_get_thread_num()] << dist << "\t1\t0\n";
@@ -800,7 +1383,7 @@ int main(int argc, char *argv[]) {
 								x = indexSample / intraTnfsSize2;
 								y = indexSample % intraTnfsSize2;
 								assert(x < intraTnfsSize);
-								float dist = intraTnfs[x].getDistance(intraTnfs2[y]);
+								float dist = intraTnfs.getDistance(x, intraTnfs2, y);
 								intraHist.observe(dist);
 								if (dataPtr[omp_get_thread_num()] != NULL)
 									*dataPtr[omp_get_thread_num()] << dist << "\t1\t0\n";
@@ -810,8 +1393,7 @@ int main(int argc, char *argv[]) {
 					}
 
 				}
-				shrededReads.clear();
-				shrededReads2.clear();
+				fileReadIdxs.clear();
 				if (readIdx + 1 != reads.getSize()) {
 					thisFileIdx = reads.getReadFileNum(readIdx+1) - 1;
 				} else {
@@ -831,26 +1413,27 @@ int main(int argc, char *argv[]) {
 				maxInterSamples += 1;
 		}
 
-		for(long fileIdxi = 0; fileIdxi < (long) interTnfs.size(); fileIdxi++) {
-			TNFS &interi = interTnfs[fileIdxi];
+		TNFMatrix wholeMatrix(wholeTnfs);
+		for(long fileIdxi = 0; fileIdxi < (long) interMatrices.size(); fileIdxi++) {
+			TNFMatrix &interi = interMatrices[fileIdxi];
 
 #pragma omp parallel for
 			for(long k = 0 ; k < (long) interi.size(); k++) {
-				for(long fileIdxj = 0; fileIdxj < (int) interTnfs.size(); fileIdxj++) {
+				for(long fileIdxj = 0; fileIdxj < (long) interMatrices.size(); fileIdxj++) {
 					if (fileIdxi == fileIdxj) continue; // intra already calculated
-					float dist = wholeTnfs[fileIdxj].getDistance(interi[k]);
+					float dist = wholeMatrix.getDistance(fileIdxj, interi, k);
 					interVsWholeHist.observe(dist);
 				}
 			}
 
 			// if windows are the same size, just calc lower triangle
-			long maxJ = (window == window2) ? fileIdxi : interTnfs2.size();
+			long maxJ = (window == window2) ? fileIdxi : interMatrices2.size();
 
 			for(long fileIdxj = 0 ; fileIdxj < maxJ; fileIdxj++) { // lower triangle only
 				if (fileIdxj == fileIdxi)
 					continue; // intra already calculated
 				// choose which version to use window or window2
-				TNFS &interj = (window == window2) ? interTnfs[fileIdxj] : interTnfs2[fileIdxj];
+				TNFMatrix &interj = (window == window2) ? interMatrices[fileIdxj] : interMatrices2[fileIdxj];
 
 				long isize = interi.size(), jsize = interj.size();
 				long numSamples = isize * jsize;
@@ -859,7 +1442,7 @@ int main(int argc, char *argv[]) {
 #pragma omp parallel for
 					for(long k = 0 ; k < isize; k++) {
 						for(long l = 0; l < jsize; l++) {
-							float dist = interi[k].getDistance(interj[l]);
+							float dist = interi.getDistance(k, interj, l);
 							interHist.observe(dist);
 							if (dataPtr[omp_get_thread_num()] != NULL)
 								*dataPtr[omp_get_thread_num()] << dist << "\t0\t1\n";
@@ -873,7 +1456,7 @@ int main(int argc, char *argv[]) {
 						long x = indexSample / jsize, y = indexSample % jsize;
 						assert(x < isize);
 						assert(y < jsize);
-						float dist = interi[x].getDistance(interj[y]);
+						float dist = interi.getDistance(x, interj, y);
 						interHist.observe(dist);
 						if (dataPtr[omp_get_thread_num()] != NULL)
 							*dataPtr[omp_get_thread_num()] << dist << "\t0\t1\n";
@@ -903,123 +1486,44 @@ int main(int argc, char *argv[]) {
 
 	string clusterFile = TnfDistanceBaseOptions::getOptions().getClusterFile();
 	if (!clusterFile.empty()) {
-		bool debug = Log::isDebug(1);
-		long size = readTnfs.size();
-
 		LOG_VERBOSE(1, "Building clusters");
 		OfstreamMap om(clusterFile, "");
 		ostream &os = om.getOfstream("");
-		DMatrix distMatrix;
-		distMatrix.resize( size );
-		vector< vector< string > > clusterNames;
-		clusterNames.resize( size );
-
-		//TODO optimize this and the the while loop (use LT, and directed updates to minVec)
-		vector< DVector::iterator > minVec;
-		minVec.resize( size );
 		float clusterThreshold = TnfDistanceBaseOptions::getOptions().getClusterThreshold();
-
-		for(long i = 0; i < size; i++) {
-			clusterNames[i].push_back( reads.getRead(i).getName() );
-			DVector &vect = distMatrix[i];
-			vect.resize(i+1);
-			for(long j = 0 ; j <= i; j++) {
-				if (j==i)
-					vect[j] = clusterThreshold+1.0;
-				else
-					vect[j] = readTnfs[i].getDistance(readTnfs[j]);
-			}
-			minVec[i] = std::min_element( vect.begin(), vect.end() );
-		}
-
-		LOG_VERBOSE(1, "Finished dist matrix");
-		if (debug) {
-			ostream &debugOut = Log::Debug("DistMatrix");
-			for(long i = 0 ; i < size ; i++) {
-				debugOut << "distMatrix: " << i << "\t" << clusterNames[i][0];
-				for(long j = 0 ; j <= i ; j++)
-					debugOut << "\t" << distMatrix[i][j];
-				debugOut << std::endl;
+		int lshTables = TnfDistanceBaseOptions::getOptions().getClusterLshTables();
+		int lshProjections = TnfDistanceBaseOptions::getOptions().getClusterLshProjections();
+		Clusters clusters;
+		if (lshTables > 0) {
+			TNFLSHClusters lsh(readTnfs, clusterThreshold, lshTables, lshProjections);
+			clusters = lsh.getClusters();
+			LOG_VERBOSE(1, "Built " << clusters.size() << " approximate clusters from " << lsh.getNumEdges() << " candidate edges");
+
+			// cluster an evenly spaced sample of the sequences both ways, and compare
+			long size = readTnfs.size();
+			long numSamples = std::min(TnfDistanceBaseOptions::getOptions().getClusterLshSamples(), size);
+			if (numSamples > 1) {
+				long sampleStride = size / numSamples;
+				TNFS sampleTnfs;
+				sampleTnfs.reserve(numSamples);
+				for(long sample = 0; sample < numSamples; sample++)
+					sampleTnfs.push_back(readTnfs[sample * sampleStride]);
+				LOG_VERBOSE(1, "Comparing the approximate and exact clusters of " << numSamples << " sampled sequences");
+				vector< long > approximateIds = numSamples == size ? lsh.getClusterIds()
+						: TNFLSHClusters(sampleTnfs, clusterThreshold, lshTables, lshProjections).getClusterIds();
+				ClusterAgreement agreement(getClusterIds(buildExactClusters(sampleTnfs, clusterThreshold), numSamples), approximateIds);
+				LOG_VERBOSE(1, "Approximate clustering of " << numSamples << " sampled sequences agrees with the exact clustering on "
+						<< agreement.randIndex * 100.0 << "% of pairs, co-clustered pair precision " << agreement.precision * 100.0
+						<< "% and recall " << agreement.recall * 100.0 << "%");
 			}
+		} else {
+			clusters = buildExactClusters(readTnfs, clusterThreshold);
 		}
 
-
-		TNFS readTnfs2 = TNFS(readTnfs);
-
-		while( true ) {
-			// set the thresholds for each remaining read
-
-			vector< DVector::iterator >::iterator minElem = std::min_element(minVec.begin(), minVec.end(), mvo);
-			if (**minElem > clusterThreshold)
-				break;
-			LOG_DEBUG(1, **minElem );
-
-			unsigned long tgtj = minElem - minVec.begin();
-			unsigned long tgti = *minElem - distMatrix[tgtj].begin();
-
-			unsigned long lastIdx = minVec.size() - 1;
-			if (debug) {
-				ostream &debugOut = Log::Debug("MinValue");
-				for(unsigned long i2 = 0 ; i2 < minVec.size(); i2++) {
-					unsigned long j = (i2 <= tgti) ? i2 : tgti;
-					unsigned long i = (i2 <= tgti) ? tgti : i2;
-
-					debugOut << distMatrix[i][j] << "\t";
-				}
-				debugOut << endl;
-			}
-			clusterNames[tgti].insert( clusterNames[tgti].end(), clusterNames[tgtj].begin(), clusterNames[tgtj].end() );
-			clusterNames[tgtj].clear();
-			LOG_VERBOSE(1, "Cluster merged " << tgti << " with " << tgtj << " " << **minElem);
-			readTnfs2[tgti] = readTnfs2[tgti] + readTnfs2[tgtj];
-
-			// remove tgtj from vectors and matrix (1 row and 1 column);
-			std::swap(minVec[tgtj], minVec[lastIdx]); minVec.pop_back();
-			std::swap(clusterNames[tgtj], clusterNames[lastIdx]); clusterNames.pop_back();
-			std::swap(distMatrix[tgtj], distMatrix[lastIdx]); distMatrix.pop_back();
-			std::swap(readTnfs2[tgtj], readTnfs2[lastIdx]); readTnfs2.pop_back();
-
-			for(unsigned long i = tgtj + 1; i < minVec.size(); i++) {
-				float dist = distMatrix[tgtj][i];
-				distMatrix[i][tgtj] = dist;
-
-				if (*minVec[i] > dist) {
-					minVec[i] = distMatrix[i].begin() + tgtj;
-				}
-			}
-			distMatrix[tgtj].resize(tgtj+1);
-			distMatrix[tgtj][tgtj] = clusterThreshold + 1.0;
-			minVec[tgtj] = std::min_element( distMatrix[tgtj].begin(), distMatrix[tgtj].end() );
-
-			// update row & column tgti and affected minVects
-			for(unsigned long i = 0 ; i < minVec.size(); i++) {
-				if (i == tgti)
-					distMatrix[tgti][tgti] = clusterThreshold+1.0;
-				else {
-					float dist = readTnfs2[tgti].getDistance(readTnfs2[i]);
-					if (i < tgti) {
-						distMatrix[tgti][i] = dist;
-					} else {
-						distMatrix[i][tgti] = dist;
-						if (*minVec[i] > dist) {
-							minVec[i] = distMatrix[i].begin() + tgti;
-						}
-					}
-				}
-			}
-			minVec[tgti] = std::min_element( distMatrix[tgti].begin(), distMatrix[tgti].end() );
-
-		}
-
-		for(unsigned long i = 0 ; i < minVec.size(); i++) {
-			for(unsigned long j = 0 ; j < clusterNames[i].size(); j++)
-				os << clusterNames[i][j] << "\t";
-			if (!clusterNames[i].empty())
-				os << endl;
-			clusterNames[i].clear();
+		for(unsigned long i = 0; i < clusters.size(); i++) {
+			for(unsigned long j = 0; j < clusters[i].size(); j++)
+				os << reads.getRead(clusters[i][j]).getName() << "\t";
+			os << endl;
 		}
-		clusterNames.clear();
-
 	}
 
 	return 0;
@@ -58,22 +58,28 @@ such enhancements or derivative works thereof, in binary and source code form.
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/categories.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/condition.hpp>
 
 #include "MemoryBufferStream.h"
 
+// Broadcasts a stream from broadcastRank to the destination on every rank of the communicator.
+// The stream is relayed in chunks down a binary tree rooted at broadcastRank, and every rank
+// forwards a chunk to its children and writes it to its destination while the next chunks are
+// still arriving, so the root only sends each chunk twice, whatever the size of the communicator.
 template< int BUFFER_SIZE = 131072 >
 class BroadcastOstreamDetail {
 public:
 	const static int padding = sizeof(int) * 2; // (int)offset, (int)instance, (char[]) streambuffer
-	const static int MAX_SIZE = BUFFER_SIZE - padding - 128;
+	const static int NUM_BUFFERS = 4;
+	const static int TREE_FANOUT = 2;
+	const static int TAG = 0;
 
-	BroadcastOstreamDetail(const MPI_Comm &_comm, int _broadcastRank, std::ostream &_destination) :
-		broadcastRank(_broadcastRank), destination(_destination) {
+	BroadcastOstreamDetail(const MPI_Comm &_comm, int _broadcastRank, std::ostream &_destination, int bufferSize = BUFFER_SIZE) :
+		broadcastRank(_broadcastRank), destination(_destination), maxSize(bufferSize - padding - 128) {
 		myComm = mpi::communicator(_comm, mpi::comm_duplicate);
 		assert(MPI::Is_thread_main());
 		assert(!omp_in_parallel());
+		if (maxSize <= 0)
+			LOG_THROW("Invalid BroadcastOstream buffer size: " << bufferSize);
 		MPI_Comm_rank(myComm, &myRank);
 		init();
 	}
@@ -81,8 +87,10 @@ public:
 		assert(MPI::Is_thread_main());
 		assert(!omp_in_parallel());
 		_close();
-		free(buf1); buf1 = NULL;
-		free(buf2); buf2 = NULL;
+		for(int i = 0; i < NUM_BUFFERS; i++) {
+			free(buffers[i]);
+			buffers[i] = NULL;
+		}
 	}
 
 	bool isActive() {
@@ -104,10 +112,10 @@ public:
 		assert(omp_get_thread_num() == 0);
 		assert(isActive());
 		int &offset = _getOffset(activeIn);
-		std::streamsize wrote = std::min((std::streamsize) (MAX_SIZE-offset), n);
+		std::streamsize wrote = std::min((std::streamsize) (maxSize-offset), n);
 		memcpy(activeIn + offset + padding, s, wrote);
 		offset += wrote;
-		if (offset == MAX_SIZE)
+		if (offset == maxSize)
 			_flush();
 		return wrote;
 	}
@@ -119,117 +127,131 @@ protected:
 	int &_getInstance(char *buf) {
 		return *(((int*)buf) + 1);
 	}
-	void _swapBuffers() {
-		if (activeIn == buf1) {
-			activeIn = buf2;
-		} else {
-			activeIn = buf1;
-		}
-	}
 	void init() {
-		buf1 = (char*) calloc(MAX_SIZE + padding, 1);
-		buf2 = (char*) calloc(MAX_SIZE + padding, 1);
-		activeIn = buf1;
-		activeOut = NULL;
-		_getOffset(buf1) = 0;
-		_getOffset(buf2) = 0;
+		int ourSize;
+		MPI_Comm_size(myComm, &ourSize);
+		int treeRank = (myRank - broadcastRank + ourSize) % ourSize;
+		parent = (treeRank == 0) ? MPI_PROC_NULL : ((treeRank - 1) / TREE_FANOUT + broadcastRank) % ourSize;
+		for(int i = 1; i <= TREE_FANOUT; i++) {
+			int child = treeRank * TREE_FANOUT + i;
+			if (child < ourSize)
+				children.push_back((child + broadcastRank) % ourSize);
+		}
+		for(int i = 0; i < NUM_BUFFERS; i++) {
+			buffers[i] = (char*) calloc(maxSize + padding, 1);
+			recvRequests[i] = MPI_REQUEST_NULL;
+			sendRequests[i].resize(children.size(), MPI_REQUEST_NULL);
+		}
+		current = 0;
+		activeIn = buffers[current];
+		totalBytes = 0;
+		startTime = MPI_Wtime();
 	}
 	void _close() {
 		LOG_DEBUG_OPTIONAL(1, true, "Entered BroadcastOstream::_close(): " << this << " isActive: " << isActive());
 
-		if (buf1 == NULL)
+		if (activeIn == NULL)
 			return;
 
-		if (activeIn != NULL) {
-			int &offset = _getOffset(activeIn);
-			if (myRank == broadcastRank) {
-				if (offset == MAX_SIZE) {
-					_flush(); _flush();
-				} else {
-					_flush();
-				}
-			} else {
-				while (isActive())
-					_flush();
-			}
+		if (myRank == broadcastRank) {
+			// a full last buffer is followed by an empty one to mark the end of transmission
+			bool wasFull = _getOffset(activeIn) == maxSize;
+			_flush();
+			if (wasFull)
+				_flush();
+		} else {
+			_receiveAll();
 		}
-
+		for(int i = 0; i < NUM_BUFFERS; i++)
+			_waitSends(i);
 		activeIn = NULL;
+
+		double seconds = MPI_Wtime() - startTime;
+		LOG_VERBOSE_OPTIONAL(1, myRank == broadcastRank, "BroadcastOstream: sent " << totalBytes << " bytes to " << children.size() << " ranks in " << seconds << " s (" << (seconds > 0.0 ? totalBytes / seconds / 1048576.0 : 0.0) << " MB/s)");
+		LOG_DEBUG_OPTIONAL(1, myRank != broadcastRank, "BroadcastOstream: received and forwarded " << totalBytes << " bytes to " << children.size() << " ranks in " << seconds << " s (" << (seconds > 0.0 ? totalBytes / seconds / 1048576.0 : 0.0) << " MB/s)");
 	}
+
+	// root: send the active buffer and start filling the next one
 	void _flush() {
 		LOG_DEBUG_OPTIONAL(2, true, "BroadcastOstream::Entered flush(): " << this);
-		if (omp_in_parallel()) {
-			_flushThreaded();
-		} else
-			_flushSerial();
-	}
-	void _outputBuffer(char *buf) {
-		int &myoffset = _getOffset(buf);
-		LOG_DEBUG_OPTIONAL(2, true, "BroadcastOstream::_outputBuffer(): writing output buffer " << myoffset << " bytes: " << this);
-		if (myoffset > 0) {
-			destination.write(buf+padding, myoffset);
-		}
-		if (myRank != broadcastRank) {
-			if (myoffset < MAX_SIZE) {
-				LOG_DEBUG_OPTIONAL(2, true, "BroadcastOstream detected End of transmission");
-				activeIn = NULL;
-			}
-		}
-		myoffset = 0;
-	}
-
-	void _flushSerial() {
 		assert(MPI::Is_thread_main());
 		assert(omp_get_thread_num() == 0);
-		assert(activeOut == NULL);
 		assert(isActive());
-		LOG_DEBUG_OPTIONAL(2, true, "BroadcastOstream::_flushSerial() Entered: " << ((myRank == broadcastRank) ? _getOffset(activeIn) : 0) );
-
-		activeOut = activeIn;
-		_swapBuffers();
-
-		MPI_Bcast(activeOut, MAX_SIZE+padding, MPI_BYTE, broadcastRank, myComm);
-
-		_outputBuffer(activeOut);
-		activeOut = NULL;
-
+		_forwardBuffer(current);
+		_outputBuffer(activeIn);
+		current = (current + 1) % NUM_BUFFERS;
+		_waitSends(current);
+		activeIn = buffers[current];
+		_getOffset(activeIn) = 0;
 	}
-	void _flushThreaded() {
-		assert(omp_in_parallel());
-		if (MPI::Is_thread_main()) { // (omp_get_thread_num() == 0) {
-			{
-				boost::mutex::scoped_lock mylock(mutex);
-				while (activeOut != NULL) {
-					LOG_DEBUG_OPTIONAL(1, true, "BroadcastOstream::_flushThreaded(): Waiting for flushReady.");
-					flushReady.wait(mylock);
-				}
-				_flushSerial();
+
+	// non-root: keep every buffer receiving the next chunks from the parent, and
+	// forward and output each in turn, until a buffer that is not full
+	void _receiveAll() {
+		for(int i = 0; i < NUM_BUFFERS; i++)
+			_postReceive(i);
+		while (true) {
+			MPI_Wait(&recvRequests[current], MPI_STATUS_IGNORE);
+			activeIn = buffers[current];
+			bool isLast = _getOffset(activeIn) < maxSize;
+			_forwardBuffer(current);
+			_outputBuffer(activeIn);
+			if (isLast) {
+				LOG_DEBUG_OPTIONAL(2, true, "BroadcastOstream detected End of transmission");
+				break;
 			}
-			broadcastReady.notify_one();
-		} else {
-			{
-				boost::mutex::scoped_lock mylock(mutex);
-				while (activeOut == NULL) {
-					LOG_DEBUG_OPTIONAL(1, true, "BroadcastOstream::_flushThreaded(): Waiting for broadcastReady.");
-					broadcastReady.wait(mylock);
-				}
-				_outputBuffer(activeOut);
-				activeOut = NULL;
+			_waitSends(current);
+			_postReceive(current);
+			current = (current + 1) % NUM_BUFFERS;
+		}
+		// the receives posted past the end of transmission will never match
+		for(int i = 0; i < NUM_BUFFERS; i++) {
+			if (recvRequests[i] != MPI_REQUEST_NULL) {
+				MPI_Cancel(&recvRequests[i]);
+				MPI_Wait(&recvRequests[i], MPI_STATUS_IGNORE);
 			}
-			flushReady.notify_one();
 		}
 	}
-
+	void _postReceive(int bufIdx) {
+		if (MPI_SUCCESS != MPI_Irecv(buffers[bufIdx], maxSize + padding, MPI_BYTE, parent, TAG, myComm, &recvRequests[bufIdx]))
+			LOG_THROW("MPI_Irecv() failed");
+	}
+	void _forwardBuffer(int bufIdx) {
+		char *buf = buffers[bufIdx];
+		int length = _getOffset(buf) + padding;
+		for(int i = 0; i < (int) children.size(); i++)
+			if (MPI_SUCCESS != MPI_Isend(buf, length, MPI_BYTE, children[i], TAG, myComm, &sendRequests[bufIdx][i]))
+				LOG_THROW("MPI_Isend() failed");
+		totalBytes += _getOffset(buf);
+	}
+	void _waitSends(int bufIdx) {
+		if (!sendRequests[bufIdx].empty())
+			MPI_Waitall(sendRequests[bufIdx].size(), &sendRequests[bufIdx][0], MPI_STATUSES_IGNORE);
+	}
+	void _outputBuffer(char *buf) {
+		int &myoffset = _getOffset(buf);
+		LOG_DEBUG_OPTIONAL(2, true, "BroadcastOstream::_outputBuffer(): writing output buffer " << myoffset << " bytes: " << this);
+		if (myoffset > 0) {
+			destination.write(buf+padding, myoffset);
+		}
+	}
 
 private:
 	mpi::communicator myComm;
 	int broadcastRank;
 	std::ostream &destination;
+	int maxSize;
 	int myRank;
 	int myInstance;
-	char *buf1, *buf2, *activeIn, *activeOut;
-	boost::mutex mutex;
-	boost::condition_variable flushReady, broadcastReady;
+	int parent;
+	std::vector< int > children;
+	char *buffers[NUM_BUFFERS];
+	MPI_Request recvRequests[NUM_BUFFERS];
+	std::vector< MPI_Request > sendRequests[NUM_BUFFERS];
+	int current;
+	char *activeIn;
+	long totalBytes;
+	double startTime;
 
 };
 
@@ -97,12 +97,23 @@ public:
 
 	Read extendContig(const Read &oldContig, const ReadSet &inputReads) {
 
+		if (ExternalAssemblerWorkerPool::getInstance() != NULL) {
+			std::string cmd = Cap3Options::getOptions().getCap3Path() + " input.fa > input.fa.log 2>&1";
+			LOG_DEBUG_OPTIONAL(1, true, "Executing cap3 in a worker for " << oldContig.getName() << "(" << inputReads.getSize() << " read pool): " << cmd);
+			Read bestRead = executeAssemblyInWorker(cmd, "input.fa", "input.fa.cap.contigs", "input.fa.log", inputReads, oldContig);
+			if (bestRead.empty())
+				LOG_WARN(1, "Could not assemble " << oldContig.getName() << " with pool of " << inputReads.getSize() << " reads");
+			return bestRead;
+		}
+
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
 		std::string prefix = "/.cap3-assembly";
 		std::string outputDir = Cleanup::makeTempDir(Options::getOptions().getTmpDir(), prefix);
 		LOG_VERBOSE_OPTIONAL(1, !GeneralOptions::getOptions().getKeepTempDir().empty(), "Saving Cap3 working directory for " << oldContig.getName()
 				<< " to " << GeneralOptions::getOptions().getKeepTempDir() << outputDir.substr(outputDir.find(prefix)));
 		std::string baseName = outputDir + "/input.fa";
 		writeReads(inputReads, oldContig, baseName, FormatOutput::FastaUnmasked());
+		lastTimes.write = lapSeconds(start);
 		std::string log = baseName + ".log";
 		std::string cmd = Cap3Options::getOptions().getCap3Path() + " " + baseName + " > " + log + " 2>&1";
 		LOG_DEBUG_OPTIONAL(1, true, "Executing cap3 for " << oldContig.getName() << "(" << inputReads.getSize() << " read pool): " << cmd);
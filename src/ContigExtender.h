@@ -58,9 +58,12 @@ such enhancements or derivative works thereof, in binary and source code form.
 #include "KmerSpectrum.h"
 #include "Log.h"
 
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
 class _ContigExtenderBaseOptions : public OptionsBaseInterface {
 public:
-	_ContigExtenderBaseOptions() : minimumConsensus(85), minimumCoverage(4.8), maximumDeltaRatio(0.33), minimumExtensionFactor(0.90) {}
+	_ContigExtenderBaseOptions() : minimumConsensus(85), minimumCoverage(4.8), maximumDeltaRatio(0.33), minimumExtensionFactor(0.90), nativeExtender(false) {}
 	std::string &getContigFile () {
 		return contigFile;
 	}
@@ -76,6 +79,9 @@ public:
 	double &getMinimumExtensionFactor() {
 		return minimumExtensionFactor;
 	}
+	bool &getNativeExtender() {
+		return nativeExtender;
+	}
 	void _resetDefaults() {
 	}
 	void _setOptions(po::options_description &desc, po::positional_options_description &p) {
@@ -92,6 +98,8 @@ public:
 
 				("minimum-extension-factor", po::value<double>()->default_value(minimumExtensionFactor), "minimum amount of target contig that a candidate extension contig must contain")
 
+				("native-extender", po::value<bool>()->default_value(nativeExtender), "if set, extend contigs in parallel threads with a local de Bruijn walk over each contig's pool of reads (when no external assembler is configured)")
+
 				("contig-file", po::value<std::string>()->default_value(contigFile), "filename of input contigs.fa");
 
 
@@ -106,6 +114,7 @@ public:
 		setOpt("minimum-coverage", minimumCoverage);
 		setOpt("maximum-delta-ratio", maximumDeltaRatio);
 		setOpt("minimum-extension-factor", minimumExtensionFactor);
+		setOpt("native-extender", nativeExtender);
 		setOpt("contig-file", contigFile);
 
 		if (getContigFile().empty()) {
@@ -124,6 +133,7 @@ private:
 	double minimumCoverage;
 	double maximumDeltaRatio;
 	double minimumExtensionFactor;
+	bool nativeExtender;
 };
 typedef OptionsBaseTemplate< _ContigExtenderBaseOptions > ContigExtenderBaseOptions;
 
@@ -279,4 +289,140 @@ public:
 	}
 };
 
+// Extends a single contig by a local de Bruijn walk over the kmers of its own pool of reads.
+// Unlike ContigExtender, all state is owned by the instance (the global KmerSizer is never touched),
+// so independent contigs can be extended concurrently, one instance per thread.
+// The walk applies the same consensus, coverage and coverage delta rules as KmerSpectrum::extendContig,
+// trying the smallest kmer size first and falling back to longer kmers when a base is ambiguous.
+class LocalDeBruijnExtender {
+public:
+	typedef boost::unordered_map< std::string, unsigned int > KmerCounts;
+	typedef boost::unordered_set< std::string > KmerSet;
+
+	LocalDeBruijnExtender(const ReadSet &reads, SequenceLengthType minKmerSize, SequenceLengthType maxKmerSize, SequenceLengthType kmerStep = 2)
+	: minimumConsensus(ContigExtenderBaseOptions::getOptions().getMinimumConsensus()),
+	  minimumCoverage(ContigExtenderBaseOptions::getOptions().getMinimumCoverage()),
+	  maximumDeltaRatio(ContigExtenderBaseOptions::getOptions().getMaximumDeltaRatio()) {
+
+		for(SequenceLengthType kmerSize = minKmerSize; kmerSize <= maxKmerSize; kmerSize += std::max((SequenceLengthType) 1, kmerStep))
+			kmerSizes.push_back(kmerSize);
+		readKmers.resize(kmerSizes.size());
+
+		for(ReadSet::ReadSetSizeType i = 0; i < reads.getSize(); i++) {
+			std::string fasta = reads.getRead(i).getFasta();
+			for(unsigned int k = 0; k < kmerSizes.size(); k++)
+				countKmers(readKmers[k], fasta, kmerSizes[k]);
+		}
+	}
+
+	// returns the extended sequence, reporting the number of bases added to either end
+	std::string extend(const std::string &contig, SequenceLengthType maxExtend, std::string::size_type &leftTotal, std::string::size_type &rightTotal) const {
+		std::string fasta = contig;
+		leftTotal = rightTotal = 0;
+		if (kmerSizes.empty() || fasta.length() < kmerSizes[0])
+			return fasta;
+
+		// the contig's own kmers mark repeats, and grow with it
+		std::vector< KmerSet > contigKmers(kmerSizes.size());
+		for(unsigned int k = 0; k < kmerSizes.size(); k++) {
+			KmerCounts counts;
+			countKmers(counts, fasta, kmerSizes[k]);
+			for(KmerCounts::const_iterator it = counts.begin(); it != counts.end(); it++)
+				contigKmers[k].insert(it->first);
+		}
+
+		bool extendLeft = true, extendRight = true;
+		SequenceLengthType iteration = 0;
+		while (iteration++ < maxExtend && (extendLeft | extendRight)) {
+			if (extendLeft && (extendLeft = extendOne(fasta, false, contigKmers)))
+				leftTotal++;
+			if (extendRight && (extendRight = extendOne(fasta, true, contigKmers)))
+				rightTotal++;
+		}
+		LOG_DEBUG_OPTIONAL(2, true, "LocalDeBruijnExtender::extend(): left +" << leftTotal << " right +" << rightTotal << " to " << fasta.length());
+		return fasta;
+	}
+
+	static std::string reverseComplement(const std::string &fasta) {
+		std::string rc(fasta.rbegin(), fasta.rend());
+		for(std::string::iterator it = rc.begin(); it != rc.end(); it++)
+			*it = complement(*it);
+		return rc;
+	}
+
+protected:
+	static char complement(char base) {
+		switch(base) {
+		case 'A': return 'T';
+		case 'C': return 'G';
+		case 'G': return 'C';
+		case 'T': return 'A';
+		default: return 'N';
+		}
+	}
+	static bool isBase(char base) {
+		return base == 'A' || base == 'C' || base == 'G' || base == 'T';
+	}
+	static std::string leastComplement(const std::string &kmer) {
+		std::string rc = reverseComplement(kmer);
+		return rc < kmer ? rc : kmer;
+	}
+	static void countKmers(KmerCounts &counts, const std::string &fasta, SequenceLengthType kmerSize) {
+		// skip any window containing an ambiguous base
+		std::string::size_type validRun = 0;
+		for(std::string::size_type pos = 0; pos < fasta.length(); pos++) {
+			validRun = isBase(fasta[pos]) ? validRun + 1 : 0;
+			if (validRun >= kmerSize)
+				counts[ leastComplement(fasta.substr(pos + 1 - kmerSize, kmerSize)) ]++;
+		}
+	}
+	unsigned int getCount(unsigned int k, const std::string &kmer) const {
+		KmerCounts::const_iterator it = readKmers[k].find(leastComplement(kmer));
+		return it == readKmers[k].end() ? 0 : it->second;
+	}
+
+	bool extendOne(std::string &fasta, bool toRight, std::vector< KmerSet > &contigKmers) const {
+		static const char bases[] = "ACGT";
+		for(unsigned int k = 0; k < kmerSizes.size(); k++) {
+			SequenceLengthType kmerSize = kmerSizes[k];
+			if (fasta.length() <= kmerSize)
+				break;
+			std::string edge = toRight ? fasta.substr(fasta.length() - kmerSize) : fasta.substr(0, kmerSize);
+			double edgeValue = getCount(k, edge);
+			if (edgeValue == 0.0)
+				continue;
+
+			std::string next[4];
+			double values[4], total = 0.0;
+			for(int b = 0; b < 4; b++) {
+				next[b] = toRight ? edge.substr(1) + bases[b] : bases[b] + edge.substr(0, kmerSize - 1);
+				total += values[b] = getCount(k, next[b]);
+			}
+			if (total < minimumCoverage || (total / edgeValue) <= maximumDeltaRatio)
+				continue;
+
+			int best = -1;
+			for(int b = 0; b < 4; b++) {
+				if (values[b] / total >= minimumConsensus) {
+					best = b;
+					break;
+				}
+			}
+			if (best < 0 || contigKmers[k].find(leastComplement(next[best])) != contigKmers[k].end())
+				continue; // ambiguous or a repeat at this kmer size
+
+			fasta.insert(toRight ? fasta.length() : 0, 1, bases[best]);
+			for(unsigned int j = 0; j < kmerSizes.size() && kmerSizes[j] <= fasta.length(); j++)
+				contigKmers[j].insert(leastComplement(toRight ? fasta.substr(fasta.length() - kmerSizes[j]) : fasta.substr(0, kmerSizes[j])));
+			return true;
+		}
+		return false;
+	}
+
+private:
+	std::vector< SequenceLengthType > kmerSizes;
+	std::vector< KmerCounts > readKmers;
+	double minimumConsensus, minimumCoverage, maximumDeltaRatio;
+};
+
 #endif /* CONTIGEXTENDER_H_ */
@@ -62,12 +62,16 @@ namespace mpi = boost::mpi;
 #include "MPIBuffer.h"
 #include "ReadSet.h"
 #include "ReadSelector.h"
+#include "ReadCorrector.h"
 #include "MPIUtils.h"
 #include "DistributedOfstreamMap.h"
 
 #include <boost/optional.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <vector>
+#include <map>
+#include <queue>
+#include <numeric>
 
 // collective
 void setGlobalReadSetConstants(mpi::communicator &world, ReadSet &store) {
@@ -118,18 +122,32 @@ public:
 	typedef typename KS::SizeTracker SizeTracker;
 	typedef typename SizeTracker::Elements SizeTrackerElements;
 	typedef typename KS::WeakKAP WeakKAP;
+	typedef typename KS::BucketOwnershipPtr BucketOwnershipPtr;
 
 protected:
 	mpi::communicator world;
+	boost::shared_ptr< boost::thread > _checkpointWriter;
+	int _checkpointBuild;
+	long _checkpointGeneration;
 
 public:
 	DistributedKmerSpectrum(mpi::communicator &_world, unsigned long estimatedRawKmers = 0, bool separateSingletons = true)
-	: KS(estimatedRawKmers, separateSingletons), world(_world, mpi::comm_duplicate), msgPurgeVariant(NULL), _purgedVariants(0) {
+	: KS(estimatedRawKmers, separateSingletons), world(_world, mpi::comm_duplicate), _checkpointBuild(0), _checkpointGeneration(0), msgPurgeVariant(NULL) {
 		int numBuckets = this->weak.getNumBuckets();
 		assert(mpi::all_reduce(world, numBuckets, mpi::maximum<int>()) == numBuckets);
 		LOG_DEBUG(2, "DistributedKmerSpectrum() with " << numBuckets);
+		initBucketOwnership();
+	}
+	// each rank owns an even share of the globally sketched kmers
+	DistributedKmerSpectrum(mpi::communicator &_world, const KmerCardinality &cardinality, bool separateSingletons = true)
+	: KS(cardinality, 1.0 / _world.size(), separateSingletons), world(_world, mpi::comm_duplicate), _checkpointBuild(0), _checkpointGeneration(0), msgPurgeVariant(NULL) {
+		int numBuckets = this->weak.getNumBuckets();
+		assert(mpi::all_reduce(world, numBuckets, mpi::maximum<int>()) == numBuckets);
+		LOG_DEBUG(2, "DistributedKmerSpectrum() with " << numBuckets);
+		initBucketOwnership();
 	}
 	virtual ~DistributedKmerSpectrum() {
+		joinCheckpointWriter();
 	}
 	DistributedKmerSpectrum &operator=(const DistributedKmerSpectrum &other) {
 		*((KS*) this) = other;
@@ -160,23 +178,57 @@ public:
 		return estimatedKmers;
 	}
 
+	// max-reduces the HyperLogLog registers and sums the raw kmers over all ranks
+	static void reduceKmerCardinality(mpi::communicator &world, KmerCardinality &cardinality) {
+		HyperLogLog *sketches[2] = { &cardinality.distinct, &cardinality.solid };
+		for(int i = 0; i < 2; i++) {
+			HyperLogLog::RegisterVector &registers = sketches[i]->getRegisters();
+			HyperLogLog::RegisterVector reduced(registers.size());
+			mpi::all_reduce(world, &registers[0], registers.size(), &reduced[0], mpi::maximum<HyperLogLog::RegisterType>());
+			registers.swap(reduced);
+		}
+		cardinality.rawKmers = mpi::all_reduce(world, cardinality.rawKmers, std::plus<unsigned long>());
+	}
+	// kmers repeated only across ranks are not seen as solid, so with many ranks and shallow data
+	// the solid estimate is a lower bound
+	static KmerCardinality estimateKmerCardinality(mpi::communicator &world, const ReadSet &store) {
+		KmerCardinality cardinality;
+		CountMinSketch repeats(KmerCardinality::getSketchBytes(), 4);
+		cardinality.addReads(store, repeats);
+		reduceKmerCardinality(world, cardinality);
+		LOG_DEBUG_OPTIONAL(1, Logger::isMaster(), "estimateKmerCardinality(world, reads): " << cardinality.toString());
+		return cardinality;
+	}
+
 	template<typename D>
 	MmapFile writeKmerMap(D &kmerMap, std::string filepath) {
 		MmapFile mmap;
 		NumberType alignment = mmap.alignment();
+		int worldSize = world.size();
+
+		initBucketOwnership();
+		const DMPBucketOwnership &ownership = *this->getBucketOwnership();
 
 		NumberType totalMmapSize = sizeof(NumberType) * 2; // numBuckets + bucketMask
 		NumberType numBuckets = kmerMap.getNumBuckets();
 		totalMmapSize += numBuckets * sizeof(NumberType); // offsets for each bucket
+		NumberType ownershipOffset = totalMmapSize;
+		totalMmapSize += ownership.sizeToStore(); // bucket owners, ignored by KmerMap::restore
 		totalMmapSize += alignment - (totalMmapSize % alignment); // align
 
 		LOG_DEBUG_OPTIONAL(1, true, "numBuckets: " << numBuckets);
-		// Get the size of each bucket
+
+		// Get the size and owner of each bucket
+		std::vector< std::vector< IndexType > > rankBuckets(worldSize);
 		NumberType *mySizeCounts = new NumberType[ numBuckets ];
 		for(IndexType i = 0 ; i < numBuckets; i++) {
 			mySizeCounts[i] = kmerMap.getBucketByIdx(i).size();
-			// DMP buckets should only be populated at rank blocks
-			assert( mySizeCounts[i] == 0ul || (long) (world.size() * i / numBuckets) == world.rank());
+			int owner = ownership.getBucketOwner(i, numBuckets);
+			if (owner < 0)
+				LOG_THROW("writeKmerMap(): " << filepath << " has fewer buckets (" << numBuckets << ") than the distributed ownership table (" << ownership.getNumPartitions() << ")");
+			// DMP buckets should only be populated at their owning rank
+			assert( mySizeCounts[i] == 0ul || owner == world.rank());
+			rankBuckets[owner].push_back(i);
 		}
 		// Globally share bucket sizes
 		NumberType *ourSizeCounts = new NumberType[ numBuckets ];
@@ -185,78 +237,214 @@ public:
 		// rename variable for clarity
 		NumberType *offsetArray = mySizeCounts;
 
-		// store the arrays in mmap blocked and aligned by mpi rank
+		// store the arrays in mmap grouped and aligned by owning mpi rank
 		NumberType myOffset = 0, mySize = 0;
-		int lastRank = world.size();
-		for(IndexType i = 0; i < numBuckets; i++) {
-			int rank = world.size() * i / numBuckets;
-			if (rank == world.rank() && lastRank != rank)
+		for(int rank = 0; rank < worldSize; rank++) {
+			if (rank == world.rank())
 				myOffset = totalMmapSize;
-
-			offsetArray[i] = totalMmapSize;
-			totalMmapSize += D::BucketType::sizeToStore( ourSizeCounts[i] );
-
-			if (world.size() * (i+1) / numBuckets != (IndexType) rank) {
-				totalMmapSize += alignment - (totalMmapSize % alignment); // align for each rank
-				if (rank == world.rank())
-					mySize = totalMmapSize - myOffset;
+			for(typename std::vector< IndexType >::iterator it = rankBuckets[rank].begin(); it != rankBuckets[rank].end(); it++) {
+				offsetArray[*it] = totalMmapSize;
+				totalMmapSize += D::BucketType::sizeToStore( ourSizeCounts[*it] );
 			}
-			LOG_DEBUG_GATHER(1, "myOffset " << myOffset << " mySize " << mySize << " totalMmapSize " << totalMmapSize);
-			lastRank = rank;
+			totalMmapSize += alignment - (totalMmapSize % alignment); // align for each rank
+			totalMmapSize = MPICollectiveFile::alignToStripe(totalMmapSize);
+			if (rank == world.rank())
+				mySize = totalMmapSize - myOffset;
 		}
+		LOG_DEBUG_GATHER(1, "myOffset " << myOffset << " mySize " << mySize << " totalMmapSize " << totalMmapSize);
 
-		if (world.rank() == 0) {
-			mmap = MmapTempFile::buildNewMmap(totalMmapSize , filepath);
-			NumberType *numbers = (NumberType *) mmap.data();
-			*(numbers++) = numBuckets;
-			*(numbers++) = kmerMap.getBucketMask();
-			// store offsetArray in mmap
-			for(IndexType i = 0; i < numBuckets; i++) {
-				*(numbers++) = offsetArray[i];
+		// collectively write the header from rank 0 and the buckets of each rank, in blocks
+		{
+			MPICollectiveFile ourFile(world, filepath, totalMmapSize);
+			std::vector< char > buffer;
+			if (world.rank() == 0) {
+				buffer.resize(ownershipOffset + ownership.sizeToStore());
+				NumberType *numbers = (NumberType *) &buffer[0];
+				*(numbers++) = numBuckets;
+				*(numbers++) = kmerMap.getBucketMask();
+				// store offsetArray in header
+				for(IndexType i = 0; i < numBuckets; i++) {
+					*(numbers++) = offsetArray[i];
+				}
+				numbers = (NumberType *) ownership.store(numbers);
+				assert((char*) numbers == &buffer[0] + buffer.size());
 			}
-			msync(mmap.data(), (char*) numbers - mmap.data(), MS_SYNC);
-			LOG_DEBUG(2, "writeKmerMap(): barrier");
-			world.barrier();
-		} else {
-			LOG_DEBUG(2, "writeKmerMap(): barrier");
-			world.barrier();
-			mmap = MmapFile(filepath, std::ios_base::in | std::ios_base::out, totalMmapSize);
-			NumberType *numbers = (NumberType *) mmap.data();
-			LOG_DEBUG_OPTIONAL(1, true, *numbers << " vs " << numBuckets);
-			assert(*(numbers++) == numBuckets);
-			assert(*(numbers++) == kmerMap.getBucketMask());
-
-			for(IndexType i = 0 ; i < numBuckets; i++) {
-				assert(*(numbers++) == offsetArray[i]);
+			ourFile.writeAtAll(0, buffer.empty() ? NULL : &buffer[0], buffer.size());
+
+			// my buckets are contiguous, so split them into blocks of about WRITE_BLOCK_SIZE
+			std::vector< IndexType > &myBuckets = rankBuckets[world.rank()];
+			std::vector< size_t > blockStarts;
+			NumberType blockSize = 0;
+			for(size_t i = 0; i < myBuckets.size(); i++) {
+				NumberType bucketSize = D::BucketType::sizeToStore( ourSizeCounts[myBuckets[i]] );
+				if (blockStarts.empty() || blockSize + bucketSize > (NumberType) DistributedOfstreamMap::WRITE_BLOCK_SIZE) {
+					blockStarts.push_back(i);
+					blockSize = 0;
+				}
+				blockSize += bucketSize;
 			}
-		}
-
-		// store our part of mmap (interleaved DMP)
-		for(IndexType i = 0 ; i < numBuckets; i++) {
-			int rank = (world.size() * i / numBuckets);
-			if (rank == world.rank()) {
-				assert(myOffset <= offsetArray[i]);
-				assert(myOffset + mySize >= offsetArray[i] +  kmerMap.getBucketByIdx(i).size());
-				kmerMap.getBucketByIdx(i).store(mmap.data() + offsetArray[i]);
-			} else {
-				assert( kmerMap.getBucketByIdx(i).size() == 0);
+			long myBlocks = blockStarts.size();
+			blockStarts.push_back(myBuckets.size());
+			long ourBlocks = mpi::all_reduce(world, myBlocks, mpi::maximum<long>());
+
+			for(long block = 0; block < ourBlocks; block++) {
+				NumberType blockOffset = myOffset;
+				buffer.clear();
+				if (block < myBlocks) {
+					IndexType last = myBuckets[blockStarts[block+1] - 1];
+					blockOffset = offsetArray[ myBuckets[blockStarts[block]] ];
+					buffer.resize(offsetArray[last] + D::BucketType::sizeToStore( ourSizeCounts[last] ) - blockOffset);
+					for(size_t i = blockStarts[block]; i < blockStarts[block+1]; i++) {
+						IndexType bucketIdx = myBuckets[i];
+						assert(myOffset <= offsetArray[bucketIdx]);
+						assert(myOffset + mySize >= offsetArray[bucketIdx] +  kmerMap.getBucketByIdx(bucketIdx).size());
+						const char *end = (const char *) kmerMap.getBucketByIdx(bucketIdx).store(&buffer[0] + offsetArray[bucketIdx] - blockOffset);
+						assert(end <= &buffer[0] + buffer.size());
+					}
+				}
+				ourFile.writeAtAll(blockOffset, buffer.empty() ? NULL : &buffer[0], buffer.size());
 			}
 		}
-		// share with other processes
-		msync(mmap.data() + myOffset, mySize, MS_ASYNC);
 
 		delete [] mySizeCounts;	// aka offsetArray
-		LOG_DEBUG(2, "writeKmerMap(): barrier2");
+		delete [] ourSizeCounts;
+		LOG_DEBUG(2, "writeKmerMap(): barrier");
 		world.barrier();
+		mmap = MmapFile(filepath, std::ios_base::in | std::ios_base::out);
+		assert(mmap.size() == totalMmapSize);
 
 		// swap memory maps
 		const D full = D::restore(mmap.data());
 		kmerMap.swap( const_cast<D&>(full) );
 		madvise(const_cast<char*>(mmap.data()), mmap.size(), MADV_RANDOM);
+		assert(ownershipOffset < mmap.size());
 
 		return mmap;
 	};
 
+	/*
+	 * Bucket ownership
+	 *
+	 * Kmers are owned by the rank assigned to the lowest bits of their hash (DMPBucketOwnership),
+	 * so each bucket of the maps is populated on only one rank.  Every spectrum has its own table,
+	 * and its maps spread their buckets so that the buckets owned by each rank keep their designed size.
+	 * By default ranks own contiguous blocks of buckets.  When built from a ReadSet, a spectrum
+	 * samples 1 in --kmer-balance-sample reads, all-reduces the kmer counts per partition and
+	 * greedily packs the partitions (largest first) onto the least loaded rank.
+	 * The table is stored in the header of every kmer map written by writeKmerMap
+	 */
+	void initBucketOwnership() {
+		int worldSize = world.size();
+		if (this->getBucketOwnership().get() != NULL && this->getBucketOwnership()->isSet(worldSize))
+			return;
+		NumberType numPartitions = std::min(this->weak.getNumBuckets(), (NumberType) DMPBucketOwnership::MAX_PARTITIONS);
+		if (this->hasSingletons)
+			numPartitions = std::min(numPartitions, (NumberType) this->singleton.getNumBuckets());
+		numPartitions = mpi::all_reduce(world, numPartitions, mpi::minimum<NumberType>());
+		BucketOwnershipPtr ownership(new DMPBucketOwnership(world.rank()));
+		ownership->setBlocks(numPartitions, worldSize);
+		this->setBucketOwnership(ownership);
+		LOG_DEBUG_OPTIONAL(1, world.rank() == 0, "initBucketOwnership(): " << numPartitions << " partitions in contiguous blocks, " << this->weak.getNumBuckets() << " weak buckets");
+	}
+	// the subtracted kmers are looked up by the rank counting them, so share the ownership of the reference
+	void subtractReference(boost::shared_ptr< DistributedKmerSpectrum > subtractingSpectrum) {
+		if (subtractingSpectrum.get() != NULL && subtractingSpectrum->getBucketOwnership() != this->getBucketOwnership()) {
+			if (this->getBucketOwnership()->isLocked())
+				LOG_THROW("Invalid: subtractReference(): the spectrum has already distributed kmers by its own bucket ownership");
+			this->setBucketOwnership(subtractingSpectrum->getBucketOwnership());
+		}
+		KS::subtractReference(subtractingSpectrum);
+	}
+
+	void balanceBucketOwnership(const ReadSet &store) {
+		int worldSize = world.size();
+		int sampleRate = MPIOptions::getOptions().getKmerBalanceSample();
+		initBucketOwnership();
+		if (sampleRate <= 0 || worldSize == 1 || this->getBucketOwnership()->isLocked())
+			return;
+
+		NumberType numPartitions = this->getBucketOwnership()->getNumPartitions();
+		NumberType partitionMask = numPartitions - 1;
+		long kmerSubsample = KS::getKmerSubsample();
+		int numThreads = omp_get_max_threads();
+		std::vector< std::vector< unsigned long > > threadCounts(numThreads, std::vector< unsigned long >(numPartitions, 0));
+		ReadSetSizeType storeSize = store.getSize();
+
+#pragma omp parallel num_threads(numThreads)
+		{
+			std::vector< unsigned long > &counts = threadCounts[omp_get_thread_num()];
+			KmerReadUtils kru;
+#pragma omp for schedule(dynamic, 64)
+			for(long readIdx = 0; readIdx < (long) storeSize; readIdx += sampleRate) {
+				const Read &read = store.getRead(readIdx);
+				if (read.isDiscarded())
+					continue;
+				KmerWeightedExtensions &kmers = kru.buildWeightedKmers(read, true, true);
+				for (PositionType readPos = 0 ; readPos < kmers.size(); readPos++) {
+					KmerHasher::HashType hash = kmers[readPos].hash();
+					if (kmerSubsample > 1 && hash % kmerSubsample != 0)
+						continue;
+					WeightType weight = kmers.valueAt(readPos).getWeight();
+					if (TrackingData::isDiscard( (weight<0.0) ? 0.0-weight : weight ))
+						continue;
+					counts[hash & partitionMask]++;
+				}
+			}
+		}
+		for(int threadId = 1; threadId < numThreads; threadId++)
+			for(NumberType i = 0; i < numPartitions; i++)
+				threadCounts[0][i] += threadCounts[threadId][i];
+		std::vector< unsigned long > ourCounts(numPartitions, 0);
+		all_reduce(world, &(threadCounts[0][0]), numPartitions, &(ourCounts[0]), std::plus<unsigned long>());
+
+		// largest partition first, onto the least loaded rank.  Deterministic, so every rank builds the same table
+		typedef std::pair< unsigned long, NumberType > CountPartition;
+		std::vector< CountPartition > partitions(numPartitions);
+		for(NumberType i = 0; i < numPartitions; i++)
+			partitions[i] = CountPartition(ourCounts[i] + 1, i); // +1 spreads unsampled partitions too
+		std::sort(partitions.begin(), partitions.end(), std::greater< CountPartition >());
+
+		typedef std::pair< unsigned long, int > LoadRank;
+		std::priority_queue< LoadRank, std::vector< LoadRank >, std::greater< LoadRank > > loads;
+		for(int rank = 0; rank < worldSize; rank++)
+			loads.push(LoadRank(0, rank));
+		DMPBucketOwnership::OwnerVector owners(numPartitions);
+		std::vector< unsigned long > rankLoads(worldSize, 0), blockLoads(worldSize, 0);
+		for(typename std::vector< CountPartition >::iterator it = partitions.begin(); it != partitions.end(); it++) {
+			LoadRank least = loads.top();
+			loads.pop();
+			owners[it->second] = least.second;
+			least.first += it->first;
+			loads.push(least);
+			rankLoads[least.second] += it->first - 1;
+			blockLoads[ worldSize * it->second / numPartitions ] += it->first - 1;
+		}
+		BucketOwnershipPtr balanced(new DMPBucketOwnership(world.rank()));
+		balanced->set(owners, worldSize);
+		this->setBucketOwnership(balanced);
+
+		unsigned long total = std::accumulate(rankLoads.begin(), rankLoads.end(), 0ul);
+		double mean = std::max(1.0, (double) total / worldSize);
+		LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Balanced kmer ownership of " << numPartitions << " partitions from " << total << " sampled kmers: max/mean load "
+				<< *std::max_element(rankLoads.begin(), rankLoads.end()) / mean << " (contiguous blocks: " << *std::max_element(blockLoads.begin(), blockLoads.end()) / mean << ")");
+	}
+
+	// report the distribution of the spectrum across ranks
+	void reportBucketLoad() {
+		unsigned long myKmers = this->solid.size() + this->weak.size() + this->singleton.size();
+		std::vector< unsigned long > ourKmers;
+		mpi::gather(world, myKmers, ourKmers, 0);
+		if (world.rank() == 0) {
+			unsigned long total = std::accumulate(ourKmers.begin(), ourKmers.end(), 0ul);
+			double mean = std::max(1.0, (double) total / world.size());
+			std::stringstream byRank;
+			for(int rank = 0; rank < world.size(); rank++)
+				byRank << "\n\trank " << rank << ": " << ourKmers[rank] << " kmers (" << ourKmers[rank] / mean << " of mean)";
+			LOG_VERBOSE(1, "Spectrum load across ranks: " << total << " kmers, max/mean " << *std::max_element(ourKmers.begin(), ourKmers.end()) / mean);
+			LOG_VERBOSE(2, "Spectrum load by rank:" << byRank.str());
+		}
+	}
+
 	/*
 	 * StoreKmer / buildKmerSpectrumMPI
 	 *
@@ -330,6 +518,195 @@ public:
 
 	typedef MPIAllToAllMessageBuffer< StoreKmerMessageHeader, StoreKmerMessageHeaderProcessor > StoreKmerMessageBuffer;
 
+	/*
+	 * Checkpoint / Restart of _buildKmerSpectrumMPI
+	 *
+	 * With --checkpoint-reads N the build runs in segments of N reads per rank.  Each segment
+	 * finalizes its message buffers, so every kmer from the reads consumed so far is stored at its owner,
+	 * and then every rank saves an image of its local maps and the number of reads taken from its stream.
+	 * The images are copied into file backed mmaps (.tmp) and a background thread syncs them to disk,
+	 * renames them and finally writes the manifest, which marks the image as complete.
+	 *
+	 * Generations alternate between two slots, and the previous writer is joined before the
+	 * barrier that starts the next checkpoint, so every rank always has the newest generation that
+	 * is complete on all ranks.  --resume-from restores that generation and skips the consumed reads.
+	 *
+	 * files: <prefix>-b<build>-s<slot>-r<rank> (manifest) and -solid, -weak, -singleton map images
+	 */
+	class CheckpointWriter {
+	public:
+		typedef std::pair< std::string, std::string > TmpFinalNames;
+		std::vector< MmapFile > mmaps;
+		std::vector< TmpFinalNames > names;
+		std::string manifestName, manifest;
+
+		CheckpointWriter(std::string _manifestName, std::string _manifest) : manifestName(_manifestName), manifest(_manifest) {}
+		void add(MmapFile mmap, std::string tmpName, std::string finalName) {
+			mmaps.push_back(mmap);
+			names.push_back(TmpFinalNames(tmpName, finalName));
+		}
+		void operator()() {
+			for(unsigned int i = 0; i < mmaps.size(); i++) {
+				msync(mmaps[i].data(), mmaps[i].size(), MS_SYNC);
+				mmaps[i].close();
+				if (rename(names[i].first.c_str(), names[i].second.c_str()) != 0) {
+					LOG_WARN(1, "Could not rename checkpoint " << names[i].first << " to " << names[i].second);
+					return;
+				}
+			}
+			std::string tmpName = manifestName + ".tmp";
+			{
+				std::ofstream os(tmpName.c_str());
+				os << manifest;
+				os.flush();
+				if (os.fail()) {
+					LOG_WARN(1, "Could not write checkpoint manifest " << tmpName);
+					return;
+				}
+			}
+			if (rename(tmpName.c_str(), manifestName.c_str()) != 0)
+				LOG_WARN(1, "Could not rename checkpoint " << tmpName << " to " << manifestName);
+		}
+	};
+
+	static int &getBuildCount() {
+		static int buildCount = 0;
+		return buildCount;
+	}
+	std::string getCheckpointName(std::string prefix, int build, long generation) {
+		std::stringstream ss;
+		ss << prefix << "-b" << build << "-s" << (generation % 2) << "-r" << world.rank();
+		return ss.str();
+	}
+	std::string getCheckpointPrefix() {
+		std::string prefix = MPIOptions::getOptions().getCheckpointPrefix();
+		if (prefix.empty())
+			prefix = Options::getOptions().getOutputFile() + "-checkpoint";
+		return prefix;
+	}
+	void joinCheckpointWriter() {
+		if (_checkpointWriter.get() != NULL) {
+			_checkpointWriter->join();
+			_checkpointWriter.reset();
+		}
+	}
+
+	// collective
+	void writeCheckpoint(bool isSolid, ReadSetSizeType numReads, ReadSetSizeType globalReadSetOffset) {
+		// a slot is reused only once the generation in it is superseded on every rank
+		joinCheckpointWriter();
+		world.barrier();
+
+		std::string name = getCheckpointName(getCheckpointPrefix(), _checkpointBuild, _checkpointGeneration);
+		unlink(name.c_str());
+
+		std::stringstream manifest;
+		manifest << "KmernatorCheckpoint 1\n"
+				<< "generation " << _checkpointGeneration << "\n"
+				<< "worldSize " << world.size() << "\n"
+				<< "rank " << world.rank() << "\n"
+				<< "kmerSize " << KmerSizer::getSequenceLength() << "\n"
+				<< "globalReadSetOffset " << globalReadSetOffset << "\n"
+				<< "isSolid " << isSolid << "\n"
+				<< "reads " << numReads << "\n"
+				<< "solid " << this->hasSolids << "\n"
+				<< "singleton " << this->hasSingletons << "\n"
+				<< "owners " << this->getBucketOwnership()->getNumPartitions();
+		const DMPBucketOwnership::OwnerVector &owners = this->getBucketOwnership()->getOwners();
+		for(DMPBucketOwnership::OwnerVector::const_iterator it = owners.begin(); it != owners.end(); it++)
+			manifest << " " << *it;
+		manifest << "\n";
+
+		CheckpointWriter writer(name, manifest.str());
+		if (this->hasSolids)
+			writer.add(this->solid.store(name + "-solid.tmp"), name + "-solid.tmp", name + "-solid");
+		writer.add(this->weak.store(name + "-weak.tmp"), name + "-weak.tmp", name + "-weak");
+		if (this->hasSingletons)
+			writer.add(this->singleton.store(name + "-singleton.tmp"), name + "-singleton.tmp", name + "-singleton");
+		_checkpointWriter.reset(new boost::thread(writer));
+
+		LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Checkpointing kmer spectrum build " << _checkpointBuild << " generation " << _checkpointGeneration << " to " << getCheckpointPrefix());
+		LOG_DEBUG_GATHER(1, "writeCheckpoint(): " << name << " after " << numReads << " reads");
+		_checkpointGeneration++;
+	}
+
+	// returns the generation stored in a complete checkpoint manifest, or -1
+	long readCheckpointManifest(std::string name, std::map< std::string, std::string > &values) {
+		values.clear();
+		std::ifstream is(name.c_str());
+		std::string key, value;
+		while (is >> key && std::getline(is, value))
+			values[key] = value.empty() ? value : value.substr(1);
+		if (values.find("KmernatorCheckpoint") == values.end() || values.find("owners") == values.end())
+			return -1;
+		return atol(values["generation"].c_str());
+	}
+
+	template<typename M>
+	void restoreCheckpointMap(M &map, std::string filename) {
+		MmapFile mmap = MmapTempFile::openMmap(filename);
+		if (!mmap.is_open() || mmap.size() == 0)
+			LOG_THROW("Could not open checkpoint " << filename);
+		M tmp(mmap.data());
+		map.swap(tmp);
+	}
+
+	// collective.  returns the number of reads already consumed from store
+	ReadSetSizeType resumeCheckpoint(ReadSetStream &store, bool isSolid, ReadSetSizeType globalReadSetOffset) {
+		std::string prefix = MPIOptions::getOptions().getResumeFrom();
+		if (prefix.empty())
+			return 0;
+
+		std::map< std::string, std::string > values;
+		long myGeneration = std::max(readCheckpointManifest(getCheckpointName(prefix, _checkpointBuild, 0), values),
+				readCheckpointManifest(getCheckpointName(prefix, _checkpointBuild, 1), values));
+		long ourGeneration = mpi::all_reduce(world, myGeneration, mpi::minimum<long>());
+		if (ourGeneration < 0) {
+			LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "No complete checkpoint of kmer spectrum build " << _checkpointBuild << " at " << prefix << ", starting from the beginning");
+			return 0;
+		}
+
+		std::string name = getCheckpointName(prefix, _checkpointBuild, ourGeneration);
+		if (readCheckpointManifest(name, values) != ourGeneration)
+			LOG_THROW("Checkpoint " << name << " is not generation " << ourGeneration);
+		if (atoi(values["worldSize"].c_str()) != world.size() || atoi(values["rank"].c_str()) != world.rank()
+				|| atol(values["kmerSize"].c_str()) != (long) KmerSizer::getSequenceLength()
+				|| strtoul(values["globalReadSetOffset"].c_str(), NULL, 10) != globalReadSetOffset
+				|| (atoi(values["isSolid"].c_str()) != 0) != isSolid)
+			LOG_THROW("Checkpoint " << name << " was written by a different run (ranks, kmer size or input)");
+
+		std::stringstream ss(values["owners"]);
+		NumberType numPartitions = 0;
+		ss >> numPartitions;
+		DMPBucketOwnership::OwnerVector owners(numPartitions);
+		for(NumberType i = 0; i < numPartitions; i++)
+			ss >> owners[i];
+		if (this->getBucketOwnership()->isLocked() && owners != this->getBucketOwnership()->getOwners())
+			LOG_THROW("Checkpoint " << name << " was written with a different kmer ownership than the earlier spectrum");
+		BucketOwnershipPtr ownership(new DMPBucketOwnership(world.rank()));
+		ownership->set(owners, world.size());
+		ownership->lock();
+
+		if (atoi(values["solid"].c_str()) != 0) {
+			this->prepareSolids();
+			restoreCheckpointMap(this->solid, name + "-solid");
+		}
+		restoreCheckpointMap(this->weak, name + "-weak");
+		if (atoi(values["singleton"].c_str()) != 0)
+			restoreCheckpointMap(this->singleton, name + "-singleton");
+		// the restored maps are already distributed by the checkpointed ownership
+		this->setBucketOwnership(ownership, false);
+
+		ReadSetSizeType numReads = strtoul(values["reads"].c_str(), NULL, 10);
+		if (store.skip(numReads) != numReads)
+			LOG_THROW("Checkpoint " << name << " consumed more reads than are in the input");
+
+		_checkpointGeneration = ourGeneration + 1;
+		LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Resumed kmer spectrum build " << _checkpointBuild << " from generation " << ourGeneration << " at " << prefix);
+		LOG_DEBUG_GATHER(1, "resumeCheckpoint(): " << name << " skipped " << numReads << " reads");
+		return numReads;
+	}
+
 	void _buildKmerSpectrumMPI(const ReadSet &store, bool isSolid) {
 		assert(store.isGlobal());
 		if (store.getGlobalSize() == 0)
@@ -354,104 +731,120 @@ public:
 
 		//ReadSetSizeType globalReadSetOffset = store.getGlobalOffset(world.rank());
 		//assert( world.rank() == 0 ? (globalReadSetOffset == 0) : (store.getSize() == 0 || globalReadSetOffset > 0) );
-		msgBuffers = new StoreKmerMessageBuffer(world, messageSize, StoreKmerMessageHeaderProcessor(*this,isSolid));
 
 		long kmerSubsample = KS::getKmerSubsample();
 		ReadSetSizeType batchReadsSize = 8192;
-		ReadSetSizeType numReads = 0;
 
-		std::stringstream ss;
+		_checkpointBuild = getBuildCount()++;
+		_checkpointGeneration = 0;
+		ReadSetSizeType numReads = resumeCheckpoint(store, isSolid, globalReadSetOffset);
+		initBucketOwnership();
+		this->getBucketOwnership()->lock();
+		ReadSetSizeType checkpointReads = MPIOptions::getOptions().getCheckpointReads();
+
+		// without checkpoints, all the reads are processed in a single segment
+		bool hasMoreReads = true;
+		while (hasMoreReads) {
+			ReadSetSizeType segmentEnd = checkpointReads > 0 ? numReads + checkpointReads : (ReadSetSizeType) -1;
+			msgBuffers = new StoreKmerMessageBuffer(world, messageSize, StoreKmerMessageHeaderProcessor(*this,isSolid));
+
+			std::stringstream ss;
 #pragma omp parallel num_threads(numThreads)
-		{
-			int threadId = omp_get_thread_num();
+			{
+				int threadId = omp_get_thread_num();
 
 #pragma omp master
-			{
-				LOG_DEBUG(2, "message buffers ready");
-				world.barrier();
-			}
+				{
+					LOG_DEBUG(2, "message buffers ready");
+					world.barrier();
+				}
 #pragma omp barrier
 
-			// allow the master thread to only handle communications
-			int loopThreadId = threadId, loopNumThreads = numThreads;
-			bool isRunningInLoop = true;
-			if (numThreads > 1) {
-				if (loopThreadId == 0)
-					isRunningInLoop = false;
-				loopThreadId--; loopNumThreads--;
-			}
-			ReadSetSizeType myOffset = 0;
-			KmerReadUtils kru;
-			long progressCount = 0, progressMark = 1000000 / world.size();
-			while (isRunningInLoop) {
-				Read batchReads[batchReadsSize];
-				ReadSetSizeType batchReadSetSize = 0;
+				// allow the master thread to only handle communications
+				int loopThreadId = threadId, loopNumThreads = numThreads;
+				bool isRunningInLoop = true;
+				if (numThreads > 1) {
+					if (loopThreadId == 0)
+						isRunningInLoop = false;
+					loopThreadId--; loopNumThreads--;
+				}
+				ReadSetSizeType myOffset = 0;
+				KmerReadUtils kru;
+				long progressCount = 0, progressMark = 1000000 / world.size();
+				while (isRunningInLoop) {
+					Read batchReads[batchReadsSize];
+					ReadSetSizeType batchReadSetSize = 0;
 #pragma omp critical (readSmallBatch)
-				{
-					batchReadSetSize = 0;
-					while (batchReadSetSize < batchReadsSize && store.hasNext())
-						batchReads[batchReadSetSize++] = store.getRead();
-					myOffset = numReads;
+					{
+						batchReadSetSize = 0;
+						while (batchReadSetSize < batchReadsSize && numReads + batchReadSetSize < segmentEnd && store.hasNext())
+							batchReads[batchReadSetSize++] = store.getRead();
+						myOffset = numReads;
 #pragma omp atomic
-					numReads += batchReadSetSize;
-
-				}
-				if (batchReadSetSize == 0)
-					break;
-				// for(long readIdx = loopThreadId ; readIdx < readSetSize; readIdx+=loopNumThreads)
-				for(ReadSetSizeType batchReadIdx = 0; batchReadIdx < batchReadSetSize ; batchReadIdx++)
-				{
-					ReadSetSizeType readIdx = batchReadIdx + myOffset;
+						numReads += batchReadSetSize;
 
-					if (loopThreadId == 0 && progressCount++ % progressMark == 0) {
-						long mark = (progressCount-1)/progressMark;
-						LOG_VERBOSE_OPTIONAL(1, mark % world.size() == world.rank(), "Building Kmers: distributed processing (approx) " << (readIdx * world.size()) << " reads. (mark: " << mark << ")");
-						LOG_DEBUG(1, "Building Kmers: mark: " << mark << " reads: " << readIdx << " memory: " << MemoryUtils::getMemoryUsage());
 					}
+					if (batchReadSetSize == 0)
+						break;
+					// for(long readIdx = loopThreadId ; readIdx < readSetSize; readIdx+=loopNumThreads)
+					for(ReadSetSizeType batchReadIdx = 0; batchReadIdx < batchReadSetSize ; batchReadIdx++)
+					{
+						ReadSetSizeType readIdx = batchReadIdx + myOffset;
+
+						if (loopThreadId == 0 && progressCount++ % progressMark == 0) {
+							long mark = (progressCount-1)/progressMark;
+							LOG_VERBOSE_OPTIONAL(1, mark % world.size() == world.rank(), "Building Kmers: distributed processing (approx) " << (readIdx * world.size()) << " reads. (mark: " << mark << ")");
+							LOG_DEBUG(1, "Building Kmers: mark: " << mark << " reads: " << readIdx << " memory: " << MemoryUtils::getMemoryUsage());
+						}
 
-					const Read &read = batchReads[ batchReadIdx ]; // store.getRead( readIdx );
-
-					if (read.isDiscarded())
-						continue;
-
-					DataPointers pointers(*this);
-					KmerWeightedExtensions &kmers = kru.buildWeightedKmers(read, true, true);
-					ReadSetSizeType globalReadIdx = readIdx + globalReadSetOffset;
-					LOG_DEBUG(3, "_buildKmerSpectrumMPI(): Read " << readIdx << " (" << globalReadIdx << ") " << kmers.size() );
+						const Read &read = batchReads[ batchReadIdx ]; // store.getRead( readIdx );
 
-					for (PositionType readPos = 0 ; readPos < kmers.size(); readPos++) {
-						int rankDest, threadDest;
-						if (kmerSubsample > 1 && kmers[readPos].hash() % kmerSubsample != 0) {
+						if (read.isDiscarded())
 							continue;
-						}
-						const WeightedExtensionMessagePacket &v = kmers.valueAt(readPos);
-						WeightType weight = v.getWeight();
-						if ( TrackingData::isDiscard( (weight<0.0) ? 0.0-weight : weight ) )  {
-							LOG_DEBUG(4, "discarded kmer " << readIdx << "@" << readPos << " " << weight << " " << kmers[readPos].toFasta());
-						} else {
 
-							this->getThreadIds(kmers[readPos], threadDest, loopNumThreads, rankDest, worldSize, true);
+						DataPointers pointers(*this);
+						KmerWeightedExtensions &kmers = kru.buildWeightedKmers(read, true, true);
+						ReadSetSizeType globalReadIdx = readIdx + globalReadSetOffset;
+						LOG_DEBUG(3, "_buildKmerSpectrumMPI(): Read " << readIdx << " (" << globalReadIdx << ") " << kmers.size() );
 
-							if (rankDest == rank && threadDest == loopThreadId) {
-								this->append(pointers, kmers[readPos], v.getWeight(), globalReadIdx, readPos, isSolid, v.getLeft(), v.getRight());
+						for (PositionType readPos = 0 ; readPos < kmers.size(); readPos++) {
+							int rankDest, threadDest;
+							if (kmerSubsample > 1 && kmers[readPos].hash() % kmerSubsample != 0) {
+								continue;
+							}
+							const WeightedExtensionMessagePacket &v = kmers.valueAt(readPos);
+							WeightType weight = v.getWeight();
+							if ( TrackingData::isDiscard( (weight<0.0) ? 0.0-weight : weight ) )  {
+								LOG_DEBUG(4, "discarded kmer " << readIdx << "@" << readPos << " " << weight << " " << kmers[readPos].toFasta());
 							} else {
-								msgBuffers->bufferMessage(rankDest, numThreads == loopNumThreads ? threadDest : threadDest+1)->set(globalReadIdx, readPos, v, kmers[readPos]);
+
+								this->getThreadIds(kmers[readPos], threadDest, loopNumThreads, rankDest, worldSize, true);
+
+								if (rankDest == rank && threadDest == loopThreadId) {
+									this->append(pointers, kmers[readPos], v.getWeight(), globalReadIdx, readPos, isSolid, v.getLeft(), v.getRight());
+								} else {
+									msgBuffers->bufferMessage(rankDest, numThreads == loopNumThreads ? threadDest : threadDest+1)->set(globalReadIdx, readPos, v, kmers[readPos]);
+								}
 							}
 						}
 					}
 				}
-			}
 
-			LOG_DEBUG(2, "finished generating kmers from reads");
+				LOG_DEBUG(2, "finished generating kmers from reads");
+
+				msgBuffers->finalize();
+
+			} // omp parallel
+			delete msgBuffers;
 
-			msgBuffers->finalize();
+			hasMoreReads = mpi::all_reduce(world, numReads == segmentEnd, std::logical_or<bool>());
+			if (checkpointReads > 0)
+				writeCheckpoint(isSolid, numReads, globalReadSetOffset);
+		}
 
-		} // omp parallel
 		LOG_DEBUG(1, "Done building kmers");
 		LOG_VERBOSE(1, "Processed " << numReads << " reads. " << this->solid.size() << "/" << this->weak.size() << "/" << this->singleton.size() << " kmers");
 
-		delete msgBuffers;
-
 		LOG_DEBUG(3, "_buildKmerSpectrumMPI() final barrier");
 		world.barrier();
 		LOG_DEBUG_GATHER(1, "finished _buildKmerSpectrumMPI. " << MemoryUtils::getMemoryUsage());
@@ -542,12 +935,14 @@ public:
 		assert(store.isGlobal());
 		if (store.getGlobalSize() == 0)
 			return;
+		balanceBucketOwnership(store);
 		ReadSetStream rss(store);
 		this->buildKmerSpectrum(rss, isSolid, store.getGlobalOffset(world.rank()));
 	}
 	void buildKmerSpectrum(ReadSetStream &rss, bool isSolid, ReadSetSizeType globalOffset = 0) {
 
 		_buildKmerSpectrumMPI(rss, isSolid, globalOffset);
+		reportBucketLoad();
 
 		if(Log::isVerbose(2)) {
 			std::string hist = getHistogram(isSolid);
@@ -604,6 +999,29 @@ public:
 		return ourSpectrum;
 	}
 
+	// restores the bucket ownership saved by writeKmerMaps too, if present
+	Kmernator::MmapFileVector restoreMmap(string mmapFilename) {
+		Kmernator::MmapFileVector spectrumMmaps = KS::restoreMmap(mmapFilename);
+		Kmernator::MmapFile weakMmap = MmapTempFile::openMmap(mmapFilename);
+		if (weakMmap.is_open() && weakMmap.size() > 0 && !this->getBucketOwnership()->isLocked()) {
+			const NumberType *numbers = (const NumberType *) weakMmap.data();
+			NumberType headerOffset = sizeof(NumberType) * (2 + numbers[0]);
+			BucketOwnershipPtr ownership(new DMPBucketOwnership(world.rank()));
+			if (headerOffset < weakMmap.size()
+					&& ownership->restore(weakMmap.data() + headerOffset, weakMmap.size() - headerOffset)) {
+				// every rank maps the whole spectrum, so any table for this number of ranks routes the lookups
+				if (!ownership->isSet(world.size())) {
+					LOG_WARN(1, "Kmer spectrum " << mmapFilename << " was saved by a different number of ranks, using contiguous bucket ownership");
+					ownership.reset(new DMPBucketOwnership(world.rank()));
+					ownership->setBlocks(this->getBucketOwnership()->getNumPartitions(), world.size());
+				}
+				ownership->lock();
+				this->setBucketOwnership(ownership, false);
+			}
+		}
+		return spectrumMmaps;
+	}
+
 	/*
 	 * PurgeVariantKmer / buildKmerSpectrumMPI
 	 *
@@ -631,66 +1049,51 @@ public:
 	class PurgeVariantKmerMessageHeaderProcessor {
 	public:
 		DistributedKmerSpectrum &_spectrum;
-		std::vector< DataPointers > _pointers;
-		double _variantSigmas, _minDepth;
-		PurgeVariantKmerMessageHeaderProcessor(DistributedKmerSpectrum &spectrum,  double variantSigmas, double minDepth)
-		: _spectrum(spectrum), _variantSigmas(variantSigmas), _minDepth(minDepth) {
-			for(int i = 0; i < omp_get_max_threads(); i++)
-				_pointers.push_back( DataPointers(_spectrum) );
-		}
-		inline DataPointers &getDataPointer() {
-			return _pointers[omp_get_thread_num()];
-		}
-		inline DistributedKmerSpectrum &getSpectrum() {
-			return _spectrum;
-		}
-		inline double getVariantSigmas() {
-			return _variantSigmas;
-		}
-		inline double getMinDepth() {
-			return _minDepth;
-		}
+		PurgeVariantKmerMessageHeaderProcessor(DistributedKmerSpectrum &spectrum)
+		: _spectrum(spectrum) {}
 		int process(PurgeVariantKmerMessageHeader *msg, MessagePackage &msgPkg) {
 			LOG_DEBUG(5, "PurgeVariantKmerMessage: " << msg->threshold << " " << msg->getKmer()->toFasta());
-			DistributedKmerSpectrum &spectrum = getSpectrum();
-			DataPointers &pointers = getDataPointer();
-			double dummy;
-			bool purged = spectrum._setPurgeVariant(pointers, *msg->getKmer(), msg->threshold, dummy);
-
-			if (purged)
-				spectrum.variantWasPurged();
+			Kmer &kmer = *msg->getKmer();
+			_spectrum._probeVariant(kmer, kmer.hash(), msg->threshold, _spectrum._receivedVariants[omp_get_thread_num()]);
 			return 0;
 		}
 	};
 
 	typedef MPIAllToAllMessageBuffer< PurgeVariantKmerMessageHeader, PurgeVariantKmerMessageHeaderProcessor > PurgeVariantKmerMessageBuffer;
+	typedef typename KS::VariantBatch VariantBatch;
+	typedef typename KS::VariantCounters VariantCounters;
 
-	void variantWasPurged(long count = 1) {
-#pragma omp atomic
-		_purgedVariants += count;
-	}
 	private:
 	PurgeVariantKmerMessageBuffer *msgPurgeVariant;
-	long _purgedVariants;
+	// probes of messages received from other ranks, by local thread
+	std::vector< VariantCounters > _receivedVariants;
 
 	void _preVariants(double variantSigmas, double minDepth) {
-		_purgedVariants = 0;
+		_receivedVariants.assign(omp_get_max_threads(), VariantCounters());
 		long messageSize = sizeof(PurgeVariantKmerMessageHeader) + KmerSizer::getByteSize();
 
 		if (msgPurgeVariant != NULL)
 			delete msgPurgeVariant;
-		msgPurgeVariant = new PurgeVariantKmerMessageBuffer(world, messageSize, PurgeVariantKmerMessageHeaderProcessor(*this, variantSigmas, minDepth));
+		msgPurgeVariant = new PurgeVariantKmerMessageBuffer(world, messageSize, PurgeVariantKmerMessageHeaderProcessor(*this));
 
 		LOG_DEBUG(2, "_preVariants(): barrier");
 		world.barrier();
 	}
 
-	long _postVariants(long purgedKmers) {
-		_purgedVariants += this->KS::_postVariants(purgedKmers);
+	// returns the variants purged on this rank, and reports the counters summed over all ranks
+	long _postVariants(VariantCounters &counters) {
 		delete msgPurgeVariant;
 		msgPurgeVariant = NULL;
 
-		return _purgedVariants;
+		for(size_t i = 0; i < _receivedVariants.size(); i++)
+			counters.add(_receivedVariants[i]);
+		_receivedVariants.clear();
+
+		VariantCounters allCounters;
+		mpi::all_reduce(world, counters.counts, VariantCounters::SIZE, allCounters.counts, std::plus<long>());
+		LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Distributed removed " << allCounters[VariantCounters::PURGED] << " kmer-variants (" << allCounters.toString() << ")");
+
+		return counters[VariantCounters::PURGED];
 	}
 	void _variantThreadSync(long processed, long remaining, double maxDepth) {
 		// call parent
@@ -707,41 +1110,63 @@ public:
 		mpi::all_reduce(world, remaining, allRemaining, std::plus<long>());
 		if (threshold > 0.0) {
 			long allPurged;
-			mpi::reduce(world, purgedKmers+_purgedVariants, allPurged, std::plus<long>(), 0);
+			mpi::reduce(world, purgedKmers, allPurged, std::plus<long>(), 0);
 			LOG_VERBOSE_OPTIONAL(2, world.rank() == 0, "Distributed Purged " << allPurged << " variants below: " << maxDepth << " / " <<  threshold << ".  Remaining: " << allRemaining);
 		}
 		world.barrier();
 		return allRemaining;
 	}
-	// recursively purge kmers within editdistance
-	long _purgeVariants(DataPointers &pointers, const Kmer &kmer, WeakKAP &variants, double threshold, short editDistance) {
+	// probes the neighbours owned by this rank directly and sends the rest, grouped by rank, to their owners
+	void _probeVariants(VariantBatch &batch) {
 		int rank = world.rank();
-		int worldSize = world.size();
-		if (editDistance == 0)
-			return 0;
-
-		variants.permuteBases(kmer, variants, editDistance, true);
-
-		for(SequenceLengthType i = 0 ; i < variants.size(); i++) {
-			int rankDest, threadDest;
-			Kmer &varKmer = variants[i];
-			this->solid.getThreadIds(varKmer, threadDest, 1, rankDest, worldSize);
+		batch.prepare(this->weak, world.size());
+		long messageSize = sizeof(PurgeVariantKmerMessageHeader) + KmerSizer::getByteSize();
 
-			if (rankDest == rank) {
-				double dummy;
-				if (this->_setPurgeVariant(pointers, varKmer, threshold, dummy))
-					variantWasPurged();
+		for(typename VariantBatch::Probes::iterator it = batch.probes.begin(); it != batch.probes.end(); it++) {
+			Kmer &varKmer = batch.kmers[it->idx];
+			float threshold = batch.kmers.valueAt(it->idx);
+			if (it->rank == rank) {
+				this->_probeVariant(varKmer, it->hash, threshold, batch.counters);
 			} else {
-				msgPurgeVariant->bufferMessage(rankDest, threadDest)->set(threshold, varKmer);
+				msgPurgeVariant->bufferMessage(it->rank, 0)->set(threshold, varKmer);
+				batch.counters[VariantCounters::MESSAGES]++;
+				batch.counters[VariantCounters::BYTES] += messageSize;
 			}
 		}
+		batch.clear();
 		msgPurgeVariant->sendReceive();
-		return 0;
 	}
 
 
 }; // DistributedKmerSpectrum
 
+// a request for the value of a kmer from its owning rank, or the response to it
+template<typename ScoreType>
+class ReqRespKmerMessage {
+public:
+	long requestId;
+	// either ScoreType or Kmer is the next part of the message
+	// Kmer is next bytes, dynamically determined by KmerSizer::getTwoBitLength()
+	// kmer is least complement
+
+	// THIS IS DANGEROUS unless allocated an extra Kmer or ScoreType!
+	Kmer *getKmer() {
+		return (Kmer*) (((char*)this)+sizeof(*this));
+	}
+	ScoreType &getScore() {
+		return *((ScoreType*) (((char*)this)+sizeof(*this)));
+	}
+
+	void set(long _requestId, const Kmer &_kmer) {
+		requestId = _requestId;
+		*(getKmer()) = _kmer;
+	}
+
+	void set(long _requestId, ScoreType _score) {
+		requestId = _requestId;
+		getScore() = _score;
+	}
+};
 
 
 
@@ -766,9 +1191,16 @@ public:
 	typedef std::vector<KmerValueVector> KmerValueVectorVector;
 	typedef std::vector<ReadSetSizeType> ReadIdxVector;
 	typedef typename ReadIdxVector::const_iterator ReadIdxVectorIterator;
+	typedef typename RS::Pair Pair;
+	typedef typename RS::PairScore PairScore;
+	typedef typename RS::PairScoreVector PairScoreVector;
 
 protected:
 	mpi::communicator _world;
+	// the best (i.e. lowest) pick order of this round's candidates for each locally owned kmer (by picked count index)
+	std::map< typename RS::PickedCounts::IndexType, long > _roundKmerOrders;
+	// hashes of the picked (trimmed) sequences whose first kmer is owned by this rank
+	boost::unordered_set< long > _pickedSequences;
 
 public:
 	DistributedReadSelector(mpi::communicator &world, const ReadSet &reads, const KMType &map)
@@ -806,32 +1238,7 @@ done when empty cycle is received
 	 *
 	 */
 
-	class ReqRespKmerMessageHeader {
-	public:
-		long requestId;
-		// either ScoreType or Kmer is the next part of the message
-		// Kmer is next bytes, dynamically determined by KmerSizer::getTwoBitLength()
-		// kmer is least complement
-
-		// THIS IS DANGEROUS unless allocated an extra Kmer or ScoreType!
-		Kmer *getKmer() {
-			return (Kmer*) (((char*)this)+sizeof(*this));
-		}
-		ScoreType &getScore() {
-			return *((ScoreType*) (((char*)this)+sizeof(*this)));
-		}
-
-		void set(long _requestId, const Kmer &_kmer) {
-			requestId = _requestId;
-			*(getKmer()) = _kmer;
-		}
-
-		void set(long _requestId, ScoreType _score) {
-			requestId = _requestId;
-			getScore() = _score;
-		}
-	};
-
+	typedef ReqRespKmerMessage< ScoreType > ReqRespKmerMessageHeader;
 
 	class ReqRespKmerMessageHeaderProcessor;
 	typedef MPIAllToAllMessageBuffer< ReqRespKmerMessageHeader, ReqRespKmerMessageHeaderProcessor > ReqRespKmerMessageBuffer;
@@ -1044,9 +1451,645 @@ done when empty cycle is received
 		_world.barrier();
 	}
 
-	// TODO
-	// rescoreByBestCoveringSubset*
+	/*
+	 * rescoreByBestCoveringSubset / pickBestCoveringSubset*
+	 *
+	 * Each kmer's picked count lives only on the rank that owns the kmer.  Candidate pairs (or reads)
+	 * stay on their local ranks in a max heap of (possibly stale) scores, and are picked in the same order as
+	 * the serial ReadSelector, by score and then by global read index, so the picks do not depend on the number
+	 * of ranks.  Each round:
+	 *   1. every rank pops its best candidates and rescores them with LOOKUP messages
+	 *   2. the fresh scores and the best stale score left on every rank are gathered, giving each candidate its
+	 *      place in the global pick order
+	 *   3. candidates scoring at least the best stale score TOUCH their kmers with their place, and then CHECK
+	 *      whether any kmer was touched by an earlier candidate
+	 *   4. candidates before the first one that scored too low or shares a kmer with an earlier one RESERVE
+	 *      their kmers and are picked.  The rest are requeued with their fresh scores
+	 * Duplicate reads are found across ranks by sending a hash of each picked read (as a DUPLICATE message) to
+	 * the owner of its first kmer.
+	 */
+
+	enum CoveringKmerAction { CKA_LOOKUP, CKA_RESERVE, CKA_RELEASE, CKA_TOUCH, CKA_CHECK, CKA_DUPLICATE };
+	static bool _hasCoveringResponse(unsigned char action) {
+		return action != CKA_RELEASE && action != CKA_TOUCH;
+	}
+
+	class CoveringKmerMessageHeader {
+	public:
+		long requestId;
+		long key; // the pick order or sequence hash, when the action needs one
+		unsigned char action;
+		unsigned char maxPickedKmerDepth;
+		// either ScoreType or Kmer is the next part of the message, as in ReqRespKmerMessage
+
+		// THIS IS DANGEROUS unless allocated an extra Kmer or ScoreType!
+		Kmer *getKmer() {
+			return (Kmer*) (((char*)this)+sizeof(*this));
+		}
+		ScoreType &getScore() {
+			return *((ScoreType*) (((char*)this)+sizeof(*this)));
+		}
+
+		void set(long _requestId, unsigned char _action, unsigned char _maxPickedKmerDepth, const Kmer &_kmer, long _key) {
+			requestId = _requestId;
+			key = _key;
+			action = _action;
+			maxPickedKmerDepth = _maxPickedKmerDepth;
+			*(getKmer()) = _kmer;
+		}
+
+		void set(long _requestId, ScoreType _score) {
+			requestId = _requestId;
+			key = 0;
+			action = CKA_LOOKUP;
+			maxPickedKmerDepth = 0;
+			getScore() = _score;
+		}
+	};
+
+	class CoveringKmerMessageHeaderProcessor;
+	typedef MPIAllToAllMessageBuffer< CoveringKmerMessageHeader, CoveringKmerMessageHeaderProcessor > CoveringKmerMessageBuffer;
+
+	class CoveringKmerMessageHeaderProcessor {
+	public:
+		KmerValueVector &_kmerValues;
+		DistributedReadSelector *_readSelector;
+		int _numThreads;
+
+		CoveringKmerMessageHeaderProcessor(KmerValueVector &kmerValues, DistributedReadSelector &readSelector, int numThreads): _kmerValues(kmerValues), _readSelector(&readSelector), _numThreads(numThreads) {}
+
+		// store response in the (shared) kmer value vector.  requestIds are unique, so no locking is needed
+		int processRespond(CoveringKmerMessageHeader *msg, MessagePackage &msgPkg) {
+			LOG_DEBUG(5, "CoveringKmerMessage respond: " << msg->requestId << " " << msg->getScore() << " recv Source: " << msgPkg.source << " recvTag: " << msgPkg.tag);
+			_kmerValues[msg->requestId] = msg->getScore();
+			return sizeof(ScoreType);
+		}
+
+		// apply the action to the locally owned kmer and respond, unless it is a release
+		int processRequest(CoveringKmerMessageHeader *msg, MessagePackage &msgPkg) {
+			ScoreType score = _readSelector->_processCoveringKmer(msg->action, *msg->getKmer(), msg->maxPickedKmerDepth, msg->key);
+			LOG_DEBUG(5, "CoveringKmerMessage request: " << (int) msg->action << " " << msg->getKmer()->toFasta() << " " << msg->requestId << " " << score);
+			if (_hasCoveringResponse(msg->action))
+				((CoveringKmerMessageBuffer*)msgPkg.bufferCallback)->bufferMessage(msgPkg.source, msgPkg.tag + _numThreads, sizeof(ScoreType))->set(msg->requestId, score);
+			return KmerSizer::getByteSize();
+		}
+
+		int process(CoveringKmerMessageHeader *msg, MessagePackage &msgPkg) {
+			if (msgPkg.tag >= _numThreads)
+				return processRespond(msg, msgPkg);
+			else
+				return processRequest(msg, msgPkg);
+		}
+	};
+
+	// must only be called for kmers owned by this rank
+	ScoreType _processCoveringKmer(unsigned char action, const Kmer &kmer, unsigned char maxPickedKmerDepth, long key = 0) {
+		ScoreType score = 0.0;
+		const DataType *data;
+		typename RS::PickedCounts::IndexType countIdx = this->_counts.find(kmer, data);
+		long order = key;
+		switch (action) {
+		case CKA_LOOKUP:
+			score = countIdx == RS::PickedCounts::MAX_INDEX ? ScoreType(0) : ScoreType(data->getCount());
+			if (score <= 0) {
+				LOG_WARN(1, "_processCoveringKmer(): Reads should have already been trimmed to exclude this kmer: " << kmer.toFasta());
+				return -1.0;
+			}
+			if (this->_counts.get(countIdx) >= maxPickedKmerDepth)
+				return -1.0;
+			return score * (maxPickedKmerDepth - this->_counts.get(countIdx));
+		case CKA_RESERVE:
+			if (countIdx != RS::PickedCounts::MAX_INDEX && this->_counts.reserve(countIdx, maxPickedKmerDepth))
+				score = 1.0;
+			return score;
+		case CKA_RELEASE:
+			if (countIdx != RS::PickedCounts::MAX_INDEX && this->_counts.get(countIdx) > 0)
+				this->_counts.release(countIdx);
+			return score;
+		case CKA_TOUCH:
+			if (countIdx != RS::PickedCounts::MAX_INDEX) {
+#pragma omp critical (DistributedReadSelector_roundKmerOrders)
+				{
+					typename std::map< typename RS::PickedCounts::IndexType, long >::iterator it = _roundKmerOrders.insert(std::make_pair(countIdx, order)).first;
+					it->second = std::min(it->second, order);
+				}
+			}
+			return score;
+		case CKA_CHECK:
+			if (countIdx != RS::PickedCounts::MAX_INDEX) {
+#pragma omp critical (DistributedReadSelector_roundKmerOrders)
+				{
+					typename std::map< typename RS::PickedCounts::IndexType, long >::const_iterator it = _roundKmerOrders.find(countIdx);
+					if (it != _roundKmerOrders.end() && it->second < order)
+						score = 1.0;
+				}
+			}
+			return score;
+		case CKA_DUPLICATE:
+#pragma omp critical (DistributedReadSelector_pickedSequences)
+			{
+				if (!_pickedSequences.insert(key).second)
+					score = 1.0;
+			}
+			return score;
+		default:
+			LOG_THROW("Invalid: _processCoveringKmer(): unknown action " << (int) action);
+		}
+		return score;
+	}
+
+	// collective: applies action to every kmer of the (trimmed) reads, storing results in values[ offsets[i] + kmerIdx ]
+	// CKA_RELEASE only releases the kmers with a positive value (i.e. a granted reservation)
+	// kmers flagged in isRepeat are skipped.  CKA_TOUCH and CKA_CHECK send the pick order of each read in readKeys.
+	// CKA_DUPLICATE sends only the first kmer of each read with its sequence hash in readKeys, so offsets are 0 .. readIdxs.size()
+	void _exchangeCoveringKmers(CoveringKmerAction action, unsigned char maxPickedKmerDepth, const ReadIdxVector &readIdxs, const ReadIdxVector &offsets, KmerValueVector &values,
+			const std::vector<bool> &isRepeat = std::vector<bool>(), const std::vector<long> &readKeys = std::vector<long>()) {
+		int numThreads = omp_get_max_threads();
+		int rank = _world.rank();
+		int worldSize = _world.size();
+		assert(offsets.size() == readIdxs.size() + 1);
+		assert(values.size() == offsets.back());
+
+		CoveringKmerMessageBuffer *buffer = new CoveringKmerMessageBuffer(_world, sizeof(CoveringKmerMessageHeader),
+				CoveringKmerMessageHeaderProcessor(values, *this, numThreads), 2);
+		std::vector< KA > _kmers(numThreads, KA());
+
+#pragma omp parallel num_threads(numThreads)
+		{
+			int threadId = omp_get_thread_num();
+			int loopNumThreads = omp_get_num_threads();
+			KA &kmers = _kmers[threadId];
+			for(long i = threadId; i < (long) readIdxs.size(); i += loopNumThreads) {
+				this->getKmersForTrimmedRead(readIdxs[i], kmers);
+				SequenceLengthType numKmers = action == CKA_DUPLICATE ? std::min((SequenceLengthType) 1, (SequenceLengthType) kmers.size()) : kmers.size();
+				assert(numKmers == offsets[i+1] - offsets[i]);
+				for(SequenceLengthType kmerIdx = 0; kmerIdx < numKmers; kmerIdx++) {
+					ReadSetSizeType requestId = offsets[i] + kmerIdx;
+					if ((action == CKA_RELEASE && values[requestId] <= 0) || (!isRepeat.empty() && isRepeat[requestId]))
+						continue;
+					int localThreadId, distributedThreadId;
+					this->_map.getThreadIds(kmers[kmerIdx], localThreadId, numThreads, distributedThreadId, worldSize);
+					long key = readKeys.empty() ? 0 : readKeys[i];
+					if (distributedThreadId == rank) {
+						ScoreType score = _processCoveringKmer(action, kmers[kmerIdx], maxPickedKmerDepth, key);
+						if (_hasCoveringResponse(action))
+							values[requestId] = score;
+					} else {
+						buffer->bufferMessage(distributedThreadId, threadId, KmerSizer::getByteSize())->set(requestId, action, maxPickedKmerDepth, kmers[kmerIdx], key);
+					}
+				}
+			}
+			buffer->sendReceive(); // flush/send all pending requests for this thread
+			buffer->sendReceive();
+			buffer->sendReceive(); // receive all pending responses for this thread
+			buffer->sendReceive();
+			buffer->finalize();
+		}
+		delete buffer;
+	}
+
+	// the reads of each candidate that participate in covering, and the offset of each read's kmers
+	void _getCoveringReads(const PairScoreVector &candidates, ReadIdxVector &readIdxs, ReadIdxVector &offsets, ReadIdxVector &candidateOffsets) {
+		readIdxs.resize(0);
+		offsets.resize(1, 0);
+		candidateOffsets.resize(1, 0);
+		for(typename PairScoreVector::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+			ReadSetSizeType pairReads[2] = { it->pair.read1, it->pair.read2 };
+			for(int j = 0; j < 2; j++) {
+				ReadSetSizeType readIdx = pairReads[j];
+				if (this->isPassingRead(readIdx) && this->_trims[readIdx].isAvailable) {
+					SequenceLengthType trimLength = this->_trims[readIdx].trimLength;
+					SequenceLengthType numKmers = trimLength >= KmerSizer::getSequenceLength() ? trimLength - KmerSizer::getSequenceLength() + 1 : 0;
+					readIdxs.push_back(readIdx);
+					offsets.push_back(offsets.back() + numKmers);
+				}
+			}
+			candidateOffsets.push_back(readIdxs.size());
+		}
+	}
+
+	// collective: rescores all candidates, updating the trim scores of their reads
+	void _rescoreCoveringCandidates(unsigned char maxPickedKmerDepth, PairScoreVector &candidates, bool byPair) {
+		ReadIdxVector readIdxs, offsets, candidateOffsets;
+		_getCoveringReads(candidates, readIdxs, offsets, candidateOffsets);
+		KmerValueVector values(offsets.back(), ScoreType(-1));
+		_exchangeCoveringKmers(CKA_LOOKUP, maxPickedKmerDepth, readIdxs, offsets, values);
+
+		for(ReadSetSizeType i = 0; i < readIdxs.size(); i++) {
+			ScoreType score = 0.0;
+			for(KmerValueVectorIterator it = values.begin() + offsets[i]; it != values.begin() + offsets[i+1]; it++) {
+				if (*it < 0) {
+					score = -1.0;
+					break;
+				}
+				score += *it;
+			}
+			this->_trims[readIdxs[i]].score = score;
+		}
+
+		for(ReadSetSizeType c = 0; c < candidates.size(); c++) {
+			ScoreType score = 0.0;
+			double len = 0.0;
+			bool isCovering = candidateOffsets[c] != candidateOffsets[c+1];
+			for(ReadSetSizeType i = candidateOffsets[c]; i < candidateOffsets[c+1]; i++) {
+				ReadTrimType &trim = this->_trims[readIdxs[i]];
+				if (trim.score <= 0) {
+					score = isCovering ? trim.score : std::min(score, trim.score);
+					isCovering = false;
+				} else if (isCovering) {
+					score += trim.score;
+					len += trim.trimLength;
+				}
+			}
+			if (isCovering && byPair && len > 0.0)
+				score /= len;
+			candidates[c].score = score;
+		}
+	}
+
+	// collective: picks each candidate that was granted every kmer, setting wasGranted.
+	// Releases the reservations of the others and of any where pickIfNew fails (those are not retried).
+	// A kmer repeated within a candidate is only reserved once, so it can not block itself
+	ReadSetSizeType _reserveAndPickCoveringCandidates(unsigned char maxPickedKmerDepth, PairScoreVector &candidates, std::vector<bool> &wasGranted) {
+		ReadSetSizeType picked = 0;
+		ReadIdxVector readIdxs, offsets, candidateOffsets;
+		_getCoveringReads(candidates, readIdxs, offsets, candidateOffsets);
+		KmerValueVector values(offsets.back(), ScoreType(0));
+
+		std::vector<bool> isRepeat(offsets.back(), false);
+		KA kmers, candidateKmers;
+		for(ReadSetSizeType c = 0; c < candidates.size(); c++) {
+			candidateKmers.resize(0);
+			for(ReadSetSizeType i = candidateOffsets[c]; i < candidateOffsets[c+1]; i++) {
+				this->getKmersForTrimmedRead(readIdxs[i], kmers);
+				for(SequenceLengthType kmerIdx = 0; kmerIdx < kmers.size(); kmerIdx++) {
+					bool isFound;
+					candidateKmers.findIndex(kmers[kmerIdx], isFound);
+					if (isFound) {
+						isRepeat[ offsets[i] + kmerIdx ] = true;
+						values[ offsets[i] + kmerIdx ] = 1.0;
+					} else {
+						candidateKmers.append(kmers[kmerIdx]);
+					}
+				}
+			}
+		}
+		_exchangeCoveringKmers(CKA_RESERVE, maxPickedKmerDepth, readIdxs, offsets, values, isRepeat);
+
+		wasGranted.assign(candidates.size(), false);
+		for(ReadSetSizeType c = 0; c < candidates.size(); c++) {
+			KmerValueVectorIterator begin = values.begin() + offsets[ candidateOffsets[c] ];
+			KmerValueVectorIterator end = values.begin() + offsets[ candidateOffsets[c+1] ];
+			bool granted = true;
+			for(KmerValueVectorIterator it = begin; it != end; it++) {
+				if (*it <= 0) {
+					granted = false;
+					break;
+				}
+			}
+			wasGranted[c] = granted;
+			if (granted && this->pickIfNew(candidates[c].pair)) {
+				picked++;
+				LOG_DEBUG(4, "Selected pair: " << candidates[c].pair.read1 << " " << candidates[c].pair.read2);
+				// keep these reservations
+				std::fill(begin, end, ScoreType(0));
+			}
+		}
+		_exchangeCoveringKmers(CKA_RELEASE, maxPickedKmerDepth, readIdxs, offsets, values, isRepeat);
+		return picked;
+	}
+
+	// a candidate's place in the global pick order: by score, then by global read index, as PairScore orders local reads
+	class GlobalPairScore {
+	public:
+		ScoreType score;
+		ReadSetSizeType globalRead1;
+		int rank;
+		ReadSetSizeType idx;
+		GlobalPairScore(ScoreType _score = -1.0, ReadSetSizeType _globalRead1 = 0, int _rank = 0, ReadSetSizeType _idx = 0)
+		: score(_score), globalRead1(_globalRead1), rank(_rank), idx(_idx) {}
+		bool operator<(const GlobalPairScore &cmp) const {
+			return score < cmp.score || (score == cmp.score && globalRead1 < cmp.globalRead1);
+		}
+	};
+	typedef std::vector< GlobalPairScore > GlobalPairScoreVector;
+
+	// collective: sets the global pick order of each (best first) candidate, returning how many candidates on
+	// all ranks score at least the best remaining score of any heap (so can be picked this round)
+	long _orderCoveringCandidates(const PairScoreVector &candidates, const PairScoreVector &heapedPairs, std::vector<long> &orders) {
+		int worldSize = _world.size();
+		long maxCount = mpi::all_reduce(_world, (long) candidates.size(), mpi::maximum<long>());
+		long n = maxCount + 1;
+		std::vector<long> counts;
+		mpi::all_gather(_world, (long) candidates.size(), counts);
+
+		// the best remaining score, followed by the candidates
+		KmerValueVector scores(n, ScoreType(-1.0)), allScores(n * worldSize);
+		ReadIdxVector reads(n, 0), allReads(n * worldSize);
+		if (!heapedPairs.empty()) {
+			scores[0] = heapedPairs.front().score;
+			reads[0] = this->_reads.getGlobalReadIdx(heapedPairs.front().pair.read1);
+		}
+		for(ReadSetSizeType i = 0; i < candidates.size(); i++) {
+			scores[i + 1] = candidates[i].score;
+			reads[i + 1] = this->_reads.getGlobalReadIdx(candidates[i].pair.read1);
+		}
+		mpi::all_gather(_world, &scores[0], n, &allScores[0]);
+		mpi::all_gather(_world, &reads[0], n, &allReads[0]);
+
+		GlobalPairScore threshold;
+		GlobalPairScoreVector all;
+		for(int r = 0; r < worldSize; r++) {
+			GlobalPairScore top(allScores[r * n], allReads[r * n]);
+			if (threshold < top)
+				threshold = top;
+			for(long i = 0; i < counts[r]; i++)
+				all.push_back( GlobalPairScore(allScores[r * n + i + 1], allReads[r * n + i + 1], r, i) );
+		}
+		std::sort(all.rbegin(), all.rend());
+
+		long pickable = 0;
+		orders.resize(candidates.size());
+		for(long o = 0; o < (long) all.size(); o++) {
+			if (pickable == o && !(all[o] < threshold))
+				pickable++;
+			if (all[o].rank == _world.rank())
+				orders[ all[o].idx ] = o;
+		}
+		return pickable;
+	}
+
+	// collective: returns the global pick order of the first candidate that shares a kmer with an earlier one
+	long _findFirstCoveringConflict(unsigned char maxPickedKmerDepth, const PairScoreVector &candidates, const std::vector<long> &orders, long pickable) {
+		PairScoreVector touching;
+		std::vector<long> touchingOrders;
+		for(ReadSetSizeType c = 0; c < candidates.size(); c++) {
+			if (orders[c] < pickable) {
+				touching.push_back(candidates[c]);
+				touchingOrders.push_back(orders[c]);
+			}
+		}
+		ReadIdxVector readIdxs, offsets, candidateOffsets;
+		_getCoveringReads(touching, readIdxs, offsets, candidateOffsets);
+		std::vector<long> readOrders(readIdxs.size());
+		for(ReadSetSizeType c = 0; c < touching.size(); c++)
+			for(ReadSetSizeType i = candidateOffsets[c]; i < candidateOffsets[c+1]; i++)
+				readOrders[i] = touchingOrders[c];
+
+		KmerValueVector values(offsets.back(), ScoreType(0));
+		_exchangeCoveringKmers(CKA_TOUCH, maxPickedKmerDepth, readIdxs, offsets, values, std::vector<bool>(), readOrders);
+		_exchangeCoveringKmers(CKA_CHECK, maxPickedKmerDepth, readIdxs, offsets, values, std::vector<bool>(), readOrders);
+		_roundKmerOrders.clear();
+
+		long firstConflict = pickable;
+		for(ReadSetSizeType c = 0; c < touching.size(); c++) {
+			for(ReadSetSizeType k = offsets[ candidateOffsets[c] ]; k < offsets[ candidateOffsets[c+1] ]; k++) {
+				if (values[k] > 0) {
+					firstConflict = std::min(firstConflict, touchingOrders[c]);
+					break;
+				}
+			}
+		}
+		return mpi::all_reduce(_world, firstConflict, mpi::minimum<long>());
+	}
+
+	// collective: removes the candidates with a read that duplicates an earlier pick on any rank.
+	// As ReadSelector::pickIfNew, read2 is only checked (and recorded) if read1 is new, and a duplicate read is no longer available
+	void _removeDuplicateCoveringCandidates(PairScoreVector &candidates) {
+		std::vector<bool> isDuplicate(candidates.size(), false);
+		for(int j = 0; j < 2; j++) {
+			ReadIdxVector readIdxs, offsets(1, 0), candidateIdxs;
+			std::vector<long> hashes;
+			for(ReadSetSizeType c = 0; c < candidates.size(); c++) {
+				ReadSetSizeType readIdx = j == 0 ? candidates[c].pair.read1 : candidates[c].pair.read2;
+				if (isDuplicate[c] || !this->_reads.isValidRead(readIdx))
+					continue;
+				const ReadTrimType &trim = this->_trims[readIdx];
+				readIdxs.push_back(readIdx);
+				offsets.push_back(offsets.back() + (trim.trimLength >= KmerSizer::getSequenceLength() ? 1 : 0));
+				candidateIdxs.push_back(c);
+				hashes.push_back( (long) boost::hash<std::string>()( this->_reads.getRead(readIdx).getFasta(trim.trimOffset, trim.trimLength) ) );
+			}
+			KmerValueVector values(offsets.back(), ScoreType(0));
+			_exchangeCoveringKmers(CKA_DUPLICATE, 0, readIdxs, offsets, values, std::vector<bool>(), hashes);
+			for(ReadSetSizeType i = 0; i < readIdxs.size(); i++) {
+				if (offsets[i+1] > offsets[i] && values[ offsets[i] ] > 0) {
+					isDuplicate[ candidateIdxs[i] ] = true;
+					this->_trims[ readIdxs[i] ].isAvailable = false;
+				}
+			}
+		}
+		PairScoreVector newCandidates;
+		for(ReadSetSizeType c = 0; c < candidates.size(); c++)
+			if (!isDuplicate[c])
+				newCandidates.push_back(candidates[c]);
+		candidates.swap(newCandidates);
+	}
+
+	ReadSetSizeType _pickBestCoveringSubset(unsigned char maxPickedKmerDepth, ScoreType minimumScore, float minimumLength, bool bothPass, bool byPair) {
+		this->_initPickBestCoveringSubset();
+		// counts are kept by the reservations on the owning rank, not by pickIfNew
+		ScopedTempValue<bool> noLocalCounts(this->_needCounts, false);
+		// and duplicates are found by the owner of their first kmer
+		ScopedTempValue<bool> noLocalDuplicateCheck(this->_needDuplicateCheck, false);
+
+		int rank = _world.rank();
+		ReadSetSizeType maxRoundSize = std::max((ReadSetSizeType) 1, (ReadSetSizeType) (Options::getOptions().getBatchSize() / _world.size()));
+
+		PairScoreVector heapedPairs;
+		long candidatesSize = byPair ? this->_reads.getPairSize() : this->_reads.getSize();
+		for(long idx = 0; idx < candidatesSize; idx++) {
+			Pair pair = byPair ? this->_reads.getPair(idx) : Pair(idx, ReadSet::MAX_READ_IDX);
+			bool isAvailable1 = this->isPassingRead(pair.read1) && this->_trims[pair.read1].isAvailable;
+			bool isAvailable2 = this->isPassingRead(pair.read2) && this->_trims[pair.read2].isAvailable;
+			if ((bothPass && this->isPairedRead(pair)) ? (isAvailable1 && isAvailable2) : (isAvailable1 || isAvailable2))
+				heapedPairs.push_back( PairScore( pair, 0.0 ) );
+		}
+		_rescoreCoveringCandidates(maxPickedKmerDepth, heapedPairs, byPair);
+
+		PairScoreVector candidates;
+		for(typename PairScoreVector::iterator it = heapedPairs.begin(); it != heapedPairs.end(); it++)
+			if (it->score > minimumScore && this->isPassingPair(it->pair, minimumScore, minimumLength, bothPass))
+				candidates.push_back(*it);
+		heapedPairs.swap(candidates);
+		std::make_heap(heapedPairs.begin(), heapedPairs.end());
+
+		long heapSize = mpi::all_reduce(_world, (long) heapedPairs.size(), std::plus<long>());
+		LOG_VERBOSE_OPTIONAL(1, rank == 0, "picking " << (byPair ? "pairs" : "reads") << " at depth: " << (int) maxPickedKmerDepth << " out of " << heapSize);
+
+		ReadSetSizeType picked = 0, roundSize = 1;
+		long iterations = 0;
+		std::vector<bool> wasGranted;
+		std::vector<long> orders;
+		PairScoreVector reserves;
+		while (true) {
+			candidates.resize(0);
+			while (!heapedPairs.empty() && candidates.size() < roundSize) {
+				candidates.push_back(heapedPairs.front());
+				std::pop_heap(heapedPairs.begin(), heapedPairs.end());
+				heapedPairs.pop_back();
+			}
+			long remaining = mpi::all_reduce(_world, (long) (candidates.size() + heapedPairs.size()), std::plus<long>());
+			if (remaining == 0)
+				break;
+
+			if (++iterations % 1000 == 0) {
+				ReadSetSizeType totalPicked = mpi::all_reduce(_world, picked, std::plus<ReadSetSizeType>());
+				LOG_VERBOSE_OPTIONAL(1, rank == 0, "Processing heap size " << remaining << " picked " << totalPicked);
+			} else {
+				LOG_DEBUG(3, "heap size " << remaining << " picked " << picked);
+			}
+
+			_rescoreCoveringCandidates(maxPickedKmerDepth, candidates, byPair);
+			reserves.resize(0);
+			for(typename PairScoreVector::iterator it = candidates.begin(); it != candidates.end(); it++)
+				if (it->score > minimumScore && this->isPassingPair(it->pair, minimumScore, minimumLength, bothPass) && this->isNew(it->pair))
+					reserves.push_back(*it);
+			candidates.swap(reserves);
+
+			long pickable = _orderCoveringCandidates(candidates, heapedPairs, orders);
+			pickable = _findFirstCoveringConflict(maxPickedKmerDepth, candidates, orders, pickable);
+
+			reserves.resize(0);
+			for(ReadSetSizeType c = 0; c < candidates.size(); c++) {
+				if (orders[c] < pickable) {
+					reserves.push_back(candidates[c]);
+				} else {
+					heapedPairs.push_back(candidates[c]);
+					std::push_heap(heapedPairs.begin(), heapedPairs.end());
+				}
+			}
+			_removeDuplicateCoveringCandidates(reserves);
+			ReadSetSizeType myPicks = _reserveAndPickCoveringCandidates(maxPickedKmerDepth, reserves, wasGranted);
+			for(ReadSetSizeType c = 0; c < reserves.size(); c++) {
+				if (!wasGranted[c] && this->isNew(reserves[c].pair)) {
+					heapedPairs.push_back(reserves[c]);
+					std::push_heap(heapedPairs.begin(), heapedPairs.end());
+				}
+			}
+			picked += myPicks;
+			// ask for about twice as many as were picked
+			ReadSetSizeType roundPicks = mpi::all_reduce(_world, myPicks, std::plus<ReadSetSizeType>());
+			roundSize = std::min(maxRoundSize, std::max((ReadSetSizeType) 1, (2 * roundPicks + _world.size() - 1) / _world.size()));
+		}
+
+		ReadSetSizeType totalPicked = mpi::all_reduce(_world, picked, std::plus<ReadSetSizeType>());
+		LOG_VERBOSE_OPTIONAL(1, rank == 0, "Picked " << totalPicked);
+		this->optimizePickOrder();
+		return picked;
+	}
+
+	ReadSetSizeType pickBestCoveringSubsetPairs(unsigned char maxPickedKmerDepth, ScoreType minimumScore = 0.0,
+			float minimumLength = ReadSelectorOptions::getOptions().getMinReadLength(), bool bothPass = false) {
+		return _pickBestCoveringSubset(maxPickedKmerDepth, minimumScore, minimumLength, bothPass, true);
+	}
+
+	ReadSetSizeType pickBestCoveringSubsetReads(unsigned char maxPickedKmerDepth, ScoreType minimumScore = 0.0,
+			float minimumLength = ReadSelectorOptions::getOptions().getMinReadLength()) {
+		return _pickBestCoveringSubset(maxPickedKmerDepth, minimumScore, minimumLength, false, false);
+	}
+
+};
+
+template<typename Map>
+class DistributedReadCorrector : public ReadCorrector<Map>
+{
+public:
+	typedef ReadCorrector<Map> RC;
+	typedef typename RC::KMType KMType;
+	typedef typename RC::KA KA;
+	typedef typename RC::ScoreType ScoreType;
+	typedef typename RC::KmerValueVector KmerValueVector;
+	typedef typename RC::ReadSetSizeType ReadSetSizeType;
 
+protected:
+	mpi::communicator _world;
+
+public:
+	DistributedReadCorrector(mpi::communicator &world, ReadSet &reads, const KMType &map, ScoreType minSolidDepth = KmerSpectrumOptions::getOptions().getMinDepth())
+	: RC(reads, map, minSolidDepth), _world(world, mpi::comm_duplicate) {
+	}
+
+	unsigned long correctReads(unsigned int maxEdits = ReadCorrectorOptions::getOptions().getCorrectMaxEdits()) {
+		unsigned long correctedReads = RC::correctReads(maxEdits);
+		unsigned long allCorrectedReads = mpi::all_reduce(_world, correctedReads, std::plus<unsigned long>());
+		unsigned long allCorrectedBases = mpi::all_reduce(_world, this->getCorrectedBases(), std::plus<unsigned long>());
+		LOG_VERBOSE_OPTIONAL(1, _world.rank() == 0, "Distributed corrected " << allCorrectedBases << " bases in " << allCorrectedReads << " reads");
+		return correctedReads;
+	}
+
+	// the kmer is sent to its owning rank, which responds with the count
+	typedef ReqRespKmerMessage< ScoreType > ReqRespKmerMessageHeader;
+
+	class ReqRespKmerMessageHeaderProcessor;
+	typedef MPIAllToAllMessageBuffer< ReqRespKmerMessageHeader, ReqRespKmerMessageHeaderProcessor > ReqRespKmerMessageBuffer;
+
+	class ReqRespKmerMessageHeaderProcessor {
+	public:
+		KmerValueVector &_kmerValues;
+		DistributedReadCorrector *_readCorrector;
+		int _numThreads;
+
+		ReqRespKmerMessageHeaderProcessor(KmerValueVector &kmerValues, DistributedReadCorrector &readCorrector, int numThreads): _kmerValues(kmerValues), _readCorrector(&readCorrector), _numThreads(numThreads) {}
+
+		// store response in the (shared) kmer value vector.  requestIds are unique, so no locking is needed
+		int processRespond(ReqRespKmerMessageHeader *msg, MessagePackage &msgPkg) {
+			_kmerValues[msg->requestId] = msg->getScore();
+			return sizeof(ScoreType);
+		}
+
+		int processRequest(ReqRespKmerMessageHeader *msg, MessagePackage &msgPkg) {
+			ScoreType score = _readCorrector->getValue( *msg->getKmer() );
+			((ReqRespKmerMessageBuffer*)msgPkg.bufferCallback)->bufferMessage(msgPkg.source, msgPkg.tag + _numThreads, sizeof(ScoreType))->set(msg->requestId, score);
+			return KmerSizer::getByteSize();
+		}
+
+		int process(ReqRespKmerMessageHeader *msg, MessagePackage &msgPkg) {
+			if (msgPkg.tag >= _numThreads)
+				return processRespond(msg, msgPkg);
+			else
+				return processRequest(msg, msgPkg);
+		}
+	};
+
+protected:
+	// collective: every rank looks up its batch of kmers with a single exchange
+	void _lookupKmers(const KA &kmers, KmerValueVector &values) {
+		int numThreads = omp_get_max_threads();
+		int rank = _world.rank();
+		int worldSize = _world.size();
+		values.assign(kmers.size(), ScoreType(-1));
+
+		ReqRespKmerMessageBuffer *buffer = new ReqRespKmerMessageBuffer(_world, sizeof(ReqRespKmerMessageHeader),
+				ReqRespKmerMessageHeaderProcessor(values, *this, numThreads), 2);
+
+#pragma omp parallel num_threads(numThreads)
+		{
+			int threadId = omp_get_thread_num();
+			int loopNumThreads = omp_get_num_threads();
+			for(long i = threadId; i < (long) kmers.size(); i += loopNumThreads) {
+				int localThreadId, distributedThreadId;
+				this->_map.getThreadIds(kmers[i], localThreadId, numThreads, distributedThreadId, worldSize);
+				if (distributedThreadId == rank) {
+					values[i] = this->getValue(kmers[i]);
+				} else {
+					buffer->bufferMessage(distributedThreadId, threadId, KmerSizer::getByteSize())->set(i, kmers[i]);
+				}
+			}
+			buffer->sendReceive(); // flush/send all pending requests for this thread
+			buffer->sendReceive();
+			buffer->sendReceive(); // receive all pending responses for this thread
+			buffer->sendReceive();
+			buffer->finalize();
+		}
+		delete buffer;
+	}
+	ReadSetSizeType _getMostReads(ReadSetSizeType readsSize) {
+		return mpi::all_reduce(_world, readsSize, mpi::maximum<ReadSetSizeType>());
+	}
+	unsigned long _getAllCandidates(unsigned long candidates) {
+		return mpi::all_reduce(_world, candidates, std::plus<unsigned long>());
+	}
 };
 
 /*
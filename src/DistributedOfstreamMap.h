@@ -60,6 +60,7 @@ namespace mpi = boost::mpi;
 #include "Log.h"
 #include "ReadSet.h"
 #include "Utils.h"
+#include "MPIUtils.h"
 
 /*
  * DistributedOfstreamMap
@@ -172,7 +173,6 @@ public:
 		assert(isBuildInMemory());
 
 		int size = _world.size();
-		MPI_Comm world = _world;
 
 		// synchronize all files
 		int numFiles = keys.size();
@@ -213,32 +213,10 @@ public:
 			}
 
 			LOG_DEBUG_OPTIONAL(1, _world.rank() == 0, "Opening " << fullPath);
-			int err;
-			MPI_File ourFile;
-			err = MPI_File_open(world, const_cast<char*>(fullPath.c_str()), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &ourFile);
-			if (err != MPI_SUCCESS) {
-				LOG_THROW("Could not open " << fullPath << " collectively");
-			}
-			err = MPI_File_set_size(ourFile, totalSize);
-			if (err != MPI_SUCCESS) {
-				LOG_THROW("Could not set the size for " << fullPath << " to " << totalSize);
-			}
+			MPICollectiveFile ourFile(_world, fullPath, totalSize);
 			LOG_DEBUG(2, "Writing " << mySize << " at " << myStart << " to " << fullPath);
-			char *data = const_cast<char*>(contents.data());
-			int64_t offset = 0;
-			int64_t maxwrite = 0xf000000; // keep writes to less than max int size at a time to avoid MPI overflows
-			int64_t bytesToEndofBlock = WRITE_BLOCK_SIZE - (myStart % WRITE_BLOCK_SIZE);
-			bytesToEndofBlock = std::min(bytesToEndofBlock, mySize - offset);
-			bytesToEndofBlock = bytesToEndofBlock == 0 ? maxwrite : bytesToEndofBlock;
-			while (offset < mySize) {
-				int64_t thisWriteSize = std::min(maxwrite, mySize - offset);
-				thisWriteSize = std::min(bytesToEndofBlock, thisWriteSize);
-				MPI_File_write_at(ourFile, myStart+offset, data+offset, thisWriteSize, MPI_BYTE, MPI_STATUS_IGNORE);
-				offset += thisWriteSize;
-				bytesToEndofBlock = maxwrite;
-			}
+			ourFile.writeAtAll(myStart, contents.data(), mySize);
 			LOG_DEBUG_OPTIONAL(1, _world.rank()==0, "Closing " << fullPath);
-			MPI_File_close(&ourFile);
 		}
 
 	}
@@ -274,11 +252,8 @@ public:
 
 	static void mergeFiles(mpi::communicator &world, std::string rankFile, std::string globalFile, bool unlinkAfter = false) {
 		MPI_Offset mySize = 0;
-		char *buf[2];
 		int bufSize = WRITE_BLOCK_SIZE;
-		buf[0] = new char[bufSize];
-		buf[1] = new char[bufSize];
-		int bufId = 0;
+		char *buf = new char[bufSize];
 		MPI_Info info(MPI_INFO_NULL);
 
 		int rank = world.rank();
@@ -317,77 +292,37 @@ public:
 
 		LOG_DEBUG_OPTIONAL(1, true, "Writing to '" << globalFile << "' at " << myStart << " for " << mySize << " total: "<< totalSize << " bytes");
 
-		MPI_File ourFile;
-		err = MPI_File_open(world, const_cast<char*>(globalFile.c_str()), MPI_MODE_CREATE | MPI_MODE_WRONLY, info, &ourFile);
-		if (err != MPI_SUCCESS) {
-			LOG_THROW("Could not open " << globalFile << " collectively");
-		}
-		err = MPI_File_set_size(ourFile, totalSize);
-		if (err != MPI_SUCCESS) {
-			LOG_THROW("Could not set the size for " << globalFile << " to " << totalSize);
-		}
-
-		MPI_Status status, writeStatus;
-		MPI_Request writeRequest = MPI_REQUEST_NULL;
-		myPos = myStart;
-		MPI_Offset bytesToEndofBlock = WRITE_BLOCK_SIZE - (myStart % WRITE_BLOCK_SIZE);
-		int lastWrite = 0;
-		bytesToEndofBlock = std::min(bytesToEndofBlock, mySize);
-		while (isOpen && myPos < myStart + mySize) {
-			err = MPI_File_read(myFile, buf[bufId % 2], bytesToEndofBlock == 0 ? bufSize : bytesToEndofBlock, MPI_BYTE, &status);
-			if (err != MPI_SUCCESS) {
-				LOG_THROW("Could not read from " << rankFile);
-			}
-			int sendBytes;
-			err = MPI_Get_count(&status, MPI_BYTE, &sendBytes);
-			LOG_DEBUG_OPTIONAL(3, true, "Read " << sendBytes << " from " << rankFile);
-			if (sendBytes == 0 || err != MPI_SUCCESS)
-				break;
-
-			err = MPI_Wait(&writeRequest, &writeStatus);
-			if (err != MPI_SUCCESS) {
-				LOG_THROW("Could not wait for write of " << globalFile);
-			}
-			if (lastWrite > 0) {
-				int x;
-				err = MPI_Get_count(&writeStatus, MPI_BYTE, &x);
-				if (err != MPI_SUCCESS || x != lastWrite) {
-					LOG_THROW("Last write was for a different size than requested! " << lastWrite << " vs " << x);
+		{
+			MPICollectiveFile ourFile(world, globalFile, totalSize);
+
+			// collective writes, so every rank makes the same number of (possibly empty) writes
+			int64_t myBlocks = (mySize + bufSize - 1) / bufSize;
+			int64_t ourBlocks = mpi::all_reduce(world, myBlocks, mpi::maximum<int64_t>());
+			MPI_Status status;
+			myPos = myStart;
+			for(int64_t block = 0; block < ourBlocks; block++) {
+				int readBytes = 0;
+				if (isOpen && myPos < myStart + mySize) {
+					err = MPI_File_read(myFile, buf, std::min((int64_t) bufSize, (int64_t) (myStart + mySize - myPos)), MPI_BYTE, &status);
+					if (err != MPI_SUCCESS)
+						LOG_THROW("Could not read from " << rankFile);
+					MPI_Get_count(&status, MPI_BYTE, &readBytes);
+					LOG_DEBUG_OPTIONAL(3, true, "Read " << readBytes << " from " << rankFile);
 				}
+				ourFile.writeAtAll(myPos, buf, readBytes);
+				LOG_DEBUG_OPTIONAL(3, true, "Writing at " << myPos << " for " << readBytes << " to " << globalFile);
+				myPos += readBytes;
 			}
-			err = MPI_File_iwrite_at(ourFile, myPos, buf[bufId % 2], sendBytes, MPI_BYTE, &writeRequest);
-			lastWrite = sendBytes;
-			if (err != MPI_SUCCESS) {
-				LOG_THROW("Could not write to " << globalFile);
-			}
-			LOG_DEBUG_OPTIONAL(3, true, "Writing at " << myPos << " for " << sendBytes << " to " << globalFile);
-			bufId++;
-			myPos += sendBytes;
-			bytesToEndofBlock = 0;
+			if (myPos != myStart + mySize)
+				LOG_THROW("Could not read all of " << rankFile << ": " << (myPos - myStart) << " of " << mySize << " bytes");
 		}
-		assert(myPos == myStart + mySize);
-		err = MPI_Wait(&writeRequest, &writeStatus);
-		if (err != MPI_SUCCESS)
-			LOG_THROW("Error waiting for write request " << rankFile << " to " << globalFile);
-		if (lastWrite > 0) {
-			int x;
-			err = MPI_Get_count(&writeStatus, MPI_BYTE, &x);
-			if (err != MPI_SUCCESS || x != lastWrite) {
-				LOG_THROW("Last write was for a different size than requested! " << lastWrite << " vs " << x);
-			}
-		}
-
-		err = MPI_File_close(&ourFile);
-		if (err != MPI_SUCCESS)
-			LOG_THROW("Error closing for global file: " << globalFile);
 
 		if (isOpen)
 			err = MPI_File_close(&myFile);
 		if (isOpen && err != MPI_SUCCESS)
 			LOG_THROW("Error closing for rankfile file: " << rankFile);
 
-		delete [] buf[0];
-		delete [] buf[1];
+		delete [] buf;
 
 		if (isOpen && unlinkAfter)
 			unlink(rankFile.c_str());
@@ -57,7 +57,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 
 class _DuplicateFragmentFilterOptions : public OptionsBaseInterface {
 public:
-	_DuplicateFragmentFilterOptions() : deDupMode(0), deDupSingle(false), deDupConsensus(true), deDupEditDistance(0), deDupStartOffset(0),
+	_DuplicateFragmentFilterOptions() : deDupMode(0), deDupSingle(false), deDupConsensus(true), deDupSort(false), deDupEditDistance(0), deDupStartOffset(0),
 	deDupLength(24) {}
 	virtual ~_DuplicateFragmentFilterOptions() {}
 
@@ -85,6 +85,10 @@ public:
 		return deDupConsensus;
 	}
 
+	bool &getDeDupSort() {
+		return deDupSort;
+	}
+
 	unsigned int &getDeDupStartOffset()
 	{
 		return deDupStartOffset;
@@ -106,6 +110,8 @@ public:
 
 						("dedup-consensus", po::value<bool>()->default_value(deDupConsensus), "if set then a single consensus read will be calculated, if not set, a random read will be selected")
 
+						("dedup-sort", po::value<bool>()->default_value(deDupSort), "if set (and dedup-edit-distance is 0) duplicates are found by radix sorting the hashed fragment prefixes instead of building a kmer spectrum (much less memory).  Without dedup-consensus, the fragment with the highest quality is kept instead of a random one")
+
 						("dedup-edit-distance", po::value<unsigned int>()->default_value(deDupEditDistance), "if -1, no fragment de-duplication will occur, if 0, only exact match, ...")
 
 						("dedup-start-offset", po::value<unsigned int>()->default_value(deDupStartOffset), "de-duplication start offset to find unique fragments, must be multiple of 4")
@@ -125,6 +131,7 @@ public:
 		setOpt("dedup-single", getDeDupSingle());
 
 		setOpt("dedup-consensus", getDeDupConsensus());
+		setOpt("dedup-sort", getDeDupSort());
 
 		// set dedup edit distance
 		setOpt("dedup-edit-distance", getDeDupEditDistance());
@@ -143,7 +150,7 @@ public:
 	}
 protected:
 	unsigned int deDupMode;
-	bool deDupSingle, deDupConsensus;
+	bool deDupSingle, deDupConsensus, deDupSort;
 	unsigned int deDupEditDistance, deDupStartOffset, deDupLength;
 
 };
@@ -169,6 +176,90 @@ public:
 	typedef ReadSet::Pair Pair;
 	typedef ReadSet::ReadSetSizeType ReadSetSizeType;
 
+	typedef std::vector< ReadSetSizeType > IdVector;
+
+	enum FragmentStatus { FRAGMENT_OK, FRAGMENT_DISCARDED, FRAGMENT_INVALID, FRAGMENT_TOO_SHORT, FRAGMENT_UNPAIRED };
+
+	// builds into kmer the concatenated prefixes of the pair (or the single read when !paired)
+	// and sets fragmentIdx to the pairIdx (+ pairSize when reverse complemented) or the readIdx when !paired
+	static FragmentStatus _getFragmentPrefix(ReadSet &reads, long pairIdx, unsigned char bytes, bool useReverseComplement, bool paired, unsigned int startOffset, Kmer &kmer, ReadSetSizeType &fragmentIdx) {
+		Pair &pair = reads.getPair(pairIdx);
+		SequenceLengthType sequenceLength = bytes * 4;
+
+		if (paired && pair.isPaired() ) {
+			if(reads.isValidRead(pair.read1) && reads.isValidRead(pair.read2)) {
+				const Read &read1 = reads.getRead(pair.read1);
+				const Read &read2 = reads.getRead(pair.read2);
+				if (read1.isDiscarded() || read2.isDiscarded()) {
+					LOG_DEBUG(6, "Skipped Discarded Reads: \n" << read1.toFastq() << read2.toFastq());
+					return FRAGMENT_DISCARDED;
+				}
+
+				// create read1 + the reverse complement of read2 (1:rev2)
+				// when useReverseComplement, it is represented as a kmer, and the leastcomplement of 1:rev2 and 2:rev1 will be stored
+				// and properly account for duplicate fragment pairs
+
+				SequenceLengthType readLength;
+				readLength = read1.getFirstMarkupXLength();
+				if (readLength >= sequenceLength + startOffset) {
+					memcpy(kmer.getTwoBitSequence()       , read1.getTwoBitSequence() + (startOffset/4), bytes);
+				} else {
+					LOG_DEBUG(6, "Skipped Read1 TooShort: \n" << read1.toFastq() << read2.toFastq());
+					return FRAGMENT_TOO_SHORT;
+				}
+
+				readLength = read2.getFirstMarkupXLength();
+				if (readLength >= sequenceLength + startOffset) {
+					TwoBitSequence::reverseComplement( read2.getTwoBitSequence() + (startOffset/4), kmer.getTwoBitSequence() + bytes, sequenceLength);
+				} else {
+					LOG_DEBUG(6, "Skipped Read2 TooShort: \n" << read1.toFastq() << read2.toFastq());
+					return FRAGMENT_TOO_SHORT;
+				}
+
+				fragmentIdx = pairIdx;
+				if (useReverseComplement) {
+					// choose orientation and flag in pairIdx
+					TEMP_KMER(tmpRevComp);
+					if (! kmer.buildLeastComplement(tmpRevComp) ) {
+						kmer = tmpRevComp;
+						fragmentIdx = pairIdx + reads.getPairSize();
+					}
+				}
+				// store the pairIdx (not readIdx)
+				return FRAGMENT_OK;
+			} else {
+				LOG_DEBUG(6, "Skipped Read(s) invalid");
+				return FRAGMENT_INVALID;
+			}
+		} else if ( pair.isSingle() && (!paired) ) {
+			ReadSetSizeType readIdx = pair.lesser();
+			if (reads.isValidRead(readIdx)) {
+				const Read &read1 = reads.getRead(readIdx);
+				if (read1.isDiscarded()) {
+					LOG_DEBUG(6, "Skipped (single) Discarded : \n" << read1.toFastq());
+					return FRAGMENT_DISCARDED;
+				}
+
+				SequenceLengthType readLength = read1.getFirstMarkupXLength();
+				if (readLength >= sequenceLength + startOffset) {
+					memcpy(kmer.getTwoBitSequence()        , read1.getTwoBitSequence() + (startOffset/4), bytes);
+				} else {
+					LOG_DEBUG(6, "Skipped (single) TooShort: \n" << read1.toFastq());
+					return FRAGMENT_TOO_SHORT;
+				}
+				// store the readIdx (not the pairIdx)
+				fragmentIdx = readIdx;
+				return FRAGMENT_OK;
+			} else {
+				LOG_DEBUG(6, "Skipped Read(s) invalid");
+				return FRAGMENT_INVALID;
+			}
+		} else {
+			LOG_DEBUG(6, "Skipped Unpaired: " << pairIdx);
+			return FRAGMENT_UNPAIRED;
+		}
+	}
+
 	static void _buildDuplicateFragmentMap(KSV &ksv, ReadSet &reads, unsigned char bytes, bool useReverseComplement, bool paired, unsigned int startOffset = DuplicateFragmentFilterOptions::getOptions().getDeDupStartOffset()) {
 		// build one KS per thread, then merge, skipping singletons
 		// no need to include quality scores
@@ -187,94 +278,21 @@ public:
 		ReadSet::madviseMmapsSequential();
 		if (!paired)
 			bytes *= 2;
-		SequenceLengthType sequenceLength = bytes * 4;
 		long skippedDiscard = 0, skippedInvalid = 0, skippedTooShort = 0, skippedUnpaired = 0;
 
 #pragma omp parallel for reduction(+:skippedDiscard) reduction(+:skippedTooShort) reduction(+:skippedUnpaired) reduction(+:skippedInvalid)
 		for(long pairIdx = 0; pairIdx < pairSize; pairIdx++) {
-			Pair &pair = reads.getPair(pairIdx);
 			int threadNum = omp_get_thread_num();
 			KmerWeights &kmerWeights = tmpKmerv[threadNum];
 			Kmer &kmer = kmerWeights[0];
-
-			if (paired && pair.isPaired() ) {
-				if(reads.isValidRead(pair.read1) && reads.isValidRead(pair.read2)) {
-					const Read &read1 = reads.getRead(pair.read1);
-					const Read &read2 = reads.getRead(pair.read2);
-					if (read1.isDiscarded() || read2.isDiscarded()) {
-						skippedDiscard++;
-						LOG_DEBUG(6, "Skipped Discarded Reads: \n" << read1.toFastq() << read2.toFastq());
-						continue;
-					}
-
-					// create read1 + the reverse complement of read2 (1:rev2)
-					// when useReverseComplement, it is represented as a kmer, and the leastcomplement of 1:rev2 and 2:rev1 will be stored
-					// and properly account for duplicate fragment pairs
-
-					SequenceLengthType readLength;
-					readLength = read1.getFirstMarkupXLength();
-					if (readLength >= sequenceLength + startOffset) {
-						memcpy(kmer.getTwoBitSequence()       , read1.getTwoBitSequence() + (startOffset/4), bytes);
-					} else {
-						skippedTooShort++;
-						LOG_DEBUG(6, "Skipped Read1 TooShort: \n" << read1.toFastq() << read2.toFastq());
-						continue;
-					}
-
-					readLength = read2.getFirstMarkupXLength();
-					if (readLength >= sequenceLength + startOffset) {
-						TwoBitSequence::reverseComplement( read2.getTwoBitSequence() + (startOffset/4), kmer.getTwoBitSequence() + bytes, sequenceLength);
-					} else {
-						skippedTooShort++;
-						LOG_DEBUG(6, "Skipped Read2 TooShort: \n" << read1.toFastq() << read2.toFastq());
-						continue;
-					}
-
-					long myPairIdx = pairIdx;
-					if (useReverseComplement) {
-						// choose orientation and flag in pairIdx
-						TEMP_KMER(tmpRevComp);
-						if (! kmer.buildLeastComplement(tmpRevComp) ) {
-							kmer = tmpRevComp;
-							myPairIdx = pairIdx + pairSize;
-						}
-					}
-					// store the pairIdx (not readIdx)
-					ksv[threadNum].append(kmerWeights, myPairIdx);
-				} else {
-					skippedInvalid++;
-					LOG_DEBUG(6, "Skipped Read(s) invalid");
-					continue;
-				}
-			} else if ( pair.isSingle() && (!paired) ) {
-				ReadSetSizeType readIdx = pair.lesser();
-				if (reads.isValidRead(readIdx)) {
-					const Read &read1 = reads.getRead(readIdx);
-					if (read1.isDiscarded()) {
-						skippedDiscard++;
-						LOG_DEBUG(6, "Skipped (single) Discarded : \n" << read1.toFastq());
-						continue;
-					}
-
-					SequenceLengthType readLength = read1.getFirstMarkupXLength();
-					if (readLength >= sequenceLength + startOffset) {
-						memcpy(kmer.getTwoBitSequence()        , read1.getTwoBitSequence() + (startOffset/4), bytes);
-					} else {
-						skippedTooShort++;
-						LOG_DEBUG(6, "Skipped (single) TooShort: \n" << read1.toFastq());
-						continue;
-					}
-					// store the readIdx (not the pairIdx)
-					ksv[threadNum].append(kmerWeights, readIdx);
-				} else {
-					skippedInvalid++;
-					LOG_DEBUG(6, "Skipped Read(s) invalid");
-					continue;
-				}
-			} else {
-				LOG_DEBUG(6, "Skipped Unpaired: " << pairIdx);
-				skippedUnpaired++;
-				continue;
+			ReadSetSizeType fragmentIdx;
+
+			switch (_getFragmentPrefix(reads, pairIdx, bytes, useReverseComplement, paired, startOffset, kmer, fragmentIdx)) {
+			case FRAGMENT_OK: ksv[threadNum].append(kmerWeights, fragmentIdx); break;
+			case FRAGMENT_DISCARDED: skippedDiscard++; break;
+			case FRAGMENT_INVALID: skippedInvalid++; break;
+			case FRAGMENT_TOO_SHORT: skippedTooShort++; break;
+			case FRAGMENT_UNPAIRED: skippedUnpaired++; break;
 			}
 		}
 		if (Log::isDebug(3)) {
@@ -358,58 +376,96 @@ public:
 		ks.printHistograms();
 
 	}
-	static ReadSetSizeType _buildConsensusUnPairedReads(KS &ks, ReadSet &reads, ReadSet &newReads, unsigned int cutoffThreshold) {
+	// collapses one group of duplicate reads into a consensus read appended to newReads,
+	// or, if keepIdx < readIdxs.size(), keeps only that read.  All others are discarded
+	static void _collapseUnPairedGroup(ReadSet &reads, const IdVector &readIdxs, ReadSetSizeType keepIdx, ReadSet &newReads, unsigned char minQual) {
+		if (keepIdx >= readIdxs.size()) {
+			ReadSet tmpReadSet1;
+			for(IdVector::const_iterator it = readIdxs.begin(); it != readIdxs.end(); it++)
+				tmpReadSet1.append( reads.getRead(*it) );
+			newReads.append( tmpReadSet1.getConsensusRead(minQual) );
+		}
+		for(ReadSetSizeType i = 0; i < readIdxs.size(); i++) {
+			if (i != keepIdx)
+				reads.getRead(readIdxs[i]).discard();
+		}
+	}
+
+	// collapses one group of duplicate fragments (pairIdx, or pairIdx + pairSize when reverse complemented)
+	// into a consensus pair appended to newReads, or, if keepIdx < pairIdxs.size(), keeps only that pair.  All others are discarded
+	static void _collapsePairedGroup(ReadSet &reads, const IdVector &pairIdxs, ReadSetSizeType keepIdx, ReadSet &newReads, unsigned char minQual) {
+		ReadSetSizeType pairSize = reads.getPairSize();
+		if (keepIdx >= pairIdxs.size()) {
+			ReadSet tmpReadSet1;
+			ReadSet tmpReadSet2;
+			for(IdVector::const_iterator it = pairIdxs.begin(); it != pairIdxs.end(); it++) {
+				// correct orientation
+				ReadSetSizeType pairIdx = *it;
+				bool isCorrectOrientation = true;
+				if (pairIdx >= pairSize) {
+					isCorrectOrientation = false;
+					pairIdx = pairIdx - pairSize;
+				}
+				Pair &pair = reads.getPair(pairIdx);
+				tmpReadSet1.append( reads.getRead(isCorrectOrientation ? pair.read1 : pair.read2) );
+				tmpReadSet2.append( reads.getRead(isCorrectOrientation ? pair.read2 : pair.read1) );
+			}
+			newReads.append( tmpReadSet1.getConsensusRead(minQual) );
+			newReads.append( tmpReadSet2.getConsensusRead(minQual) );
+		}
+		for(ReadSetSizeType i = 0; i < pairIdxs.size(); i++) {
+			if (i == keepIdx)
+				continue;
+			ReadSetSizeType pairIdx = pairIdxs[i];
+			// orientation does not matter here, but correcting the index is important!
+			if (pairIdx >= pairSize)
+				pairIdx = pairIdx - pairSize;
+			Pair &pair = reads.getPair(pairIdx);
+			reads.getRead(pair.read1).discard();
+			reads.getRead(pair.read2).discard();
+		}
+	}
+
+	static ReadSetSizeType _buildConsensusReads(KS &ks, ReadSet &reads, ReadSet &newReads, unsigned int cutoffThreshold, bool paired) {
 		ReadSet::madviseMmapsRandom();
 		LOG_VERBOSE(1, "Building consensus reads. ");
 		LOG_DEBUG(1, MemoryUtils::getMemoryUsage());
 
 		unsigned char minQual = Options::getOptions().getMinQuality();
+		bool isConsensus = DuplicateFragmentFilterOptions::getOptions().getDeDupConsensus();
 
 		ReadSetSizeType affectedCount = 0;
+		int numThreads = omp_get_max_threads();
+		ReadSet _threadNewReads[numThreads];
 
-#pragma omp parallel reduction(+:affectedCount)
-		for(KSWeakIterator it = ks.weak.beginThreaded(); it != ks.weak.endThreaded(); it++) {
-			if (it->value().getCount() >= cutoffThreshold) {
-				RPW rpw = it->value().getEachInstance();
-
-				ReadSet tmpReadSet1;
-
-				ReadSetSizeType randomIdx = rpw.size();
-                                if (DuplicateFragmentFilterOptions::getOptions().getDeDupConsensus()) {
-					for(RPWIterator rpwit = rpw.begin(); rpwit != rpw.end(); rpwit++) {
-
-						ReadSetSizeType readIdx = rpwit->readId;
-
-						const Read &read1 = reads.getRead(readIdx);
-						tmpReadSet1.append( read1 );
-	
-					}
-
-					Read consensus1 = tmpReadSet1.getConsensusRead(minQual);
-
-					#pragma omp critical (BCUR_newReads)
-					{
-						newReads.append(consensus1);
+#pragma omp parallel num_threads(numThreads) reduction(+:affectedCount)
+		{
+			IdVector ids;
+			ReadSet &threadNewReads = _threadNewReads[omp_get_thread_num()];
+			for(KSWeakIterator it = ks.weak.beginThreaded(); it != ks.weak.endThreaded(); it++) {
+				if (it->value().getCount() >= cutoffThreshold) {
+					// iterator readId is the pairIdx (or readIdx when !paired) built above
+					RPW rpw = it->value().getEachInstance();
+					ids.clear();
+					for(RPWIterator rpwit = rpw.begin(); rpwit != rpw.end(); rpwit++)
+						ids.push_back(rpwit->readId);
+
+					ReadSetSizeType keepIdx = ids.size();
+					if (!isConsensus) {
+						keepIdx = LongRand::rand() % ids.size();
+						LOG_DEBUG_OPTIONAL(2, true, "Selected " << keepIdx << " out of " << ids.size());
 					}
-				} else {
-					randomIdx = LongRand::rand() % tmpReadSet1.getSize();
-					LOG_DEBUG_OPTIONAL(2, true, "Selected " << randomIdx << " out of " << rpw.size() << reads.getRead( reads.getPair((rpw.begin() + randomIdx)->readId).read1 ).getName());
+					if (paired)
+						_collapsePairedGroup(reads, ids, keepIdx, threadNewReads, minQual);
+					else
+						_collapseUnPairedGroup(reads, ids, keepIdx, threadNewReads, minQual);
+					affectedCount += (paired ? 2 : 1) * ids.size();
 				}
-				affectedCount += rpw.size();
-
-				ReadSetSizeType count = 0;
-				for(RPWIterator rpwit = rpw.begin(); rpwit != rpw.end(); rpwit++) {
-					if (count++ == randomIdx)
-						continue;	
-
-					ReadSetSizeType readIdx = rpwit->readId;
-
-					Read &read1 = reads.getRead(readIdx);
-					read1.discard();
-				}
-
 			}
 		}
+		for(int i = 0 ; i < numThreads; i++)
+			newReads.append(_threadNewReads[i]);
+
 		LOG_DEBUG(1, "Clearing duplicate pair map: " << MemoryUtils::getMemoryUsage() );
 		ks.reset();
 		LOG_VERBOSE(1, "Built " << newReads.getSize() << " new consensus reads: " <<  MemoryUtils::getMemoryUsage() );
@@ -417,86 +473,144 @@ public:
 		return affectedCount;
 	}
 
-	static ReadSetSizeType _buildConsensusPairedReads(KS &ks, ReadSet &reads, ReadSet &newReads, unsigned int cutoffThreshold) {
-		ReadSet::madviseMmapsRandom();
-		LOG_VERBOSE(1, "Building consensus reads. ");
-		LOG_DEBUG(1, MemoryUtils::getMemoryUsage());
-
-		unsigned char minQual = Options::getOptions().getMinQuality();
+	// one fragment: the hash of its prefix, its pairIdx, and the sum of its quality scores
+	class FragmentRecord {
+	public:
+		uint64_t key;
+		ReadSetSizeType pairIdx;
+		uint32_t quality;
+	};
+	typedef std::vector< FragmentRecord > FragmentRecordVector;
+
+	static uint32_t _getQualitySum(const Read &read) {
+		std::string quals = read.getQuals();
+		uint32_t sum = 0;
+		for(std::string::const_iterator it = quals.begin(); it != quals.end(); it++)
+			sum += (unsigned char) *it;
+		return sum;
+	}
 
-		ReadSetSizeType affectedCount = 0;
-		ReadSetSizeType pairSize = reads.getPairSize();
+	// instead of a kmer spectrum of the fragment prefixes, radix sorts a flat vector of FragmentRecords,
+	// then only fragments sharing a hashed prefix are compared (by their full prefix) to group exact duplicates
+	static ReadSetSizeType _findDuplicateFragmentsBySort(ReadSet &reads, ReadSet &newReads, unsigned char bytes, unsigned int cutoffThreshold, bool useReverseComplement, bool paired, unsigned int startOffset = DuplicateFragmentFilterOptions::getOptions().getDeDupStartOffset()) {
+		long pairSize = reads.getPairSize();
+		ReadSet::madviseMmapsSequential();
+		if (!paired)
+			bytes *= 2;
 		int numThreads = omp_get_max_threads();
-		ReadSet _threadNewReads[numThreads];
-
-#pragma omp parallel num_threads(numThreads) reduction(+:affectedCount)
-		for(KSWeakIterator it = ks.weak.beginThreaded(); it != ks.weak.endThreaded(); it++) {
-			if (it->value().getCount() >= cutoffThreshold) {
-				RPW rpw = it->value().getEachInstance();
-
-				ReadSetSizeType randomIdx = rpw.size();
-
-				if (DuplicateFragmentFilterOptions::getOptions().getDeDupConsensus()) {
-					ReadSet tmpReadSet1;
-					ReadSet tmpReadSet2;
-					ReadSet &threadNewReads = _threadNewReads[omp_get_thread_num()];
-
-					for(RPWIterator rpwit = rpw.begin(); rpwit != rpw.end(); rpwit++) {
-	
-						// iterator readId is actually the pairIdx built above
-						ReadSetSizeType pairIdx = rpwit->readId;
-
-						// correct orientation
-						bool isCorrectOrientation = true;
-						if (pairIdx >= pairSize) {
-							isCorrectOrientation = false;
-							pairIdx = pairIdx - pairSize;
-						}
-						Pair &pair = reads.getPair(pairIdx);
-						const Read &read1 = reads.getRead(isCorrectOrientation ? pair.read1 : pair.read2);
-						const Read &read2 = reads.getRead(isCorrectOrientation ? pair.read2 : pair.read1);
-	
-						tmpReadSet1.append( read1 );
-						tmpReadSet2.append( read2 );
-	
-					}
+		KmerWeights::Vector tmpKmerv(numThreads);
+		for(int i = 0; i < numThreads; i++)
+			tmpKmerv[i].resize(1);
 
-					Read consensus1 = tmpReadSet1.getConsensusRead(minQual);
-					Read consensus2 = tmpReadSet2.getConsensusRead(minQual);
+		FragmentRecordVector records(pairSize);
+		long skippedDiscard = 0, skippedInvalid = 0, skippedTooShort = 0, skippedUnpaired = 0;
 
-					threadNewReads.append(consensus1);
-					threadNewReads.append(consensus2);
-				} else {
-					randomIdx = LongRand::rand() % rpw.size();
-					LOG_DEBUG_OPTIONAL(2, true, "Selected " << randomIdx << " out of " << rpw.size() << reads.getRead( reads.getPair((rpw.begin() + randomIdx)->readId).read1 ).getName());
-				}
+#pragma omp parallel for reduction(+:skippedDiscard) reduction(+:skippedTooShort) reduction(+:skippedUnpaired) reduction(+:skippedInvalid)
+		for(long pairIdx = 0; pairIdx < pairSize; pairIdx++) {
+			Kmer &kmer = tmpKmerv[omp_get_thread_num()][0];
+			FragmentRecord &record = records[pairIdx];
+			record.pairIdx = ReadSet::MAX_READ_IDX;
+			ReadSetSizeType fragmentIdx;
+
+			switch (_getFragmentPrefix(reads, pairIdx, bytes, useReverseComplement, paired, startOffset, kmer, fragmentIdx)) {
+			case FRAGMENT_OK: break;
+			case FRAGMENT_DISCARDED: skippedDiscard++; continue;
+			case FRAGMENT_INVALID: skippedInvalid++; continue;
+			case FRAGMENT_TOO_SHORT: skippedTooShort++; continue;
+			case FRAGMENT_UNPAIRED: skippedUnpaired++; continue;
+			}
+			record.key = KmerHasher::getHash(kmer.getTwoBitSequence(), KmerSizer::getByteSize());
+			record.pairIdx = pairIdx;
+			const Pair &pair = reads.getPair(pairIdx);
+			if (paired)
+				record.quality = _getQualitySum(reads.getRead(pair.read1)) + _getQualitySum(reads.getRead(pair.read2));
+			else
+				record.quality = _getQualitySum(reads.getRead(pair.lesser()));
+		}
+		LOG_VERBOSE(1, "Duplicate Detection skipped " << (paired?"pairs":"reads") << ": " << (skippedDiscard + skippedInvalid + skippedTooShort + skippedUnpaired) << "\n"
+				<< "\tDiscarded " << skippedDiscard << " TooShort " << skippedTooShort << " UnPaired " << skippedUnpaired << " Invalid " << skippedInvalid);
 
-				affectedCount += 2 * rpw.size();
-				ReadSetSizeType count = 0;
-				for(RPWIterator rpwit = rpw.begin(); rpwit != rpw.end(); rpwit++) {
-					if (count++ == randomIdx)
-						continue;
+		long numRecords = 0;
+		for(long i = 0; i < pairSize; i++)
+			if (records[i].pairIdx != ReadSet::MAX_READ_IDX)
+				records[numRecords++] = records[i];
+		records.resize(numRecords);
+		LOG_VERBOSE(2, "Sorting " << numRecords << " duplicate fragment records. " << MemoryUtils::getMemoryUsage());
+		RadixSort< FragmentRecord >::sort(records);
+
+		// only runs of at least cutoffThreshold records can contain a duplicate group
+		std::vector< long > runStarts;
+		for(long i = 0; i < numRecords; ) {
+			long end = i + 1;
+			while (end < numRecords && records[end].key == records[i].key)
+				end++;
+			if (end - i >= (long) cutoffThreshold)
+				runStarts.push_back(i);
+			i = end;
+		}
+		long numRuns = runStarts.size();
+		LOG_VERBOSE(2, "Collapsing " << numRuns << " duplicate fragment prefixes. " << MemoryUtils::getMemoryUsage());
 
-					ReadSetSizeType pairIdx = rpwit->readId;
+		ReadSet::madviseMmapsRandom();
+		unsigned char minQual = Options::getOptions().getMinQuality();
+		bool isConsensus = DuplicateFragmentFilterOptions::getOptions().getDeDupConsensus();
+		ReadSetSizeType affectedCount = 0;
+		ReadSet _threadNewReads[numThreads];
 
-					// orientation does not matter here, but correcting the index is important!
-					if (pairIdx >= pairSize) {
-						pairIdx = pairIdx - pairSize;
+#pragma omp parallel num_threads(numThreads) reduction(+:affectedCount)
+		{
+			// the full prefix and the offset within the run, so duplicates sort adjacently in pairIdx order
+			typedef std::pair< std::string, long > PrefixRecord;
+			std::vector< PrefixRecord > prefixes;
+			IdVector fragmentIdxs, ids;
+			ReadSet &threadNewReads = _threadNewReads[omp_get_thread_num()];
+			Kmer &kmer = tmpKmerv[omp_get_thread_num()][0];
+
+#pragma omp for schedule(dynamic, 64)
+			for(long run = 0; run < numRuns; run++) {
+				long begin = runStarts[run], end = begin + 1;
+				while (end < numRecords && records[end].key == records[begin].key)
+					end++;
+
+				// verify the whole prefixes, in case of hash collisions
+				prefixes.clear();
+				fragmentIdxs.resize(end - begin);
+				for(long i = begin; i < end; i++) {
+					_getFragmentPrefix(reads, records[i].pairIdx, bytes, useReverseComplement, paired, startOffset, kmer, fragmentIdxs[i - begin]);
+					prefixes.push_back(PrefixRecord(std::string((const char*) kmer.getTwoBitSequence(), KmerSizer::getByteSize()), i - begin));
+				}
+				std::sort(prefixes.begin(), prefixes.end());
+
+				for(long first = 0; first < (long) prefixes.size(); ) {
+					long last = first + 1;
+					while (last < (long) prefixes.size() && prefixes[last].first == prefixes[first].first)
+						last++;
+					if (last - first >= (long) cutoffThreshold) {
+						ids.clear();
+						ReadSetSizeType keepIdx = last - first;
+						uint32_t bestQuality = 0;
+						for(long i = first; i < last; i++) {
+							long offset = prefixes[i].second;
+							uint32_t quality = records[begin + offset].quality;
+							if (!isConsensus && (i == first || quality > bestQuality)) {
+								keepIdx = ids.size();
+								bestQuality = quality;
+							}
+							ids.push_back(fragmentIdxs[offset]);
+						}
+						if (paired)
+							_collapsePairedGroup(reads, ids, keepIdx, threadNewReads, minQual);
+						else
+							_collapseUnPairedGroup(reads, ids, keepIdx, threadNewReads, minQual);
+						affectedCount += (paired ? 2 : 1) * ids.size();
 					}
-					Pair &pair = reads.getPair(pairIdx);
-					Read &read1 = reads.getRead(pair.read1);
-					Read &read2 = reads.getRead(pair.read2);
-					read1.discard();
-					read2.discard();
+					first = last;
 				}
-
 			}
 		}
 		for(int i = 0 ; i < numThreads; i++)
 			newReads.append(_threadNewReads[i]);
 
-		LOG_DEBUG(1, "Clearing duplicate pair map: " << MemoryUtils::getMemoryUsage() );
-		ks.reset();
 		LOG_VERBOSE(1, "Built " << newReads.getSize() << " new consensus reads: " <<  MemoryUtils::getMemoryUsage() );
 		newReads.identifyPairs();
 		return affectedCount;
@@ -507,28 +621,29 @@ public:
 		int numThreads = omp_get_max_threads();
 		KSV ksv(numThreads);
 
-		LOG_VERBOSE(1, "Building " << (paired?"Paired":"Un-Paired") << " Duplicate Fragment Spectrum" );
-
 		SequenceLengthType affectedCount = 0;
 
 		bool useReverseComplement = (DuplicateFragmentFilterOptions::getOptions().getDeDupMode() == 2);
 
-		// build the paired duplicate fragment map
-		_buildDuplicateFragmentMap(ksv, reads, bytes, useReverseComplement, paired);
+		ReadSet newReads;
+		if (editDistance == 0 && DuplicateFragmentFilterOptions::getOptions().getDeDupSort()) {
+			LOG_VERBOSE(1, "Sorting " << (paired?"Paired":"Un-Paired") << " Duplicate Fragments" );
+			affectedCount += _findDuplicateFragmentsBySort(reads, newReads, bytes, cutoffThreshold, useReverseComplement, paired);
+		} else {
+			LOG_VERBOSE(1, "Building " << (paired?"Paired":"Un-Paired") << " Duplicate Fragment Spectrum" );
 
-		KS &ks = ksv[0];
-		// analyze the spectrum
-		ks.printHistograms();
+			// build the paired duplicate fragment map
+			_buildDuplicateFragmentMap(ksv, reads, bytes, useReverseComplement, paired);
 
-		if (editDistance > 0) {
-			_mergeNodesWithinEditDistance(ks, cutoffThreshold, editDistance);
-		}
+			KS &ks = ksv[0];
+			// analyze the spectrum
+			ks.printHistograms();
 
-		ReadSet newReads;
-		if (paired) {
-			affectedCount += _buildConsensusPairedReads(ks, reads, newReads, cutoffThreshold);
-		} else {
-			affectedCount += _buildConsensusUnPairedReads(ks, reads, newReads, cutoffThreshold);
+			if (editDistance > 0) {
+				_mergeNodesWithinEditDistance(ks, cutoffThreshold, editDistance);
+			}
+
+			affectedCount += _buildConsensusReads(ks, reads, newReads, cutoffThreshold, paired);
 		}
 
 		if (FilterKnownOdditiesOptions::getOptions().getSkipArtifactFilter() == 0) {
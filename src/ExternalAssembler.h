@@ -51,18 +51,289 @@ such enhancements or derivative works thereof, in binary and source code form.
 #define EXTERNAL_ASSEMBLER_H
 
 #include <stdlib.h>
+#include <ftw.h>
 #include <boost/date_time.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "ReadSet.h"
 #include "Log.h"
 #include "Utils.h"
 #include "KmerReadUtils.h"
 
+class _ExternalAssemblerOptions : public OptionsBaseInterface {
+public:
+	_ExternalAssemblerOptions() : assemblerWorkers(0), assemblerWorkDir() {}
+	virtual ~_ExternalAssemblerOptions() {}
+	int &getAssemblerWorkers() {
+		return assemblerWorkers;
+	}
+	std::string &getAssemblerWorkDir() {
+		return assemblerWorkDir;
+	}
+	void _resetDefaults() {
+	}
+	void _setOptions(po::options_description &desc,	po::positional_options_description &p) {
+		po::options_description opts("External Assembler Options");
+
+		opts.add_options()
+				("assembler-workers", po::value<int>()->default_value(assemblerWorkers), "if > 0, this many long-lived helper processes run the external assemblies (cap3 or newbler), exchanging reads and contigs with the threads over pipes")
+				("assembler-work-dir", po::value<std::string>()->default_value(assemblerWorkDir), "the directory the assembler workers run in (default /dev/shm if writable, otherwise --temp-dir)")
+
+				;
+
+		desc.add(opts);
+	}
+	bool _parseOptions(po::variables_map &vm) {
+		bool ret = true;
+		setOpt("assembler-workers", assemblerWorkers);
+		setOpt("assembler-work-dir", assemblerWorkDir);
+
+		if (assemblerWorkers < 0) {
+			setOptionsErrorMsg("--assembler-workers must not be negative");
+			ret = false;
+		}
+		return ret;
+	}
+protected:
+	int assemblerWorkers;
+	std::string assemblerWorkDir;
+};
+typedef OptionsBaseTemplate< _ExternalAssemblerOptions > ExternalAssemblerOptions;
+
+// A pool of helper processes, forked once while the caller is still small, that run external
+// assemblies for the threads of the caller.  Each worker owns a working directory (usually on tmpfs)
+// and receives the command and the input reads over a pipe, runs the command there and returns the
+// contents of the output and log files over another pipe, then empties the directory.
+class ExternalAssemblerWorkerPool {
+public:
+	class Job {
+	public:
+		std::string command, inputName, inputData, outputName, logName;
+	};
+	class Result {
+	public:
+		Result() : status(-1) {}
+		int status;
+		std::string outputData, logData;
+	};
+	typedef ExternalAssemblerWorkerPool * WorkerPoolPtr;
+
+	static void initialize(int numWorkers, std::string workDir) {
+		finalize();
+		getInstance() = new ExternalAssemblerWorkerPool(numWorkers, workDir);
+	}
+	// like the ForkDaemon, the workers must be forked before MPI_Init, which is before the options are parsed,
+	// so this reads the few options of the pool directly from the command line
+	static void initialize(int argc, char *argv[]) {
+		int numWorkers = atoi(getCommandLineValue(argc, argv, "assembler-workers", "0").c_str());
+		if (numWorkers <= 0 || (getCommandLineValue(argc, argv, "cap3-path").empty() && getCommandLineValue(argc, argv, "newbler-path").empty()))
+			return;
+		std::string workDir = getCommandLineValue(argc, argv, "assembler-work-dir");
+		if (workDir.empty()) {
+			// a memory backed directory, when one is available
+			if (access("/dev/shm", W_OK | X_OK) == 0)
+				workDir = "/dev/shm";
+			else
+				workDir = getCommandLineValue(argc, argv, "temp-dir", Options::getOptions().getTmpDir());
+		}
+		initialize(numWorkers, workDir);
+	}
+	static void finalize() {
+		if (getInstance() != NULL) {
+			delete getInstance();
+			getInstance() = NULL;
+		}
+	}
+	static WorkerPoolPtr &getInstance() {
+		static WorkerPoolPtr poolPtr = NULL;
+		return poolPtr;
+	}
+
+	int getNumWorkers() const {
+		return workers.size();
+	}
+
+	// threads sharing a worker take turns
+	bool run(const Job &job, Result &result, int threadNum = omp_get_thread_num()) {
+		Worker &worker = *workers[threadNum % workers.size()];
+		boost::mutex::scoped_lock lock(worker.mutex);
+		if (!writeString(worker.writer, job.command) || !writeString(worker.writer, job.inputName)
+				|| !writeString(worker.writer, job.inputData) || !writeString(worker.writer, job.outputName)
+				|| !writeString(worker.writer, job.logName)) {
+			LOG_WARN(1, "ExternalAssemblerWorkerPool::run(): could not send job to worker " << worker.pid);
+			return false;
+		}
+		if (!ForkDaemon::fullRead(worker.reader, &result.status, sizeof(result.status))
+				|| !readString(worker.reader, result.outputData) || !readString(worker.reader, result.logData)) {
+			LOG_WARN(1, "ExternalAssemblerWorkerPool::run(): could not read result from worker " << worker.pid);
+			return false;
+		}
+		return true;
+	}
+
+private:
+	class Worker {
+	public:
+		Worker() : pid(0), writer(-1), reader(-1) {}
+		pid_t pid;
+		int writer, reader;
+		boost::mutex mutex;
+	};
+	typedef boost::shared_ptr< Worker > WorkerPtr;
+	typedef std::vector< WorkerPtr > Workers;
+
+	ExternalAssemblerWorkerPool(int numWorkers, std::string workDir) {
+		for(int i = 0; i < numWorkers; i++) {
+			int jobPipe[2], resultPipe[2];
+			if (pipe(jobPipe) != 0 || pipe(resultPipe) != 0)
+				LOG_THROW("ExternalAssemblerWorkerPool(): Could not create the pipe file descriptors");
+			pid_t pid = fork();
+			if (pid < 0) {
+				LOG_THROW("ExternalAssemblerWorkerPool(): Could not fork a worker process");
+			} else if (pid == 0) {
+				// worker: only keep its own ends of its own pipes
+				for(Workers::iterator it = workers.begin(); it != workers.end(); it++) {
+					close((*it)->writer);
+					close((*it)->reader);
+				}
+				if (close(jobPipe[1]) != 0 || close(resultPipe[0]) != 0 || close(STDIN_FILENO) != 0)
+					LOG_WARN(1, "ExternalAssemblerWorkerPool(worker (" << getpid() << ")): could not close parent pipes or STDIN!");
+				Cleanup::reset();
+				int status = runWorker(jobPipe[0], resultPipe[1], workDir);
+				_exit(status);
+			}
+			if (close(jobPipe[0]) != 0 || close(resultPipe[1]) != 0)
+				LOG_WARN(1, "ExternalAssemblerWorkerPool(main (" << getpid() << ")): could not close worker pipes!");
+			WorkerPtr worker(new Worker());
+			worker->pid = pid;
+			worker->writer = jobPipe[1];
+			worker->reader = resultPipe[0];
+			workers.push_back(worker);
+			Cleanup::trackChild(pid);
+		}
+		LOG_VERBOSE(1, "ExternalAssemblerWorkerPool(): started " << numWorkers << " workers in " << workDir);
+	}
+	~ExternalAssemblerWorkerPool() {
+		// closing the job pipe ends the worker
+		for(Workers::iterator it = workers.begin(); it != workers.end(); it++) {
+			Worker &worker = **it;
+			close(worker.writer);
+			close(worker.reader);
+			int status = 0;
+			if (waitpid(worker.pid, &status, 0) == worker.pid)
+				Cleanup::releaseChild(worker.pid);
+			else
+				LOG_WARN(1, "~ExternalAssemblerWorkerPool(): waitpid on " << worker.pid << " failed");
+		}
+		workers.clear();
+	}
+
+	// the value of --name, as "--name value" or "--name=value", or defaultValue if it is absent
+	static std::string getCommandLineValue(int argc, char *argv[], std::string name, std::string defaultValue = "") {
+		std::string option = "--" + name, value = defaultValue;
+		for(int i = 1; i < argc; i++) {
+			std::string arg(argv[i]);
+			if (arg == option && i + 1 < argc)
+				value = argv[++i];
+			else if (arg.compare(0, option.length() + 1, option + "=") == 0)
+				value = arg.substr(option.length() + 1);
+		}
+		return value;
+	}
+	static bool writeString(int fd, const std::string &str) {
+		int64_t length = str.length();
+		return ForkDaemon::fullWrite(fd, &length, sizeof(length))
+				&& (length == 0 || ForkDaemon::fullWrite(fd, str.data(), length));
+	}
+	static bool readString(int fd, std::string &str) {
+		int64_t length;
+		if (!ForkDaemon::fullRead(fd, &length, sizeof(length)))
+			return false;
+		str.resize(length);
+		return length == 0 || ForkDaemon::fullRead(fd, &str[0], length);
+	}
+	static void readFile(std::string filename, std::string &contents) {
+		std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+		std::stringstream buf;
+		if (ifs.good())
+			buf << ifs.rdbuf();
+		contents = buf.str();
+	}
+	static int _removeEntry(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+		if (ftwbuf->level == 0)
+			return 0;
+		return remove(path);
+	}
+	// removes everything below dir
+	static void emptyDir(std::string dir) {
+		if (nftw(dir.c_str(), _removeEntry, 16, FTW_DEPTH | FTW_PHYS) != 0)
+			LOG_WARN(1, "ExternalAssemblerWorkerPool(worker): could not empty " << dir);
+	}
+
+	static int runWorker(int reader, int writer, std::string workDir) {
+		std::string dir = workDir + "/" + UniqueName::generateUniqueName(".assembler-worker");
+		if (mkdir(dir.c_str(), 0700) != 0) {
+			LOG_WARN(1, "ExternalAssemblerWorkerPool(worker): could not mkdir " << dir);
+			return 1;
+		}
+		Job job;
+		while (readString(reader, job.command) && readString(reader, job.inputName) && readString(reader, job.inputData)
+				&& readString(reader, job.outputName) && readString(reader, job.logName)) {
+			Result result;
+			{
+				std::ofstream ofs((dir + "/" + job.inputName).c_str(), std::ios::out | std::ios::binary);
+				ofs.write(job.inputData.data(), job.inputData.length());
+			}
+			std::string cmd = "cd " + dir + " && " + job.command;
+			LOG_DEBUG(2, "ExternalAssemblerWorkerPool(worker): " << cmd);
+			result.status = ::system(cmd.c_str());
+			readFile(dir + "/" + job.outputName, result.outputData);
+			readFile(dir + "/" + job.logName, result.logData);
+			emptyDir(dir);
+			if (!ForkDaemon::fullWrite(writer, &result.status, sizeof(result.status))
+					|| !writeString(writer, result.outputData) || !writeString(writer, result.logData))
+				break;
+		}
+		emptyDir(dir);
+		rmdir(dir.c_str());
+		close(reader);
+		close(writer);
+		return 0;
+	}
+
+	Workers workers;
+};
+
 class ExternalAssembler {
 public:
 	typedef ReadSet::ReadSetSizeType ReadSetSizeType;
 
+	// seconds spent preparing the input, running the assembler and choosing the new contig
+	class AssemblyTimes {
+	public:
+		AssemblyTimes() : write(0.0), assemble(0.0), select(0.0) {}
+		double write, assemble, select;
+		AssemblyTimes &operator+=(const AssemblyTimes &other) {
+			write += other.write;
+			assemble += other.assemble;
+			select += other.select;
+			return *this;
+		}
+		std::string toString() const {
+			std::stringstream ss;
+			ss << std::fixed << std::setprecision(3) << "write " << write << " s, assemble " << assemble << " s, select " << select << " s";
+			return ss.str();
+		}
+	};
+	// returns the seconds since start, and restarts it
+	static double lapSeconds(boost::posix_time::ptime &start) {
+		boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+		double seconds = (now - start).total_microseconds() / 1000000.0;
+		start = now;
+		return seconds;
+	}
+
 	int &getRepeatContig() {
 		return repeatContig;
 	}
@@ -84,18 +355,21 @@ public:
 
 	void writeReads(const ReadSet &reads, const Read &oldContig, std::string outputName, FormatOutput format = FormatOutput::FastaUnmasked()) {
 		OfstreamMap ofm(outputName, "");
-		reads.writeAll(ofm.getOfstream(""), format);
+		writeReads(reads, oldContig, ofm.getOfstream(""), format);
+	}
+	void writeReads(const ReadSet &reads, const Read &oldContig, std::ostream &os, FormatOutput format = FormatOutput::FastaUnmasked()) {
+		reads.writeAll(os, format);
 		if (oldContig.getLength() > maxSeedLength) {
 			LOG_DEBUG(1, "Shredding " << oldContig.getName() << " " << oldContig.getLength());
 			for(int i = 0; i < repeatContig; i++) {
 				ReadSet shreds = ReadSet::shred(oldContig, maxSeedLength, shredStep);
 				for(int j = 0 ; j < (int) shreds.getSize(); j++) {
-					shreds.getRead(j).write(ofm.getOfstream(""), format);
+					shreds.getRead(j).write(os, format);
 				}
 			}
 		} else {
 			for(int i = 0; i < repeatContig; i++) {
-				oldContig.write(ofm.getOfstream(""), format);
+				oldContig.write(os, format);
 			}
 		}
 	}
@@ -135,7 +409,9 @@ public:
 
 	Read executeAssembly(std::string cmd, std::string newContigFile, const Read &oldContig) {
 		int status;
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
 		status = ForkDaemon::system(cmd);
+		lastTimes.assemble = lapSeconds(start);
 
 		if (status == 0) {
 
@@ -144,6 +420,7 @@ public:
 				ReadSet newContig;
 				newContig.appendFastaFile(newContigFile);
 				Read bestRead = selectBestContig(newContig, oldContig);
+				lastTimes.select = lapSeconds(start);
 				return bestRead;
 			} else {
 				LOG_WARN(1, myName << "::executeAssembly(): returned no file or zero byte file: " << newContigFile << " cmd: " << cmd);
@@ -154,6 +431,38 @@ public:
 		return Read();
 	}
 
+	// runs cmd in the working directory of a pooled worker, with the reads and oldContig in inputName there
+	Read executeAssemblyInWorker(std::string cmd, std::string inputName, std::string newContigName, std::string logName,
+			const ReadSet &inputReads, const Read &oldContig) {
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+		ExternalAssemblerWorkerPool::Job job;
+		job.command = cmd;
+		job.inputName = inputName;
+		job.outputName = newContigName;
+		job.logName = logName;
+		{
+			std::ostringstream oss;
+			writeReads(inputReads, oldContig, oss, FormatOutput::FastaUnmasked());
+			job.inputData = oss.str();
+		}
+		lastTimes.write = lapSeconds(start);
+
+		ExternalAssemblerWorkerPool::Result result;
+		bool ran = ExternalAssemblerWorkerPool::getInstance()->run(job, result);
+		lastTimes.assemble = lapSeconds(start);
+
+		Read bestRead;
+		if (ran && result.status == 0 && !result.outputData.empty()) {
+			ReadSet newContig;
+			newContig.appendFastaData(result.outputData);
+			bestRead = selectBestContig(newContig, oldContig);
+			lastTimes.select = lapSeconds(start);
+		} else {
+			LOG_WARN(1, myName << "::executeAssemblyInWorker(): cmd failed (" << result.status << ") or returned no contigs: " << cmd << ": " << result.logData);
+		}
+		return bestRead;
+	}
+
 	std::string extendContigs(const ReadSet & contigs,
 			ReadSet::ReadSetVector &contigReadSet, ReadSet & changedContigs,
 			ReadSet & finalContigs, ReadSet::ReadSetSizeType minimumCoverage, int threadNum, int numThreads) {
@@ -170,6 +479,7 @@ public:
 			ReadSet::ReadSetSizeType poolSize = contigReadSet[i].getSize();
 
 			boost::posix_time::ptime extTime = boost::posix_time::microsec_clock::local_time();
+			lastTimes = AssemblyTimes();
 			if (poolSize > minimumCoverage) {
 				LOG_VERBOSE_OPTIONAL(2, true, myName << "::extendContigs(): Extending " << oldRead.getName() << " with " << poolSize << " pool of reads");
 				newRead = extendContig(oldRead, contigReadSet[i]);
@@ -184,28 +494,34 @@ public:
 				extendLog << std::endl << myName << "::extendContigs(): Extended " << oldRead.getName() << " "
 						<< deltaLen << " bases to " << newRead.getLength() << ": "
 						<< newRead.getName() << " with " << poolSize
-						<< " reads in the pool, in " << microseconds/1000  << " msec";
+						<< " reads in the pool, in " << microseconds/1000  << " msec (" << lastTimes.toString() << ")";
 				//#pragma omp critical
 				changedContigs.append(newRead);
 			} else {
-				extendLog << std::endl << "Did not extend " << oldRead.getName() << " with " << poolSize << " reads in the pool, in " << extTime << " sec";
+				extendLog << std::endl << "Did not extend " << oldRead.getName() << " with " << poolSize << " reads in the pool, in " << microseconds/1000 << " msec (" << lastTimes.toString() << ")";
 				//#pragma omp critical
 				finalContigs.append(oldRead);
 			}
+			totalTimes += lastTimes;
 		}
 
 		LOG_VERBOSE_OPTIONAL(2, true, myName << "::::extendContigs(): Extended " << contigs.getSize() - poolsWithoutMinimumCoverage << " contigs out of " << processedContigs << " total " << contigs.getSize());
+		LOG_VERBOSE_OPTIONAL(1, true, myName << "::extendContigs(): timing for " << processedContigs << " contigs: " << totalTimes.toString());
 
 		return extendLog.str();
 	}
 
 	virtual Read extendContig(const Read &oldContig, const ReadSet &_inputReads) = 0;
 
+protected:
+	AssemblyTimes lastTimes;
+
 private:
 	std::string myName;
 	KmerReadUtils kmerReadUtils;
 	int repeatContig;
 	SequenceLengthType maxSeedLength, shredStep;
+	AssemblyTimes totalTimes;
 
 };
 
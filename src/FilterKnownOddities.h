@@ -71,7 +71,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 class _FilterKnownOdditiesOptions : public OptionsBaseInterface {
 public:
 	_FilterKnownOdditiesOptions() : skipArtifactFilter(false), artifactFilterMatchLength(24),
-	artifactFilterEditDistance(2), buildArtifactEditsInFilter(2),
+	artifactFilterEditDistance(2),
 	maskSimpleRepeats(false), phiXOutput(false), filterOutput(false) {}
 	~_FilterKnownOdditiesOptions() {}
 
@@ -87,10 +87,6 @@ public:
 	{
 		return artifactReferenceFiles;
 	}
-	unsigned int &getBuildArtifactEditsInFilter()
-	{
-		return buildArtifactEditsInFilter;
-	}
 	bool &getFilterOutput()
 	{
 		return filterOutput;
@@ -123,11 +119,11 @@ public:
 
 	    				("skip-artifact-filter", po::value<bool>()->default_value(skipArtifactFilter), "if set, Skip homo-polymer, primer-dimer and duplicated fragment pair filtering")
 
-	    				("artifact-match-length", po::value<unsigned int>()->default_value(artifactFilterMatchLength), "Kmer match length to known artifact sequences")
+	    				("artifact-match-length", po::value<unsigned int>()->default_value(artifactFilterMatchLength), "Kmer match length to known artifact sequences (any length)")
 
-	    				("artifact-edit-distance", po::value<unsigned int>()->default_value(artifactFilterEditDistance), "edit-distance to apply to artifact-match-length matches to know artifacts")
+	    				("artifact-edit-distance", po::value<unsigned int>()->default_value(artifactFilterEditDistance), "edit-distance (substitutions) to apply to artifact-match-length matches to know artifacts")
 
-	    				("build-artifact-edits-in-filter", po::value<unsigned int>()->default_value(buildArtifactEditsInFilter), "0 - edits will be applied to reads on the fly, 1 - edits will be pre-build in the filter (needs more memory, less overall CPU), 2 - automatic based on size")
+	    				("build-artifact-edits-in-filter", po::value<unsigned int>(), "deprecated and ignored, artifact edits are no longer expanded")
 
 	    				("mask-simple-repeats", po::value<bool>()->default_value(maskSimpleRepeats), "if set filtering artifacts will also mask simple repeats")
 
@@ -142,7 +138,14 @@ public:
 		setOpt("skip-artifact-filter", skipArtifactFilter);
 		setOpt("artifact-match-length", artifactFilterMatchLength);
 		setOpt("artifact-edit-distance", artifactFilterEditDistance);
-		setOpt("build-artifact-edits-in-filter", buildArtifactEditsInFilter);
+		if (artifactFilterMatchLength == 0 || artifactFilterEditDistance >= artifactFilterMatchLength) {
+			setOptionsErrorMsg("Invalid --artifact-match-length and --artifact-edit-distance.  Please choose a match length longer than the edit distance");
+			ret = false;
+		}
+
+		if (vm.count("build-artifact-edits-in-filter")) {
+			LOG_WARN(1, "--build-artifact-edits-in-filter is deprecated and ignored");
+		}
 
 		// set simple repeat masking
 		setOpt("mask-simple-repeats", maskSimpleRepeats);
@@ -161,17 +164,163 @@ public:
 protected:
 	bool skipArtifactFilter;
 	unsigned int artifactFilterMatchLength,
-	artifactFilterEditDistance, buildArtifactEditsInFilter;
+	artifactFilterEditDistance;
 	bool maskSimpleRepeats, phiXOutput, filterOutput;
 	FileListType artifactReferenceFiles;
 };
 typedef OptionsBaseTemplate< _FilterKnownOdditiesOptions > FilterKnownOdditiesOptions;
 
 
+// An index of artifact sequences, on both strands, to find all windows of a read within
+// a number of substitutions of any artifact, for any window length.
+// Each window is split into maxErrors+1 segments, so any match shares at least one exact
+// segment with the read (the pigeonhole principle).  The (up to 32 base) segments are looked up
+// in sorted tables of packed 2-bit words, and each candidate is verified over the whole window
+// with an XOR and popcount per 32 bases, so no edits need to be enumerated.
+class ArtifactIndex {
+public:
+	typedef uint64_t WordType;
+	typedef std::vector< WordType > PackedSequence;
+	typedef std::vector< unsigned int > Values;
+	static const SequenceLengthType BASES_PER_WORD = 32;
+
+	class Seed {
+	public:
+		WordType key;
+		unsigned int target;
+		SequenceLengthType position;
+		Seed(WordType _key = 0, unsigned int _target = 0, SequenceLengthType _position = 0) : key(_key), target(_target), position(_position) {}
+		bool operator<(const Seed &other) const {
+			return key < other.key;
+		}
+	};
+	typedef std::vector< Seed > Seeds;
+
+	ArtifactIndex(SequenceLengthType length = 0, unsigned int maxErrors = 0) : _length(length), _maxErrors(maxErrors) {
+		if (_length == 0)
+			return;
+		unsigned int numSegments = std::min(_maxErrors + 1, (unsigned int) _length);
+		SequenceLengthType maxSeedLength = BASES_PER_WORD;
+		_segmentOffsets.resize(numSegments);
+		_segmentLengths.resize(numSegments);
+		for(unsigned int i = 0; i < numSegments; i++) {
+			_segmentOffsets[i] = i * _length / numSegments;
+			SequenceLengthType end = (i + 1) * _length / numSegments;
+			_segmentLengths[i] = std::min(end - _segmentOffsets[i], maxSeedLength);
+		}
+		_seeds.resize(numSegments);
+	}
+
+	SequenceLengthType getLength() const {
+		return _length;
+	}
+	unsigned long getNumSeeds() const {
+		unsigned long count = 0;
+		for(unsigned int i = 0; i < _seeds.size(); i++)
+			count += _seeds[i].size();
+		return count;
+	}
+
+	// adds every window of fasta, and its reverse complement, reporting value when matched
+	void addSequence(const std::string &fasta, unsigned int value) {
+		if (fasta.length() < _length)
+			return;
+		_addTarget(fasta, value);
+		static const char complements[] = {'T', 'G', 'C', 'A'};
+		SequenceLengthType len = fasta.length();
+		std::string reverse(len, 'T');
+		for(SequenceLengthType i = 0; i < len; i++) {
+			unsigned char base = TwoBitSequence::compressBase(fasta[i]);
+			if (base <= 3)
+				reverse[len - 1 - i] = complements[base];
+		}
+		_addTarget(reverse, value);
+	}
+
+	// must be called after all sequences are added
+	void build() {
+		for(unsigned int i = 0; i < _seeds.size(); i++)
+			std::sort(_seeds[i].begin(), _seeds[i].end());
+	}
+
+	// sets the (sorted, distinct) values of all artifacts matching the window at offset of the packed read
+	// when values are added in increasing order, the first is the value of the first sequence added
+	void findMatches(const PackedSequence &read, SequenceLengthType offset, Values &values) const {
+		values.clear();
+		for(unsigned int segment = 0; segment < _seeds.size(); segment++) {
+			const Seeds &seeds = _seeds[segment];
+			Seed query(getWord(read, offset + _segmentOffsets[segment], _segmentLengths[segment]));
+			for(Seeds::const_iterator it = std::lower_bound(seeds.begin(), seeds.end(), query); it != seeds.end() && it->key == query.key; it++) {
+				if (countMismatches(read, offset, _targets[it->target], it->position, _length, _maxErrors) <= _maxErrors)
+					values.push_back(_targetValues[it->target]);
+			}
+		}
+		if (values.size() > 1) {
+			std::sort(values.begin(), values.end());
+			values.erase(std::unique(values.begin(), values.end()), values.end());
+		}
+	}
+
+	// packs fasta into 2 bits per base (non ACGT bases become A), with a trailing word so getWord never overruns
+	static void pack(const std::string &fasta, PackedSequence &packed) {
+		SequenceLengthType len = fasta.length();
+		packed.assign(len / BASES_PER_WORD + 2, 0);
+		for(SequenceLengthType i = 0; i < len; i++) {
+			WordType base = TwoBitSequence::compressBase(fasta[i]);
+			if (base > 3)
+				base = 0;
+			packed[i / BASES_PER_WORD] |= base << (2 * (i % BASES_PER_WORD));
+		}
+	}
+	// returns the bases (at most 32) starting at offset, as a packed word
+	static inline WordType getWord(const PackedSequence &packed, SequenceLengthType offset, SequenceLengthType bases) {
+		SequenceLengthType wordIdx = offset / BASES_PER_WORD, shift = 2 * (offset % BASES_PER_WORD);
+		WordType word = packed[wordIdx] >> shift;
+		if (shift > 0)
+			word |= packed[wordIdx + 1] << (64 - shift);
+		if (bases < BASES_PER_WORD)
+			word &= (((WordType) 1) << (2 * bases)) - 1;
+		return word;
+	}
+	// returns the number of substituted bases, stopping as soon as it exceeds maxMismatches
+	static inline unsigned int countMismatches(const PackedSequence &a, SequenceLengthType offsetA, const PackedSequence &b, SequenceLengthType offsetB, SequenceLengthType length, unsigned int maxMismatches) {
+		unsigned int mismatches = 0;
+		SequenceLengthType wordBases = BASES_PER_WORD;
+		for(SequenceLengthType i = 0; i < length && mismatches <= maxMismatches; i += wordBases) {
+			SequenceLengthType bases = std::min(length - i, wordBases);
+			WordType diff = getWord(a, offsetA + i, bases) ^ getWord(b, offsetB + i, bases);
+			mismatches += __builtin_popcountll((diff | (diff >> 1)) & 0x5555555555555555ull);
+		}
+		return mismatches;
+	}
+
+private:
+	void _addTarget(const std::string &fasta, unsigned int value) {
+		unsigned int target = _targets.size();
+		_targets.push_back(PackedSequence());
+		_targetValues.push_back(value);
+		PackedSequence &packed = _targets.back();
+		pack(fasta, packed);
+		SequenceLengthType lastPosition = fasta.length() - _length;
+		for(unsigned int segment = 0; segment < _seeds.size(); segment++) {
+			Seeds &seeds = _seeds[segment];
+			for(SequenceLengthType position = 0; position <= lastPosition; position++)
+				seeds.push_back(Seed(getWord(packed, position + _segmentOffsets[segment], _segmentLengths[segment]), target, position));
+		}
+	}
+
+	SequenceLengthType _length;
+	unsigned int _maxErrors;
+	std::vector< SequenceLengthType > _segmentOffsets, _segmentLengths;
+	std::vector< Seeds > _seeds;
+	std::vector< PackedSequence > _targets;
+	Values _targetValues;
+};
+
 class FilterKnownOddities {
 public:
 	typedef Kmer::NumberType NumberType;
-	typedef KmerMap<unsigned int> KM;
+	typedef unsigned int ValueType;
 	typedef ReadSet::ReadSetSizeType ReadSetSizeType;
 	typedef std::vector< ReadSetSizeType > SequenceCounts;
 	typedef std::vector< long > BaseCounts;
@@ -181,17 +330,14 @@ private:
 	ReadSet sequences;
 	unsigned short length;
 	unsigned short twoBitLength;
-	KM filter;
+	ArtifactIndex filter;
 	SequenceCounts counts;
 	int numErrors;
 	ReadSets remnantReads;
 
 public:
 	FilterKnownOddities(int _length = FilterKnownOdditiesOptions::getOptions().getArtifactFilterMatchLength(), int _numErrors = FilterKnownOdditiesOptions::getOptions().getArtifactFilterEditDistance()) :
-		length(_length), filter(512*1024), numErrors(_numErrors) {
-		if (length > 28) {
-			LOG_THROW("Invalid: FilterKnownOddities must use 7 bytes or less (<= 28 bases)");
-		}
+		length(_length), filter(_length, _numErrors), numErrors(_numErrors) {
 		twoBitLength = TwoBitSequence::fastaLengthToTwoBitLength(length);
 		// T is 11, A is 00, so mask is all T's surrounded by A's
 
@@ -231,66 +377,28 @@ public:
 		clear();
 	}
 	void clear() {
-		unsigned long oldKmerLength = KmerSizer::getSequenceLength();
-		KmerSizer::set(length);
-		filter.clear();
+		filter = ArtifactIndex();
 		counts.clear();
 		numErrors = 0;
-		KmerSizer::set(oldKmerLength);
 	}
 
 	void prepareMaps() {
-		unsigned long oldKmerLength = KmerSizer::getSequenceLength();
-		assert(length % 4 == 0);
-		KmerSizer::set(length);
-
-		LOG_DEBUG(2, "Preparing exact match artifacts");
-		KmerReadUtils kru;
+		LOG_DEBUG(2, "Preparing artifact index");
 		for (unsigned int i = 0; i < sequences.getSize(); i++) {
-			const Read &read = sequences.getRead(i);
-			KmerWeightedExtensions &kmers = kru.buildWeightedKmers(read, true);
-			for (Kmer::IndexType j = 0; j < kmers.size(); j++) {
-				filter.getOrSetElement( kmers[j] , i );
-			}
+			filter.addSequence(sequences.getRead(i).getFasta(), i);
 			if (Log::isDebug(2) && i % 10000 == 0)
-				LOG_DEBUG(2, "Processed" << i << " artifact reads." << filter.size() << "" << MemoryUtils::getMemoryUsage())
+				LOG_DEBUG(2, "Processed" << i << " artifact reads." << filter.getNumSeeds() << "" << MemoryUtils::getMemoryUsage())
 		}
-		LOG_DEBUG(2, "Processed" << sequences.getSize() << " artifact reads." << filter.size() << "" << MemoryUtils::getMemoryUsage())
-
-		int maxErrors = numErrors;
-		int buildEdits = FilterKnownOdditiesOptions::getOptions().getBuildArtifactEditsInFilter();
-		for (int error = 0; error < maxErrors; error++) {
-			if (buildEdits == 1 || (buildEdits == 2 && (filter.size() < 750000))) {
-				numErrors--;
-
-				LOG_DEBUG(2,  "Preparing edit distance" << (error+1) << " match:" << filter.size() << "" << MemoryUtils::getMemoryUsage() );
-
-				std::vector< KM::BucketType > tmpKmers;
-				tmpKmers.reserve(filter.size());
-				for(KM::Iterator it = filter.begin(); it != filter.end(); it++) {
-					tmpKmers.push_back( KM::BucketType::permuteBases(it->key(), it->value(), true) );
-				}
-				for(std::vector< KM::BucketType >::iterator it = tmpKmers.begin(); it != tmpKmers.end(); it++) {
-					KM::BucketType &kmers = *it;
-					for (Kmer::IndexType j = 0; j < kmers.size(); j++) {
-						filter.getOrSetElement( kmers[j] , kmers.valueAt(j) );
-					}
-				}
-				tmpKmers.clear();
-				LOG_DEBUG(2, "Prepared order" << (error+1) << ":" << filter.size() << "" << MemoryUtils::getMemoryUsage() );
-			}
-		}
-		LOG_DEBUG(2, "filter is " << filter.size() << ".  Remaining edits is:" << numErrors);
-
-		KmerSizer::set(oldKmerLength);
+		filter.build();
+		LOG_DEBUG(2, "Processed" << sequences.getSize() << " artifact reads." << filter.getNumSeeds() << " seeds for edit distance " << numErrors << ". " << MemoryUtils::getMemoryUsage())
 	}
 
 	class FilterResults {
 	public:
-		KM::ValueType value; // the type of the artifact filter hit
+		ValueType value; // the type of the artifact filter hit
 		SequenceLengthType minPass, maxPass; // the range of the read to keep
 		FilterResults() : value(0), minPass(0), maxPass(MAX_SEQUENCE_LENGTH) {}
-		FilterResults(KM::ValueType &_v, SequenceLengthType &_min, SequenceLengthType &_max) :
+		FilterResults(ValueType &_v, SequenceLengthType &_min, SequenceLengthType &_max) :
 			value(_v), minPass(_min), maxPass(_max) {}
 	};
 	class Recorder {
@@ -390,7 +498,7 @@ public:
 
 		Read &read = reads.getRead(readIdx);
 		FilterResults results;
-		KM::ValueType &value = results.value;
+		ValueType &value = results.value;
 		SequenceLengthType &minPass = results.minPass;
 		SequenceLengthType &maxPass = results.maxPass;
 
@@ -402,8 +510,6 @@ public:
 		minPass = 0;
 		maxPass = seqLen;
 
-		TwoBitEncoding *ptr = read.getTwoBitSequence();
-
 		// Validate quality scores.  Find the two best ranges of data.
 		std::string quals = read.getQuals();
 		SequenceLengthType qualsize = quals.size();
@@ -447,46 +553,28 @@ public:
 		if (byteHops < 0 || byteHops > bytes)
 			byteHops = 0;
 
-		KM::ElementType elem;
 		bool wasPhiX = false;
-		KM::BucketType kmers;
-		TEMP_KMER(leastKmer);
+		ArtifactIndex::PackedSequence packed;
+		ArtifactIndex::pack(read.getFasta(), packed);
+		ArtifactIndex::Values values;
 
 		LOG_DEBUG(3, "applyFilterToRad(): minPass: " << minPass << " maxPass: " << maxPass << " byteHops: " << byteHops << " twoBitLength: " << twoBitLength);
 		SequenceLengthType minAffected = maxPass, maxAffected = minPass;
 		for(long byteHop = minPass/4; byteHop <= byteHops; byteHop++) {
-
-			const Kmer &fwd = (const Kmer&) *ptr;
-			fwd.buildLeastComplement(leastKmer);
-
-			elem = filter.getElementIfExists( leastKmer );
-			if (elem.isValid()) {
-				SequenceLengthType pos = byteHop*4;
-				value = elem.value();
+			SequenceLengthType pos = byteHop*4;
+			if (pos + length > seqLen)
+				break;
+
+			// like the kmer map it replaced, a window reports the first artifact added that matches it
+			filter.findMatches(packed, pos, values);
+			if (!values.empty()) {
+				value = values.front();
 				wasPhiX |= isPhiX(value);
 				if (minAffected > pos)
 					minAffected = pos;
 				if (maxAffected < pos+length)
 					maxAffected = pos+length;
 			}
-
-			if (numErrors > 0) {
-				KM::BucketType::permuteBases(leastKmer, kmers, numErrors, true);
-				for(unsigned int i = 0; i < kmers.size(); i++) {
-					elem = filter.getElementIfExists( kmers[i] );
-					if (elem.isValid()) {
-						SequenceLengthType pos = byteHop*4;
-						value = elem.value();
-						wasPhiX |= isPhiX(value);
-						if (minAffected > pos)
-							minAffected = pos;
-						if (maxAffected < pos+length)
-							maxAffected = pos+length;
-					}
-				}
-			}
-
-			ptr++;
 		}
 		LOG_DEBUG(3, "After artifact match: " << minAffected << " " << maxAffected << " value: " << value);
 
@@ -540,7 +628,7 @@ public:
 		return results;
 	}
 
-	std::string getFilterName(KM::ValueType value) {
+	std::string getFilterName(ValueType value) {
 		assert(value > 0);
 		if (value < sequences.getSize()) {
 			return sequences.getRead(value).getName();
@@ -661,9 +749,6 @@ public:
 	}
 
 	unsigned long applyFilter(ReadSet &reads) {
-		unsigned long oldKmerLength = KmerSizer::getSequenceLength();
-		KmerSizer::set(length);
-
 		Recorder recorder( *this );
 		unsigned long affectedCount = 0;
 
@@ -727,7 +812,6 @@ public:
 			LOG_VERBOSE(1, s);
 		}
 
-		KmerSizer::set(oldKmerLength);
 		return affectedCount;
 	}
 
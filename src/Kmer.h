@@ -267,6 +267,119 @@ protected:
 
 };
 
+// Optional table assigning the low bits of a kmer hash (the KmerMap buckets) to distributed threads (MPI ranks)
+// Each spectrum holds its own table and shares it with its maps (see BucketExposedMapLogic::setBucketOwnership).
+// When set for the number of distributed threads in use, it replaces the default striping by (hash >> DMP_HASH_SHIFT),
+// so every bucket of a map with at least getNumPartitions() buckets belongs to exactly one distributed thread.
+// A table with a local owner is distributed: the maps of that thread only populate its own buckets
+// and spread them over getSpread() times as many buckets to keep their designed size
+class DMPBucketOwnership {
+public:
+	typedef KmerHasher::HashType HashType;
+	typedef Kmernator::KmerNumberType NumberType;
+	typedef std::vector<int> OwnerVector;
+	static const NumberType MAGIC = 0x53524e574f504d44ull; // "DMPOWNRS"
+	static const NumberType MAX_PARTITIONS = 1ul << 16;
+
+	DMPBucketOwnership(int localOwner = -1) : _numDistributedThreads(0), _localOwner(localOwner), _locked(false) {}
+
+	bool isSet(int numDistributedThreads) const {
+		return !_owners.empty() && _numDistributedThreads == numDistributedThreads;
+	}
+	NumberType getNumPartitions() const {
+		return _owners.size();
+	}
+	inline int getOwner(HashType hash) const {
+		return _owners[hash & (_owners.size() - 1)];
+	}
+	// returns -1 if the bucket holds kmers from more than one partition
+	int getBucketOwner(NumberType bucketIdx, NumberType numBuckets) const {
+		if (numBuckets < getNumPartitions())
+			return -1;
+		return getOwner(bucketIdx);
+	}
+	const OwnerVector &getOwners() const {
+		return _owners;
+	}
+	int getNumDistributedThreads() const {
+		return _numDistributedThreads;
+	}
+	// the distributed thread of this process, or -1 if every owner is local (i.e. build partitions)
+	int getLocalOwner() const {
+		return _localOwner;
+	}
+	bool isDistributed() const {
+		return _localOwner >= 0;
+	}
+	// the factor to grow the buckets of a distributed map by
+	NumberType getSpread() const {
+		NumberType spread = 1;
+		if (isDistributed())
+			while (spread < (NumberType) _numDistributedThreads)
+				spread <<= 1;
+		return spread;
+	}
+
+	// must not be called while any kmers are distributed by this table
+	void set(const OwnerVector &owners, int numDistributedThreads) {
+		assert(!omp_in_parallel());
+		if (isLocked())
+			LOG_THROW("Invalid: DMPBucketOwnership::set(): the table is locked");
+		if (owners.empty() || (owners.size() & (owners.size() - 1)) != 0 || owners.size() > MAX_PARTITIONS)
+			LOG_THROW("Invalid: DMPBucketOwnership::set(): number of partitions must be a power of 2 up to " << MAX_PARTITIONS << ": " << owners.size());
+		for(OwnerVector::const_iterator it = owners.begin(); it != owners.end(); it++)
+			if (*it < 0 || *it >= numDistributedThreads)
+				LOG_THROW("Invalid: DMPBucketOwnership::set(): owner " << *it << " is not within " << numDistributedThreads);
+		_owners = owners;
+		_numDistributedThreads = numDistributedThreads;
+	}
+	// contiguous blocks of partitions, as in world.size() * i / numPartitions
+	void setBlocks(NumberType numPartitions, int numDistributedThreads) {
+		OwnerVector owners(numPartitions);
+		for(NumberType i = 0; i < numPartitions; i++)
+			owners[i] = numDistributedThreads * i / numPartitions;
+		set(owners, numDistributedThreads);
+	}
+	// once kmers have been distributed the table must not change
+	bool isLocked() const {
+		return _locked;
+	}
+	void lock() {
+		_locked = true;
+	}
+
+	// store/restore in a mmap header: MAGIC, numDistributedThreads, numPartitions, owners[numPartitions]
+	NumberType sizeToStore() const {
+		return sizeof(NumberType) * (3 + getNumPartitions());
+	}
+	void *store(void *dst) const {
+		NumberType *numbers = (NumberType *) dst;
+		*(numbers++) = MAGIC;
+		*(numbers++) = _numDistributedThreads;
+		*(numbers++) = getNumPartitions();
+		for(OwnerVector::const_iterator it = _owners.begin(); it != _owners.end(); it++)
+			*(numbers++) = *it;
+		return numbers;
+	}
+	// returns false if src (of at most maxBytes) does not hold a stored table
+	bool restore(const void *src, NumberType maxBytes) {
+		const NumberType *numbers = (const NumberType *) src;
+		if (maxBytes < sizeof(NumberType) * 3 || numbers[0] != MAGIC)
+			return false;
+		int numDistributedThreads = numbers[1];
+		NumberType numPartitions = numbers[2];
+		if (maxBytes < sizeof(NumberType) * (3 + numPartitions))
+			return false;
+		set(OwnerVector(numbers + 3, numbers + 3 + numPartitions), numDistributedThreads);
+		return true;
+	}
+private:
+	OwnerVector _owners;
+	int _numDistributedThreads;
+	int _localOwner;
+	bool _locked;
+};
+
 #include <boost/functional/hash.hpp>
 class BoostKmerHasher : public KmerHasher {
 public:
@@ -412,6 +525,54 @@ protected:
 
 };
 
+// Generates the Hamming neighbours of a kmer in place by XOR-ing a 2-bit mask into the packed bases.
+// The reverse complement is carried alongside (complement(b ^ m) == complement(b) ^ m), so the least
+// complement of every neighbour costs a single compare rather than a full reverse complement
+class KmerNeighbours {
+public:
+	KmerNeighbours() : _length(KmerSizer::getSequenceLength()) {}
+
+	// appends (neighbour, value) for every kmer exactly editDistance substitutions away from kmer
+	// returns the number of neighbours appended
+	template<typename KA>
+	unsigned long appendNeighbours(const Kmer &kmer, KA &neighbours, short editDistance, bool leastComplement, const typename KA::ValueType &value) const {
+		if (editDistance <= 0)
+			return 0;
+		TEMP_KMER(fwd);
+		TEMP_KMER(rev);
+		fwd.set(kmer);
+		kmer.buildReverseComplement(rev);
+		return _appendNeighbours(fwd, rev, neighbours, 0, editDistance, leastComplement, value);
+	}
+
+private:
+	template<typename KA>
+	unsigned long _appendNeighbours(Kmer &fwd, Kmer &rev, KA &neighbours, SequenceLengthType startIdx, short editDistance, bool leastComplement, const typename KA::ValueType &value) const {
+		unsigned long count = 0;
+		TwoBitEncoding *f = fwd.getTwoBitSequence(), *r = rev.getTwoBitSequence();
+		for(SequenceLengthType baseIdx = startIdx; baseIdx + editDistance <= _length; baseIdx++) {
+			SequenceLengthType revIdx = _length - 1 - baseIdx;
+			TwoBitEncoding *fByte = f + (baseIdx >> 2), *rByte = r + (revIdx >> 2);
+			int fShift = 6 - 2 * (baseIdx & 0x03), rShift = 6 - 2 * (revIdx & 0x03);
+			for(TwoBitEncoding mask = 1; mask <= 3; mask++) {
+				TwoBitEncoding fMask = mask << fShift, rMask = mask << rShift;
+				*fByte ^= fMask;
+				*rByte ^= rMask;
+				if (editDistance == 1) {
+					neighbours.append((leastComplement && rev < fwd) ? rev : fwd, value);
+					count++;
+				} else {
+					count += _appendNeighbours(fwd, rev, neighbours, baseIdx + 1, editDistance - 1, leastComplement, value);
+				}
+				*fByte ^= fMask;
+				*rByte ^= rMask;
+			}
+		}
+		return count;
+	}
+	SequenceLengthType _length;
+};
+
 #ifndef MAX_KMER_INSTANCE_BASES
 #define MAX_KMER_INSTANCE_BASES 95
 #endif
@@ -2169,6 +2330,7 @@ public:
 	typedef Kmer::IndexType     IndexType;
 	typedef Kmer::SizeType      SizeType;
 	typedef KmerHasher::HashType HashType;
+	typedef boost::shared_ptr< const DMPBucketOwnership > BucketOwnershipPtr;
 
 	typedef typename BucketType::iterator BaseBucketTypeIterator;
 	typedef typename BucketType::const_iterator ConstBaseBucketTypeIterator;
@@ -2216,6 +2378,7 @@ public:
 		// with at least bucketCount buckets
 		resizeBuckets(numBuckets, elementsPerBucket);
 	}
+	// the bucket ownership stays with the map being assigned to (or swapped), see setBucketOwnership
 	BucketExposedMapLogic &operator=(const BucketExposedMapLogic &copy) {
 		_buckets = copy._buckets;
 		BUCKET_MASK = copy.BUCKET_MASK;
@@ -2255,6 +2418,42 @@ public:
 		std::swap(BUCKET_MASK, other.BUCKET_MASK);
 	}
 
+	// routes kmers to distributed threads by bucket, when set for their number (see DMPBucketOwnership)
+	void setBucketOwnership(const BucketOwnershipPtr &ownership) {
+		_bucketOwnership = ownership;
+	}
+	const BucketOwnershipPtr &getBucketOwnership() const {
+		return _bucketOwnership;
+	}
+	// a distributed map only populates the buckets owned by its local thread, so move the (still empty) buckets,
+	// and any memory reserved in them, onto the owned buckets, growing the map to at least one bucket per partition.
+	// previous is the ownership the buckets were already distributed by, or NULL if all of them are to be moved
+	// and (if spread) the map grown by the spread of the ownership
+	void distributeBuckets(const DMPBucketOwnership *previous = NULL, bool spread = true) {
+		assert(_bucketOwnership.get() != NULL && _bucketOwnership->isDistributed());
+		if (size() != 0)
+			LOG_THROW("Invalid: BucketExposedMap::distributeBuckets(): the map is not empty");
+		int localOwner = _bucketOwnership->getLocalOwner();
+		NumberType oldNumBuckets = getNumBuckets();
+		NumberType growth = (spread && previous == NULL) ? _bucketOwnership->getSpread() : 1;
+		NumberType numBuckets = std::max(oldNumBuckets * growth, _bucketOwnership->getNumPartitions());
+		numBuckets = std::min(numBuckets, (NumberType) std::max((NumberType) MAX_KMER_MAP_BUCKETS, oldNumBuckets));
+
+		BucketsVector buckets(getMinPowerOf2(numBuckets));
+		NumberType oldIdx = 0;
+		for(NumberType i = 0; i < buckets.size() && oldIdx < oldNumBuckets; i++) {
+			if (_bucketOwnership->getOwner(i) != localOwner)
+				continue;
+			while (oldIdx < oldNumBuckets && previous != NULL && previous->getOwner(oldIdx) != localOwner)
+				oldIdx++;
+			if (oldIdx < oldNumBuckets)
+				buckets[i].swap(_buckets[oldIdx++]);
+		}
+		_buckets.swap(buckets);
+		BUCKET_MASK = _buckets.size() - 1;
+		LOG_DEBUG(2, "BEML::distributeBuckets(): " << oldNumBuckets << " to " << getNumBuckets() << " " << this);
+	}
+
 	HashType &getBucketMask() {
 		return BUCKET_MASK;
 	}
@@ -2283,13 +2482,15 @@ public:
 	}
 	inline int getDistributedThreadId(HashType hash, int numDistributedThreads) const {
 		assert(numDistributedThreads >= 1);
-		assert((1ul << KmerHasher::DMP_HASH_SHIFT) > getBucketMask());
+		assert(_bucketOwnership.get() != NULL || (1ul << KmerHasher::DMP_HASH_SHIFT) > getBucketMask());
 		// partition blocks of 'global' buckets
 		int tid;
-		if (numDistributedThreads > 1)
-			tid = ((hash >> KmerHasher::DMP_HASH_SHIFT) & KmerHasher::DMP_HASH_MASK) % numDistributedThreads;
-		else
+		if (numDistributedThreads <= 1)
 			tid = 0;
+		else if (_bucketOwnership.get() != NULL && _bucketOwnership->isSet(numDistributedThreads))
+			tid = _bucketOwnership->getOwner(hash);
+		else
+			tid = ((hash >> KmerHasher::DMP_HASH_SHIFT) & KmerHasher::DMP_HASH_MASK) % numDistributedThreads;
 		//LOG_DEBUG(1, "BEML::getDistributedThreadId(" << hash << ", " << numDistributedThreads << "): " << tid);
 		return tid;
 	}
@@ -2413,6 +2614,7 @@ public:
 private:
 	BucketsVector _buckets;
 	HashType BUCKET_MASK;
+	BucketOwnershipPtr _bucketOwnership;
 };
 template<typename _KeyType, typename _ValueType, typename _BucketType, typename _Hasher>
 class BucketExposedMap : public BucketExposedMapLogic<_KeyType, _ValueType, _BucketType, _Hasher> {
@@ -3310,6 +3512,14 @@ public:
 	KmerMapBySTLMap(const void *src) {
 		LOG_THROW("Unimplemented restore");
 	}
+	// the buckets are not preallocated, so a distributed map need not grow
+	void distributeBuckets(const DMPBucketOwnership *previous = NULL) {
+		Base::distributeBuckets(previous, false);
+	}
+	const Kmernator::MmapFile store(std::string permanentFile = "") const {
+		LOG_THROW("Unimplemented store");
+		return Kmernator::MmapFile();
+	}
 	KmerMapBySTLMap(const KmerMapBySTLMap &copy) {
 		*this = copy;
 	}
@@ -55,6 +55,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 #include <cstdlib>
 #include <vector>
 #include <algorithm>
+#include <fstream>
 #include <sys/mman.h>
 
 /*
@@ -91,7 +92,7 @@ class _KmerSpectrumOptions : public OptionsBaseInterface {
 public:
 	_KmerSpectrumOptions() : minKmerQuality(0.10), minDepth(2), estimatedDepth(20.), estimatedErrorRate(0.35),
 		saveKmerMmap(false), loadKmerMmap(),
-		buildPartitions(0), kmerSubsample(1),
+		buildPartitions(0), maxMemory(0), buildExternal(false), kmerSubsample(1), cardinalitySketchMB(0),
 		variantSigmas(-1.0), minVariantKmerDepth(512), variantHammingDistance(2),
 		periodicSingletonPurge(0), gcHeatMap(false) {
 	}
@@ -120,8 +121,14 @@ public:
 
 				("build-partitions", po::value<unsigned int>()->default_value(buildPartitions), "If set, kmer spectrum will be computed in stages and then combined in mmaped files on disk.")
 
+				("max-memory", po::value<unsigned int>()->default_value(maxMemory), "If > 0, the MB that a partial kmer spectrum may use. Without --build-partitions, the number of stages is planned from a kmer cardinality estimate. Stages are added if a stage exceeds this")
+
+				("build-external", po::value<bool>()->default_value(buildExternal), "If set, a spectrum built in stages kmerizes the reads once into a bin per stage in --temp-dir, instead of re-reading all the reads for every stage")
+
 				("kmer-subsample", po::value<long>()->default_value(kmerSubsample),"The 1 / kmer-subsample fraction of kmers to track. 1 to not sample")
 
+				("cardinality-sketch-mb", po::value<unsigned int>()->default_value(cardinalitySketchMB), "If > 0, pre-allocate the kmer spectrum from a HyperLogLog estimate of the distinct and solid kmers, found with a count-min sketch of this many MB (per process)")
+
 				;
 
 		desc.add(opts);
@@ -163,6 +170,8 @@ public:
 
 		// set buildPartitions
 		setOpt("build-partitions", getBuildPartitions());
+		setOpt("max-memory", maxMemory);
+		setOpt("build-external", buildExternal);
 
 		// set the minimum weight that will be used to track kmers
 		// based on the given options
@@ -170,11 +179,17 @@ public:
 		TrackingData::setMinimumDepth( getMinDepth() );
 
 		setOpt("kmer-subsample", kmerSubsample);
+		setOpt("cardinality-sketch-mb", cardinalitySketchMB);
 
 		setOpt("variant-sigmas", getVariantSigmas());
 		setOpt("min-variant-kmer-depth", getMinVariantKmerDepth());
 		setOpt("variant-edit-disance", getVariantHammingDistance());
 		setOpt("periodic-singleton-purge", getPeriodicSingletonPurge());
+		// the bins of an external build do not keep the read boundaries that the purge period counts
+		if (buildExternal && periodicSingletonPurge > 0) {
+			setOptionsErrorMsg("--build-external can not be combined with --periodic-singleton-purge");
+			ret = false;
+		}
 		setOpt("gc-heat-map", getGCHeatMap());
 
 
@@ -209,9 +224,18 @@ public:
 	{
 		return buildPartitions;
 	}
+	unsigned int &getMaxMemory() {
+		return maxMemory;
+	}
+	bool &getBuildExternal() {
+		return buildExternal;
+	}
 	long &getKmerSubsample() {
 		return kmerSubsample;
 	}
+	unsigned int &getCardinalitySketchMB() {
+		return cardinalitySketchMB;
+	}
 	double &getVariantSigmas()
 	{
 		return variantSigmas;
@@ -247,7 +271,10 @@ private:
 	bool saveKmerMmap;
 	std::string loadKmerMmap;
 	unsigned int buildPartitions;
+	unsigned int maxMemory;
+	bool buildExternal;
 	long kmerSubsample;
+	unsigned int cardinalitySketchMB;
 	double       variantSigmas;
 	int minVariantKmerDepth, variantHammingDistance;
 	unsigned int periodicSingletonPurge;
@@ -339,6 +366,202 @@ namespace PurgeUtilsDetail {
 
 };
 
+// HyperLogLog estimates of the distinct and the solid (seen at least twice) canonical kmers in a stream of reads.
+// A count-min sketch, shared by all threads, flags the repeats.  Its increments are not atomic, so a rare
+// lost update can delay a kmer being counted as solid until its next occurrence
+class KmerCardinality {
+public:
+	typedef KmerArrayPair<char> Kmers;
+
+	HyperLogLog distinct, solid;
+	unsigned long rawKmers;
+
+	KmerCardinality(int precision = HyperLogLog::DEFAULT_PRECISION) : distinct(precision), solid(precision), rawKmers(0) {}
+
+	double getDistinct() const {
+		return distinct.estimate();
+	}
+	double getSolid() const {
+		return std::min(solid.estimate(), getDistinct());
+	}
+	void merge(const KmerCardinality &other) {
+		distinct.merge(other.distinct);
+		solid.merge(other.solid);
+		rawKmers += other.rawKmers;
+	}
+
+	// adds the kmers of every read, up to its first N or X
+	void addReads(const ReadSet &store, CountMinSketch &repeats) {
+		long size = store.getSize();
+		std::vector< KmerCardinality > threadCardinality(omp_get_max_threads(), KmerCardinality(distinct.getPrecision()));
+#pragma omp parallel
+		{
+			KmerCardinality &mine = threadCardinality[omp_get_thread_num()];
+			Kmers kmers;
+#pragma omp for schedule(dynamic, 1000)
+			for(long readIdx = 0; readIdx < size; readIdx++)
+				mine.addRead(store.getRead(readIdx), kmers, repeats);
+		}
+		for(size_t i = 0; i < threadCardinality.size(); i++)
+			merge(threadCardinality[i]);
+	}
+	void addRead(const Read &read, Kmers &kmers, CountMinSketch &repeats) {
+		if (read.isDiscarded())
+			return;
+		SequenceLengthType length = read.getLength();
+		SequenceLengthType markupLength = TwoBitSequence::firstMarkupNorX(read.getMarkups());
+		if (markupLength > 0)
+			length = markupLength - 1;
+		if (length < KmerSizer::getSequenceLength())
+			return;
+		kmers.build(read.getTwoBitSequence(), length, true);
+		for(SequenceLengthType j = 0; j < kmers.size(); j++) {
+			Kmer::HashType hash = kmers[j].hash();
+			distinct.add(hash);
+			if (repeats.increment(hash) >= 2)
+				solid.add(hash);
+		}
+		rawKmers += kmers.size();
+	}
+	std::string toString() const {
+		std::stringstream out;
+		out << "rawKmers: " << rawKmers << " distinct: " << (unsigned long) getDistinct() << " solid: " << (unsigned long) getSolid()
+		    << " (+/- " << distinct.getStandardError() * 100.0 << "%)";
+		return out.str();
+	}
+
+	static const unsigned int DEFAULT_SKETCH_MB = 16;
+	// --cardinality-sketch-mb, or the default when an estimate is needed for --max-memory planning
+	static unsigned long getSketchBytes() {
+		unsigned long sketchMB = KmerSpectrumOptions::getOptions().getCardinalitySketchMB();
+		if (sketchMB == 0)
+			sketchMB = DEFAULT_SKETCH_MB;
+		return sketchMB * 1024ul * 1024ul;
+	}
+	static KmerCardinality estimate(const ReadSet &store) {
+		KmerCardinality cardinality;
+		CountMinSketch repeats(getSketchBytes(), 4);
+		cardinality.addReads(store, repeats);
+		LOG_DEBUG_OPTIONAL(1, true, "KmerCardinality::estimate(" << store.getSize() << " reads): " << cardinality.toString() << " repeat false positive rate: " << repeats.getFalsePositiveRate());
+		return cardinality;
+	}
+};
+
+
+// Disk bins for an external partitioned build: one pass over the reads spills every kmer, with its weight
+// and extensions (and its read position, only if the tracking data keeps it), to the bin of the build part
+// that owns its bucket.
+// Each writing thread has its own file per bin, so reading them in thread order replays the reads in order.
+class KmerBins {
+public:
+	typedef WeightedExtensionMessagePacket ValueType;
+	typedef ReadSet::ReadSetSizeType ReadSetSizeType;
+	typedef TrackingData::PositionType PositionType;
+	typedef Kmernator::KmerNumberType NumberType;
+	class ReadPosition {
+	public:
+		ReadSetSizeType readIdx;
+		PositionType readPos;
+	};
+	static const size_t BUFFER_BYTES = 64 * 1024 * 1024;
+
+	KmerBins(NumberType numBins, int numThreads, bool tracksReads) : _numBins(numBins), _numThreads(numThreads), _tracksReads(tracksReads), _buffers(numThreads), _bytes(0) {
+		_prefix = Options::getOptions().getTmpDir() + UniqueName::generateUniqueName("/.tmp-kmerbins-");
+		// kmers are read in place, so keep records 8 byte aligned
+		_kmerBytes = KmerSizer::getByteSize();
+		_recordBytes = ((_kmerBytes + sizeof(ValueType) + (_tracksReads ? sizeof(ReadPosition) : 0) + 7) / 8) * 8;
+		_bufferBytes = std::max((size_t) 4096, BUFFER_BYTES / numThreads / numBins);
+		for(int i = 0; i < numThreads; i++)
+			_buffers[i].resize(numBins);
+	}
+	~KmerBins() {
+		for(NumberType binIdx = 0; binIdx < _numBins; binIdx++)
+			for(int threadId = 0; threadId < _numThreads; threadId++)
+				unlink(getFilename(binIdx, threadId).c_str());
+	}
+	NumberType getNumBins() const {
+		return _numBins;
+	}
+	int getNumThreads() const {
+		return _numThreads;
+	}
+	size_t getRecordBytes() const {
+		return _recordBytes;
+	}
+	unsigned long getBytes() const {
+		return _bytes;
+	}
+	std::string getFilename(NumberType binIdx, int threadId) const {
+		return _prefix + boost::lexical_cast<std::string>(binIdx) + "-" + boost::lexical_cast<std::string>(threadId);
+	}
+
+	void add(int threadId, NumberType binIdx, const Kmer &least, ReadSetSizeType readIdx, PositionType readPos, const ValueType &value) {
+		std::vector<char> &buffer = _buffers[threadId][binIdx];
+		size_t offset = buffer.size();
+		buffer.resize(offset + _recordBytes);
+		char *record = &buffer[offset];
+		memcpy(record, least.getTwoBitSequence(), _kmerBytes);
+		getValue(record) = value;
+		if (_tracksReads) {
+			ReadPosition &position = getReadPosition(record);
+			position.readIdx = readIdx;
+			position.readPos = readPos;
+		}
+		if (buffer.size() >= _bufferBytes)
+			flush(threadId, binIdx);
+	}
+	void flush(int threadId, NumberType binIdx) {
+		std::vector<char> &buffer = _buffers[threadId][binIdx];
+		if (buffer.empty())
+			return;
+		std::string filename = getFilename(binIdx, threadId);
+		std::ofstream os(filename.c_str(), std::ios::binary | std::ios::app);
+		os.write(&buffer[0], buffer.size());
+		os.close();
+		if (os.fail())
+			LOG_THROW("Could not write kmer bin: " << filename);
+#pragma omp atomic
+		_bytes += buffer.size();
+		buffer.clear();
+	}
+	void flushAll(int threadId) {
+		for(NumberType binIdx = 0; binIdx < _numBins; binIdx++) {
+			flush(threadId, binIdx);
+			std::vector<char>().swap(_buffers[threadId][binIdx]);
+		}
+	}
+
+	// reads up to maxRecords of the open bin file, returns the number read
+	size_t read(std::ifstream &is, std::vector<char> &records, size_t maxRecords) const {
+		records.resize(maxRecords * _recordBytes);
+		is.read(&records[0], records.size());
+		size_t numRecords = is.gcount() / _recordBytes;
+		records.resize(numRecords * _recordBytes);
+		return numRecords;
+	}
+	Kmer &getKmer(char *record) const {
+		return *((Kmer*) record);
+	}
+	// the value and then the read position (if any) end the record, so both stay aligned
+	ValueType &getValue(char *record) const {
+		return *((ValueType*) (record + _recordBytes - sizeof(ValueType) - (_tracksReads ? sizeof(ReadPosition) : 0)));
+	}
+	ReadPosition &getReadPosition(char *record) const {
+		return *((ReadPosition*) (record + _recordBytes - sizeof(ReadPosition)));
+	}
+	bool tracksReads() const {
+		return _tracksReads;
+	}
+
+private:
+	std::string _prefix;
+	NumberType _numBins;
+	int _numThreads;
+	bool _tracksReads;
+	size_t _kmerBytes, _recordBytes, _bufferBytes;
+	std::vector< std::vector< std::vector<char> > > _buffers; // [thread][bin]
+	unsigned long _bytes;
+};
 
 template<typename So = KmerMapByKmerArrayPair< TrackingDataMinimal4 >, typename We = KmerMapByKmerArrayPair< TrackingDataMinimal4 >, typename Si = KmerMapByKmerArrayPair< TrackingDataSingleton> >
 class KmerSpectrum {
@@ -391,6 +614,7 @@ public:
 	typedef std::vector< KmerSpectrum > Vector;
 
 	typedef Kmer::NumberType NumberType;
+	typedef boost::shared_ptr< DMPBucketOwnership > BucketOwnershipPtr;
 
 public:
 	SolidMapType solid;
@@ -407,6 +631,7 @@ private:
 	long uniqueKmers;    // total number of unique kmers (includes singleton)
 	long singletonKmers; // total number of kmers seen exactly once
 	long subtracted;
+	BucketOwnershipPtr bucketOwnership; // shared by all the maps, if any
 
 public:
 	// if singletons are separated use less buckets (but same # as singletons)
@@ -415,9 +640,19 @@ public:
 		solid(), weak((int) (estimatedRawKmers / KmerSpectrumOptions::getOptions().getEstimatedDepth())), singleton(separateSingletons ? estimatedRawKmers * KmerSpectrumOptions::getOptions().getEstimatedErrorRate() : 1),
 		hasSolids(false), hasSingletons(separateSingletons), purgedSingletons(0), rawKmers(0), rawGoodKmers(0), uniqueKmers(0), singletonKmers(0), subtracted(0)
 	{
-		// apply the minimum quality automatically
-		if (!Read::isQualityToProbabilityInitialized)
-			Read::setMinQualityScore( );
+		_initMinQuality();
+	}
+	// pre-allocates for share of the sketched kmers: the solid ones in weak and the rest in singleton
+	KmerSpectrum(const KmerCardinality &cardinality, double share = 1.0, bool separateSingletons = true):
+		solid(), weak((unsigned long) (share * (separateSingletons ? cardinality.getSolid() : cardinality.getDistinct())) + 1),
+		singleton(separateSingletons ? (unsigned long) (share * (cardinality.getDistinct() - cardinality.getSolid())) + 1 : 1),
+		hasSolids(false), hasSingletons(separateSingletons), purgedSingletons(0), rawKmers(0), rawGoodKmers(0), uniqueKmers(0), singletonKmers(0), subtracted(0)
+	{
+		_initMinQuality();
+		// threads and build partitions stripe both maps by the buckets of weak, so the few sketched singletons
+		// still get (lazily allocated) buckets for every bucket of weak
+		if (separateSingletons && singleton.getNumBuckets() < weak.getNumBuckets())
+			singleton.resizeBuckets(weak.getNumBuckets(), 0);
 	}
 	virtual ~KmerSpectrum() {}
 	KmerSpectrum(const KmerSpectrum &copy) {
@@ -435,6 +670,8 @@ public:
 		this->uniqueKmers = other.uniqueKmers;
 		this->singletonKmers = other.singletonKmers;
 		this->subtracted = other.subtracted;
+		this->bucketOwnership = other.bucketOwnership;
+		_applyBucketOwnership();
 		return *this;
 	}
 
@@ -450,6 +687,42 @@ public:
 		std::swap(uniqueKmers, other.uniqueKmers);
 		std::swap(singletonKmers, other.singletonKmers);
 		std::swap(subtracted, other.subtracted);
+		bucketOwnership.swap(other.bucketOwnership);
+		_applyBucketOwnership();
+		other._applyBucketOwnership();
+	}
+
+	const BucketOwnershipPtr &getBucketOwnership() const {
+		return bucketOwnership;
+	}
+	// routes the kmers of every map by the ownership (NULL for the default striping).
+	// if distributeBuckets, the (empty) buckets of the maps are moved to the owned buckets of a distributed ownership,
+	// otherwise the maps must already be distributed by an equivalent ownership (i.e. restored)
+	void setBucketOwnership(BucketOwnershipPtr ownership, bool distributeBuckets = true) {
+		BucketOwnershipPtr previous = bucketOwnership;
+		bucketOwnership = ownership;
+		_applyBucketOwnership();
+		if (distributeBuckets && bucketOwnership.get() != NULL && bucketOwnership->isDistributed()) {
+			const DMPBucketOwnership *distributed = (previous.get() != NULL && previous->isDistributed()) ? previous.get() : NULL;
+			if (hasSolids)
+				solid.distributeBuckets(distributed);
+			weak.distributeBuckets(distributed);
+			singleton.distributeBuckets(distributed);
+		}
+	}
+	// true if any of the maps keeps the read positions of its kmers
+	static bool tracksReads() {
+		return TracksReads<SolidValueType>::value || TracksReads<WeakValueType>::value || TracksReads<SingletonValueType>::value;
+	}
+	void _applyBucketOwnership() {
+		solid.setBucketOwnership(bucketOwnership);
+		weak.setBucketOwnership(bucketOwnership);
+		singleton.setBucketOwnership(bucketOwnership);
+	}
+	// apply the minimum quality automatically
+	static void _initMinQuality() {
+		if (!Read::isQualityToProbabilityInitialized())
+			Read::setMinQualityScore( );
 	}
 
 	inline long getRawKmers() const { return rawKmers; }
@@ -520,7 +793,13 @@ public:
 	void prepareSolids() {
 		if (!hasSolids) {
 			solid.clear(true);
-			solid = SolidMapType(weak.getNumBuckets());
+			if (bucketOwnership.get() != NULL && bucketOwnership->isDistributed()) {
+				// size as the weak map was before its buckets were distributed
+				solid = SolidMapType(weak.getNumBuckets() / bucketOwnership->getSpread());
+				solid.distributeBuckets();
+			} else {
+				solid = SolidMapType(weak.getNumBuckets());
+			}
 			hasSolids = true;
 		}
 	}
@@ -897,6 +1176,123 @@ public:
 			elements.clear();
 			track(0,0,0,0);
 		}
+
+		// uniqueKmers = errorRate * rawKmers + genomeSize * (1 - ((genomeSize + errorRate - 1) / genomeSize) ^ rawKmers)
+		// i.e. every erroneous kmer is new, and the genomic kmers saturate at genomeSize
+		class GrowthModel {
+		public:
+			double errorRate;
+			double genomeSize;
+			int iterations;
+			bool converged;
+			GrowthModel(double _errorRate = 0.0, double _genomeSize = 0.0) : errorRate(_errorRate), genomeSize(_genomeSize), iterations(0), converged(false) {}
+
+			double predict(double rawKmers) const {
+				return errorRate * rawKmers + genomeSize * (1.0 - getSaturation(rawKmers));
+			}
+			// ((genomeSize + errorRate - 1) / genomeSize) ^ rawKmers
+			double getSaturation(double rawKmers) const {
+				return exp(rawKmers * log1p((errorRate - 1.0) / genomeSize));
+			}
+			// the asymptote, which predicts the unique kmers of the full data set
+			double predictAsymptote(double rawKmers) const {
+				return errorRate * rawKmers + genomeSize;
+			}
+			std::string toString() const {
+				std::stringstream out;
+				out << "errorRate: " << errorRate << " genomeSize: " << genomeSize << " iterations: " << iterations << " converged: " << converged;
+				return out.str();
+			}
+		};
+
+		// weighted (by log(rawKmers)) least squares fit of the GrowthModel to the tracked unique kmer curve using
+		// Levenberg-Marquardt with the parameters clamped to the same bounds as EstimateSize.R
+		// a fit that stalls, runs out of iterations or ends on a bound is not converged
+		GrowthModel fitGrowthModel(double maxErrorRate = 0.5, int maxIterations = 500) const {
+			const double minErrorRate = 0.00005, minGenomeSize = 5000.0, maxGenomeSize = 100000000000.0;
+			std::vector<double> x, y, w;
+			double sumW = 0.0;
+			for(ElementsConstIterator it = elements.begin(); it != elements.end(); it++) {
+				if (it->rawKmers <= 1 || (!x.empty() && it->rawKmers <= x.back()))
+					continue;
+				x.push_back(it->rawKmers);
+				y.push_back(it->uniqueKmers);
+				w.push_back(log((double) it->rawKmers));
+				sumW += w.back();
+			}
+			GrowthModel model;
+			size_t n = x.size();
+			if (n < 3)
+				return model;
+			for(size_t i = 0; i < n; i++)
+				w[i] /= sumW;
+
+			// start from the line through the last two points
+			double slope = (y[n-1] - y[n-2]) / (x[n-1] - x[n-2]);
+			model.errorRate = std::min(maxErrorRate, std::max(minErrorRate, slope));
+			model.genomeSize = std::min(maxGenomeSize, std::max(minGenomeSize, y[n-1] - model.errorRate * x[n-1]));
+
+			double sse = _getSSE(model, x, y, w);
+			double lambda = 0.001;
+			while (model.iterations++ < maxIterations) {
+				// normal equations of the weighted jacobian
+				double a00 = 0.0, a01 = 0.0, a11 = 0.0, g0 = 0.0, g1 = 0.0;
+				double c = 1.0 + (model.errorRate - 1.0) / model.genomeSize;
+				for(size_t i = 0; i < n; i++) {
+					double cx = model.getSaturation(x[i]);
+					double dE = x[i] * (1.0 - cx / c);
+					double dG = 1.0 - cx - x[i] * cx / c * (1.0 - model.errorRate) / model.genomeSize;
+					double r = y[i] - model.predict(x[i]);
+					a00 += w[i] * dE * dE;
+					a01 += w[i] * dE * dG;
+					a11 += w[i] * dG * dG;
+					g0 += w[i] * dE * r;
+					g1 += w[i] * dG * r;
+				}
+
+				bool improved = false;
+				GrowthModel trial = model;
+				while (lambda < 1e12) {
+					double m00 = a00 * (1.0 + lambda), m11 = a11 * (1.0 + lambda);
+					double det = m00 * m11 - a01 * a01;
+					if (det > 0.0) {
+						trial.errorRate = std::min(maxErrorRate, std::max(minErrorRate, model.errorRate + (m11 * g0 - a01 * g1) / det));
+						trial.genomeSize = std::min(maxGenomeSize, std::max(minGenomeSize, model.genomeSize + (m00 * g1 - a01 * g0) / det));
+						double trialSSE = _getSSE(trial, x, y, w);
+						if (trialSSE <= sse) {
+							improved = true;
+							// a negligible improvement only counts as converged for a (nearly) Gauss-Newton step
+							bool isGaussNewton = lambda <= 0.001;
+							lambda = std::max(lambda / 10.0, 1e-12);
+							double change = std::max(fabs(trial.errorRate - model.errorRate) / model.errorRate, fabs(trial.genomeSize - model.genomeSize) / model.genomeSize);
+							model.errorRate = trial.errorRate;
+							model.genomeSize = trial.genomeSize;
+							if (change < 1e-8 || (isGaussNewton && sse - trialSSE <= 1e-12 * sse))
+								model.converged = true;
+							sse = trialSSE;
+							break;
+						}
+					}
+					lambda *= 10.0;
+				}
+				if (!improved || model.converged)
+					break; // converged, or stalled with no downhill step remaining
+			}
+			if (model.errorRate <= minErrorRate || model.errorRate >= maxErrorRate || model.genomeSize <= minGenomeSize || model.genomeSize >= maxGenomeSize)
+				model.converged = false; // clamped to a bound, so not a minimum of the model
+			LOG_DEBUG_OPTIONAL(1, Logger::isMaster(), "SizeTracker::fitGrowthModel(): " << model.toString() << " sse: " << sse);
+			return model;
+		}
+
+	private:
+		static double _getSSE(const GrowthModel &model, const std::vector<double> &x, const std::vector<double> &y, const std::vector<double> &w) {
+			double sse = 0.0;
+			for(size_t i = 0; i < x.size(); i++) {
+				double r = y[i] - model.predict(x[i]);
+				sse += w[i] * r * r;
+			}
+			return sse;
+		}
 	};
 	SizeTracker sizeTracker;
 	SizeTracker getSizeTracker() const {
@@ -1814,8 +2210,37 @@ public:
 		}
 	}
 
+	// approximate bytes held per kmer in a map, with 50% slack for the growth of its buckets
+	template<typename DataType>
+	static double getBytesPerEntry() {
+		return 1.5 * (KmerSizer::getByteSize() + sizeof(DataType));
+	}
+	double getPartitionBytes(double uniqueKmers, double singletonKmers) const {
+		if (hasSingletons)
+			return (uniqueKmers - singletonKmers) * getBytesPerEntry<WeakDataType>() + singletonKmers * getBytesPerEntry<SingletonDataType>();
+		else
+			return uniqueKmers * getBytesPerEntry<WeakDataType>();
+	}
+	// every part must own whole buckets of both maps to be merged by mergeStripedBuckets
+	NumberType getMaxBuildPartitions() const {
+		NumberType maxParts = std::min(weak.getNumBuckets(), (NumberType) DMPBucketOwnership::MAX_PARTITIONS);
+		if (hasSingletons)
+			maxParts = std::min(maxParts, (NumberType) singleton.getNumBuckets());
+		return maxParts;
+	}
+
+	// the number of parts needed to keep the distinct kmers of each part within maxMemoryBytes
+	NumberType planBuildPartitions(const KmerCardinality &cardinality, unsigned long maxMemoryBytes) const {
+		double bytes = getPartitionBytes(cardinality.getDistinct(), cardinality.getDistinct() - cardinality.getSolid());
+		NumberType numParts = std::min((NumberType) std::ceil(bytes / std::max(maxMemoryBytes, 1ul)), getMaxBuildPartitions());
+		numParts = std::max(numParts, (NumberType) 1);
+		LOG_VERBOSE(1, "Planned " << numParts << " build partitions for an estimated " << (unsigned long) (bytes / 1024 / 1024) << " MB of kmers within " << maxMemoryBytes / 1024 / 1024 << " MB");
+		return numParts;
+	}
+
 	// important! returned memory maps must remain in scope!
-	Kmernator::MmapFileVector buildKmerSpectrumInParts(const ReadSet &store, NumberType numParts, std::string mmapFileNamePrefix = "") {
+	// if maxMemoryBytes > 0 and a part grows beyond it, the remaining parts are split further
+	Kmernator::MmapFileVector buildKmerSpectrumInParts(const ReadSet &store, NumberType numParts, std::string mmapFileNamePrefix = "", unsigned long maxMemoryBytes = 0) {
 		bool isSolid = false; // not supported for references...
 		Kmernator::MmapFileVector mmaps;
 		if (numParts <= 1) {
@@ -1834,58 +2259,106 @@ public:
 		if (KmerSpectrumOptions::getOptions().getSaveKmerMmap() == 0) {
 			LOG_WARN(1, "Can not honor --save-kmer-mmap=0 option, as spectrum is building in parts. Temporary mmaps will be made at " << mmapFileNamePrefix);
 		}
-		mmaps.resize(numParts*2);
+		NumberType maxParts = getMaxBuildPartitions();
+		if (numParts > maxParts) {
+			LOG_WARN(1, "Can only build the spectrum in up to " << maxParts << " parts, not " << numParts);
+			numParts = maxParts;
+		}
+		// stripe the buckets over the parts, so that part p of n is also parts p and p+n of 2n
+		BucketOwnershipPtr previousOwnership = bucketOwnership;
+		bool ownsBucketOwnership = previousOwnership.get() == NULL;
+		if (ownsBucketOwnership)
+			_setBuildPartitionOwnership(numParts);
+		else if (!previousOwnership->isSet(numParts) || previousOwnership->isDistributed())
+			LOG_THROW("Invalid: buildKmerSpectrumInParts(): can not build " << numParts << " parts with a bucket ownership for " << previousOwnership->getNumPartitions() << " partitions");
+
+		bool separateSingletons = hasSingletons;
+		std::vector<bool> isBuilt(numParts, false);
+		Kmernator::MmapFileVector weakMmaps, singletonMmaps;
+
+		boost::shared_ptr< KmerBins > bins;
+		if (KmerSpectrumOptions::getOptions().getBuildExternal()) {
+			bins.reset( new KmerBins(numParts, omp_get_max_threads(), tracksReads()) );
+			_writeKmerBins(store, *bins);
+		}
 
 		// build each part of the spectrum
 		for (NumberType partIdx = 0; partIdx < numParts; partIdx++) {
+			if (isBuilt[partIdx])
+				continue;
 			LOG_VERBOSE(2, "Building part of spectrum: " << (partIdx+1) << " of " << numParts << std::endl << MemoryUtils::getMemoryUsage());
+			trackSpectrum(true);
+			typename SizeTracker::SizeTrackerElement before = sizeTracker.getLastElement();
 
 			// build
-			buildKmerSpectrum(store, isSolid, partIdx, numParts);
+			if (bins.get() != NULL)
+				_buildKmerSpectrumFromBin(*bins, partIdx % bins->getNumBins(), partIdx, numParts);
+			else
+				buildKmerSpectrum(store, isSolid, partIdx, numParts);
+			trackSpectrum(true);
+			typename SizeTracker::SizeTrackerElement after = sizeTracker.getLastElement();
+			double partBytes = getPartitionBytes(after.uniqueKmers - before.uniqueKmers, after.singletonKmers - before.singletonKmers);
 
 			// purge
 			purgeMinDepth(KmerSpectrumOptions::getOptions().getMinDepth());
 
-			std::string mmapFilename = mmapFileNamePrefix + boost::lexical_cast<std::string>(partIdx) + "-tmpKmer";
-			mmaps[partIdx] = weak.store(mmapFilename);
+			std::string mmapFilename = mmapFileNamePrefix + boost::lexical_cast<std::string>(weakMmaps.size()) + "-tmpKmer";
+			weakMmaps.push_back( weak.store(mmapFilename) );
 			unlink(mmapFilename.c_str());
 			if (KmerSpectrumOptions::getOptions().getMinDepth() <= 1) {
-				mmaps[partIdx + numParts] = singleton.store(mmapFilename);
+				singletonMmaps.push_back( singleton.store(mmapFilename) );
 				unlink(mmapFilename.c_str());
 			} else
 				LOG_VERBOSE(1, "Not storing singletons which would have been this size: " << singleton.getSizeToStore() );
+			isBuilt[partIdx] = true;
 
-			// optimize memory preallocations
-			weak.rotateDMPBuffers(numParts);
-			singleton.rotateDMPBuffers(numParts);
-		}
-
-		// first free up memory
-		if (KmerSpectrumOptions::getOptions().getMinDepth() <= 1) {
-			LOG_DEBUG(2, "Clearing memory from singletons\n"  << MemoryUtils::getMemoryUsage());
-			singleton.clear();
+			// start the next part with empty maps of the same buckets
+			weak.clear(false);
+			singleton.clear(false);
+			hasSingletons = separateSingletons;
+
+			if (maxMemoryBytes > 0 && partBytes > maxMemoryBytes && partIdx + 1 < numParts) {
+				NumberType factor = 1;
+				while (partBytes / factor > maxMemoryBytes && numParts * factor * 2 <= maxParts)
+					factor *= 2;
+				if (factor > 1 && ownsBucketOwnership) {
+					LOG_VERBOSE(1, "Part " << (partIdx+1) << " of " << numParts << " used about " << (unsigned long) (partBytes / 1024 / 1024) << " MB, more than --max-memory. Splitting the remaining parts by " << factor);
+					std::vector<bool> wasBuilt;
+					wasBuilt.swap(isBuilt);
+					isBuilt.resize(numParts * factor);
+					for(NumberType i = 0; i < isBuilt.size(); i++)
+						isBuilt[i] = wasBuilt[i % numParts];
+					numParts *= factor;
+					_setBuildPartitionOwnership(numParts);
+				} else {
+					LOG_WARN(1, "Part " << (partIdx+1) << " of " << numParts << " used about " << (unsigned long) (partBytes / 1024 / 1024) << " MB, more than --max-memory, but it can not be split further");
+				}
+			}
 		}
+		bins.reset();
+		if (ownsBucketOwnership)
+			setBucketOwnership(previousOwnership);
 
-		LOG_VERBOSE(2, "Merging partial spectrums" );
+		LOG_VERBOSE(2, "Merging " << weakMmaps.size() << " partial spectrums" );
 		LOG_DEBUG(2, MemoryUtils::getMemoryUsage() );
 
-		WeakMapType _weak(weak.getNumBuckets());
-		SingletonMapType _singleton(singleton.getNumBuckets());
-
-		// restore and merge
-		for (NumberType partIdx = 0; partIdx < numParts; partIdx++) {
-			const WeakMapType tmpWMap = WeakMapType::restore( mmaps[partIdx].data() ) ;
+		// restore and merge into the (now empty) maps, as every bucket was built by exactly one part
+		for (NumberType i = 0; i < weakMmaps.size(); i++) {
+			const WeakMapType tmpWMap = WeakMapType::restore( weakMmaps[i].data() ) ;
 			WeakMapType &_tmpWMap = const_cast<WeakMapType&>(tmpWMap);
-			_weak.mergeStripedBuckets( _tmpWMap );
-			if (mmaps[partIdx+numParts].is_open()) {
-				const SingletonMapType tmpSMap = SingletonMapType::restore( mmaps[partIdx+numParts].data() );
-				SingletonMapType &_tmpSMap = const_cast<SingletonMapType&>(tmpSMap);
-				_singleton.mergeStripedBuckets( _tmpSMap );
-			}
+			weak.mergeStripedBuckets( _tmpWMap );
+		}
+		for (NumberType i = 0; i < singletonMmaps.size(); i++) {
+			const SingletonMapType tmpSMap = SingletonMapType::restore( singletonMmaps[i].data() );
+			SingletonMapType &_tmpSMap = const_cast<SingletonMapType&>(tmpSMap);
+			singleton.mergeStripedBuckets( _tmpSMap );
+		}
+		if (KmerSpectrumOptions::getOptions().getMinDepth() > 1) {
+			singleton.clear(false);
+			hasSingletons = false;
 		}
-		weak.swap( _weak );
-		if (KmerSpectrumOptions::getOptions().getMinDepth() <= 1)
-			singleton.swap( _singleton );
+		mmaps = weakMmaps;
+		mmaps.insert(mmaps.end(), singletonMmaps.begin(), singletonMmaps.end());
 
 		LOG_VERBOSE(2, "Finished merging partial spectrums\n" << MemoryUtils::getMemoryUsage());
 
@@ -1900,6 +2373,75 @@ public:
 
 		return mmaps;
 	}
+	// one pass over the reads, spilling each kmer to the bin of its part (bins must match the bucket ownership)
+	void _writeKmerBins(const ReadSet &store, KmerBins &bins) {
+		NumberType numBins = bins.getNumBins();
+		long size = store.getSize();
+		LOG_VERBOSE(2, "Writing " << size << " reads into " << numBins << " kmer bins" << std::endl << MemoryUtils::getMemoryUsage());
+#pragma omp parallel num_threads(bins.getNumThreads())
+		{
+			int threadId = omp_get_thread_num();
+			KmerReadUtils kru;
+			// static scheduling gives each thread a contiguous range of reads, in thread order
+#pragma omp for schedule(static)
+			for(long readIdx = 0; readIdx < size; readIdx++) {
+				const Read &read = store.getRead( readIdx );
+				if (read.isDiscarded())
+					continue;
+				KmerWeightedExtensions &kmers = kru.buildWeightedKmers(read, true, true);
+				for(PositionType readPos = 0; readPos < kmers.size(); readPos++) {
+					Kmer &least = kmers[readPos];
+					bins.add(threadId, getDMPThread(least, numBins, true), least, readIdx, readPos, kmers.valueAt(readPos));
+				}
+			}
+			bins.flushAll(threadId);
+		}
+		LOG_VERBOSE(2, "Wrote " << bins.getBytes() / 1024 / 1024 << " MB of kmer bins");
+	}
+	// counts the kmers of one part from its bin, every thread tracking the kmers of its own buckets
+	void _buildKmerSpectrumFromBin(const KmerBins &bins, NumberType binIdx, NumberType partIdx, NumberType numParts) {
+		solid.reset(false);
+		weak.reset(false);
+		singleton.reset(false);
+
+		size_t maxRecords = std::max((size_t) 1, KmerBins::BUFFER_BYTES / bins.getRecordBytes());
+		std::vector<char> records;
+		for(int writer = 0; writer < bins.getNumThreads(); writer++) {
+			std::ifstream is(bins.getFilename(binIdx, writer).c_str(), std::ios::binary);
+			if (!is.is_open())
+				continue; // this thread wrote no kmers to the bin
+			size_t numRecords;
+			while ((numRecords = bins.read(is, records, maxRecords)) > 0) {
+#pragma omp parallel
+				{
+					int threadId = omp_get_thread_num(), numThreads = omp_get_num_threads();
+					DataPointers pointers(*this);
+					for(size_t i = 0; i < numRecords; i++) {
+						char *record = &records[i * bins.getRecordBytes()];
+						Kmer &least = bins.getKmer(record);
+						int smpThreadId;
+						if (!getSMPThread(least, smpThreadId, numThreads, partIdx, numParts, true) || smpThreadId != threadId)
+							continue;
+						const KmerBins::ValueType &value = bins.getValue(record);
+						if (bins.tracksReads()) {
+							const KmerBins::ReadPosition &position = bins.getReadPosition(record);
+							append(pointers, least, value.getWeight(), position.readIdx, position.readPos, false, value.getLeft(), value.getRight());
+						} else {
+							append(pointers, least, value.getWeight(), 0, 0, false, value.getLeft(), value.getRight());
+						}
+					}
+				}
+			}
+		}
+	}
+	void _setBuildPartitionOwnership(NumberType numParts) {
+		DMPBucketOwnership::OwnerVector owners(getMaxBuildPartitions());
+		for(NumberType i = 0; i < owners.size(); i++)
+			owners[i] = i % numParts;
+		BucketOwnershipPtr ownership(new DMPBucketOwnership());
+		ownership->set(owners, numParts);
+		setBucketOwnership(ownership);
+	}
 
 	void _evaluateBatch(bool isSolid, long batchIdx, long purgeEvery, long purgeCount) {
 		if (Log::isDebug(2)) {
@@ -2114,52 +2656,138 @@ public:
 
 	}
 
-	bool _setPurgeVariant(DataPointers &pointers, const Kmer &kmer, double threshold, double &v) {
-		bool returnValue = false;
-		pointers.set( kmer );
-		WeakElementType &w = pointers.weakElem;
-		if (w.isValid()) {
-			v = TrackingData::useWeighted() ? w.value().getWeightedCount() : w.value().getCount();
-			if (v > 0.0 && v < threshold) {
-				w.value().reset();
-				LOG_DEBUG(4, "Purged Variant " << kmer.toFasta() << " " << v);
-				returnValue = true;
-			} else if (v < threshold) {
-				// already been visited
-				v = -1.0;
+	// counts reported by purgeVariants
+	class VariantCounters {
+	public:
+		enum { NEIGHBOURS, PROBES, HITS, PURGED, MESSAGES, BYTES, SIZE };
+		long counts[SIZE];
+
+		VariantCounters() {
+			reset();
+		}
+		void reset() {
+			for(int i = 0; i < SIZE; i++)
+				counts[i] = 0;
+		}
+		long &operator[](int i) {
+			return counts[i];
+		}
+		long operator[](int i) const {
+			return counts[i];
+		}
+		void add(const VariantCounters &other) {
+			for(int i = 0; i < SIZE; i++) {
+#pragma omp atomic
+				counts[i] += other.counts[i];
 			}
-		} else {
-			v = 0.0;
 		}
-		return returnValue;
-	}
-
-	// recursively purge kmers within edit distance and below threshold
-	virtual long _purgeVariants(DataPointers &pointers, const Kmer &kmer, WeakKAP &variants, double threshold, short editDistance) {
-		long purgedKmers = 0;
-
-		if (editDistance == 0)
-			return purgedKmers;
+		std::string toString() const {
+			std::stringstream out;
+			out << "neighbours: " << counts[NEIGHBOURS] << " probes: " << counts[PROBES] << " hits: " << counts[HITS]
+			    << " purged: " << counts[PURGED] << " messages: " << counts[MESSAGES] << " bytesSent: " << counts[BYTES];
+			return out.str();
+		}
+	};
 
-		for (int thisEditDistance = 1 ; thisEditDistance <= editDistance; thisEditDistance++) {
-			double thisThreshold = threshold / (VARIANT_EDIT_DISTANCE_EXPONENT ^ (thisEditDistance-1));
-			variants.permuteBases(kmer, variants, thisEditDistance, true);
+	// neighbours of the kmers being scanned, each valued with the threshold it must fall below to be purged.
+	// prepare() orders them by owning rank and bucket so that probes walk the map (and the message buffers)
+	// sequentially, and collapses duplicates so each distinct neighbour is probed once per batch
+	class VariantBatch {
+	public:
+		typedef KmerArrayPair< float > KAP;
+		class Probe {
+		public:
+			int rank;
+			NumberType bucketIdx;
+			HashType hash;
+			IndexType idx;
+			bool operator<(const Probe &other) const {
+				if (rank != other.rank)
+					return rank < other.rank;
+				if (bucketIdx != other.bucketIdx)
+					return bucketIdx < other.bucketIdx;
+				if (hash != other.hash)
+					return hash < other.hash;
+				return idx < other.idx;
+			}
+		};
+		typedef std::vector< Probe > Probes;
+
+		KAP kmers;
+		Probes probes;
+		VariantCounters counters;
+
+		// neighbours at edit distance e must be below threshold / VARIANT_EDIT_DISTANCE_EXPONENT^(e-1)
+		void addNeighbours(const Kmer &kmer, double threshold, short editDistance) {
+			double divisor = 1.0;
+			for(short e = 1; e <= editDistance; e++) {
+				counters[VariantCounters::NEIGHBOURS] += _neighbours.appendNeighbours(kmer, kmers, e, true, (float) (threshold / divisor));
+				divisor *= (double) VARIANT_EDIT_DISTANCE_EXPONENT;
+			}
+		}
+		void prepare(const WeakMapType &map, int worldSize) {
+			probes.resize(kmers.size());
+			for(IndexType i = 0; i < kmers.size(); i++) {
+				Probe &probe = probes[i];
+				probe.hash = kmers[i].hash();
+				probe.rank = map.getDistributedThreadId(probe.hash, worldSize);
+				probe.bucketIdx = map.getBucketIdx(probe.hash);
+				probe.idx = i;
+			}
+			std::sort(probes.begin(), probes.end());
 
-			for(SequenceLengthType i = 0 ; i < variants.size(); i++) {
-				Kmer &varKmer = variants[i];
-				double dummy;
-				if (this->_setPurgeVariant(pointers, varKmer, thisThreshold, dummy)) {
-					LOG_DEBUG(4, "Purged " << dummy << " < " << thisThreshold << " : "  << varKmer.toFasta() << " vs " << kmer.toFasta());
-					purgedKmers++;
+			size_t unique = 0;
+			for(size_t i = 0; i < probes.size(); i++) {
+				if (unique > 0 && probes[unique-1].hash == probes[i].hash && kmers[probes[unique-1].idx] == kmers[probes[i].idx]) {
+					float &threshold = kmers.valueAt(probes[unique-1].idx);
+					threshold = std::max(threshold, kmers.valueAt(probes[i].idx));
+				} else {
+					probes[unique++] = probes[i];
 				}
 			}
+			probes.resize(unique);
 		}
-		return purgedKmers;
+		void clear() {
+			kmers.reset(false);
+			probes.clear();
+		}
+		IndexType size() const {
+			return kmers.size();
+		}
+	private:
+		KmerNeighbours _neighbours;
+	};
+
+	// purges kmer if it has a positive count below threshold
+	bool _probeVariant(const Kmer &kmer, HashType hash, double threshold, VariantCounters &counters) {
+		counters[VariantCounters::PROBES]++;
+		WeakElementType elem = weak.getElementIfExists(kmer, hash);
+		if (!elem.isValid())
+			return false;
+		double v = TrackingData::useWeighted() ? elem.value().getWeightedCount() : elem.value().getCount();
+		if (v <= 0.0) // already been purged
+			return false;
+		counters[VariantCounters::HITS]++;
+		if (v < threshold) {
+			elem.value().reset();
+			counters[VariantCounters::PURGED]++;
+			LOG_DEBUG(4, "Purged Variant " << kmer.toFasta() << " " << v << " < " << threshold);
+			return true;
+		}
+		return false;
+	}
+
+	// probes and then clears every neighbour in the batch
+	virtual void _probeVariants(VariantBatch &batch) {
+		batch.prepare(weak, 1);
+		for(typename VariantBatch::Probes::iterator it = batch.probes.begin(); it != batch.probes.end(); it++)
+			_probeVariant(batch.kmers[it->idx], it->hash, batch.kmers.valueAt(it->idx), batch.counters);
+		batch.clear();
 	}
 	virtual void _preVariants(double variantSigmas, double minDepth) {}
-	virtual long _postVariants(long purgedKmers) {
-		LOG_VERBOSE(1, "Removed " << purgedKmers << " kmer-variants");
-		return purgedKmers;
+	virtual long _postVariants(VariantCounters &counters) {
+		LOG_VERBOSE(1, "Removed " << counters[VariantCounters::PURGED] << " kmer-variants (" << counters.toString() << ")");
+		return counters[VariantCounters::PURGED];
 	}
 	virtual void _variantThreadSync(long processed, long remaining, double maxDepth) {
 		LOG_DEBUG(2, "Batch processed " << processed << " remaining: " << remaining << " threshold: " << maxDepth);
@@ -2176,7 +2804,6 @@ public:
 	long purgeVariants(double variantSigmas = KmerSpectrumOptions::getOptions().getVariantSigmas(), short editDistance = KmerSpectrumOptions::getOptions().getVariantHammingDistance(), double minVariantKmerDepth = KmerSpectrumOptions::getOptions().getMinVariantKmerDepth()) {
 		if (variantSigmas <= 0.0)
 			return 0;
-		long purgedKmers = 0;
 		double maxDepth = minVariantKmerDepth;
 
 		if (hasSolids) {
@@ -2186,8 +2813,9 @@ public:
 		int numThreads = omp_get_max_threads();
 		this->_preVariants(variantSigmas, minVariantKmerDepth);
 		LOG_DEBUG(1, "Purging with " << numThreads << " threads");
-		std::vector<DataPointers> pointers(numThreads, DataPointers(*this));
-		std::vector<WeakKAP> variants(numThreads);
+		std::vector<VariantBatch> batches(numThreads);
+		IndexType batchSize = Options::getOptions().getBatchSize();
+		VariantCounters counters;
 
 		// sweep through all kmers above minVariantKmerDepth
 		long remaining = 1;
@@ -2197,34 +2825,41 @@ public:
 			remaining = 0;
 			processed = 0;
 			LOG_DEBUG_OPTIONAL(2, true, "Starting threaded kmer scan");
-#pragma omp parallel num_threads(numThreads) reduction(+: purgedKmers) reduction(+: processed) reduction(+: remaining)
+#pragma omp parallel num_threads(numThreads) reduction(+: processed) reduction(+: remaining)
 			{
-				int threadId = omp_get_thread_num();
+				VariantBatch &batch = batches[omp_get_thread_num()];
 
 				for(WeakIterator it = weak.beginThreaded(); it != weak.endThreaded(); it++) {
 					double count = TrackingData::useWeighted() ? it->value().getWeightedCount() : it->value().getCount();
 					if (count <= minVariantKmerDepth)
 						continue;
 					double threshold = getVariantThreshold(count, variantSigmas);
+					if (threshold <= 0.0)
+						continue;
 					int thisEditDistance = editDistance;
 					while(thisEditDistance > 1) {
-						if (count > minVariantKmerDepth * (VARIANT_EDIT_DISTANCE_EXPONENT^thisEditDistance))
+						if (count > minVariantKmerDepth * pow((double) VARIANT_EDIT_DISTANCE_EXPONENT, thisEditDistance))
 							break;
 						thisEditDistance--;
 					}
 					LOG_DEBUG(3, "Purging Variants of " << it->key().toFasta() << " below " << threshold << " (" << count << ")");
-					purgedKmers += this->_purgeVariants(pointers[threadId], it->key(), variants[threadId], threshold, thisEditDistance);
+					batch.addNeighbours(it->key(), threshold, thisEditDistance);
+					if (batch.size() >= batchSize)
+						this->_probeVariants(batch);
 
 					if (++processed % 10000 == 0)
 						LOG_DEBUG(2, "progress processed " << processed);
 				}
+				this->_probeVariants(batch);
 				this->_variantThreadSync(processed, remaining, maxDepth);
+				counters.add(batch.counters);
+				batch.counters.reset();
 			}
-			remaining = this->_variantBatchSync(remaining, purgedKmers, maxDepth, getVariantThreshold(maxDepth, variantSigmas));
+			remaining = this->_variantBatchSync(remaining, counters[VariantCounters::PURGED], maxDepth, getVariantThreshold(maxDepth, variantSigmas));
 		}
 
-		LOG_DEBUG(3, "Finished processing variants: " << purgedKmers << " waiting for _postVariants");
-		purgedKmers = this->_postVariants(purgedKmers);
+		LOG_DEBUG(3, "Finished processing variants: " << counters[VariantCounters::PURGED] << " waiting for _postVariants");
+		long purgedKmers = this->_postVariants(counters);
 
 		LOG_DEBUG(1, "Purging to min depth: " << KmerSpectrumOptions::getOptions().getMinDepth());
 		this->purgeMinDepth(KmerSpectrumOptions::getOptions().getMinDepth());
@@ -2247,7 +2882,6 @@ public:
 	long purgeVariantsBottomUp(double variantSigmas = KmerSpectrumOptions::getOptions().getVariantSigmas(), short editDistance = KmerSpectrumOptions::getOptions().getVariantHammingDistance()) {
 		if (variantSigmas < 0.0)
 			return 0;
-		long purgedKmers = 0;
 		LOG_VERBOSE(1, "Purging kmer variants (bottom up) within " << editDistance << " edit distance which are >= " << variantSigmas << " sigmas less abundant than a more abundant version");
 
 		if (hasSolids) {
@@ -2258,8 +2892,9 @@ public:
 		this->_preVariants(variantSigmas, minDepth);
 		LOG_DEBUG(1, "Purging with " << numThreads << " threads");
 
-		std::vector<DataPointers> pointers(numThreads, DataPointers(*this));
-		std::vector<WeakBucketType> variants(numThreads);
+		std::vector<VariantBatch> batches(numThreads);
+		IndexType batchSize = Options::getOptions().getBatchSize();
+		VariantCounters counters;
 
 		// sweep through bottom up.  Start at first possible variant to compare at
 		double maxDepth = getNewMaxDepth(minDepth, variantSigmas);
@@ -2273,9 +2908,9 @@ public:
 			remaining = 0;
 			processed = 0;
 			LOG_DEBUG_OPTIONAL(2, true, "Starting threaded kmer scan");
-#pragma omp parallel num_threads(numThreads) reduction(+: purgedKmers) reduction(+: processed) reduction(+: remaining)
+#pragma omp parallel num_threads(numThreads) reduction(+: processed) reduction(+: remaining)
 			{
-				int threadId = omp_get_thread_num();
+				VariantBatch &batch = batches[omp_get_thread_num()];
 
 				for(WeakIterator it = weak.beginThreaded(); it != weak.endThreaded(); it++) {
 					double count = TrackingData::useWeighted() ? it->value().getWeightedCount() : it->value().getCount();
@@ -2288,18 +2923,24 @@ public:
 					double threshold = getVariantThreshold(count, variantSigmas);
 					if (threshold > minDepth) {
 						LOG_DEBUG(3, "Purging Variants of " << it->key().toFasta() << " below " << threshold << " (" << count << ")");
-						purgedKmers += this->_purgeVariants(pointers[threadId], it->key(), variants[threadId], threshold, editDistance);
+						batch.addNeighbours(it->key(), threshold, editDistance);
+						if (batch.size() >= batchSize)
+							this->_probeVariants(batch);
 					}
 					if (++processed % 10000 == 0)
 						LOG_DEBUG(2, "progress processed " << processed);
 				}
+				// a step must be fully purged before the next one scans its survivors
+				this->_probeVariants(batch);
 				this->_variantThreadSync(processed, remaining, maxDepth);
+				counters.add(batch.counters);
+				batch.counters.reset();
 			}
-			remaining = this->_variantBatchSync(remaining, purgedKmers, maxDepth, getVariantThreshold(maxDepth, variantSigmas));
+			remaining = this->_variantBatchSync(remaining, counters[VariantCounters::PURGED], maxDepth, getVariantThreshold(maxDepth, variantSigmas));
 		}
 
-		LOG_DEBUG(3, "Finished processing variants: " << purgedKmers << " waiting for _postVariants");
-		purgedKmers = this->_postVariants(purgedKmers);
+		LOG_DEBUG(3, "Finished processing variants: " << counters[VariantCounters::PURGED] << " waiting for _postVariants");
+		long purgedKmers = this->_postVariants(counters);
 
 		LOG_DEBUG(1, "Purging to min depth: " << KmerSpectrumOptions::getOptions().getMinDepth());
 		this->purgeMinDepth(KmerSpectrumOptions::getOptions().getMinDepth());
@@ -2307,7 +2948,6 @@ public:
 		return purgedKmers;
 	}
 
-
 	bool extendContig(std::string &fasta, bool toRight, double minimumCoverage, double minimumConsensus, double maximumDeltaRatio, const KmerSpectrum *excludeSpectrum = NULL) const {
 
 		SequenceLengthType kmerSize = KmerSizer::getSequenceLength();
@@ -52,6 +52,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 
 #include <iomanip>
 #include <boost/shared_ptr.hpp>
+#include <boost/type_traits/is_base_of.hpp>
 
 #include "config.h"
 #include "Log.h"
@@ -999,6 +1000,15 @@ std::ostream &operator<<(std::ostream &stream, TrackingData &ob);
 std::ostream &operator<<(std::ostream &stream, TrackingDataSingleton &ob);
 std::ostream &operator<<(std::ostream &stream, TrackingDataWithAllReads &ob);
 
+// true if the tracking data keeps the read index and position of its kmers
+template<typename T>
+class TracksReads {
+public:
+	static const bool value = boost::is_base_of<TrackingDataWithLastRead, T>::value
+			|| boost::is_base_of<TrackingDataSingletonWithReadPosition, T>::value
+			|| boost::is_base_of<TrackingDataWithAllReads, T>::value;
+};
+
 class WeightedExtensionMessagePacket : public ExtensionMessagePacket {
 public:
 	typedef TrackingData::WeightType WeightType;
@@ -68,9 +68,13 @@ such enhancements or derivative works thereof, in binary and source code form.
 #define MPI_BUFFER_DEFAULT_SIZE (32 * 1024 * 1024)
 #define MPI_MIN_TRANSMIT_DEFAULT_SIZE 2048
 
+// how MPIAllToAllMessageBuffer exchanges its transmit buffers
+// TRANSPORT_SHM hands the buffer over within the process and requires a single rank
+enum MessageTransport { TRANSPORT_AUTO, TRANSPORT_MPI, TRANSPORT_SHM };
+
 class _MPIOptions : public OptionsBaseInterface {
 public:
-	_MPIOptions() : mpiBufferSize(MPI_BUFFER_DEFAULT_SIZE), mpiMinTransmitSize(MPI_MIN_TRANSMIT_DEFAULT_SIZE) {}
+	_MPIOptions() : mpiBufferSize(MPI_BUFFER_DEFAULT_SIZE), mpiMinTransmitSize(MPI_MIN_TRANSMIT_DEFAULT_SIZE), kmerBalanceSample(100), mpiIOStripeSize(0), checkpointReads(0), mpiTransport("auto") {}
 	virtual ~_MPIOptions() {}
 	int &getTotalBufferSize() {
 		return mpiBufferSize;
@@ -78,6 +82,33 @@ public:
 	int &getMinTransmitSize() {
 		return mpiMinTransmitSize;
 	}
+	int &getKmerBalanceSample() {
+		return kmerBalanceSample;
+	}
+	int &getMPIIOStripeSize() {
+		return mpiIOStripeSize;
+	}
+	long &getCheckpointReads() {
+		return checkpointReads;
+	}
+	std::string &getCheckpointPrefix() {
+		return checkpointPrefix;
+	}
+	std::string &getResumeFrom() {
+		return resumeFrom;
+	}
+	std::string &getMPITransport() {
+		return mpiTransport;
+	}
+	MessageTransport getTransport(int worldSize) {
+		if (mpiTransport == "mpi")
+			return TRANSPORT_MPI;
+		if (worldSize == 1)
+			return TRANSPORT_SHM;
+		if (mpiTransport == "shm")
+			LOG_DEBUG(1, "--mpi-transport shm requires a single rank, using mpi for " << worldSize << " ranks");
+		return TRANSPORT_MPI;
+	}
 	void _setOptions(po::options_description &desc, po::positional_options_description &p) {
 		po::options_description opts("MPI Options");
 		opts.add_options()
@@ -85,16 +116,42 @@ public:
 					("mpi-buffer-size", po::value<int>()->default_value(mpiBufferSize),
 							"total amount of RAM to devote to MPI message batching buffers in bytes")
 					("mpi-min-transmit-size", po::value<int>()->default_value(mpiMinTransmitSize), "the minimum inter rank-thread buffer size")
+					("kmer-balance-sample", po::value<int>()->default_value(kmerBalanceSample),
+							"sample 1 in this many reads to balance kmer spectrum ownership across ranks (0 assigns contiguous blocks)")
+					("mpi-io-stripe-size", po::value<int>()->default_value(mpiIOStripeSize),
+							"if set, the MPI-IO striping unit and collective buffer size in bytes for new files (0 uses the filesystem default)")
+					("checkpoint-reads", po::value<long>()->default_value(checkpointReads),
+							"checkpoint the distributed kmer spectrum build after every this many reads per rank (0 disables)")
+					("checkpoint-prefix", po::value<std::string>(),
+							"file prefix for kmer spectrum checkpoints (default is --output-file with '-checkpoint')")
+					("resume-from", po::value<std::string>(),
+							"resume the kmer spectrum build from the checkpoints with this prefix")
+					("mpi-transport", po::value<std::string>()->default_value(mpiTransport),
+							"message buffer transport: 'mpi', 'shm' (in-process handoff, single rank only) or 'auto' (shm when there is a single rank)")
 							;
 		desc.add(opts);
 	}
 	bool _parseOptions(po::variables_map &vm) {
 		setOpt("mpi-buffer-size", mpiBufferSize);
 		setOpt("mpi-min-transmit-size", mpiMinTransmitSize);
+		setOpt("kmer-balance-sample", kmerBalanceSample);
+		setOpt("mpi-io-stripe-size", mpiIOStripeSize);
+		setOpt("checkpoint-reads", checkpointReads);
+		setOpt("checkpoint-prefix", checkpointPrefix);
+		setOpt("resume-from", resumeFrom);
+		setOpt("mpi-transport", mpiTransport);
+		if (mpiIOStripeSize < 0)
+			setOptionsErrorMsg("--mpi-io-stripe-size must not be negative");
+		if (checkpointReads < 0)
+			setOptionsErrorMsg("--checkpoint-reads must not be negative");
+		if (mpiTransport != "auto" && mpiTransport != "mpi" && mpiTransport != "shm")
+			setOptionsErrorMsg("--mpi-transport must be one of auto, mpi or shm");
 		return true;
 	}
 protected:
-	int mpiBufferSize, mpiMinTransmitSize;
+	int mpiBufferSize, mpiMinTransmitSize, kmerBalanceSample, mpiIOStripeSize;
+	long checkpointReads;
+	std::string checkpointPrefix, resumeFrom, mpiTransport;
 };
 typedef OptionsBaseTemplate< _MPIOptions > MPIOptions;
 
@@ -585,15 +642,23 @@ public:
 			setAllStates(UNUSED);
 			finalCount = 0;
 		}
-		static void AllToAll(TransmitBuffer &out, TransmitBuffer &in, mpi::communicator &world) {
-			// mpi_alltoall
+		static void AllToAll(TransmitBuffer &out, TransmitBuffer &in, mpi::communicator &world, MessageTransport transport = TRANSPORT_MPI) {
 			assert(out.areAllInState(READY_OUT));
 			assert(in.areAllInState(EMPTY_IN));
 			in.setAllStates(BUILDING_IN);
-			MPI_Alltoallv(out.xmit + out.getHeaderSize(), &out.getSize(0),
-					&out.getOffset(0), MPI_BYTE, in.xmit
-					+ in.getHeaderSize(), &in.getSize(0),
-					&in.getOffset(0), MPI_BYTE, world);
+			if (transport == TRANSPORT_SHM) {
+				// a single rank sends only to itself and both buffers share one layout,
+				// so hand the out storage to in instead of copying it
+				assert(out.worldSize == 1 && in.worldSize == 1);
+				assert(out.totalSize == in.totalSize);
+				std::swap(out.xmit, in.xmit);
+			} else {
+				// mpi_alltoall
+				MPI_Alltoallv(out.xmit + out.getHeaderSize(), &out.getSize(0),
+						&out.getOffset(0), MPI_BYTE, in.xmit
+						+ in.getHeaderSize(), &in.getSize(0),
+						&in.getOffset(0), MPI_BYTE, world);
+			}
 
 			out.setAllStates(UNUSED);
 			in.setAllStates(READY_IN);
@@ -724,19 +789,23 @@ private:
 	std::vector<std::vector<std::vector<BuildBuffer> > > buildsTWT;
 	int numTags;
 	int threadsSending;
+	MessageTransport transport;
 
 public:
 
 	MPIAllToAllMessageBuffer(mpi::communicator &world, int messageSize,
 			MessageClassProcessor processor = MessageClassProcessor(),
-			int _numTags = 1, int totalBufferSize = MPIOptions::getOptions().getTotalBufferSize(), double softRatio = 0.90) :
+			int _numTags = 1, int totalBufferSize = MPIOptions::getOptions().getTotalBufferSize(), double softRatio = 0.90,
+			MessageTransport _transport = TRANSPORT_AUTO) :
 				BufferBase(world, messageSize, processor, totalBufferSize, softRatio),
-				numTags(_numTags), threadsSending(0) {
+				numTags(_numTags), threadsSending(0), transport(_transport) {
 		assert(!omp_in_parallel());
 		assert(omp_get_thread_num() == 0);
 		assert(numTags > 0);
 		int worldSize = this->getWorldSize();
 		int numThreads = this->getNumThreads();
+		if (transport == TRANSPORT_AUTO || (transport == TRANSPORT_SHM && worldSize != 1))
+			transport = MPIOptions::getOptions().getTransport(worldSize);
 
 		buildsTWT.resize(numThreads);
 		for (int threadId = 0; threadId < numThreads; threadId++) {
@@ -885,7 +954,7 @@ private:
 			LOG_DEBUG(4, "sendReceive(): Starting all2all on buffer: " << thisBuffer << " threadsSending: " << threadsSending);
 			waitTime = MPI_Wtime();
 			// mpi_alltoall
-			TransmitBuffer::AllToAll(out, in, this->getWorld());
+			TransmitBuffer::AllToAll(out, in, this->getWorld(), transport);
 			this->transit(MPI_Wtime() - waitTime);
 			this->newMessageDelivery();
 			LOG_DEBUG(4, "sendReceive(): Finished all2all on buffer: " << thisBuffer << " threadsSending: " << threadsSending);
@@ -897,6 +966,9 @@ public:
 	long sendReceive() {
 		return sendReceive(false);
 	}
+	MessageTransport getTransport() const {
+		return transport;
+	}
 
 	int getBytesInBuffer() const {
 		int offset = 0;
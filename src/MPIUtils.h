@@ -68,6 +68,7 @@ namespace mpi = boost::mpi;
 #include "Options.h"
 #include "Log.h"
 #include "Utils.h"
+#include "MPIBuffer.h"
 
 class DistributedDirectoryManagement {
 public:
@@ -120,7 +121,7 @@ public:
 	ScopedMPIFile(const MPI_Comm &_comm, std::string _ourFileName, int amode = MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_Info info = MPI_INFO_NULL)
 	: comm(_comm), ourFileName(_ourFileName) {
 		LOG_DEBUG_OPTIONAL(1, true, "Opening " << ourFileName << " MPI_File");
-		if (MPI_SUCCESS != MPI_File_open(comm, (char*) ourFileName.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &mpiFile))
+		if (MPI_SUCCESS != MPI_File_open(comm, (char*) ourFileName.c_str(), amode, info, &mpiFile))
 			LOG_THROW("ScopedMPIFile(," << ourFileName << "," << amode << ",): Could not open MPI_File: " << ourFileName);
 	}
 	~ScopedMPIFile() {
@@ -141,6 +142,81 @@ private:
 	MPI_File mpiFile;
 };
 
+/*
+ * MPICollectiveFile
+ *
+ * Each rank writes its own contiguous regions of a shared file with MPI_File_write_at_all, so the MPI-IO
+ * layer can aggregate them with collective buffering into large, stripe aligned writes
+ * (no rank temp files, mmaps of the shared file or msync)
+ */
+class MPICollectiveFile {
+public:
+	static const int64_t MAX_WRITE_SIZE = 0xf000000; // keep writes to less than max int size at a time to avoid MPI overflows
+
+	// collective
+	MPICollectiveFile(const MPI_Comm &_comm, std::string _ourFileName, MPI_Offset totalSize)
+	: comm(_comm), ourFileName(_ourFileName), info(createInfo()), mpiFile(comm, ourFileName, MPI_MODE_CREATE | MPI_MODE_WRONLY, info) {
+		if (MPI_SUCCESS != MPI_File_set_size(mpiFile, totalSize))
+			LOG_THROW("MPICollectiveFile(): Could not set the size for " << ourFileName << " to " << totalSize);
+	}
+	~MPICollectiveFile() {
+		MPI_Info_free(&info);
+	}
+
+	// collective. every rank must call it, with length 0 if it has nothing to write
+	void writeAtAll(MPI_Offset offset, const void *data, int64_t length) {
+		writeAtAll(comm, mpiFile, offset, data, length);
+	}
+
+	static void writeAtAll(const MPI_Comm &comm, MPI_File &ourFile, MPI_Offset offset, const void *data, int64_t length) {
+		const int64_t maxWrite = MAX_WRITE_SIZE;
+		int64_t myRounds = (length + maxWrite - 1) / maxWrite, ourRounds = 0;
+		if (MPI_SUCCESS != MPI_Allreduce(&myRounds, &ourRounds, 1, MPI_LONG_LONG_INT, MPI_MAX, comm))
+			LOG_THROW("MPICollectiveFile::writeAtAll(): MPI_Allreduce() failed");
+		const char *ptr = (const char *) data;
+		for(int64_t round = 0; round < ourRounds; round++) {
+			int64_t pos = std::min(round * maxWrite, length);
+			int count = std::min(maxWrite, length - pos);
+			MPI_Status status;
+			if (MPI_SUCCESS != MPI_File_write_at_all(ourFile, offset + pos, const_cast<char*>(ptr + pos), count, MPI_BYTE, &status))
+				LOG_THROW("MPICollectiveFile::writeAtAll(): MPI_File_write_at_all() failed");
+			int writeCount;
+			MPI_Get_count(&status, MPI_BYTE, &writeCount);
+			if (writeCount != count)
+				LOG_THROW("MPICollectiveFile::writeAtAll(): writeCount " << writeCount << " != count " << count);
+		}
+	}
+
+	// rounds offset up to the striping unit, if one is set
+	static MPI_Offset alignToStripe(MPI_Offset offset) {
+		MPI_Offset stripeSize = MPIOptions::getOptions().getMPIIOStripeSize();
+		if (stripeSize > 0 && offset % stripeSize != 0)
+			offset += stripeSize - (offset % stripeSize);
+		return offset;
+	}
+
+	static MPI_Info createInfo() {
+		MPI_Info info;
+		MPI_Info_create(&info);
+		MPI_Info_set(info, const_cast<char*>("romio_cb_write"), const_cast<char*>("enable"));
+		int stripeSize = MPIOptions::getOptions().getMPIIOStripeSize();
+		if (stripeSize > 0) {
+			std::string stripe = boost::lexical_cast<std::string>(stripeSize);
+			MPI_Info_set(info, const_cast<char*>("striping_unit"), const_cast<char*>(stripe.c_str()));
+			MPI_Info_set(info, const_cast<char*>("cb_buffer_size"), const_cast<char*>(stripe.c_str()));
+		}
+		return info;
+	}
+	operator MPI_File&() {
+		return mpiFile;
+	}
+
+private:
+	MPI_Comm comm;
+	std::string ourFileName;
+	MPI_Info info;
+	ScopedMPIFile mpiFile;
+};
 
 class MPIUtils {
 public:
@@ -231,17 +307,17 @@ public:
 		MPI_Offset totalWritten = 0;
 		int bufSize = 16 * 1024 * 1024; // 16 MB chunks
 		char *buf = (char*) calloc(bufSize, 1);
-		while(!data.eof() & !data.fail()) {
-			data.read(buf, bufSize);
-			int count = data.gcount();
-			MPI_Status status;
-			if (MPI_SUCCESS != MPI_File_write_at(ourFile, myOffset, buf, count, MPI_BYTE, &status))
-				LOG_THROW("MPI_File_write_at() failed");
-
-			int writeCount;
-			MPI_Get_count(&status, MPI_BYTE, &writeCount);
-			if (writeCount != count)
-				LOG_THROW("writeCount " << writeCount << " != count " << count);
+		// collective writes, so every rank makes the same number of (possibly empty) writes
+		int64_t myChunks = (myLength + bufSize - 1) / bufSize, ourChunks = 0;
+		if (MPI_SUCCESS != MPI_Allreduce(&myChunks, &ourChunks, 1, MPI_LONG_LONG_INT, MPI_MAX, comm))
+			LOG_THROW("MPI_Allreduce() failed");
+		for(int64_t chunk = 0; chunk < ourChunks; chunk++) {
+			int count = 0;
+			if (!data.eof() & !data.fail()) {
+				data.read(buf, bufSize);
+				count = data.gcount();
+			}
+			MPICollectiveFile::writeAtAll(comm, ourFile, myOffset, buf, count);
 			myOffset += count;
 			totalWritten += count;
 			LOG_DEBUG(3, "concatenateOutput(): wrote " << count);
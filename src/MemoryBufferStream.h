@@ -250,6 +250,9 @@ public:
 	template<typename U1, typename U2, typename U3>
 	stream_impl_template(U1 &u1, U2 &u2, U3 &u3) : _impl( new Impl(u1, u2, u3) ) {};
 
+	template<typename U1, typename U2, typename U3, typename U4>
+	stream_impl_template(U1 &u1, U2 &u2, U3 &u3, U4 &u4) : _impl( new Impl(u1, u2, u3, u4) ) {};
+
 	~stream_impl_template() {}
 	stream_impl_template &operator=(const stream_impl_template &copy) {
 		_impl = copy._impl;
@@ -0,0 +1,410 @@
+/*
+ * MinimizerMatch.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+/*****************
+
+Kmernator Copyright (c) 2012, The Regents of the University of California,
+through Lawrence Berkeley National Laboratory (subject to receipt of any
+required approvals from the U.S. Dept. of Energy).  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+(1) Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+(2) Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+(3) Neither the name of the University of California, Lawrence Berkeley
+National Laboratory, U.S. Dept. of Energy nor the names of its contributors may
+be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+You are under no obligation whatsoever to provide any bug fixes, patches, or
+upgrades to the features, functionality or performance of the source code
+("Enhancements") to anyone; however, if you choose to make your Enhancements
+available either publicly, or directly to Lawrence Berkeley National
+Laboratory, without imposing a separate written license agreement for such
+Enhancements, then you hereby grant the following license: a  non-exclusive,
+royalty-free perpetual license to install, use, modify, prepare derivative
+works, incorporate into other computer software, distribute, and sublicense
+such enhancements or derivative works thereof, in binary and source code form.
+
+*****************/
+
+#ifndef MINIMIZERMATCH_H_
+#define MINIMIZERMATCH_H_
+
+#include <vector>
+#include <algorithm>
+
+#include "ReadSet.h"
+#include "Options.h"
+#include "MatcherInterface.h"
+#include "KmerMatch.h"
+#include "MemoryUtils.h"
+
+class _MinimizerMatchOptions  : public OptionsBaseInterface {
+public:
+	_MinimizerMatchOptions() : minimizerWindow(0), minimizerKmerSize(0) {}
+	~_MinimizerMatchOptions() {}
+	int &getMinimizerWindow() {
+		return minimizerWindow;
+	}
+	int &getMinimizerKmerSize() {
+		return minimizerKmerSize;
+	}
+	void _resetDefaults() {
+	}
+	void _setOptions(po::options_description &desc, po::positional_options_description &p) {
+		po::options_description opts("Minimizer-Match Options");
+		opts.add_options()
+
+				("minimizer-window", po::value<int>()->default_value(minimizerWindow), "if >0 then match with an index of only the minimum kmer within every window of this many kmers, instead of the full kmer-match spectrum")
+
+				("minimizer-kmer-size", po::value<int>()->default_value(minimizerKmerSize), "the kmer size of the minimizers (at most 31). '0' uses --kmer-size")
+
+				;
+		desc.add(opts);
+
+	}
+	bool _parseOptions(po::variables_map &vm) {
+		bool ret = true;
+		setOpt("minimizer-window", minimizerWindow);
+		setOpt("minimizer-kmer-size", minimizerKmerSize);
+		if (minimizerKmerSize > 31) {
+			LOG_ERROR(1, "--minimizer-kmer-size can not exceed 31");
+			ret = false;
+		}
+		return ret;
+	}
+protected:
+	int minimizerWindow;
+	int minimizerKmerSize;
+};
+typedef OptionsBaseTemplate< _MinimizerMatchOptions > MinimizerMatchOptions;
+
+// A MatcherInterface backed by a sampled (window, kmer) minimizer index.
+// Each rank holds the posting lists for the minimizers it owns (by hash), as delta-encoded
+// global read ids, so the index costs a couple of bytes per sampled kmer instead of
+// a full spectrum entry with every read position of every kmer (as in KmerMatch).
+// Any exact overlap of at least window + kmerSize - 1 bases shares a minimizer.
+class MinimizerMatch : public MatcherInterface {
+public:
+	typedef MatcherInterface::MatchResults MatchResults;
+	typedef ReadSet::ReadSetSizeType ReadSetSizeType;
+
+	static const ReadSetSizeType BUILD_BATCH_READS = 262144;
+	static const long QUERY_BATCH_SIZE = 1024;
+
+	class Minimizer {
+	public:
+		uint64_t hash;
+		SequenceLengthType position;
+		Minimizer(uint64_t _hash = 0, SequenceLengthType _position = 0) : hash(_hash), position(_position) {}
+	};
+	typedef std::vector< Minimizer > Minimizers;
+
+	class Posting {
+	public:
+		uint64_t minimizer;
+		ReadSetSizeType readIdx;
+		Posting(uint64_t _minimizer = 0, ReadSetSizeType _readIdx = 0) : minimizer(_minimizer), readIdx(_readIdx) {}
+		bool operator<(const Posting &other) const {
+			return minimizer < other.minimizer || (minimizer == other.minimizer && readIdx < other.readIdx);
+		}
+		bool operator==(const Posting &other) const {
+			return minimizer == other.minimizer && readIdx == other.readIdx;
+		}
+	};
+	typedef std::vector< Posting > Postings;
+
+	MinimizerMatch(mpi::communicator &world, const ReadSet &target, int minDepth = KmerSpectrumOptions::getOptions().getMinDepth())
+	: MatcherInterface(world, target), _kmerSize(getDefaultKmerSize()), _window(std::max(1, MinimizerMatchOptions::getOptions().getMinimizerWindow())) {
+		assert(target.isGlobal());
+		_buildIndex(minDepth);
+	}
+	virtual ~MinimizerMatch() {}
+
+	MatchResults matchLocalImpl(std::string queryFile) {
+		ReadSetStream query(queryFile);
+		return _matchLocal(query);
+	}
+
+	static int getDefaultKmerSize() {
+		int kmerSize = MinimizerMatchOptions::getOptions().getMinimizerKmerSize();
+		if (kmerSize <= 0)
+			kmerSize = KmerBaseOptions::getOptions().getKmerSize();
+		return std::max(1, std::min(31, kmerSize));
+	}
+
+	// an invertible 64-bit mix, so distinct kmers never share a minimizer
+	static inline uint64_t mixHash(uint64_t key) {
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		key ^= key >> 33;
+		return key;
+	}
+
+	// appends the (strand independent) minimizers of fasta, in order of position
+	// runs of valid bases shorter than a full window contribute their single minimum
+	static void getMinimizers(const std::string &fasta, int kmerSize, int window, Minimizers &minimizers) {
+		minimizers.clear();
+		uint64_t mask = (((uint64_t) 1) << (2 * kmerSize)) - 1;
+		int shift = 2 * (kmerSize - 1);
+		uint64_t fwd = 0, rev = 0;
+		int valid = 0;
+		Minimizers run;
+		for(SequenceLengthType pos = 0; pos < fasta.length(); pos++) {
+			uint64_t base;
+			switch(fasta[pos]) {
+			case 'A': base = 0; break;
+			case 'C': base = 1; break;
+			case 'G': base = 2; break;
+			case 'T': base = 3; break;
+			default:
+				_addWindowMinimums(run, window, minimizers);
+				valid = 0;
+				continue;
+			}
+			fwd = ((fwd << 2) | base) & mask;
+			rev = (rev >> 2) | ((3 - base) << shift);
+			if (++valid >= kmerSize)
+				run.push_back(Minimizer(mixHash(std::min(fwd, rev)), pos + 1 - kmerSize));
+		}
+		_addWindowMinimums(run, window, minimizers);
+	}
+
+	int getOwner(uint64_t minimizer) const {
+		return minimizer % _world.size();
+	}
+	unsigned long getIndexBytes() const {
+		return _keys.capacity() * sizeof(uint64_t) + _offsets.capacity() * sizeof(uint64_t) + _postings.capacity();
+	}
+	unsigned long getNumMinimizers() const {
+		return _keys.size();
+	}
+
+	// adds every read posted under minimizer to the hits
+	void addPostings(uint64_t minimizer, MatchHitSet &hits) const {
+		std::vector< uint64_t >::const_iterator it = std::lower_bound(_keys.begin(), _keys.end(), minimizer);
+		if (it == _keys.end() || *it != minimizer)
+			return;
+		long idx = it - _keys.begin();
+		const unsigned char *ptr = &_postings[0] + _offsets[idx], *end = &_postings[0] + _offsets[idx+1];
+		ReadSetSizeType readIdx = 0;
+		while (ptr != end) {
+			readIdx += _decode(ptr);
+			hits.insert(readIdx);
+		}
+	}
+
+protected:
+
+	static void _addWindowMinimums(Minimizers &run, int window, Minimizers &minimizers) {
+		long numKmers = run.size();
+		if (numKmers > 0) {
+			long width = std::min((long) window, numKmers);
+			for(long start = 0; start + width <= numKmers; start++) {
+				long best = start;
+				for(long i = start + 1; i < start + width; i++)
+					if (run[i].hash < run[best].hash)
+						best = i;
+				if (minimizers.empty() || minimizers.back().position != run[best].position)
+					minimizers.push_back(run[best]);
+			}
+		}
+		run.clear();
+	}
+
+	static void _encode(std::vector< unsigned char > &bytes, uint64_t value) {
+		while (value >= 0x80) {
+			bytes.push_back((unsigned char) (value | 0x80));
+			value >>= 7;
+		}
+		bytes.push_back((unsigned char) value);
+	}
+	static uint64_t _decode(const unsigned char *&ptr) {
+		uint64_t value = 0;
+		int shift = 0;
+		while (*ptr & 0x80) {
+			value |= ((uint64_t) (*ptr++ & 0x7f)) << shift;
+			shift += 7;
+		}
+		value |= ((uint64_t) *ptr++) << shift;
+		return value;
+	}
+
+	// each rank sends (minimizer, globalReadIdx) postings to the owner of the minimizer
+	// in rounds of BUILD_BATCH_READS local reads, then compresses what it owns
+	void _buildIndex(int minDepth) {
+		const ReadSet &target = getTarget();
+		int numRanks = _world.size();
+		int numThreads = omp_get_max_threads();
+		ReadSetSizeType localSize = target.getSize(), batchReads = BUILD_BATCH_READS;
+		long myRounds = (localSize + batchReads - 1) / batchReads;
+		long numRounds = mpi::all_reduce(_world, myRounds, mpi::maximum<long>());
+
+		Postings postings;
+		for(long round = 0; round < numRounds; round++) {
+			ReadSetSizeType begin = std::min(localSize, round * batchReads), end = std::min(localSize, begin + batchReads);
+			std::vector< std::vector< Postings > > threadPostings(numThreads, std::vector< Postings >(numRanks));
+
+			#pragma omp parallel
+			{
+				Minimizers minimizers;
+				std::vector< Postings > &myPostings = threadPostings[omp_get_thread_num()];
+				#pragma omp for schedule(dynamic, 1024)
+				for(long i = begin; i < (long) end; i++) {
+					getMinimizers(target.getRead(i).getFasta(), _kmerSize, _window, minimizers);
+					ReadSetSizeType globalReadIdx = target.getGlobalReadIdx(i);
+					for(Minimizers::iterator it = minimizers.begin(); it != minimizers.end(); it++)
+						myPostings[getOwner(it->hash)].push_back(Posting(it->hash, globalReadIdx));
+				}
+			}
+
+			std::vector< int > sendBytes(numRanks, 0), recvBytes(numRanks, 0), sendDispl(numRanks, 0), recvDispl(numRanks, 0);
+			Postings sendBuf;
+			for(int rank = 0; rank < numRanks; rank++) {
+				sendDispl[rank] = sendBuf.size() * sizeof(Posting);
+				for(int t = 0; t < numThreads; t++) {
+					sendBuf.insert(sendBuf.end(), threadPostings[t][rank].begin(), threadPostings[t][rank].end());
+					Postings().swap(threadPostings[t][rank]);
+				}
+				sendBytes[rank] = sendBuf.size() * sizeof(Posting) - sendDispl[rank];
+			}
+			MPI_Alltoall(&sendBytes[0], 1, MPI_INT, &recvBytes[0], 1, MPI_INT, _world);
+			long totalRecv = 0;
+			for(int rank = 0; rank < numRanks; rank++) {
+				recvDispl[rank] = totalRecv;
+				totalRecv += recvBytes[rank];
+			}
+			long oldSize = postings.size();
+			postings.resize(oldSize + totalRecv / sizeof(Posting));
+			if (MPI_SUCCESS != MPI_Alltoallv(sendBuf.empty() ? NULL : &sendBuf[0], &sendBytes[0], &sendDispl[0], MPI_BYTE,
+					postings.empty() ? NULL : &postings[0] + oldSize, &recvBytes[0], &recvDispl[0], MPI_BYTE, _world))
+				LOG_THROW("MinimizerMatch::_buildIndex(): MPI_Alltoallv() failed");
+			LOG_DEBUG_OPTIONAL(2, true, "MinimizerMatch::_buildIndex(): round " << round << " received " << totalRecv / sizeof(Posting) << " postings");
+		}
+
+		std::sort(postings.begin(), postings.end());
+		postings.erase(std::unique(postings.begin(), postings.end()), postings.end());
+		_compress(postings, minDepth);
+		recordTime("buildIndex", MPI_Wtime());
+
+		unsigned long totalMinimizers = mpi::all_reduce(_world, getNumMinimizers(), std::plus<unsigned long>());
+		unsigned long totalBytes = mpi::all_reduce(_world, getIndexBytes(), std::plus<unsigned long>());
+		LOG_VERBOSE_OPTIONAL(1, _world.rank() == 0, "MinimizerMatch: indexed " << totalMinimizers << " minimizers (k=" << _kmerSize << ", w=" << _window << ") in " << totalBytes << " bytes");
+		LOG_DEBUG_GATHER(1, "MinimizerMatch::_buildIndex(): " << getNumMinimizers() << " local minimizers in " << getIndexBytes() << " bytes. " << MemoryUtils::getMemoryUsage());
+	}
+
+	// sorted, unique postings become a sorted key array, byte offsets and varint delta-encoded read ids
+	// minimizers seen in fewer than minDepth reads are dropped
+	void _compress(Postings &postings, int minDepth) {
+		_keys.clear();
+		_offsets.clear();
+		_postings.clear();
+		Postings::const_iterator it = postings.begin();
+		while (it != postings.end()) {
+			Postings::const_iterator groupEnd = it;
+			while (groupEnd != postings.end() && groupEnd->minimizer == it->minimizer)
+				groupEnd++;
+			if (groupEnd - it >= minDepth) {
+				_keys.push_back(it->minimizer);
+				_offsets.push_back(_postings.size());
+				ReadSetSizeType lastReadIdx = 0;
+				for( ; it != groupEnd; it++) {
+					_encode(_postings, it->readIdx - lastReadIdx);
+					lastReadIdx = it->readIdx;
+				}
+			}
+			it = groupEnd;
+		}
+		_offsets.push_back(_postings.size());
+		Postings().swap(postings);
+		std::vector< uint64_t >(_keys).swap(_keys);
+		std::vector< uint64_t >(_offsets).swap(_offsets);
+		std::vector< unsigned char >(_postings).swap(_postings);
+	}
+
+	// works on the full copy of the query set, in batches of QUERY_BATCH_SIZE queries over the threads
+	MatchResults _matchLocal(ReadSetStream &query) {
+		MatchResults matchResults;
+		int myRank = _world.rank();
+		long maxPositionsFromEdge = KmerMatchOptions::getOptions().getMatchMaxPositionsFromEdge();
+		float maxHits = 2 * MatcherInterfaceOptions::getOptions().getMaxReadMatches();
+		long totalMatches = 0, maxMatch = 0;
+
+		std::vector< Read > batch;
+		bool hasNext = query.hasNext(); // advances the stream
+		while (hasNext) {
+			batch.clear();
+			do {
+				batch.push_back(query.getRead());
+				hasNext = query.hasNext();
+			} while (hasNext && (long) batch.size() < QUERY_BATCH_SIZE);
+			long first = matchResults.size(), batchSize = batch.size();
+			matchResults.resize(first + batchSize);
+			std::vector< long > sizes(batchSize, 0);
+
+			#pragma omp parallel
+			{
+				Minimizers minimizers;
+				#pragma omp for schedule(dynamic)
+				for(long i = 0; i < batchSize; i++) {
+					const Read &read = batch[i];
+					long len = read.getLength();
+					getMinimizers(read.getFasta(), _kmerSize, _window, minimizers);
+					MatchHitSet hits;
+					for(Minimizers::iterator it = minimizers.begin(); it != minimizers.end(); it++) {
+						if (getOwner(it->hash) != myRank)
+							continue;
+						if (maxPositionsFromEdge > 0 && (long) it->position + _kmerSize > maxPositionsFromEdge && (long) it->position < len - maxPositionsFromEdge) {
+							LOG_DEBUG(5, "Skipping match to middle of " << first + i << " len:" << len << " minimizer:" << it->position);
+							continue;
+						}
+						addPostings(it->hash, hits);
+					}
+					sizes[i] = hits.size();
+					if (sizes[i] > maxHits)
+						matchResults[first + i] = sampleMatches(hits, maxHits / (float) sizes[i]);
+					else
+						matchResults[first + i].swap(hits);
+				}
+			}
+			for(long i = 0; i < batchSize; i++) {
+				totalMatches += sizes[i];
+				maxMatch = std::max(maxMatch, sizes[i]);
+				LOG_DEBUG(2, "MinimizerMatch::_matchLocal(): processed contig " << first + i << " with " << sizes[i] << " subsample: " << matchResults[first + i].size());
+			}
+		}
+		LOG_DEBUG(1, "MinimizerMatch::_matchLocal(): processed " << matchResults.size() << " contigs total: " << totalMatches << " max: " << maxMatch << ". " << MemoryUtils::getMemoryUsage());
+		recordTime("matchLocal", MPI_Wtime());
+		return matchResults;
+	}
+
+private:
+	int _kmerSize, _window;
+	std::vector< uint64_t > _keys;
+	std::vector< uint64_t > _offsets;
+	std::vector< unsigned char > _postings;
+};
+
+#endif /* MINIMIZERMATCH_H_ */
@@ -122,13 +122,21 @@ public:
 	virtual ~Newbler() {
 	}
 	Read extendContig(const Read &oldContig, const ReadSet &inputReads) {
+		bool inWorker = ExternalAssemblerWorkerPool::getInstance() != NULL;
 
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
 		std::string prefix = "/.newbler-assembly";
-		std::string outputDir = Cleanup::makeTempDir(Options::getOptions().getTmpDir(), prefix);
-		LOG_VERBOSE_OPTIONAL(1, !GeneralOptions::getOptions().getKeepTempDir().empty(), "Saving Newbler working directory for " << oldContig.getName()
-				<< " to " << GeneralOptions::getOptions().getKeepTempDir() << outputDir.substr(outputDir.find(prefix)));
+		std::string outputDir = ".";
+		if (!inWorker) {
+			outputDir = Cleanup::makeTempDir(Options::getOptions().getTmpDir(), prefix);
+			LOG_VERBOSE_OPTIONAL(1, !GeneralOptions::getOptions().getKeepTempDir().empty(), "Saving Newbler working directory for " << oldContig.getName()
+					<< " to " << GeneralOptions::getOptions().getKeepTempDir() << outputDir.substr(outputDir.find(prefix)));
+		}
 		std::string baseName = outputDir + "/input.fasta";
-		writeReads(inputReads, oldContig, baseName, FormatOutput::FastaUnmasked());
+		if (!inWorker) {
+			writeReads(inputReads, oldContig, baseName, FormatOutput::FastaUnmasked());
+			lastTimes.write = lapSeconds(start);
+		}
 		std::string log = baseName + ".log";
 		// TODO support CDNA & isotigs
 		// -cdna -isplit //isotig traversal when depth spikes
@@ -155,6 +163,13 @@ public:
 		cmd += " " + baseName + " > " + log + " 2>&1";
 		LOG_DEBUG_OPTIONAL(1, true, "Executing newbler for " << oldContig.getName() << "(" << inputReads.getSize() << " read pool): " << cmd);
 
+		if (inWorker) {
+			Read bestRead = executeAssemblyInWorker(cmd, "input.fasta", newContigFile, log, inputReads, oldContig);
+			if (bestRead.empty())
+				LOG_WARN(1, "Could not assemble contig: '" << oldContig.getName() << "' with pool of " << inputReads.getSize() << " reads");
+			return bestRead;
+		}
+
 		Read bestRead = executeAssembly(cmd, newContigFile, oldContig);
 
 		if (bestRead.empty())
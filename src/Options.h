@@ -288,7 +288,7 @@ class NullClass {};
 class NullOptions : public OptionsBaseTemplate< NullClass > {
 public:
 	// override default method so as not to need NullClass interface methods _parseOptions, _resetDefaults...
-	static bool parseOpts(int argc, char *argv[]) { return false; }
+	static bool parseOpts(int argc, char *argv[]) { return true; }
 };
 
 /* Example copy-paste template */
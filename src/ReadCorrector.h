@@ -0,0 +1,404 @@
+/*
+ * ReadCorrector.h
+ *
+ */
+/*****************
+
+Kmernator Copyright (c) 2012, The Regents of the University of California,
+through Lawrence Berkeley National Laboratory (subject to receipt of any
+required approvals from the U.S. Dept. of Energy).  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+(1) Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+(2) Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+(3) Neither the name of the University of California, Lawrence Berkeley
+National Laboratory, U.S. Dept. of Energy nor the names of its contributors may
+be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+You are under no obligation whatsoever to provide any bug fixes, patches, or
+upgrades to the features, functionality or performance of the source code
+("Enhancements") to anyone; however, if you choose to make your Enhancements
+available either publicly, or directly to Lawrence Berkeley National
+Laboratory, without imposing a separate written license agreement for such
+Enhancements, then you hereby grant the following license: a  non-exclusive,
+royalty-free perpetual license to install, use, modify, prepare derivative
+works, incorporate into other computer software, distribute, and sublicense
+such enhancements or derivative works thereof, in binary and source code form.
+
+*****************/
+
+#ifndef READCORRECTOR_H_
+#define READCORRECTOR_H_
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "config.h"
+#include "Options.h"
+#include "Sequence.h"
+#include "ReadSet.h"
+#include "Kmer.h"
+#include "KmerSpectrum.h"
+#include "Log.h"
+
+class _ReadCorrectorOptions : public OptionsBaseInterface {
+public:
+	_ReadCorrectorOptions() : correctReads(false), correctMaxEdits(4) {}
+	virtual ~_ReadCorrectorOptions() {}
+
+	bool &getCorrectReads() {
+		return correctReads;
+	}
+	unsigned int &getCorrectMaxEdits() {
+		return correctMaxEdits;
+	}
+
+	void _resetDefaults() {
+		KmerSpectrumOptions::_resetDefaults();
+	}
+	void _setOptions(po::options_description &desc, po::positional_options_description &p) {
+		// This class does not support non-default options for KmerSpectrumOptions
+		po::options_description opts("Read Error Correction Options");
+		opts.add_options()
+
+				("correct-reads", po::value<bool>()->default_value(correctReads), "if set, single base substitution errors are corrected in the reads before they are trimmed, when exactly one substitution makes all the kmers covering the base solid (at least min-depth)")
+
+				("correct-max-edits", po::value<unsigned int>()->default_value(correctMaxEdits), "the maximum number of bases that will be corrected in a single read");
+
+		desc.add(opts);
+	}
+	bool _parseOptions(po::variables_map &vm) {
+		bool ret = true;
+		setOpt("correct-reads", getCorrectReads());
+		setOpt("correct-max-edits", getCorrectMaxEdits());
+		if (getCorrectReads() && KmerSpectrumOptions::getOptions().getMinDepth() < 2 && Logger::isMaster())
+			LOG_WARN(1, "--correct-reads needs a --min-depth of at least 2 to distinguish solid from weak kmers");
+		return ret;
+	}
+protected:
+	bool correctReads;
+	unsigned int correctMaxEdits;
+};
+typedef OptionsBaseTemplate< _ReadCorrectorOptions > ReadCorrectorOptions;
+
+// Spectrum based correction of single base substitution errors.
+// Reads are corrected in batches and in rounds.  The first round looks up every kmer of the batch to find
+// the runs of weak (below minSolidDepth) kmers.  Each following round proposes the substitutions at the base
+// just past the solid kmers flanking each run, looks up all of the kmers covering those bases in one batch,
+// and applies a substitution only when exactly one alternate base makes all of its covering kmers solid.
+// Kmer lookups go through _lookupKmers(), so a distributed spectrum can answer each round with one exchange
+template<typename Map>
+class ReadCorrector {
+public:
+	typedef Map KMType;
+	typedef typename KMType::ElementType ElementType;
+	typedef ReadSet::ReadSetSizeType ReadSetSizeType;
+	typedef Sequence::SequenceLengthType SequenceLengthType;
+	typedef KmerArrayPair<char> KA;
+	typedef double ScoreType;
+	typedef std::vector< ScoreType > KmerValueVector;
+	typedef std::vector< ReadSetSizeType > OffsetVector;
+
+	class ReadState {
+	public:
+		ReadSetSizeType readIdx;
+		std::string fasta;
+		SequenceLengthType length; // bases before the first N or X
+		std::vector<bool> isSolid;
+		unsigned int edits;
+		bool isDone;
+		ReadState(ReadSetSizeType _readIdx = 0) : readIdx(_readIdx), fasta(), length(0), isSolid(), edits(0), isDone(false) {}
+		SequenceLengthType getNumKmers() const {
+			return length >= KmerSizer::getSequenceLength() ? length - KmerSizer::getSequenceLength() + 1 : 0;
+		}
+	};
+	typedef std::vector< ReadState > ReadStateVector;
+
+	// one alternate base at one position of one read, and the kmers that cover it
+	class Candidate {
+	public:
+		ReadSetSizeType stateIdx;
+		SequenceLengthType position, firstKmer, numKmers;
+		char base;
+		ReadSetSizeType kmerOffset;
+		Candidate() : stateIdx(0), position(0), firstKmer(0), numKmers(0), base('N'), kmerOffset(0) {}
+		Candidate(ReadSetSizeType _stateIdx, SequenceLengthType _position, SequenceLengthType _firstKmer, SequenceLengthType _numKmers, char _base)
+		: stateIdx(_stateIdx), position(_position), firstKmer(_firstKmer), numKmers(_numKmers), base(_base), kmerOffset(0) {}
+	};
+	typedef std::vector< Candidate > CandidateVector;
+
+protected:
+	ReadSet &_reads;
+	const KMType &_map;
+	ScoreType _minSolidDepth;
+	unsigned long _correctedReads, _correctedBases;
+
+public:
+	ReadCorrector(ReadSet &reads, const KMType &map, ScoreType minSolidDepth = KmerSpectrumOptions::getOptions().getMinDepth())
+	: _reads(reads), _map(map), _minSolidDepth(minSolidDepth), _correctedReads(0), _correctedBases(0) {
+	}
+	virtual ~ReadCorrector() {}
+
+	unsigned long getCorrectedReads() const {
+		return _correctedReads;
+	}
+	unsigned long getCorrectedBases() const {
+		return _correctedBases;
+	}
+
+	// returns the number of (local) reads that were changed
+	unsigned long correctReads(unsigned int maxEdits = ReadCorrectorOptions::getOptions().getCorrectMaxEdits()) {
+		ReadSetSizeType readsSize = _reads.getSize();
+		ReadSetSizeType batchSize = Options::getOptions().getBatchSize();
+		ReadSetSizeType mostReads = _getMostReads(readsSize);
+		LOG_VERBOSE(2, "ReadCorrector::correctReads(): " << readsSize << " reads with solid depth " << _minSolidDepth << " and up to " << maxEdits << " edits per read");
+
+		for(ReadSetSizeType batchStart = 0; batchStart < mostReads; batchStart += batchSize) {
+			ReadSetSizeType batchEnd = std::min(readsSize, batchStart + batchSize);
+			_correctBatch(batchStart, std::max(batchStart, batchEnd), maxEdits);
+			LOG_DEBUG(2, "ReadCorrector::correctReads(): corrected " << _correctedBases << " bases in " << _correctedReads << " reads after " << std::min(readsSize, batchStart + batchSize));
+		}
+		LOG_VERBOSE(1, "Corrected " << _correctedBases << " bases in " << _correctedReads << " reads");
+		return _correctedReads;
+	}
+
+	inline ScoreType getValue(const Kmer &kmer) const {
+		const ElementType elem = _map.getElementIfExists(kmer);
+		if (elem.isValid()) {
+			return elem.value().getCount();
+		} else {
+			return ScoreType(0);
+		}
+	}
+
+protected:
+	// looks up the count of every kmer.  Collective for a distributed spectrum
+	virtual void _lookupKmers(const KA &kmers, KmerValueVector &values) {
+		values.resize(kmers.size());
+		#pragma omp parallel for
+		for(long i = 0; i < (long) kmers.size(); i++)
+			values[i] = getValue(kmers[i]);
+	}
+	// the largest number of reads on any rank, so every rank runs the same number of batches
+	virtual ReadSetSizeType _getMostReads(ReadSetSizeType readsSize) {
+		return readsSize;
+	}
+	// the number of candidates on all ranks, so every rank runs the same number of rounds
+	virtual unsigned long _getAllCandidates(unsigned long candidates) {
+		return candidates;
+	}
+
+	void _correctBatch(ReadSetSizeType batchStart, ReadSetSizeType batchEnd, unsigned int maxEdits) {
+		SequenceLengthType kmerSize = KmerSizer::getSequenceLength();
+		ReadStateVector states;
+		states.reserve(batchEnd - batchStart);
+		for(ReadSetSizeType readIdx = batchStart; readIdx < batchEnd; readIdx++) {
+			const Read &read = _reads.getRead(readIdx);
+			if (read.isDiscarded() || read.getLength() < kmerSize)
+				continue;
+			states.push_back(ReadState(readIdx));
+		}
+
+		// the first round finds the weak kmers of every read
+		OffsetVector offsets(states.size() + 1, 0);
+		for(ReadSetSizeType i = 0; i < states.size(); i++) {
+			ReadState &state = states[i];
+			const Read &read = _reads.getRead(state.readIdx);
+			SequenceLengthType markupLength = TwoBitSequence::firstMarkupNorX(read.getMarkups());
+			state.length = markupLength == 0 ? read.getLength() : markupLength - 1;
+			offsets[i+1] = offsets[i] + state.getNumKmers();
+		}
+		KA kmers(offsets.back());
+		KmerValueVector values;
+		std::vector< KA > threadKmers(omp_get_max_threads(), KA());
+		#pragma omp parallel for schedule(guided)
+		for(long i = 0; i < (long) states.size(); i++) {
+			ReadState &state = states[i];
+			const Read &read = _reads.getRead(state.readIdx);
+			state.fasta = read.getFasta();
+			if (state.getNumKmers() == 0) {
+				state.isDone = true;
+				continue;
+			}
+			KA &readKmers = threadKmers[omp_get_thread_num()];
+			readKmers.build(read.getTwoBitSequence(), state.length, true);
+			assert(readKmers.size() == offsets[i+1] - offsets[i]);
+			for(SequenceLengthType j = 0; j < readKmers.size(); j++)
+				kmers[offsets[i] + j].set(readKmers[j]);
+		}
+		_lookupKmers(kmers, values);
+		for(ReadSetSizeType i = 0; i < states.size(); i++) {
+			ReadState &state = states[i];
+			state.isSolid.resize(state.getNumKmers());
+			bool hasSolid = false, hasWeak = false;
+			for(SequenceLengthType j = 0; j < state.isSolid.size(); j++) {
+				state.isSolid[j] = values[offsets[i] + j] >= _minSolidDepth;
+				if (state.isSolid[j])
+					hasSolid = true;
+				else
+					hasWeak = true;
+			}
+			// nothing to correct, or no solid kmer to anchor a correction
+			if (!(hasSolid && hasWeak))
+				state.isDone = true;
+		}
+
+		CandidateVector candidates;
+		for(unsigned int round = 0; round < maxEdits; round++) {
+			candidates.clear();
+			for(ReadSetSizeType i = 0; i < states.size(); i++) {
+				ReadState &state = states[i];
+				if (state.isDone || state.edits >= maxEdits)
+					continue;
+				_addCandidates(i, state, candidates);
+				if (candidates.empty() || candidates.back().stateIdx != i)
+					state.isDone = true;
+			}
+			if (_getAllCandidates(candidates.size()) == 0)
+				break;
+
+			ReadSetSizeType numKmers = 0;
+			for(typename CandidateVector::iterator it = candidates.begin(); it != candidates.end(); it++) {
+				it->kmerOffset = numKmers;
+				numKmers += it->numKmers;
+			}
+			kmers.resize(numKmers);
+			#pragma omp parallel for schedule(guided)
+			for(long c = 0; c < (long) candidates.size(); c++) {
+				const Candidate &candidate = candidates[c];
+				std::string window = states[candidate.stateIdx].fasta.substr(candidate.firstKmer, candidate.numKmers + kmerSize - 1);
+				window[candidate.position - candidate.firstKmer] = candidate.base;
+				for(SequenceLengthType j = 0; j < candidate.numKmers; j++)
+					kmers[candidate.kmerOffset + j].set(window.substr(j, kmerSize), true);
+			}
+			_lookupKmers(kmers, values);
+
+			_applyCandidates(states, candidates, values, maxEdits);
+		}
+
+		unsigned long correctedReads = 0, correctedBases = 0;
+		#pragma omp parallel for schedule(guided) reduction(+:correctedReads, correctedBases)
+		for(long i = 0; i < (long) states.size(); i++) {
+			ReadState &state = states[i];
+			if (state.edits == 0)
+				continue;
+			Read &read = _reads.getRead(state.readIdx);
+			LOG_DEBUG(4, "ReadCorrector: corrected " << state.edits << " bases in " << read.getName() << ": " << read.getFasta() << " to " << state.fasta);
+			std::string name = read.getName(), quals = read.getQuals(), comment = read.getComment();
+			read.setRead(name, state.fasta, quals, comment);
+			correctedReads++;
+			correctedBases += state.edits;
+		}
+		_correctedReads += correctedReads;
+		_correctedBases += correctedBases;
+	}
+
+	// proposes every alternate base at the base just past each solid kmer that flanks a weak run
+	void _addCandidates(ReadSetSizeType stateIdx, const ReadState &state, CandidateVector &candidates) {
+		static const char bases[] = {'A', 'C', 'G', 'T'};
+		SequenceLengthType kmerSize = KmerSizer::getSequenceLength();
+		SequenceLengthType numKmers = state.isSolid.size();
+		SequenceLengthType start = 0;
+		while (start < numKmers) {
+			if (state.isSolid[start]) {
+				start++;
+				continue;
+			}
+			SequenceLengthType end = start;
+			while (end + 1 < numKmers && !state.isSolid[end + 1])
+				end++;
+
+			SequenceLengthType positions[2];
+			int numPositions = 0;
+			if (start > 0)
+				positions[numPositions++] = start + kmerSize - 1; // first base not covered by the solid kmer to the left
+			if (end + 1 < numKmers && (numPositions == 0 || positions[0] != end))
+				positions[numPositions++] = end; // last base not covered by the solid kmer to the right
+
+			for(int p = 0; p < numPositions; p++) {
+				SequenceLengthType position = positions[p];
+				SequenceLengthType firstKmer = position >= kmerSize ? position - kmerSize + 1 : 0;
+				SequenceLengthType lastKmer = std::min(position, numKmers - 1);
+				for(int b = 0; b < 4; b++) {
+					if (bases[b] == state.fasta[position])
+						continue;
+					candidates.push_back(Candidate(stateIdx, position, firstKmer, lastKmer - firstKmer + 1, bases[b]));
+				}
+			}
+			start = end + 1;
+		}
+	}
+
+	// applies the unambiguous substitutions, at most one per overlapping window of kmers per round
+	void _applyCandidates(ReadStateVector &states, const CandidateVector &candidates, const KmerValueVector &values, unsigned int maxEdits) {
+		ReadSetSizeType begin = 0;
+		while (begin < candidates.size()) {
+			ReadSetSizeType stateIdx = candidates[begin].stateIdx;
+			ReadSetSizeType end = begin;
+			while (end < candidates.size() && candidates[end].stateIdx == stateIdx)
+				end++;
+
+			ReadState &state = states[stateIdx];
+			bool changed = false;
+			std::vector< std::pair<SequenceLengthType, SequenceLengthType> > appliedKmers;
+			ReadSetSizeType posBegin = begin;
+			while (posBegin < end) {
+				SequenceLengthType position = candidates[posBegin].position;
+				ReadSetSizeType posEnd = posBegin;
+				const Candidate *solidCandidate = NULL;
+				int numSolid = 0;
+				for( ; posEnd < end && candidates[posEnd].position == position; posEnd++) {
+					const Candidate &candidate = candidates[posEnd];
+					bool allSolid = true;
+					for(SequenceLengthType j = 0; allSolid && j < candidate.numKmers; j++)
+						allSolid = values[candidate.kmerOffset + j] >= _minSolidDepth;
+					if (allSolid) {
+						solidCandidate = &candidate;
+						numSolid++;
+					}
+				}
+				bool overlaps = false;
+				if (numSolid == 1) {
+					SequenceLengthType first = solidCandidate->firstKmer, last = first + solidCandidate->numKmers - 1;
+					for(unsigned int a = 0; !overlaps && a < appliedKmers.size(); a++)
+						overlaps = first <= appliedKmers[a].second && appliedKmers[a].first <= last;
+				}
+				if (numSolid == 1 && !overlaps && state.edits < maxEdits) {
+					state.fasta[position] = solidCandidate->base;
+					for(SequenceLengthType j = 0; j < solidCandidate->numKmers; j++)
+						state.isSolid[solidCandidate->firstKmer + j] = true;
+					appliedKmers.push_back(std::make_pair(solidCandidate->firstKmer, solidCandidate->firstKmer + solidCandidate->numKmers - 1));
+					state.edits++;
+					changed = true;
+				}
+				posBegin = posEnd;
+			}
+			// the same candidates would be proposed again
+			if (!changed)
+				state.isDone = true;
+			begin = end;
+		}
+	}
+};
+
+#endif /* READCORRECTOR_H_ */
@@ -70,7 +70,8 @@ such enhancements or derivative works thereof, in binary and source code form.
 class _ReadSelectorOptions : public OptionsBaseInterface {
 public:
 	_ReadSelectorOptions() : maxKmerDepth(-1), partitionByDepth(-1), bothPairs(1), remainderTrim(-1), minReadLength(0.40),
-	    bimodalSigmas(-1.0), kmerScoringType("MAX"), normalizationMethod("RANDOM"), useLogscaleAboveMax(false), separateOutputs(true)  {
+	    bimodalSigmas(-1.0), kmerScoringType("MAX"), normalizationMethod("RANDOM"), useLogscaleAboveMax(false), separateOutputs(true),
+	    streamingSketchMB(1024), streamingSketchHashes(4)  {
 	}
 	virtual ~_ReadSelectorOptions() {}
 	void _resetDefaults() {
@@ -87,7 +88,11 @@ public:
 
 				("use-logscale-above-max", po::value<bool>()->default_value(useLogscaleAboveMax), "if --max-kmer-output-depth is set, then reads above this threshold will be reduced by the log2 kmer abundance")
 
-				("normalization-method", po::value<std::string>()->default_value(normalizationMethod), "If --max-kmer-output-depth is selected, what algorithm to use (RANDOM, OPTIMAL) (optimal is *very* slow and is not implemented in MPI version")
+				("normalization-method", po::value<std::string>()->default_value(normalizationMethod), "If --max-kmer-output-depth is selected, what algorithm to use (RANDOM, OPTIMAL, STREAMING) (optimal is *very* slow).  STREAMING makes one pass over the input files without building the kmer spectrum, keeping reads (or pairs) whose median kmer depth among the already kept reads is below max-kmer-output-depth")
+
+				("streaming-sketch-mb", po::value<unsigned int>()->default_value(streamingSketchMB), "the fixed memory (in MB) of the count-min sketch of kept kmers for --normalization-method STREAMING")
+
+				("streaming-sketch-hashes", po::value<unsigned int>()->default_value(streamingSketchHashes), "the number of hash functions (rows) of the count-min sketch for --normalization-method STREAMING")
 
 				("partition-by-depth", po::value<int>()->default_value(partitionByDepth), "partition filtered reads by powers-of-two coverage depth (mutually exclusive with max-kmer-depth)")
 
@@ -128,10 +133,20 @@ public:
 			ret = false;
 		}
 		setOpt("normalization-method", normalizationMethod);
-		if (normalizationMethod != "RANDOM" && normalizationMethod != "OPTIMAL") {
+		if (normalizationMethod != "RANDOM" && normalizationMethod != "OPTIMAL" && normalizationMethod != "STREAMING") {
 			setOptionsErrorMsg("Invalid --normalization-method: " + normalizationMethod);
 			ret = false;
 		}
+		setOpt("streaming-sketch-mb", streamingSketchMB);
+		setOpt("streaming-sketch-hashes", streamingSketchHashes);
+		if (normalizationMethod == "STREAMING" && (maxKmerDepth <= 0 || maxKmerDepth >= CountMinSketch::MAX_COUNT)) {
+			setOptionsErrorMsg("--normalization-method STREAMING requires a --max-kmer-output-depth between 1 and 254");
+			ret = false;
+		}
+		if (normalizationMethod == "STREAMING" && (streamingSketchMB == 0 || streamingSketchHashes == 0)) {
+			setOptionsErrorMsg("--streaming-sketch-mb and --streaming-sketch-hashes must be at least 1");
+			ret = false;
+		}
 
 		// verify mutually exclusive options are not set
 		if ( (getMaxKmerDepth() > 0 && getPartitionByDepth() >  0) )
@@ -189,6 +204,12 @@ public:
 	{
 		return separateOutputs;
 	}
+	unsigned int &getStreamingSketchMB() {
+		return streamingSketchMB;
+	}
+	unsigned int &getStreamingSketchHashes() {
+		return streamingSketchHashes;
+	}
 
 
 
@@ -200,6 +221,7 @@ private:
 	std::string normalizationMethod;
 	bool useLogscaleAboveMax;
 	bool separateOutputs;
+	unsigned int streamingSketchMB, streamingSketchHashes;
 };
 typedef OptionsBaseTemplate< _ReadSelectorOptions > ReadSelectorOptions;
 
@@ -229,6 +251,90 @@ public:
 
 };
 
+// Picked counts of every kmer in a spectrum that does not change while reads are picked.
+// Counts are a dense array indexed by the kmer's bucket offset plus its index within the bucket.
+// The serial OPTIMAL pick increments the counts of each picked read directly, while the distributed
+// pick reserves one kmer at a time with an atomic increment that is rolled back above the maximum
+template<typename Map>
+class PickedKmerCounts {
+public:
+	typedef unsigned short CountType; // room for a transient increment from every thread above an unsigned char depth
+	typedef unsigned long IndexType;
+	typedef std::vector< IndexType > IndexVector;
+	typedef std::vector< CountType > CountVector;
+	typedef typename Map::BucketType BucketType;
+	typedef typename Map::ValueType DataType;
+	static const IndexType MAX_INDEX = (IndexType) -1;
+
+protected:
+	const Map *_map;
+	IndexVector _bucketOffsets;
+	CountVector _counts;
+
+public:
+	PickedKmerCounts() : _map(NULL) {}
+	PickedKmerCounts(const Map &map) : _map(&map) {
+		long numBuckets = map.getNumBuckets();
+		_bucketOffsets.resize(numBuckets + 1);
+		_bucketOffsets[0] = 0;
+		for(long i = 0; i < numBuckets; i++)
+			_bucketOffsets[i + 1] = _bucketOffsets[i] + map.getBucketByIdx(i).size();
+		_counts.resize(_bucketOffsets[numBuckets], 0);
+		LOG_DEBUG(2, "PickedKmerCounts(): " << _counts.size() << " kmers in " << numBuckets << " buckets");
+	}
+
+	void clear() {
+		_map = NULL;
+		IndexVector().swap(_bucketOffsets);
+		CountVector().swap(_counts);
+	}
+	IndexType size() const {
+		return _counts.size();
+	}
+
+	// returns MAX_INDEX if the kmer is not in the spectrum, otherwise sets data to its spectrum value
+	IndexType find(const Kmer &kmer, const DataType *&data) const {
+		assert(_map != NULL);
+		IndexType bucketIdx = _map->getBucketIdx(kmer);
+		const BucketType &bucket = _map->getBucketByIdx(bucketIdx);
+		typename BucketType::IndexType idx = bucket.findIndex(kmer);
+		if (idx == BucketType::MAX_INDEX) {
+			data = NULL;
+			return MAX_INDEX;
+		}
+		data = &bucket.valueAt(idx);
+		return _bucketOffsets[bucketIdx] + idx;
+	}
+	IndexType find(const Kmer &kmer) const {
+		const DataType *data;
+		return find(kmer, data);
+	}
+
+	// may be stale while other threads are picking
+	CountType get(IndexType idx) const {
+		return _counts[idx];
+	}
+	void increment(IndexType idx) {
+#pragma omp atomic
+		_counts[idx]++;
+	}
+	void release(IndexType idx) {
+#pragma omp atomic
+		_counts[idx]--;
+	}
+	// optimistically claims one count, rolling it back if the count was already at maxCount
+	bool reserve(IndexType idx, CountType maxCount) {
+		CountType oldCount;
+#pragma omp atomic capture
+		oldCount = _counts[idx]++;
+		if (oldCount >= maxCount) {
+			release(idx);
+			return false;
+		}
+		return true;
+	}
+};
+
 template<typename Map>
 class ReadSelector {
 public:
@@ -298,7 +404,8 @@ public:
 	typedef Map KMType;
 	typedef typename KMType::ValueType DataType;
 	typedef typename DataType::ReadPositionWeightVector ReadPositionWeightVector;
-	typedef KmerMapGoogleSparse<unsigned char> KmerCountMap;
+	typedef PickedKmerCounts< Map > PickedCounts;
+	typedef typename PickedCounts::IndexVector CountIndexVector;
 	typedef typename KMType::ConstIterator KMIterator;
 	typedef typename KMType::ElementType ElementType;
 	typedef std::vector< ReadTrimType > ReadTrimVector;
@@ -314,7 +421,7 @@ protected:
 	const KMType &_map;
 	ReadTrimVector _trims;
 	PairedIndexType _picks;
-	KmerCountMap _counts;
+	PickedCounts _counts;
 	bool _needCounts;
 	DuplicateSet _duplicateSet;
 	bool _needDuplicateCheck;
@@ -400,8 +507,7 @@ public:
 		if (_needCounts) {
 			return;
 		}
-		_counts = KmerCountMap(_map.getNumBuckets());
-		// TODO verify counts are initialized to 0
+		_counts = PickedCounts(_map);
 		_needCounts = true;
 	}
 	void setNeedDuplicateCheck() {
@@ -424,7 +530,7 @@ public:
 		}
 		kmers.build(_reads.getRead(readIdx).getTwoBitSequence(), _trims[readIdx].trimOffset + _trims[readIdx].trimLength, true);
 		if (_trims[readIdx].trimOffset > 0) {
-			kmers.copyRange(_trims[readIdx].trimOffset, _trims[readIdx].trimLength - KmerSizer::getSequenceLength() + 1);
+			kmers = kmers.copyRange(_trims[readIdx].trimOffset, _trims[readIdx].trimLength - KmerSizer::getSequenceLength() + 1);
 		}
 	}
 
@@ -463,7 +569,9 @@ public:
 		KA kmers;
 		getKmersForTrimmedRead(readIdx, kmers);
 		for(Kmer::IndexType j = 0; j < kmers.size(); j++) {
-			_counts[ kmers[j] ]++;
+			typename PickedCounts::IndexType idx = _counts.find(kmers[j]);
+			if (idx != PickedCounts::MAX_INDEX)
+				_counts.increment(idx);
 		}
 	}
 
@@ -595,26 +703,24 @@ public:
 		return picked;
 	}
 
-	bool rescoreByBestCoveringSubset(ReadSetSizeType readIdx, unsigned char maxPickedKmerDepth, ReadTrimType &trim, KA &kmers) {
+	// if countIdxs is set, the picked count index of every kmer in the read is appended to it
+	bool rescoreByBestCoveringSubset(ReadSetSizeType readIdx, unsigned char maxPickedKmerDepth, ReadTrimType &trim, KA &kmers, CountIndexVector *countIdxs = NULL) {
 		getKmersForTrimmedRead(readIdx, kmers);
 		ScoreType score = 0.0;
 		for(SequenceLengthType j = 0; j < kmers.size(); j++) {
-			ScoreType contribution = getValue(kmers[j]);
+			const DataType *data;
+			typename PickedCounts::IndexType countIdx = _counts.find(kmers[j], data);
+			ScoreType contribution = countIdx == PickedCounts::MAX_INDEX ? ScoreType(0) : ScoreType(data->getCount());
 			if (contribution > 0) {
-				KmerCountMap::ValueType pickedCount = 0;
-				if (!_counts.getValueIfExists(kmers[j], pickedCount)) {
-#pragma omp critical (ReadSelector_counts)
-					{
-						pickedCount =  _counts.getOrSetElement(kmers[j], pickedCount).value();
-					}
-				}
-
+				typename PickedCounts::CountType pickedCount = _counts.get(countIdx);
 				if ( pickedCount >= maxPickedKmerDepth ) {
 					trim.score = -1.0;
 					return false;
 				} else {
 					score += contribution * (maxPickedKmerDepth - pickedCount);
 				}
+				if (countIdxs != NULL)
+					countIdxs->push_back(countIdx);
 			} else {
 				LOG_THROW("rescoreByBestCoveringSubset(): Reads should have already been trimmed to exclude this kmer: " << kmers[j].toFasta());
 			}
@@ -625,19 +731,19 @@ public:
 		return hasNotChanged;
 	}
 
-	bool rescoreByBestCoveringSubset(const ReadSet::Pair &pair, unsigned char maxPickedKmerDepth, ScoreType &score, KA &kmers) {
+	bool rescoreByBestCoveringSubset(const ReadSet::Pair &pair, unsigned char maxPickedKmerDepth, ScoreType &score, KA &kmers, CountIndexVector *countIdxs = NULL) {
 		score = 0.0;
 		bool hasNotChanged = true;
 		double len = 0;
 		if (_reads.isValidRead(pair.read1)) {
 			ReadTrimType &trim = _trims[pair.read1];
-			hasNotChanged &= rescoreByBestCoveringSubset(pair.read1, maxPickedKmerDepth, trim, kmers);
+			hasNotChanged &= rescoreByBestCoveringSubset(pair.read1, maxPickedKmerDepth, trim, kmers, countIdxs);
 			score = trim.score;
 			len = trim.trimLength;
 		}
 		if (_reads.isValidRead(pair.read2)) {
 			ReadTrimType &trim = _trims[pair.read2];
-			hasNotChanged &= rescoreByBestCoveringSubset(pair.read2, maxPickedKmerDepth, trim, kmers);
+			hasNotChanged &= rescoreByBestCoveringSubset(pair.read2, maxPickedKmerDepth, trim, kmers, countIdxs);
 			if (score > 0) {
 				if (trim.score > 0) {
 					score += trim.score;
@@ -748,177 +854,151 @@ public:
 		return picked;
 	}
 
-	ReadSetSizeType pickBestCoveringSubsetPairs(unsigned char maxPickedKmerDepth, ScoreType minimumScore = 0.0,
-			float minimumLength = ReadSelectorOptions::getOptions().getMinReadLength(), bool bothPass = false) {
-		_initPickBestCoveringSubset();
-
-		ReadSetSizeType picked = 0;
+	// rescores a candidate pair, or a single read (as Pair(readIdx, MAX_READ_IDX)) when !byPair
+	bool _rescoreCoveringCandidate(PairScore &candidate, unsigned char maxPickedKmerDepth, bool byPair, KA &kmers, CountIndexVector *countIdxs = NULL) {
+		if (byPair)
+			return rescoreByBestCoveringSubset(candidate.pair, maxPickedKmerDepth, candidate.score, kmers, countIdxs);
+		ReadTrimType &trim = _trims[candidate.pair.read1];
+		bool hasNotChanged = rescoreByBestCoveringSubset(candidate.pair.read1, maxPickedKmerDepth, trim, kmers, countIdxs);
+		candidate.score = trim.score;
+		return hasNotChanged;
+	}
 
-		int numThreads = omp_get_max_threads();
+	// the (sorted, unique) picked count indexes of a candidate, so a kmer repeated within it is only counted once
+	static void _uniqueCountIdxs(CountIndexVector &countIdxs) {
+		std::sort(countIdxs.begin(), countIdxs.end());
+		countIdxs.erase(std::unique(countIdxs.begin(), countIdxs.end()), countIdxs.end());
+	}
 
-		PairScore bestPairs[numThreads];
-		Pair fauxPair(ReadSet::MAX_READ_IDX, ReadSet::MAX_READ_IDX);
-		PairScore fauxPairScore( fauxPair, -2.0);
+	// orders candidates best first: by score, then by PairScore order
+	class RoundOrder : public std::binary_function<ReadSetSizeType,ReadSetSizeType,bool>
+	{
+	private:
+		const PairScoreVector &_round;
+	public:
+		RoundOrder(const PairScoreVector &round) : _round(round) {}
+		inline bool operator()(ReadSetSizeType x, ReadSetSizeType y) const {
+			return _round[y] < _round[x];
+		}
+	};
 
-		PairScoreVector heapedPairs[numThreads];
-		long heapSize = 0;
-		int allAreDone = 0;
+	/*
+	 * Greedily picks the candidate with the best exact score, lazily rescoring from a max heap of stale scores
+	 * (a stale score can only be too high, as picked counts never decrease).  Ties are broken by PairScore order,
+	 * so the picks do not depend on the number of threads.
+	 * Each round pops the top candidates and rescores them in parallel.  They are then picked best first while
+	 * each still scores at least the best stale score left in the heap and shares no kmer with an earlier pick
+	 * of the round.  The rest of the round is requeued with its fresh scores.
+	 * Only the rescoring scales with threads: the picks and their count increments are made serially, in order,
+	 * which is what keeps the picks independent of the number of threads.
+	 */
+	ReadSetSizeType _pickBestCoveringSubset(unsigned char maxPickedKmerDepth, ScoreType minimumScore, float minimumLength, bool bothPass, bool byPair) {
+		_initPickBestCoveringSubset();
+		// counts are kept by the picks below, not by pickIfNew
+		ScopedTempValue<bool> noStoredCounts(_needCounts, false);
 
-		std::vector< KA > _kmers(omp_get_max_threads(), KA());
-		long pairsSize = _reads.getPairSize();
-#pragma omp parallel
-		{
-			int threadId = omp_get_thread_num();
-			KA &kmers = _kmers[threadId];
-			bestPairs[threadId].score = -3.0;
-			heapedPairs[threadId].resize(0);
-			heapedPairs[threadId].reserve(pairsSize / numThreads / 10);
-
-			for(long pairIdx = threadId; pairIdx < pairsSize; pairIdx += numThreads) {
-				const ReadSet::Pair &pair = _reads.getPair(pairIdx);
-				ScoreType score;
-				if (isPairAvailable(pair, bothPass)) {
-					rescoreByBestCoveringSubset(pair, maxPickedKmerDepth, score, kmers);
-					if (score > minimumScore && isPassingPair(pair, minimumScore, minimumLength, bothPass)) {
-						heapedPairs[threadId].push_back( PairScore( pair, score ) );
-					}
-				}
+		ReadSetSizeType picked = 0;
+		int numThreads = omp_get_max_threads();
+		std::vector< KA > _kmers(numThreads, KA());
+
+		PairScoreVector heapedPairs;
+		long candidatesSize = byPair ? _reads.getPairSize() : _reads.getSize();
+		for(long idx = 0; idx < candidatesSize; idx++) {
+			Pair pair = byPair ? _reads.getPair(idx) : Pair(idx, ReadSet::MAX_READ_IDX);
+			bool isAvailable1 = isPassingRead(pair.read1) && _trims[pair.read1].isAvailable;
+			bool isAvailable2 = isPassingRead(pair.read2) && _trims[pair.read2].isAvailable;
+			if ((bothPass && isPairedRead(pair)) ? (isAvailable1 && isAvailable2) : (isAvailable1 || isAvailable2))
+				heapedPairs.push_back( PairScore( pair, 0.0 ) );
+		}
+#pragma omp parallel for schedule(dynamic, 64) num_threads(numThreads)
+		for(long i = 0; i < (long) heapedPairs.size(); i++)
+			_rescoreCoveringCandidate(heapedPairs[i], maxPickedKmerDepth, byPair, _kmers[omp_get_thread_num()]);
+
+		PairScoreVector round;
+		for(typename PairScoreVector::iterator it = heapedPairs.begin(); it != heapedPairs.end(); it++)
+			if (it->score > minimumScore && isPassingPair(it->pair, minimumScore, minimumLength, bothPass))
+				round.push_back(*it);
+		heapedPairs.swap(round);
+		LOG_VERBOSE_OPTIONAL(1, true, "building heap out of " << heapedPairs.size() << (byPair ? " pairs" : " reads") );
+		std::make_heap(heapedPairs.begin(), heapedPairs.end());
+
+		LOG_VERBOSE_OPTIONAL(1, true, "picking " << (byPair ? "pairs" : "reads") << " at depth: " << (int) maxPickedKmerDepth);
+
+		std::vector< CountIndexVector > roundCountIdxs;
+		std::vector< ReadSetSizeType > order;
+		std::set< typename PickedCounts::IndexType > roundKmers;
+		ReadSetSizeType roundSize = numThreads;
+		long iterations = 0;
+		while (!heapedPairs.empty()) {
+			if (++iterations % 1000 == 0) {
+				LOG_VERBOSE_OPTIONAL(1, true, "Processing heap size " << heapedPairs.size() << " picked " << picked);
+			} else {
+				LOG_DEBUG(3, "heap size " << heapedPairs.size() << " picked " << picked);
 			}
 
-#pragma omp atomic
-			heapSize += heapedPairs[threadId].size();
-
-#pragma omp barrier
-			LOG_VERBOSE_OPTIONAL(1, threadId == 0, "building heap out of " << heapSize << " pairs" );
-
-			std::make_heap(heapedPairs[threadId].begin(), heapedPairs[threadId].end(), PairScoreCompare(this));
-
-			LOG_VERBOSE_OPTIONAL(1, threadId == 0, "picking pairs at depth: " << (int) maxPickedKmerDepth);
-
-			// pick pairs
-			long iterations = 0;
-			bool threadIsDone = false;
-			while (allAreDone < numThreads) {
-				if (threadId == 0) {
-					if (++iterations % 1000 == 0) {
-						LOG_VERBOSE_OPTIONAL(1, true, "Processing heap size " << heapSize << " picked " << picked);
-					} else {
-						LOG_DEBUG(3, "heap size " << heapSize << " picked " << picked);
-					}
-				}
-
-				PairScore pairScore;
-				bool isEmpty = false;
-				if (!heapedPairs[threadId].empty()) {
-					pairScore = heapedPairs[threadId].front();
-					std::pop_heap(heapedPairs[threadId].begin(), heapedPairs[threadId].end(), PairScoreCompare(this));
-					heapedPairs[threadId].pop_back();
-
-#pragma omp atomic
-					heapSize--;
-
-				} else {
-					pairScore = fauxPairScore;
-					isEmpty = true;
-				}
-
-
-				if ( isEmpty || rescoreByBestCoveringSubset(pairScore.pair, maxPickedKmerDepth, pairScore.score, kmers) ) {
-					if ( isEmpty || isNew(pairScore.pair)) {
-
-						// spin until all threads are ready
-						bestPairs[threadId] = pairScore;
-						PairScore bestPair = fauxPairScore;
-						LOG_DEBUG(4, "chose " << pairScore.pair.read1 << ", " << pairScore.pair.read2 << ": " << pairScore.score);
-
-#pragma omp barrier
-
-						for(int i = 0 ; i < numThreads; i++) {
-							if (bestPair < bestPairs[i] ) {
-								bestPair = bestPairs[i];
-							}
-						}
-
-						if (bestPair.pair == pairScore.pair && bestPair.pair != fauxPair && !isEmpty) {
-
-							pickIfNew(pairScore.pair);
-#pragma omp atomic
-							picked++;
-							LOG_DEBUG(4, "Selected pair: " << pairScore.pair.read1 << " " << pairScore.pair.read2);
-
-						}
-
-						if (isEmpty && !threadIsDone ) {
-#pragma omp atomic
-							allAreDone++;
-							threadIsDone = true;
-						}
-
-#pragma omp barrier
+			round.resize(0);
+			while (!heapedPairs.empty() && round.size() < roundSize) {
+				round.push_back(heapedPairs.front());
+				std::pop_heap(heapedPairs.begin(), heapedPairs.end());
+				heapedPairs.pop_back();
+			}
+			roundCountIdxs.resize(round.size());
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+			for(long i = 0; i < (long) round.size(); i++) {
+				roundCountIdxs[i].resize(0);
+				_rescoreCoveringCandidate(round[i], maxPickedKmerDepth, byPair, _kmers[omp_get_thread_num()], &roundCountIdxs[i]);
+			}
 
-					} else {
-						if (pairScore.score > minimumScore && isPassingPair(pairScore.pair, minimumScore, minimumLength, bothPass)) {
-							LOG_DEBUG(4, "replacing Pair(" << pairScore.pair.read1 << ", " << pairScore.pair.read2 << "): "
-									<< pairScore.score << " " << (isPassingRead(pairScore.pair.read1) ? _trims[pairScore.pair.read1].score : -2.0) << " "
-									<< (isPassingRead(pairScore.pair.read2) ? _trims[pairScore.pair.read2].score : -2.0));
-#pragma omp atomic
-							heapSize++;
+			order.resize(round.size());
+			for(ReadSetSizeType i = 0; i < order.size(); i++)
+				order[i] = i;
+			std::sort(order.begin(), order.end(), RoundOrder(round));
+
+			ReadSetSizeType roundPicks = 0;
+			bool isExact = true;
+			roundKmers.clear();
+			for(ReadSetSizeType o = 0; o < order.size(); o++) {
+				PairScore &candidate = round[ order[o] ];
+				if (!(candidate.score > minimumScore && isPassingPair(candidate.pair, minimumScore, minimumLength, bothPass)))
+					continue;
 
-							heapedPairs[threadId].push_back(pairScore);
-							std::push_heap(heapedPairs[threadId].begin(), heapedPairs[threadId].end(), PairScoreCompare(this));
-						}
+				CountIndexVector &countIdxs = roundCountIdxs[ order[o] ];
+				_uniqueCountIdxs(countIdxs);
+				if (isExact && !heapedPairs.empty() && candidate < heapedPairs.front())
+					isExact = false;
+				for(ReadSetSizeType i = 0; isExact && i < countIdxs.size(); i++)
+					if (roundKmers.find(countIdxs[i]) != roundKmers.end())
+						isExact = false;
+
+				if (!isExact) {
+					LOG_DEBUG(4, "replacing Pair(" << candidate.pair.read1 << ", " << candidate.pair.read2 << "): " << candidate.score);
+					heapedPairs.push_back(candidate);
+					std::push_heap(heapedPairs.begin(), heapedPairs.end());
+				} else if (pickIfNew(candidate.pair)) {
+					for(ReadSetSizeType i = 0; i < countIdxs.size(); i++) {
+						_counts.increment(countIdxs[i]);
+						roundKmers.insert(countIdxs[i]);
 					}
+					picked++;
+					roundPicks++;
+					LOG_DEBUG(4, "Selected pair: " << candidate.pair.read1 << " " << candidate.pair.read2 << ": " << candidate.score);
 				}
-
 			}
-			LOG_DEBUG(3, "Finished picking: " << allAreDone);
+			// ask for about twice as many as were picked, but keep every thread busy
+			roundSize = std::max((ReadSetSizeType) numThreads, 2 * roundPicks);
 		}
 		LOG_VERBOSE(1, "Picked " << picked);
 		optimizePickOrder();
 		return picked;
 	}
 
-	ReadSetSizeType pickBestCoveringSubsetReads(unsigned char maxPickedKmerDepth, ScoreType minimumScore = 0.0, float minimumLength = ReadSelectorOptions::getOptions().getMinReadLength()) {
-		_initPickBestCoveringSubset();
-		ReadSetSizeType picked = 0;
-
-		LOG_VERBOSE(1, "initializing reads into a heap");
-		// initialize heap of reads
-		PicksVector heapedReads;
-		KA kmers;
-		for(ReadSetSizeType readIdx = 0; readIdx < _reads.getSize(); readIdx++) {
-			ReadTrimType &trim = _trims[readIdx];
-			if (trim.isAvailable) {
-				rescoreByBestCoveringSubset(readIdx, maxPickedKmerDepth, trim, kmers);
-				if (isPassingRead(readIdx, minimumScore, minimumLength)) {
-					heapedReads.push_back(readIdx);
-				}
-			}
-		}
-		LOG_VERBOSE(1, "building heap out of " << heapedReads.size() << " reads");
-		std::make_heap( heapedReads.begin(), heapedReads.end(), ScoreCompare(this));
-
-		LOG_VERBOSE(1, "picking reads: ");
-
-		// pick reads
-		while (heapedReads.begin() != heapedReads.end()) {
-			ReadSetSizeType readIdx = heapedReads.front();
-			std::pop_heap(heapedReads.begin(), heapedReads.end(), ScoreCompare(this));
-			heapedReads.pop_back();
+	ReadSetSizeType pickBestCoveringSubsetPairs(unsigned char maxPickedKmerDepth, ScoreType minimumScore = 0.0,
+			float minimumLength = ReadSelectorOptions::getOptions().getMinReadLength(), bool bothPass = false) {
+		return _pickBestCoveringSubset(maxPickedKmerDepth, minimumScore, minimumLength, bothPass, true);
+	}
 
-			ReadTrimType &trim = _trims[readIdx];
-			if ( rescoreByBestCoveringSubset(readIdx, maxPickedKmerDepth, trim, kmers) ) {
-				pickIfNew(readIdx) && picked++;
-			} else {
-				if (trim.score > minimumScore) {
-					heapedReads.push_back(readIdx);
-					std::push_heap(heapedReads.begin(), heapedReads.end(), ScoreCompare(this));
-				}
-			}
-		}
-		LOG_VERBOSE(1,  picked );
-		optimizePickOrder();
-		return picked;
+	ReadSetSizeType pickBestCoveringSubsetReads(unsigned char maxPickedKmerDepth, ScoreType minimumScore = 0.0, float minimumLength = ReadSelectorOptions::getOptions().getMinReadLength()) {
+		return _pickBestCoveringSubset(maxPickedKmerDepth, minimumScore, minimumLength, false, false);
 	}
 
 	inline ScoreType getValue( const Kmer &kmer ) {
@@ -1262,4 +1342,170 @@ public:
 	}
 };
 
+// Single pass digital normalization that never builds the kmer spectrum.
+// The kmers of every kept read are counted in a fixed memory count-min sketch and a
+// read (or pair, interleaved in one file or in step in consecutive read 1 and read 2 files)
+// is kept only if the median count of its kmers among the already kept reads is below the target depth
+class StreamingReadSelector {
+public:
+	typedef Sequence::SequenceLengthType SequenceLengthType;
+	typedef CountMinSketch::CountType CountType;
+	typedef std::vector< CountType > CountVector;
+	typedef KmerArrayPair<char> Kmers;
+	typedef OfstreamMap OFM;
+
+	StreamingReadSelector(unsigned int targetDepth, float minReadLength, bool bothPass,
+			unsigned long memoryBytes = (unsigned long) ReadSelectorOptions::getOptions().getStreamingSketchMB() * 1024ul * 1024ul,
+			int numHashes = ReadSelectorOptions::getOptions().getStreamingSketchHashes())
+	: _sketch(memoryBytes, numHashes), _targetDepth(targetDepth), _minReadLength(minReadLength), _bothPass(bothPass),
+	  _readsIn(0), _readsOut(0), _basesIn(0), _basesOut(0) {
+		if (KmerSizer::getSequenceLength() == 0)
+			LOG_THROW("StreamingReadSelector requires a kmer-size");
+		LOG_VERBOSE(1, "StreamingReadSelector: targetDepth " << _targetDepth << " with a " << _sketch.getMemoryBytes() << " byte count-min sketch of " << _sketch.getNumHashes() << " hashes");
+	}
+
+	// streams every input file once, writing the kept reads and returning their count
+	// a file followed by the file of its mates is streamed together with it
+	long selectReads(OFM &ofmap, bool byInputFile = ReadSelectorOptions::getOptions().getSeparateOutputs(), FormatOutput format = FormatOutput::getDefault()) {
+		OptionsBaseInterface::FileListType &inputs = Options::getOptions().getInputFiles();
+		for(unsigned int fileIdx = 0; fileIdx < inputs.size(); fileIdx++) {
+			std::string key, mateKey;
+			if (byInputFile)
+				key = "-" + Options::getOptions().getInputFileSubstring(fileIdx);
+			if (fileIdx + 1 < inputs.size() && isMateFile(inputs[fileIdx], inputs[fileIdx + 1])) {
+				if (byInputFile)
+					mateKey = "-" + Options::getOptions().getInputFileSubstring(fileIdx + 1);
+				selectReads(inputs[fileIdx], inputs[fileIdx + 1], ofmap.getOfstream(key), ofmap.getOfstream(mateKey), format);
+				fileIdx++;
+			} else {
+				selectReads(inputs[fileIdx], ofmap.getOfstream(key), format);
+			}
+		}
+		LOG_VERBOSE(1, "StreamingReadSelector: kept " << _readsOut << " of " << _readsIn << " reads, " << _basesOut << " of " << _basesIn << " bases. Sketch occupancy " << _sketch.getOccupancy() << ", false positive rate " << _sketch.getFalsePositiveRate());
+		if (_sketch.getFalsePositiveRate() > 0.01)
+			LOG_WARN(1, "The count-min sketch is saturated (false positive rate " << _sketch.getFalsePositiveRate() << "), too few reads may have been kept.  Consider increasing --streaming-sketch-mb");
+		return _readsOut;
+	}
+
+	long selectReads(std::string inputFile, std::ostream &os, FormatOutput format = FormatOutput::getDefault()) {
+		LOG_VERBOSE(1, "StreamingReadSelector: normalizing " << inputFile);
+		long oldReadsOut = _readsOut;
+		ReadSetStream rss(inputFile);
+		Read pending;
+		bool hasPending = false;
+		while (rss.hasNext()) {
+			const Read &read = rss.getRead();
+			if (hasPending) {
+				if (ReadSet::isPair(pending, read)) {
+					_selectPair(os, os, pending, &read, format);
+					hasPending = false;
+					continue;
+				}
+				_selectPair(os, os, pending, NULL, format);
+			}
+			pending = read;
+			hasPending = true;
+		}
+		if (hasPending)
+			_selectPair(os, os, pending, NULL, format);
+		LOG_DEBUG(1, "StreamingReadSelector: kept " << (_readsOut - oldReadsOut) << " reads from " << inputFile);
+		return _readsOut - oldReadsOut;
+	}
+
+	// streams a read 1 file and its read 2 file in step, writing each kept read to the stream of its file
+	// reads that are out of step with their mates are selected alone
+	long selectReads(std::string inputFile1, std::string inputFile2, std::ostream &os1, std::ostream &os2, FormatOutput format = FormatOutput::getDefault()) {
+		LOG_VERBOSE(1, "StreamingReadSelector: normalizing pairs from " << inputFile1 << " and " << inputFile2);
+		long oldReadsOut = _readsOut, unpaired = 0;
+		ReadSetStream rss1(inputFile1), rss2(inputFile2);
+		while (true) {
+			bool has1 = rss1.hasNext(), has2 = rss2.hasNext();
+			if (has1 && has2 && ReadSet::isPair(rss1.getRead(), rss2.getRead())) {
+				_selectPair(os1, os2, rss1.getRead(), &rss2.getRead(), format);
+				continue;
+			}
+			if (!has1 && !has2)
+				break;
+			if (has1) {
+				_selectPair(os1, os1, rss1.getRead(), NULL, format);
+				unpaired++;
+			}
+			if (has2) {
+				_selectPair(os2, os2, rss2.getRead(), NULL, format);
+				unpaired++;
+			}
+		}
+		if (unpaired > 0)
+			LOG_WARN(1, "StreamingReadSelector: " << unpaired << " reads of " << inputFile1 << " and " << inputFile2 << " were not in step with their mates and were selected alone");
+		LOG_DEBUG(1, "StreamingReadSelector: kept " << (_readsOut - oldReadsOut) << " reads from " << inputFile1 << " and " << inputFile2);
+		return _readsOut - oldReadsOut;
+	}
+
+	// true if the first reads of the two files are mates
+	static bool isMateFile(std::string inputFile1, std::string inputFile2) {
+		ReadSetStream rss1(inputFile1), rss2(inputFile2);
+		return rss1.hasNext() && rss2.hasNext() && ReadSet::isPair(rss1.getRead(), rss2.getRead());
+	}
+
+	const CountMinSketch &getSketch() const {
+		return _sketch;
+	}
+
+protected:
+	// the usable length of a read stops before its first N or X
+	// returns false if that is too short to select
+	bool _scoreRead(const Read &read, Kmers &kmers, SequenceLengthType &length, CountType &median) {
+		length = read.getLength();
+		SequenceLengthType markupLength = TwoBitSequence::firstMarkupNorX(read.getMarkups());
+		if (markupLength > 0)
+			length = markupLength - 1;
+		if (length < KmerSizer::getSequenceLength() || !ReadSelectorUtil::passesLength(length, read, _minReadLength))
+			return false;
+
+		kmers.build(read.getTwoBitSequence(), length, true);
+		_scratch.resize(kmers.size());
+		for(SequenceLengthType j = 0; j < kmers.size(); j++)
+			_scratch[j] = _sketch.getCount(kmers[j].hash());
+		CountVector::iterator mid = _scratch.begin() + _scratch.size() / 2;
+		std::nth_element(_scratch.begin(), mid, _scratch.end());
+		median = *mid;
+		return true;
+	}
+
+	void _selectPair(std::ostream &os1, std::ostream &os2, const Read &read1, const Read *read2, FormatOutput format) {
+		SequenceLengthType length1 = 0, length2 = 0;
+		CountType median1 = 0, median2 = 0;
+		_readsIn += read2 == NULL ? 1 : 2;
+		_basesIn += read1.getLength() + (read2 == NULL ? 0 : read2->getLength());
+
+		bool pass1 = _scoreRead(read1, _kmers1, length1, median1);
+		bool pass2 = read2 != NULL && _scoreRead(*read2, _kmers2, length2, median2);
+		if (read2 != NULL && _bothPass && !(pass1 && pass2))
+			return;
+		if (!( (pass1 && median1 < _targetDepth) || (pass2 && median2 < _targetDepth) ))
+			return;
+
+		if (pass1)
+			_keepRead(os1, read1, _kmers1, length1, format);
+		if (pass2)
+			_keepRead(os2, *read2, _kmers2, length2, format);
+	}
+
+	void _keepRead(std::ostream &os, const Read &read, const Kmers &kmers, SequenceLengthType length, FormatOutput format) {
+		for(SequenceLengthType j = 0; j < kmers.size(); j++)
+			_sketch.increment(kmers[j].hash());
+		read.write(os, 0, length, "", format);
+		_readsOut++;
+		_basesOut += length;
+	}
+
+	CountMinSketch _sketch;
+	unsigned int _targetDepth;
+	float _minReadLength;
+	bool _bothPass;
+	Kmers _kmers1, _kmers2;
+	CountVector _scratch;
+	long _readsIn, _readsOut, _basesIn, _basesOut;
+};
+
 #endif
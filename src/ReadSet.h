@@ -720,6 +720,18 @@ public:
 	ReadSetSizeType getReadCount() {
 		return _readIdx;
 	}
+	// advance past up to numReads reads, returning the number skipped
+	ReadSetSizeType skip(ReadSetSizeType numReads) {
+		ReadSetSizeType skipped = 0;
+		if (isReadSet()) {
+			skipped = std::min(numReads, _rs->getSize() - _readIdx);
+			_readIdx += skipped;
+		} else {
+			while (skipped < numReads && hasNext())
+				skipped++;
+		}
+		return skipped;
+	}
 protected:
 	bool setNextFile() {
 		if (_files.empty()) {
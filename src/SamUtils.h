@@ -86,6 +86,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 #include <string>
 #include <algorithm>
 #include <vector>
+#include <queue>
 
 #include <boost/iostreams/filtering_streambuf.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
@@ -283,6 +284,11 @@ public:
 		reads.clear();
 	}
 
+	// the heap memory held by a read
+	static inline int64_t getMemorySize(const bam1_t *b) {
+		return sizeof(bam1_t) + b->m_data;
+	}
+
 	static void destroyBamVector(BamVector &reads, bool forceDestroy = false) {
 		BamVector &bv = getRecycledReads();
 		for (BamVector::iterator it = reads.begin(); it != reads.end(); it++) {
@@ -540,13 +546,71 @@ public:
 		return readBamFile(comm, filenames, reads);
 	}
 	static BamHeaderPtr readBamFile(const MPI_Comm &comm, std::vector< std::string > filenames, BamVector &reads) {
+		std::vector<long> myEnds;
+		std::vector<samfile_t*> fps;
+		bool needsBalance = false;
+		BamHeaderPtr header = openBamFiles(comm, filenames, fps, myEnds, needsBalance);
+
+		for(int i = 0; i < (int) filenames.size(); i++) {
+			samfile_t *fp = fps[i];
+			if (fp != NULL) {
+				LOG_VERBOSE_OPTIONAL(1, true, "Reading " << filenames[i]);
+				readBamFile(comm, fp, reads, myEnds[i], needsBalance);
+				header.reset(fp->header);
+				closeSamOrBam(fp);
+				fps[i] = NULL;
+				LOG_VERBOSE_OPTIONAL(1, true, "Read " << filenames[i] << " total reads: " << reads.size());
+			}
+		}
+
+		// whether or not balance was needed during the reading
+		// re-balance now to improve sorting partition estimates
+		distributeReadsFinal(comm, reads);
+		LOG_VERBOSE(1, "Total Reads: " << reads.size());
+		return header;
+	}
+
+	// reads from the files opened by openBamFiles until at least maxBytes of reads are held in reads,
+	// closing each file once this rank's portion of it is exhausted
+	// returns true while any file remains to be read
+	static bool readBamFiles(std::vector<samfile_t*> &fps, const std::vector<long> &myEnds, BamVector &reads, int64_t maxBytes, BamHeaderPtr &header) {
+		int64_t bytes = 0;
+		for(BamVector::const_iterator it = reads.begin(); it != reads.end(); it++)
+			bytes += BamManager::getMemorySize(*it);
+		for(int i = 0; i < (int) fps.size(); i++) {
+			samfile_t *fp = fps[i];
+			if (fp == NULL)
+				continue;
+			while (bytes < maxBytes) {
+				if ((myEnds[i] >= 0 && samTell(fp) >= myEnds[i]) || readNextBam(fp, reads) < 0) {
+					header.reset(fp->header);
+					closeSamOrBam(fp);
+					fps[i] = NULL;
+					break;
+				}
+				bytes += BamManager::getMemorySize(reads.back());
+			}
+			if (bytes >= maxBytes)
+				break;
+		}
+		LOG_DEBUG_OPTIONAL(2, true, "readBamFiles(): holding " << reads.size() << " reads in " << bytes << " bytes");
+		for(int i = 0; i < (int) fps.size(); i++)
+			if (fps[i] != NULL)
+				return true;
+		return false;
+	}
+
+	// opens every file that this rank will read a portion of (BAMs are split by byte ranges across the ranks)
+	// fps and myEnds are indexed by filename, with NULL for files this rank does not read
+	// needsBalance is set when the portions are uneven enough to distribute reads while reading
+	static BamHeaderPtr openBamFiles(const MPI_Comm &comm, std::vector< std::string > filenames, std::vector<samfile_t*> &fps, std::vector<long> &myEnds, bool &needsBalance) {
 		int rank, size;
 		MPI_Comm_rank(comm, &rank);
 		MPI_Comm_size(comm, &size);
 		BamHeaderPtr header;
-		std::vector<long> myEnds(filenames.size(), -1);
-		std::vector<samfile_t*> fps(filenames.size(), NULL);
-		bool needsBalance = false;
+		myEnds.assign(filenames.size(), -1);
+		fps.assign(filenames.size(), NULL);
+		needsBalance = false;
 		long totalFileSize = 0;
 		int countSamFiles = 0;
 
@@ -648,22 +712,6 @@ public:
 		MPI_Bcast(&x, 1, MPI_BYTE, 0, comm);
 		needsBalance = x == 1 ? true : false;
 		LOG_DEBUG_OPTIONAL(1, needsBalance && rank == 0, "Balancing reads while reading the files");
-
-		for(int i = 0; i < (int) filenames.size(); i++) {
-			samfile_t *fp = fps[i];
-			if (fp != NULL) {
-				LOG_VERBOSE_OPTIONAL(1, true, "Reading " << filenames[i]);
-				readBamFile(comm, fp, reads, myEnds[i], needsBalance);
-				header.reset(fp->header);
-				closeSamOrBam(fp);
-				LOG_VERBOSE_OPTIONAL(1, true, "Read " << filenames[i] << " total reads: " << reads.size());
-			}
-		}
-
-		// whether or not balance was needed during the reading
-		// re-balance now to improve sorting partition estimates
-		distributeReadsFinal(comm, reads);
-		LOG_VERBOSE(1, "Total Reads: " << reads.size());
 		return header;
 	}
 
@@ -947,6 +995,13 @@ public:
 			else
 				return cmpBamCore(*a, *b) < 0;
 		}
+		// compares only the position of a read with a position, for bounds within a sorted BamVector
+		inline bool operator()(const bam1_p a, const bam1_core_t &b) const {
+			return (*this)(a->core, b);
+		}
+		inline bool operator()(const bam1_core_t &a, const bam1_p b) const {
+			return (*this)(a, b->core);
+		}
 		static inline int cmpBam(const bam1_p a, const bam1_p b) {
 			int _cmp = cmpBamCore(a->core, b->core);
 			if (_cmp == 0) {
@@ -965,9 +1020,13 @@ public:
 			} else
 				return _cmp;
 		}
+		// the packed position, ordered by tid then pos, with unmapped (tid -1) last
+		static inline uint64_t getPositionKey(const bam1_core_t &a) {
+			return ((uint64_t) a.tid << 32 | (a.pos + 1));
+		}
 		static inline int cmpBamCore(const bam1_core_t &a, const bam1_core_t &b) {
-			uint64_t ax = ((uint64_t) a.tid << 32 | (a.pos + 1));
-			uint64_t bx = ((uint64_t) b.tid << 32 | (b.pos + 1));
+			uint64_t ax = getPositionKey(a);
+			uint64_t bx = getPositionKey(b);
 			if (ax < bx)
 				return -1;
 			else if (ax == bx)
@@ -1954,17 +2013,32 @@ public:
 			memcpy(dest, src, sizeof(bam1_core_t));
 		}
 
+		static const int PARTITION_OVERSAMPLING = 32;
+		static const long MAX_PARTITION_SAMPLES = 1048576;
+
 		static BamCoreVector calculateGlobalPartitions(BamVector &sortedReads,
 				const MPI_Comm &mpicomm, int granularity = -1) {
+			std::vector< double > splitFractions;
+			return calculateGlobalPartitions(sortedReads, mpicomm, splitFractions, granularity);
+		}
+		// splitFractions[i] is the fraction of the reads at the position of partition i that belong at or before rank i,
+		// from where the partition fell among the samples at that position, so deep coverage at one position
+		// can still be split across ranks
+		static BamCoreVector calculateGlobalPartitions(BamVector &sortedReads,
+				const MPI_Comm &mpicomm, std::vector< double > &splitFractions, int granularity = -1) {
 			LOG_DEBUG_OPTIONAL(2, true, "calculateGlobalPartitions(): " << sortedReads.size());
 			int myRank, ourSize;
 			MPI_Comm_rank(mpicomm, &myRank);
 			MPI_Comm_size(mpicomm, &ourSize);
+			splitFractions.clear();
 			if (ourSize == 1)
 				return BamCoreVector();
 
-			if (granularity == -1)
-				granularity = (ourSize - 1) * 11;
+			if (granularity == -1) {
+				// oversample every splitter, but bound the samples that every rank gathers
+				long maxSamples = MAX_PARTITION_SAMPLES;
+				granularity = (int) std::max((long) ourSize - 1, std::min((long) (ourSize - 1) * PARTITION_OVERSAMPLING, maxSamples / ourSize));
+			}
 
 			// find first unmapped read
 			int64_t myUnmapped, myTotal = sortedReads.size();
@@ -2054,6 +2128,7 @@ public:
 
 			BamCoreVector partitions;
 			partitions.resize(ourSize - 1);
+			splitFractions.resize(ourSize - 1, 1.0);
 
 			bam1_core_t **tmp = (bam1_core_t**) calloc(numSamples,
 					sizeof(bam1_core_t*));
@@ -2070,8 +2145,16 @@ public:
 				bam1_core_t *b;
 				if (idx >= numSamples)
 					b = nullCore();
-				else
+				else {
 					b = *(tmp + idx);
+					uint64_t key = SortByPosition::getPositionKey(*b);
+					int first = idx, last = idx;
+					while (first > 0 && SortByPosition::getPositionKey(**(tmp + first - 1)) == key)
+						first--;
+					while (last + 1 < numSamples && SortByPosition::getPositionKey(**(tmp + last + 1)) == key)
+						last++;
+					splitFractions[i] = (double) (idx + 1 - first) / (double) (last + 1 - first);
+				}
 				LOG_DEBUG_OPTIONAL(3, true, "Chose partition for i: " << i << " idx: " << idx << " blocksize: " << blockSize << " numSamples: " << numSamples);
 				copyBamCore(&partitions[i], b);
 			}
@@ -2118,14 +2201,14 @@ public:
 				return sortedCounts;
 			}
 
+			std::vector< double > splitFractions;
 			BamCoreVector partitions = calculateGlobalPartitions(myReads,
-					myComm);
+					myComm, splitFractions);
 
 			// calculate full read counts
 			LongVector sendCounts(ourSize, 0);
 			long totalSendCounts = 0;
 
-			bam1_t *b = BamManager::initOrRecycle();
 			BamVector::iterator start = myReads.begin(), it;
 			for (int i = 0; i < ourSize; i++) {
 				if (i == ourSize - 1) {
@@ -2133,23 +2216,24 @@ public:
 				} else {
 					if (start != myReads.end()) {
 						if (partitions[i].tid >= 0) {
-							memcpy(&(b->core), &partitions[i],
-									sizeof(partitions[i]));
-							it = std::upper_bound(start, myReads.end(), b,
-									SortByPosition());
+							// split the reads at the partition position as the samples were, so a
+							// position with deep coverage is spread over ranks, instead of all to one
+							BamVector::iterator lower = std::lower_bound(myReads.begin(), myReads.end(), partitions[i], SortByPosition());
+							BamVector::iterator upper = std::upper_bound(lower, myReads.end(), partitions[i], SortByPosition());
+							it = lower + (long) ((upper - lower) * splitFractions[i] + 0.5);
+							if (it < start)
+								it = start;
 							sendCounts[i] = (it - start);
 						} else {
+							// the remaining mapped reads stay here, and the remaining ranks share
+							// the rest evenly, counting those mapped reads
 							it = std::lower_bound(start, myReads.end(),
 									nullRead(), SortByPosition());
-							if (it > start) {
-								sendCounts[i] = (it - start);
-								start = it;
-							}
 							int remainingRanks = ourSize - i;
 							long remainingReads = (myReads.end() - start
 									+ remainingRanks - 1) / remainingRanks;
-							sendCounts[i] += remainingReads;
-							it = start + remainingReads;
+							sendCounts[i] = std::max((long) (it - start), remainingReads);
+							it = start + sendCounts[i];
 						}
 					} else {
 						sendCounts[i] = 0;
@@ -2159,7 +2243,6 @@ public:
 				totalSendCounts += sendCounts[i];
 				start = it;
 			}
-			BamManager::destroyOrRecycle(b);
 
 			// BamManager::checkNulls("before exchange: ", myReads);
 			assert(totalSendCounts == (int) myReads.size());
@@ -2204,18 +2287,376 @@ public:
 
 	};
 
+	class MPIExternalSortBam {
+		// A single, coordinated sorted outputFile will be constructed without holding all the reads in memory.
+		// Reads are added in batches of at most getBatchBytes(), sorted and spilled to bgzf compressed runs.
+		// sortGlobal() picks splitters from keys sampled out of every run, exchanges the runs in bounded
+		// rounds (spilling the received reads as new sorted runs) and k-way merges each rank's runs into
+		// its contiguous part of the outputFile.
+	public:
+		// runs are written in segments of at most SAMPLE_INTERVAL reads (and at least MIN_RUN_SAMPLES segments
+		// when there are enough reads), and the first read of every segment is sampled to choose the splitters
+		static const long SAMPLE_INTERVAL = 1024;
+		static const long MIN_RUN_SAMPLES = 128;
+
+		// a sorted run of reads, written as independent bgzf segments so that it can be read from any segment
+		class BamRun {
+		public:
+			BamRun(std::string _filename) : filename(_filename), size(0), mapped(0), segmentReads(1) {}
+			std::string filename;
+			long size, mapped; // reads, and the leading reads that have a position
+			long segmentReads;
+			BamCoreVector firstCores; // the first read of each segment
+			LongVector segmentOffsets; // the file offset of each segment
+		};
+		typedef std::vector< BamRun > BamRuns;
+
+		class BamRunReader {
+		public:
+			BamRunReader(const BamRun &_run) : run(&_run), fp(NULL), bam(BamManager::initOrRecycle()), idx(0), hasBam(false) {
+				fp = bam_open(run->filename.c_str(), "r");
+				if (fp == NULL)
+					LOG_THROW("Could not open the sorted run: " << run->filename);
+			}
+			~BamRunReader() {
+				bam_close(fp);
+				BamManager::destroyOrRecycle(bam);
+			}
+			// position at the first read of segment
+			void seekSegment(long segment) {
+				assert(segment >= 0 && segment < (long) run->segmentOffsets.size());
+				if (bam_seek(fp, run->segmentOffsets[segment] << 16, SEEK_SET) != 0)
+					LOG_THROW("Could not seek within the sorted run: " << run->filename);
+				idx = segment * run->segmentReads;
+				hasBam = false;
+				next();
+			}
+			// position at the first read at or after index
+			void seekIndex(long index) {
+				if (index >= run->size) {
+					idx = run->size;
+					hasBam = false;
+					return;
+				}
+				seekSegment(index / run->segmentReads);
+				while (hasBam && idx < index)
+					next();
+			}
+			// position at the first mapped read at or after core (or the end of the mapped reads)
+			void seekCore(const bam1_core_t &core) {
+				// reads equal to core may start in the last segment that begins before it
+				long segment = std::lower_bound(run->firstCores.begin(), run->firstCores.end(),
+						core, SortByPosition()) - run->firstCores.begin() - 1;
+				seekSegment(std::max(0L, segment));
+				while (hasBam && idx < run->mapped && SortByPosition::cmpBamCore(bam->core, core) < 0)
+					next();
+			}
+			void next() {
+				if (hasBam)
+					idx++;
+				hasBam = idx < run->size && bam_read1(fp, bam) >= 0;
+				if (!hasBam && idx < run->size)
+					LOG_THROW("Could not read " << run->size << " reads from the sorted run: " << run->filename << " (" << idx << ")");
+			}
+			// transfers the current read to the caller and advances
+			bam1_t *take() {
+				assert(hasBam);
+				bam1_t *taken = bam;
+				bam = BamManager::initOrRecycle();
+				next();
+				return taken;
+			}
+			const BamRun *run;
+			bamFile fp;
+			bam1_t *bam;
+			long idx;
+			bool hasBam;
+		};
+		typedef boost::shared_ptr< BamRunReader > BamRunReaderPtr;
+		typedef std::vector< BamRunReaderPtr > BamRunReaders;
+
+		class CompareReaders {
+		public:
+			inline bool operator()(const BamRunReader *a, const BamRunReader *b) const {
+				return SortByPosition::cmpBam(a->bam, b->bam) > 0;
+			}
+		};
+
+		// maxBytes is the memory this rank may use for reads
+		MPIExternalSortBam(const MPI_Comm &_comm, int64_t maxBytes) :
+			batchBytes(std::max((int64_t) 1, maxBytes / 4)), runCount(0), readExchanger(_comm) {
+			myComm = mpi::communicator(_comm, mpi::comm_duplicate);
+			tmpPrefix = Options::getOptions().getTmpDir() + UniqueName::generateUniqueName("/.tmp-bamsort-");
+		}
+		~MPIExternalSortBam() {
+			removeRuns(localRuns);
+			removeRuns(partitionRuns);
+		}
+
+		// the reads to add at a time (an exchange round holds a batch to send plus up to two received)
+		int64_t getBatchBytes() const {
+			return batchBytes;
+		}
+
+		// sorts and spills the reads as a new run, emptying reads
+		void addRun(BamVector &reads) {
+			writeRun(reads, localRuns);
+		}
+
+		// collective
+		long sortGlobal(std::string outputFileName, bam_header_t *header) {
+			int myRank, ourSize;
+			MPI_Comm_rank(myComm, &myRank);
+			MPI_Comm_size(myComm, &ourSize);
+
+			if (ourSize > 1) {
+				BamCoreVector splitters = calculateSplitters();
+				exchangeRuns(splitters);
+			} else {
+				std::swap(localRuns, partitionRuns);
+			}
+
+			std::string partFileName = tmpPrefix + "-part";
+			long count = 0;
+			{
+				std::ofstream os(partFileName.c_str(), std::ios::binary);
+				bgzf_ostream bgzfo(os, myRank == ourSize - 1);
+				if (header != NULL && myRank == 0) {
+					LOG_DEBUG_OPTIONAL(1, true, "Writing header");
+					BamManager::change_SO(header, "coordinate");
+					bgzfo << *header;
+				}
+				count = mergeRuns(partitionRuns, bgzfo);
+			}
+			removeRuns(partitionRuns);
+			LOG_VERBOSE_OPTIONAL(1, true, "MPIExternalSortBam::sortGlobal(): merged " << count << " reads");
+
+			int64_t partLength = FileUtils::getFileSize(partFileName);
+			{
+				std::ifstream is(partFileName.c_str(), std::ios::binary);
+				ScopedMPIFile ourFile(myComm, outputFileName);
+				MPIUtils::concatenateOutput(myComm, ourFile, partLength, is);
+			}
+			unlink(partFileName.c_str());
+			return count;
+		}
+
+	protected:
+		void writeRun(BamVector &reads, BamRuns &runs) {
+			if (reads.empty())
+				return;
+			sortLocal(reads);
+			BamRun run(tmpPrefix + "-run" + boost::lexical_cast<std::string>(runCount++));
+			run.size = reads.size();
+			run.mapped = std::lower_bound(reads.begin(), reads.end(), nullRead(), SortByPosition()) - reads.begin();
+			run.segmentReads = std::max(1L, std::min((long) SAMPLE_INTERVAL, run.size / (long) MIN_RUN_SAMPLES));
+
+			std::ofstream os(run.filename.c_str(), std::ios::binary);
+			for(long i = 0; i < run.size; i += run.segmentReads) {
+				long end = std::min(run.size, i + run.segmentReads);
+				run.firstCores.push_back(reads[i]->core);
+				run.segmentOffsets.push_back(os.tellp());
+				// each segment starts a new bgzf block
+				bgzf_ostream bgzfo(os, end == run.size);
+				for(long j = i; j < end; j++) {
+					bgzfo << *reads[j];
+					BamManager::destroyOrRecycle(reads[j]);
+				}
+			}
+			os.close();
+			if (os.fail())
+				LOG_THROW("Could not write the sorted run: " << run.filename);
+			LOG_DEBUG_OPTIONAL(1, true, "writeRun(): " << run.filename << " with " << run.size << " reads (" << run.mapped << " mapped) in " << run.segmentOffsets.size() << " segments");
+			reads.clear();
+			runs.push_back(run);
+		}
+
+		void removeRuns(BamRuns &runs) {
+			for(BamRuns::iterator it = runs.begin(); it != runs.end(); it++)
+				unlink(it->filename.c_str());
+			runs.clear();
+		}
+
+		// the first read of every segment of every run is the sample
+		BamCoreVector calculateSplitters() {
+			BamCoreVector sampleCores;
+			for(BamRuns::iterator it = localRuns.begin(); it != localRuns.end(); it++)
+				sampleCores.insert(sampleCores.end(), it->firstCores.begin(), it->firstCores.end());
+			std::sort(sampleCores.begin(), sampleCores.end(), SortByPosition());
+
+			std::vector< bam1_t > samples(sampleCores.size());
+			BamVector sampleReads(sampleCores.size(), NULL);
+			for(long i = 0; i < (long) sampleCores.size(); i++) {
+				MPISortBam::copyBamCore(&samples[i].core, &sampleCores[i]);
+				sampleReads[i] = &samples[i];
+			}
+			return MPISortBam::calculateGlobalPartitions(sampleReads, myComm);
+		}
+
+		// Every rank sends to every other rank in turn (rank + shift), in as many rounds as the largest
+		// transfer needs, so a round sends at most a batch and receives at most a batch on every rank.
+		// Reads with a position are partitioned by the splitters, and the reads without a position are split
+		// evenly by count across the ranks from the first splitter without a position.
+		void exchangeRuns(const BamCoreVector &splitters) {
+			int myRank, ourSize;
+			MPI_Comm_rank(myComm, &myRank);
+			MPI_Comm_size(myComm, &ourSize);
+			assert((int) splitters.size() == ourSize - 1);
+
+			int firstUnmapped = ourSize - 1;
+			for(int i = 0; i < ourSize - 1; i++) {
+				if (splitters[i].tid < 0) {
+					firstUnmapped = i;
+					break;
+				}
+			}
+			int unmappedRanks = ourSize - firstUnmapped;
+
+			BamRunReaders readers;
+			for(BamRuns::iterator it = localRuns.begin(); it != localRuns.end(); it++)
+				readers.push_back(BamRunReaderPtr(new BamRunReader(*it)));
+			std::vector< long > ends(readers.size(), 0);
+
+			BamVector received;
+			int64_t receivedBytes = 0;
+			for(int shift = 0; shift < ourSize; shift++) {
+				int dest = (myRank + shift) % ourSize;
+
+				// position every run at its reads for dest
+				for(long r = 0; r < (long) readers.size(); r++) {
+					BamRunReader &reader = *readers[r];
+					const BamRun &run = *reader.run;
+					long unmapped = run.size - run.mapped;
+					if (dest > firstUnmapped)
+						reader.seekIndex(run.mapped + (unmapped * (dest - firstUnmapped) / unmappedRanks));
+					else if (dest > 0)
+						reader.seekCore(splitters[dest - 1]);
+					else
+						reader.seekIndex(0);
+					if (dest >= firstUnmapped)
+						ends[r] = run.mapped + (unmapped * (dest - firstUnmapped + 1) / unmappedRanks);
+					else
+						ends[r] = run.mapped;
+				}
+
+				int ourMore = 1;
+				while (ourMore != 0) {
+					BamVector sendReads;
+					int64_t sendBytes = 0;
+					int myMore = 0;
+					for(long r = 0; r < (long) readers.size(); r++) {
+						BamRunReader &reader = *readers[r];
+						while (reader.hasBam && reader.idx < ends[r]
+								&& (dest >= firstUnmapped || reader.idx >= reader.run->mapped || SortByPosition::cmpBamCore(reader.bam->core, splitters[dest]) < 0)) {
+							if (sendBytes >= batchBytes) {
+								myMore = 1;
+								break;
+							}
+							sendBytes += BamManager::getMemorySize(reader.bam);
+							sendReads.push_back(reader.take());
+						}
+						if (myMore != 0)
+							break;
+					}
+
+					LongVector sendCounts(ourSize, 0), sendOffsets(ourSize, 0), recvOffsets(ourSize, 0), recvCounts;
+					sendCounts[dest] = sendReads.size();
+					BamVector recvReads;
+					while (!readExchanger.exchangeReads(sendReads, sendOffsets,
+							sendCounts, recvReads, recvOffsets, recvCounts, true).isDone())
+						;
+					BamManager::destroyBamVector(sendReads);
+					for(BamVector::iterator it = recvReads.begin(); it != recvReads.end(); it++) {
+						receivedBytes += BamManager::getMemorySize(*it);
+						received.push_back(*it);
+					}
+					if (receivedBytes >= batchBytes) {
+						writeRun(received, partitionRuns);
+						receivedBytes = 0;
+					}
+
+					if (MPI_SUCCESS != MPI_Allreduce(&myMore, &ourMore, 1, MPI_INT, MPI_LOR, myComm))
+						LOG_THROW("MPI_Allreduce() failed");
+				}
+			}
+			writeRun(received, partitionRuns);
+			readers.clear();
+			removeRuns(localRuns);
+			LOG_VERBOSE_OPTIONAL(1, true, "MPIExternalSortBam::exchangeRuns(): received " << partitionRuns.size() << " runs");
+		}
+
+		static long mergeRuns(const BamRuns &runs, std::ostream &os) {
+			BamRunReaders readers;
+			std::priority_queue< BamRunReader*, std::vector< BamRunReader* >, CompareReaders > heap;
+			for(BamRuns::const_iterator it = runs.begin(); it != runs.end(); it++) {
+				BamRunReaderPtr reader(new BamRunReader(*it));
+				readers.push_back(reader);
+				reader->seekIndex(0);
+				if (reader->hasBam)
+					heap.push(reader.get());
+			}
+			long count = 0;
+			while (!heap.empty()) {
+				BamRunReader *reader = heap.top();
+				heap.pop();
+				os << *reader->bam;
+				count++;
+				reader->next();
+				if (reader->hasBam)
+					heap.push(reader);
+			}
+			return count;
+		}
+
+	private:
+		mpi::communicator myComm;
+		int64_t batchBytes;
+		int runCount;
+		std::string tmpPrefix;
+		BamRuns localRuns, partitionRuns;
+		MPIReadExchanger readExchanger;
+	};
+
+	class PositionRecord {
+	public:
+		uint64_t key;
+		bam1_p bam;
+	};
+	typedef std::vector< PositionRecord > PositionRecordVector;
+
 	// in-place sorts a BamVector
+	// the packed positions are radix sorted, then only the reads sharing a position
+	// are compared (by name, etc) with SortByPosition
 	static void sortLocal(BamVector &reads) {
 		LOG_DEBUG_OPTIONAL(1, true, "sortLocal(): " << reads.size());
 		//BamManager::checkNulls("Before sortLocal:", reads);
-		std::sort(reads.begin(), reads.end(), SortByPosition());
-
-		// TODO parallel sort with threads
-		// partition
-		// std::sort each partition
-		// find median of medians
-		// MergeSortedRanges (into new vector of NULLs)
-		// swap with old vector
+		long size = reads.size();
+		PositionRecordVector records(size);
+		#pragma omp parallel for
+		for (long i = 0; i < size; i++) {
+			records[i].key = SortByPosition::getPositionKey(reads[i]->core);
+			records[i].bam = reads[i];
+		}
+		RadixSort< PositionRecord >::sort(records);
+
+		LongVector tieStarts;
+		for (long i = 0; i < size; i++) {
+			reads[i] = records[i].bam;
+			if (i + 1 < size && records[i].key == records[i + 1].key && (i == 0 || records[i - 1].key != records[i].key))
+				tieStarts.push_back(i);
+		}
+		PositionRecordVector().swap(records);
+		long numTies = tieStarts.size();
+		LOG_DEBUG_OPTIONAL(2, true, "sortLocal(): sorting " << numTies << " positions with more than one read");
+
+		#pragma omp parallel for schedule(dynamic, 64)
+		for (long t = 0; t < numTies; t++) {
+			BamVector::iterator begin = reads.begin() + tieStarts[t], end = begin + 1;
+			uint64_t key = SortByPosition::getPositionKey((*begin)->core);
+			while (end != reads.end() && SortByPosition::getPositionKey((*end)->core) == key)
+				end++;
+			std::sort(begin, end, SortByPosition());
+		}
 
 		//BamManager::checkNulls("After sortLocal:", reads);
 		LOG_DEBUG_OPTIONAL(2, true, "sortLocal(): finished");
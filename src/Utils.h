@@ -1591,7 +1591,7 @@ public:
 		size_t pos1 = 0, pos2 = 0;
 		while( true ) {
 			pos2 = cmd.find_first_of(' ', pos1);
-			arguments.push_back( cmd.substr(pos1, pos2) );
+			arguments.push_back( cmd.substr(pos1, pos2 == std::string::npos ? pos2 : pos2 - pos1) );
 			if (pos2 == std::string::npos)
 				break;
 			pos1 = pos2 + 1;
@@ -2086,6 +2086,192 @@ private:
 
 };
 
+// stable least significant byte radix sort of records by their uint64_t 'key' member
+// each pass counts and scatters with per-thread histograms, and passes over a byte
+// that is the same in every key are skipped
+template<typename Record>
+class RadixSort {
+public:
+	static const long MIN_RECORDS_PER_THREAD = 16384;
+	typedef std::vector< Record > RecordVector;
+
+	static void sort(RecordVector &records) {
+		long size = records.size();
+		if (size < 2)
+			return;
+		long minPerThread = MIN_RECORDS_PER_THREAD;
+		int numThreads = std::max(1L, std::min((long) omp_get_max_threads(), size / minPerThread));
+
+		RecordVector tmp(size);
+		Record *src = &records[0], *dst = &tmp[0];
+		std::vector< long > counts(numThreads * 256);
+		for (int shift = 0; shift < 64; shift += 8) {
+			std::fill(counts.begin(), counts.end(), 0);
+
+			#pragma omp parallel num_threads(numThreads)
+			{
+				int threadNum = omp_get_thread_num();
+				long *myCounts = &counts[threadNum * 256];
+				long end = size * (threadNum + 1) / numThreads;
+				for (long i = size * threadNum / numThreads; i < end; i++)
+					myCounts[(src[i].key >> shift) & 0xff]++;
+			}
+
+			bool isConstant = false;
+			long offset = 0;
+			for (int byte = 0; byte < 256 && !isConstant; byte++) {
+				long byteOffset = offset;
+				for (int threadNum = 0; threadNum < numThreads; threadNum++) {
+					long count = counts[threadNum * 256 + byte];
+					counts[threadNum * 256 + byte] = offset;
+					offset += count;
+				}
+				isConstant = (offset - byteOffset == size);
+			}
+			if (isConstant)
+				continue;
+
+			#pragma omp parallel num_threads(numThreads)
+			{
+				int threadNum = omp_get_thread_num();
+				long *myOffsets = &counts[threadNum * 256];
+				long end = size * (threadNum + 1) / numThreads;
+				for (long i = size * threadNum / numThreads; i < end; i++)
+					dst[ myOffsets[(src[i].key >> shift) & 0xff]++ ] = src[i];
+			}
+			std::swap(src, dst);
+		}
+		if (src != &records[0])
+			records.swap(tmp);
+	}
+};
+
+// fixed memory count-min sketch of saturating 8-bit counts keyed by a 64-bit hash
+// the counter in each of the numHashes rows is chosen by double hashing the two 32-bit halves of the hash
+// and increments are conservative (only the minimal counters grow), which keeps over-estimates low
+class CountMinSketch {
+public:
+	typedef unsigned char CountType;
+	typedef std::vector< CountType > CountVector;
+	static const CountType MAX_COUNT = 255;
+
+	CountMinSketch(unsigned long memoryBytes, int numHashes) : _numHashes(std::max(1, numHashes)) {
+		_width = std::max(1ul, memoryBytes / _numHashes);
+		_counts.resize(_width * _numHashes, 0);
+	}
+	unsigned long getMemoryBytes() const {
+		return _counts.size();
+	}
+	int getNumHashes() const {
+		return _numHashes;
+	}
+	CountType getCount(uint64_t hash) const {
+		CountType minCount = MAX_COUNT;
+		for(int row = 0; row < _numHashes; row++)
+			minCount = std::min(minCount, _counts[_getIndex(hash, row)]);
+		return minCount;
+	}
+	// returns the new estimated count
+	CountType increment(uint64_t hash) {
+		CountType minCount = getCount(hash);
+		if (minCount == MAX_COUNT)
+			return minCount;
+		for(int row = 0; row < _numHashes; row++) {
+			CountType &count = _counts[_getIndex(hash, row)];
+			if (count == minCount)
+				count++;
+		}
+		return minCount + 1;
+	}
+	// the fraction of non-zero counters, the chance a new key collides in a single row
+	double getOccupancy() const {
+		unsigned long used = 0, size = _counts.size();
+		#pragma omp parallel for reduction(+:used)
+		for(long i = 0; i < (long) size; i++)
+			if (_counts[i] != 0)
+				used++;
+		return (double) used / (double) size;
+	}
+	// the chance that an unseen key reports a non-zero count
+	double getFalsePositiveRate() const {
+		return pow(getOccupancy(), _numHashes);
+	}
+
+protected:
+	inline unsigned long _getIndex(uint64_t hash, int row) const {
+		uint64_t h1 = hash & 0xffffffff, h2 = (hash >> 32) | 1;
+		return row * _width + (h1 + row * h2) % _width;
+	}
+
+	int _numHashes;
+	unsigned long _width;
+	CountVector _counts;
+};
+
+// HyperLogLog cardinality estimate from 2^precision 8-bit registers keyed by a 64-bit hash
+// the top precision bits select the register, which keeps the longest run of leading zeros seen in the rest.
+// Sketches of separate streams merge by a register-wise max (i.e. an MPI max-reduction of getRegisters())
+class HyperLogLog {
+public:
+	typedef unsigned char RegisterType;
+	typedef std::vector< RegisterType > RegisterVector;
+	static const int DEFAULT_PRECISION = 16;
+
+	HyperLogLog(int precision = DEFAULT_PRECISION) : _precision(std::min(18, std::max(4, precision))) {
+		_registers.resize(1ul << _precision, 0);
+	}
+	int getPrecision() const {
+		return _precision;
+	}
+	RegisterVector &getRegisters() {
+		return _registers;
+	}
+	const RegisterVector &getRegisters() const {
+		return _registers;
+	}
+	void add(uint64_t hash) {
+		uint64_t rest = hash << _precision;
+		RegisterType rank = rest == 0 ? (RegisterType) (64 - _precision + 1) : (RegisterType) (__builtin_clzll(rest) + 1);
+		RegisterType &reg = _registers[hash >> (64 - _precision)];
+		if (rank > reg)
+			reg = rank;
+	}
+	void merge(const HyperLogLog &other) {
+		if (other._precision != _precision)
+			LOG_THROW("HyperLogLog::merge(): can not merge precision " << other._precision << " into " << _precision);
+		for(size_t i = 0; i < _registers.size(); i++)
+			if (other._registers[i] > _registers[i])
+				_registers[i] = other._registers[i];
+	}
+	void reset() {
+		std::fill(_registers.begin(), _registers.end(), 0);
+	}
+	double estimate() const {
+		double m = _registers.size();
+		double sum = 0.0;
+		long zeros = 0;
+		for(size_t i = 0; i < _registers.size(); i++) {
+			sum += ldexp(1.0, - (int) _registers[i]);
+			if (_registers[i] == 0)
+				zeros++;
+		}
+		double alpha = 0.7213 / (1.0 + 1.079 / m);
+		double e = alpha * m * m / sum;
+		// linear counting is more accurate while many registers are still empty
+		if (e <= 2.5 * m && zeros > 0)
+			e = m * log(m / (double) zeros);
+		return e;
+	}
+	// the relative standard error of estimate()
+	double getStandardError() const {
+		return 1.04 / sqrt((double) _registers.size());
+	}
+
+protected:
+	int _precision;
+	RegisterVector _registers;
+};
+
 template<typename V, typename T = float>
 class RankVector {
 public:
@@ -2141,7 +2327,7 @@ public:
 	T getSpearmanDistance(const RankVector &other) const {
 		return getSpearmanDistance(*this, other);
 	}
-	static T getSpearmanDistance(const RankVector a, const RankVector b) {
+	static T getSpearmanDistance(const RankVector &a, const RankVector &b) {
 		assert(a.ranks.size() == b.ranks.size());
 		T mean = (a.ranks.size() + 1) / 2;
 		T dist = 0, sum_xy = 0.0, sum_x2 = 0, sum_y2 = 0;
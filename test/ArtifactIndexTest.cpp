@@ -0,0 +1,208 @@
+//
+// Kmernator/test/ArtifactIndexTest.cpp
+//
+/*****************
+
+Kmernator Copyright (c) 2012, The Regents of the University of California,
+through Lawrence Berkeley National Laboratory (subject to receipt of any
+required approvals from the U.S. Dept. of Energy).  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+(1) Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+(2) Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+(3) Neither the name of the University of California, Lawrence Berkeley
+National Laboratory, U.S. Dept. of Energy nor the names of its contributors may
+be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+You are under no obligation whatsoever to provide any bug fixes, patches, or
+upgrades to the features, functionality or performance of the source code
+("Enhancements") to anyone; however, if you choose to make your Enhancements
+available either publicly, or directly to Lawrence Berkeley National
+Laboratory, without imposing a separate written license agreement for such
+Enhancements, then you hereby grant the following license: a  non-exclusive,
+royalty-free perpetual license to install, use, modify, prepare derivative
+works, incorporate into other computer software, distribute, and sublicense
+such enhancements or derivative works thereof, in binary and source code form.
+
+*****************/
+
+
+#include "config.h"
+#include "FilterKnownOddities.h"
+#define BOOST_TEST_MODULE ArtifactIndexTest
+#include <boost/test/unit_test.hpp>
+
+// a reproducible random sequence
+std::string makeSequence(std::string::size_type length, unsigned long seed) {
+	static const char bases[] = "ACGT";
+	std::string fasta(length, 'A');
+	unsigned long state = seed;
+	for(std::string::size_type i = 0; i < length; i++) {
+		state = state * 6364136223846793005ul + 1442695040888963407ul;
+		fasta[i] = bases[(state >> 33) & 3];
+	}
+	return fasta;
+}
+
+std::string reverseComplement(const std::string &fasta) {
+	std::string rc(fasta.rbegin(), fasta.rend());
+	for(std::string::size_type i = 0; i < rc.length(); i++)
+		rc[i] = rc[i] == 'A' ? 'T' : rc[i] == 'C' ? 'G' : rc[i] == 'G' ? 'C' : 'A';
+	return rc;
+}
+
+std::string substitute(const std::string &fasta, std::string::size_type pos) {
+	std::string mutated = fasta;
+	mutated[pos] = mutated[pos] == 'A' ? 'C' : 'A';
+	return mutated;
+}
+
+unsigned int naiveMismatches(const std::string &a, const std::string &b) {
+	unsigned int mismatches = 0;
+	for(std::string::size_type i = 0; i < a.length(); i++)
+		if (a[i] != b[i])
+			mismatches++;
+	return mismatches;
+}
+
+// the packed popcount agrees with a base by base count, across word boundaries
+void testCountMismatches() {
+	std::string a = makeSequence(150, 1), b = a;
+	for(std::string::size_type i = 0; i < b.length(); i += 7)
+		b = substitute(b, i);
+	ArtifactIndex::PackedSequence packedA, packedB;
+	ArtifactIndex::pack(a, packedA);
+	ArtifactIndex::pack(b, packedB);
+	for(SequenceLengthType offset = 0; offset < 40; offset += 13) {
+		for(SequenceLengthType length = 1; offset + length <= 150; length += 11) {
+			unsigned int expected = naiveMismatches(a.substr(offset, length), b.substr(offset, length));
+			BOOST_CHECK_EQUAL(ArtifactIndex::countMismatches(packedA, offset, packedB, offset, length, length), expected);
+		}
+	}
+}
+
+// a window with up to maxErrors substitutions matches, on either strand, and one more does not
+void testSeedAndVerify(SequenceLengthType length, unsigned int maxErrors) {
+	std::string artifact = makeSequence(200, 2);
+	ArtifactIndex index(length, maxErrors);
+	index.addSequence(artifact, 7);
+	index.build();
+	BOOST_CHECK_EQUAL(index.getNumSeeds(), 2ul * (maxErrors + 1) * (200 - length + 1));
+
+	ArtifactIndex::PackedSequence packed;
+	ArtifactIndex::Values values;
+	for(SequenceLengthType pos = 0; pos + length <= 200; pos += 37) {
+		for(int strand = 0; strand < 2; strand++) {
+			std::string window = artifact.substr(pos, length);
+			if (strand == 1)
+				window = reverseComplement(window);
+			// the substitutions fall in different segments, the last one in the final base
+			for(unsigned int errors = 0; errors <= maxErrors + 1; errors++) {
+				std::string read = "GG" + window + "TT";
+				if (errors > 0)
+					read = substitute(read, 2 + length - 1);
+				for(unsigned int error = 1; error < errors; error++)
+					read = substitute(read, 2 + (error - 1) * length / (maxErrors + 1));
+				ArtifactIndex::pack(read, packed);
+				index.findMatches(packed, 2, values);
+				if (errors <= maxErrors) {
+					BOOST_CHECK_EQUAL(values.size(), 1u);
+					if (!values.empty())
+						BOOST_CHECK_EQUAL(values[0], 7u);
+				} else {
+					BOOST_CHECK(values.empty());
+				}
+			}
+		}
+	}
+}
+
+// matches agree with a brute force search over every window of every artifact
+void testMatchesBruteForce(SequenceLengthType length, unsigned int maxErrors) {
+	std::vector< std::string > artifacts;
+	artifacts.push_back(makeSequence(120, 3));
+	artifacts.push_back(makeSequence(90, 4));
+	ArtifactIndex index(length, maxErrors);
+	for(unsigned int i = 0; i < artifacts.size(); i++)
+		index.addSequence(artifacts[i], i + 1);
+	index.build();
+
+	ArtifactIndex::PackedSequence packed;
+	ArtifactIndex::Values values;
+	for(unsigned long seed = 10; seed < 40; seed++) {
+		// reads built from artifact windows with a few random substitutions
+		const std::string &artifact = artifacts[seed % 2];
+		std::string read = artifact.substr(seed % 20, length + 10);
+		if (seed % 3 == 0)
+			read = reverseComplement(read);
+		for(unsigned long i = 0; i < seed % 4; i++)
+			read = substitute(read, (seed * 31 + i * 17) % read.length());
+		ArtifactIndex::pack(read, packed);
+		for(SequenceLengthType offset = 0; offset + length <= read.length(); offset++) {
+			ArtifactIndex::Values expected;
+			for(unsigned int i = 0; i < artifacts.size(); i++) {
+				bool matched = false;
+				for(int strand = 0; strand < 2 && !matched; strand++) {
+					std::string target = strand == 0 ? artifacts[i] : reverseComplement(artifacts[i]);
+					for(SequenceLengthType pos = 0; pos + length <= target.length() && !matched; pos++)
+						matched = naiveMismatches(read.substr(offset, length), target.substr(pos, length)) <= maxErrors;
+				}
+				if (matched)
+					expected.push_back(i + 1);
+			}
+			index.findMatches(packed, offset, values);
+			BOOST_CHECK(values == expected);
+		}
+	}
+}
+
+// a window in several artifacts lists the first added first
+void testFirstAdded() {
+	std::string shared = makeSequence(40, 5);
+	ArtifactIndex index(24, 2);
+	index.addSequence(makeSequence(30, 6) + shared, 1);
+	index.addSequence(shared + makeSequence(30, 7), 2);
+	index.build();
+	ArtifactIndex::PackedSequence packed;
+	ArtifactIndex::Values values;
+	ArtifactIndex::pack(substitute(shared, 3), packed);
+	index.findMatches(packed, 0, values);
+	BOOST_CHECK_EQUAL(values.size(), 2u);
+	if (!values.empty())
+		BOOST_CHECK_EQUAL(values.front(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE( ArtifactIndexTest )
+{
+	testCountMismatches();
+	testSeedAndVerify(24, 2);
+	testSeedAndVerify(29, 2);
+	testSeedAndVerify(40, 2);
+	testSeedAndVerify(64, 2);
+	testSeedAndVerify(100, 2);
+	testSeedAndVerify(40, 0);
+	testSeedAndVerify(40, 1);
+	testMatchesBruteForce(24, 2);
+	testMatchesBruteForce(40, 2);
+	testMatchesBruteForce(64, 2);
+	testFirstAdded();
+}
@@ -0,0 +1,140 @@
+//
+// Kmernator/test/ContigExtenderTest.cpp
+//
+/*****************
+
+Kmernator Copyright (c) 2012, The Regents of the University of California,
+through Lawrence Berkeley National Laboratory (subject to receipt of any
+required approvals from the U.S. Dept. of Energy).  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+(1) Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+(2) Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+(3) Neither the name of the University of California, Lawrence Berkeley
+National Laboratory, U.S. Dept. of Energy nor the names of its contributors may
+be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+You are under no obligation whatsoever to provide any bug fixes, patches, or
+upgrades to the features, functionality or performance of the source code
+("Enhancements") to anyone; however, if you choose to make your Enhancements
+available either publicly, or directly to Lawrence Berkeley National
+Laboratory, without imposing a separate written license agreement for such
+Enhancements, then you hereby grant the following license: a  non-exclusive,
+royalty-free perpetual license to install, use, modify, prepare derivative
+works, incorporate into other computer software, distribute, and sublicense
+such enhancements or derivative works thereof, in binary and source code form.
+
+*****************/
+
+
+#include "config.h"
+#include "ReadSet.h"
+#include "KmerSpectrum.h"
+#include "ContigExtender.h"
+#define BOOST_TEST_MODULE ContigExtenderTest
+#include <boost/test/unit_test.hpp>
+
+typedef KmerMapByKmerArrayPair< TrackingDataMinimal4f > MapType;
+typedef KmerSpectrum<MapType, MapType> KS;
+
+// a reproducible sequence without repeated 21-mers
+std::string makeGenome(std::string::size_type length) {
+	static const char bases[] = "ACGT";
+	std::string genome(length, 'A');
+	unsigned long state = 12345;
+	for(std::string::size_type i = 0; i < length; i++) {
+		state = state * 6364136223846793005ul + 1442695040888963407ul;
+		genome[i] = bases[(state >> 33) & 3];
+	}
+	return genome;
+}
+
+// reads of readLength every step bases, alternating strands
+ReadSet makeReads(const std::string &genome, std::string::size_type readLength, std::string::size_type step) {
+	ReadSet reads;
+	for(std::string::size_type pos = 0, i = 0; pos + readLength <= genome.length(); pos += step, i++) {
+		std::string fasta = genome.substr(pos, readLength);
+		if (i % 2 == 1)
+			fasta = LocalDeBruijnExtender::reverseComplement(fasta);
+		reads.append(Read("read" + boost::lexical_cast<std::string>(i), fasta, std::string(readLength, Read::REF_QUAL), ""));
+	}
+	return reads;
+}
+
+void testLocalDeBruijnExtender() {
+	std::string genome = makeGenome(400);
+	ReadSet reads = makeReads(genome, 60, 3);
+	LocalDeBruijnExtender extender(reads, 21, 31, 2);
+	std::string contig = genome.substr(150, 100);
+	std::string::size_type leftTotal, rightTotal;
+
+	// no extension at all
+	BOOST_CHECK_EQUAL(extender.extend(contig, 0, leftTotal, rightTotal), contig);
+	BOOST_CHECK_EQUAL(leftTotal, 0u);
+	BOOST_CHECK_EQUAL(rightTotal, 0u);
+
+	// up to maxExtend bases on either end
+	BOOST_CHECK_EQUAL(extender.extend(contig, 50, leftTotal, rightTotal), genome.substr(100, 200));
+	BOOST_CHECK_EQUAL(leftTotal, 50u);
+	BOOST_CHECK_EQUAL(rightTotal, 50u);
+
+	// until the coverage tapers off near the ends of the reads, from either strand of the contig
+	std::string covered = genome.substr(12, 375);
+	BOOST_CHECK_EQUAL(extender.extend(contig, 1000, leftTotal, rightTotal), covered);
+	BOOST_CHECK_EQUAL(leftTotal, 138u);
+	BOOST_CHECK_EQUAL(rightTotal, 137u);
+	std::string rc = LocalDeBruijnExtender::reverseComplement(contig);
+	BOOST_CHECK_EQUAL(extender.extend(rc, 1000, leftTotal, rightTotal), LocalDeBruijnExtender::reverseComplement(covered));
+	BOOST_CHECK_EQUAL(leftTotal, 137u);
+	BOOST_CHECK_EQUAL(rightTotal, 138u);
+
+	// a contig shorter than the smallest kmer is left alone
+	BOOST_CHECK_EQUAL(extender.extend(contig.substr(0, 20), 50, leftTotal, rightTotal), contig.substr(0, 20));
+	BOOST_CHECK_EQUAL(leftTotal + rightTotal, 0u);
+
+	// thin coverage does not extend
+	ReadSet thinReads = makeReads(genome, 60, 30);
+	LocalDeBruijnExtender thin(thinReads, 21, 31, 2);
+	BOOST_CHECK_EQUAL(thin.extend(contig, 50, leftTotal, rightTotal), contig);
+}
+
+// the native extender must agree with the serial spectrum extender
+void testMatchesContigExtender() {
+	std::string genome = makeGenome(400);
+	ReadSet reads = makeReads(genome, 60, 3);
+	ReadSet contigs;
+	contigs.append(Read("contig", genome.substr(150, 100), std::string(100, Read::REF_QUAL), ""));
+
+	ReadSet extended = ContigExtender<KS>::extendContigs(contigs, reads, 50, 21, 31, 2);
+	BOOST_CHECK_EQUAL(extended.getSize(), 1u);
+	if (extended.getSize() == 1) {
+		std::string::size_type leftTotal, rightTotal;
+		LocalDeBruijnExtender extender(reads, 21, 31, 2);
+		BOOST_CHECK_EQUAL(extender.extend(contigs.getRead(0).getFasta(), 50, leftTotal, rightTotal), extended.getRead(0).getFasta());
+	}
+}
+
+BOOST_AUTO_TEST_CASE( ContigExtenderTest )
+{
+	testLocalDeBruijnExtender();
+	testMatchesContigExtender();
+}
@@ -38,6 +38,7 @@
 #include <cstring>
 #include <iostream>
 #include <cstdlib>
+#include <set>
 
 // Note for versbosity: export BOOST_TEST_LOG_LEVEL=message
 
@@ -505,7 +506,29 @@ void testKmerArray(SequenceLengthType size) {
 		}
 	}
 
+	// KmerNeighbours must produce the least complements of exactly the permuteBases set
+	KmerNeighbours neighbours;
+	for (Kmer::IndexType i = 0; i < kmersFloat.size() && i < 5; i++) {
+		KmerArrayPair<float> permutations, generated;
+		KmerArrayPair<float>::permuteBases(	kmersFloat[i], permutations, 2);
+		unsigned long count = neighbours.appendNeighbours(kmersFloat[i], generated, 1, true, 1.0f);
+		count += neighbours.appendNeighbours(kmersFloat[i], generated, 2, true, 2.0f);
+		BOOST_CHECK_EQUAL(count, generated.size());
+		BOOST_CHECK_EQUAL(permutations.size(), generated.size());
 
+		std::set<std::string> expected, observed;
+		TEMP_KMER(least);
+		for (Kmer::IndexType j = 0; j < permutations.size(); j++) {
+			permutations[j].buildLeastComplement(least);
+			expected.insert(least.toFasta());
+		}
+		for (Kmer::IndexType j = 0; j < generated.size(); j++) {
+			generated[j].buildLeastComplement(least);
+			BOOST_CHECK_EQUAL(least.toFasta(), generated[j].toFasta());
+			observed.insert(generated[j].toFasta());
+		}
+		BOOST_CHECK(expected == observed);
+	}
 
 }
 
@@ -148,6 +148,10 @@ then
     $samtools view -h ${testoutsorted} | awk '{print $3" "$4}' > ${testoutsam3}
     diff -q ${testoutsam3} ${sortedorder} || failed mpi $i BamSort-P multiple-sam sort-order failed
 
+    $MPI $mpi  ../apps/BamSort-P --max-memory 1 --temp-dir ${T} ${testoutsorted} ${testbampart1} ${testbampart2}
+    $samtools view -h ${testoutsorted} | awk '{print $3" "$4}' > ${testoutsam3}
+    diff -q ${testoutsam3} ${sortedorder} || failed mpi $i BamSort-P --max-memory multiple-bam sort-order failed
+
     # build list of unmapped read ids
     $samtools view ${testoutsorted} | awk '(and($2,0x04) == 0x00) {print $1}' | sort > ${testoutsorted}-mapped-read-ids
     $samtools view ${testoutsorted} | awk '(and($2,0x04) == 0x04) && $3 != "*" {print $1}' | sort > ${testoutsorted}-unmapped-paired-read-ids
@@ -160,6 +164,12 @@ then
     $samtools view ${testoutsorted} | awk '{print $1}' | sort > ${testoutsorted}.xx
     cat ${testoutsorted}-mapped-read-ids ${testoutsorted}-unmapped-paired-read-ids | sort | diff - ${testoutsorted}.xx || failed mpi --unmapped-reads included wrong set in bam
 
+    $MPI $mpi  ../apps/BamSort-P --max-memory 1 --temp-dir ${T} --unmapped-reads ${testoutsorted}-unmapped.fastq.gz ${testoutsorted} ${testsampart1} ${testsampart2}
+    gunzip -c ${testoutsorted}-unmapped.fastq.gz | awk 'NR % 4 == 1 {print}' | sed 's/\/.*//;s/^@//;' | sort > ${testoutsorted}.xx
+    diff ${testoutsorted}.xx ${testoutsorted}-all-unmapped-read-ids || failed mpi --max-memory --unmapped-reads wrong set of reads in fastq.gz
+    $samtools view ${testoutsorted} | awk '{print $1}' | sort > ${testoutsorted}.xx
+    cat ${testoutsorted}-mapped-read-ids ${testoutsorted}-unmapped-paired-read-ids | sort | diff - ${testoutsorted}.xx || failed mpi --max-memory --unmapped-reads included wrong set in bam
+
     $MPI $mpi  ../apps/BamSort-P --keep-unmapped-paired-read false --unmapped-reads ${testoutsorted}-unmapped.fastq.gz ${testoutsorted} ${testsampart1} ${testsampart2}
     gunzip -c ${testoutsorted}-unmapped.fastq.gz | awk 'NR % 4 == 1 {print}' | sed 's/\/.*//;s/^@//;' | sort > ${testoutsorted}.xx
     diff ${testoutsorted}.xx ${testoutsorted}-all-unmapped-read-ids || failed mpi --unmapped-reads wrong set of reads in fastq.gz
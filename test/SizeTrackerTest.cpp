@@ -0,0 +1,103 @@
+//
+// Kmernator/test/SizeTrackerTest.cpp
+//
+/*****************
+
+Kmernator Copyright (c) 2012, The Regents of the University of California,
+through Lawrence Berkeley National Laboratory (subject to receipt of any
+required approvals from the U.S. Dept. of Energy).  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+(1) Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+(2) Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+(3) Neither the name of the University of California, Lawrence Berkeley
+National Laboratory, U.S. Dept. of Energy nor the names of its contributors may
+be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+You are under no obligation whatsoever to provide any bug fixes, patches, or
+upgrades to the features, functionality or performance of the source code
+("Enhancements") to anyone; however, if you choose to make your Enhancements
+available either publicly, or directly to Lawrence Berkeley National
+Laboratory, without imposing a separate written license agreement for such
+Enhancements, then you hereby grant the following license: a  non-exclusive,
+royalty-free perpetual license to install, use, modify, prepare derivative
+works, incorporate into other computer software, distribute, and sublicense
+such enhancements or derivative works thereof, in binary and source code form.
+
+*****************/
+
+
+#include "config.h"
+#include "KmerSpectrum.h"
+#define BOOST_TEST_MODULE SizeTrackerTest
+#include <boost/test/unit_test.hpp>
+
+typedef KmerMapByKmerArrayPair< TrackingDataMinimal4f > MapType;
+typedef KmerSpectrum<MapType, MapType> KS;
+typedef KS::SizeTracker SizeTracker;
+typedef SizeTracker::GrowthModel GrowthModel;
+
+// the unique kmers of a GrowthModel, tracked at the same raw kmer counts as SizeTracker::track()
+SizeTracker makeTracker(const GrowthModel &truth, double maxRawKmers, double noise = 0.0) {
+	SizeTracker tracker;
+	unsigned long state = 12345;
+	for(double raw = 128; raw <= maxRawKmers; raw *= 1.05) {
+		state = state * 6364136223846793005ul + 1442695040888963407ul;
+		double jitter = 1.0 + noise * (((state >> 33) & 0xffff) / 32768.0 - 1.0);
+		long unique = (long) (truth.predict(raw) * jitter);
+		tracker.elements.push_back(SizeTracker::SizeTrackerElement((long) raw, (long) raw, unique, 0));
+	}
+	return tracker;
+}
+
+void checkFit(double errorRate, double genomeSize, double maxRawKmers, double noise, double tolerance) {
+	GrowthModel model = makeTracker(GrowthModel(errorRate, genomeSize), maxRawKmers, noise).fitGrowthModel();
+	BOOST_CHECK(model.converged);
+	BOOST_CHECK_CLOSE(model.errorRate, errorRate, tolerance);
+	BOOST_CHECK_CLOSE(model.genomeSize, genomeSize, tolerance);
+}
+
+BOOST_AUTO_TEST_CASE( SizeTrackerTest )
+{
+	// saturated genomes, exactly and with 0.1% noise
+	checkFit(0.01, 5000000.0, 200000000.0, 0.0, 0.1);
+	checkFit(0.2, 100000.0, 10000000.0, 0.0, 0.1);
+	checkFit(0.01, 5000000.0, 200000000.0, 0.001, 2.0);
+
+	// an error rate beyond --max-error-rate ends on the bound, so it is not converged
+	GrowthModel clamped = makeTracker(GrowthModel(0.8, 100000.0), 10000000.0).fitGrowthModel(0.5);
+	BOOST_CHECK(!clamped.converged);
+	BOOST_CHECK_EQUAL(clamped.errorRate, 0.5);
+
+	// so is a genome far larger than the raw kmers, whose curve is only a line
+	GrowthModel unsaturated = makeTracker(GrowthModel(0.01, 90000000000.0), 1000000.0).fitGrowthModel();
+	BOOST_CHECK(!unsaturated.converged);
+
+	// too few iterations to get there
+	GrowthModel stopped = makeTracker(GrowthModel(0.01, 5000000.0), 200000000.0).fitGrowthModel(0.5, 1);
+	BOOST_CHECK(!stopped.converged);
+	BOOST_CHECK_EQUAL(stopped.iterations, 2);
+
+	// and too few points to fit
+	SizeTracker empty;
+	BOOST_CHECK(!empty.fitGrowthModel().converged);
+}
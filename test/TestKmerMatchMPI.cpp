@@ -50,6 +50,7 @@ such enhancements or derivative works thereof, in binary and source code form.
 
 #include "DistributedFunctions.h"
 #include "KmerMatch.h"
+#include "MinimizerMatch.h"
 #include "KmerAlign.h"
 
 // Note for versbosity: export BOOST_TEST_LOG_LEVEL=message
@@ -86,6 +87,7 @@ public:
 		KmerBaseOptions::_setOptions(desc,p);
 		KmerSpectrumOptions::_setOptions(desc,p);
 		KmerMatchOptions::_setOptions(desc,p);
+		MinimizerMatchOptions::_setOptions(desc,p);
 		KmerAlignOptions::_setOptions(desc,p);
 		MPIOptions::_setOptions(desc,p);
 	}
@@ -96,6 +98,7 @@ public:
 		ret &= KmerBaseOptions::_parseOptions(vm);
 		ret &= KmerSpectrumOptions::_parseOptions(vm);
 		ret &= KmerMatchOptions::_parseOptions(vm);
+		ret &= MinimizerMatchOptions::_parseOptions(vm);
 		ret &= KmerAlignOptions::_parseOptions(vm);
 		ret &= MPIOptions::_parseOptions(vm);
 		return ret;
@@ -116,11 +119,12 @@ bool containsRead(const ReadSet &rs, const Read &read) {
 	return hasRead;
 }
 
+template<typename Matcher>
 bool testMatchesSelf(mpi::communicator &world, ReadSet &q, ReadSet &t) {
 	LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "running testMatchesSelf on " << q.getSize() << " " << t.getSize());
 	bool passed = true;
 	bool isPair = MatcherInterfaceOptions::getOptions().getIncludeMate();
-	KmerMatch matcher(world, t);
+	Matcher matcher(world, t);
 	//std::cout << matcher.getKmerSpectrum().solid.toString() << std::endl;
 	MatcherInterface::MatchReadResults results = matcher.match(q);
 	passed &= results.size() == q.getSize();
@@ -206,13 +210,23 @@ int main(int argc, char **argv)
 	bool passed = true;
 
 	MatcherInterfaceOptions::getOptions().setIncludeMate(true);
-	passed &= testMatchesSelf(world, greads, greads);
-	passed &= testMatchesSelf(world, greads2, greads2);
+	passed &= testMatchesSelf<KmerMatch>(world, greads, greads);
+	passed &= testMatchesSelf<KmerMatch>(world, greads2, greads2);
 
 	MatcherInterfaceOptions::getOptions().setIncludeMate(false);
 	LOG_VERBOSE(1, "Ignoring pairs for matching");
-	passed &= testMatchesSelf(world, greads, greads);
-	passed &= testMatchesSelf(world, greads2, greads2);
+	passed &= testMatchesSelf<KmerMatch>(world, greads, greads);
+	passed &= testMatchesSelf<KmerMatch>(world, greads2, greads2);
+
+	MinimizerMatchOptions::getOptions().getMinimizerWindow() = 10;
+	MatcherInterfaceOptions::getOptions().setIncludeMate(true);
+	LOG_VERBOSE(1, "Matching with minimizers");
+	passed &= testMatchesSelf<MinimizerMatch>(world, greads, greads);
+	passed &= testMatchesSelf<MinimizerMatch>(world, greads2, greads2);
+
+	MatcherInterfaceOptions::getOptions().setIncludeMate(false);
+	passed &= testMatchesSelf<MinimizerMatch>(world, greads, greads);
+	passed &= testMatchesSelf<MinimizerMatch>(world, greads2, greads2);
 
 	return passed ? 0 : -1;
 }
@@ -159,7 +159,7 @@ int main(int argc, char **argv)
 		spam[i] = 'a' + (i%26);
 	}
 
-	int mb = 1;
+	int mb = 16;
 	LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "Send/Recv " << (mb) << "MB per rank");
 	world.barrier();
 	boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
@@ -169,25 +169,36 @@ int main(int argc, char **argv)
 
 	double rate = (double) mb  / (double) elapsed.total_milliseconds() * 1000.0;
 
-	world.barrier();
-	start = boost::posix_time::microsec_clock::local_time();
+	// compare the message buffer transports available to this world
+	std::vector< MessageTransport > transports;
+	transports.push_back(TRANSPORT_MPI);
+	if (world.size() == 1)
+		transports.push_back(TRANSPORT_SHM);
+
+	int numMessages = std::max(1, msgPerMb * mb / numThreads / world.size());
+	for(int t = 0; t < (int) transports.size(); t++) {
+		A2ABufferBase bench(world, sizeof(TextMessage), TextMessageProcessor(), 1, MPIOptions::getOptions().getTotalBufferSize(), 0.90, transports[t]);
+		std::string name = bench.getTransport() == TRANSPORT_SHM ? "shm" : "mpi";
+
+		world.barrier();
+		start = boost::posix_time::microsec_clock::local_time();
 
-	int numMessages = std::min(1, msgPerMb * mb / numThreads / world.size());
 #pragma omp parallel num_threads(numThreads)
-	{
-		int threadId = omp_get_thread_num();
-		for(int i = 0; i < numMessages; i++) {
-			for(int w=0; w < world.size() ; w++) {
-				a2a.bufferMessage(w, threadId, msgSize)->set(spam, msgSize);
+		{
+			int threadId = omp_get_thread_num();
+			for(int i = 0; i < numMessages; i++) {
+				for(int w=0; w < world.size() ; w++) {
+					bench.bufferMessage(w, threadId, msgSize)->set(spam, msgSize);
+				}
 			}
+			bench.finalize();
 		}
-		a2a.finalize();
-	}
 
-	end = boost::posix_time::microsec_clock::local_time();
-	elapsed = end - start;
-	rate = (double) mb / (double) elapsed.total_milliseconds() * 1000.0;
-	LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "MPI all2all messagebuffer: " << rate << " MB/s " << rate * 8 << " Mbit/s " << elapsed.total_milliseconds() << "ms");
+		end = boost::posix_time::microsec_clock::local_time();
+		elapsed = end - start;
+		rate = (double) mb / (double) std::max((long) 1, (long) elapsed.total_milliseconds()) * 1000.0;
+		LOG_VERBOSE_OPTIONAL(1, world.rank() == 0, "MPI all2all messagebuffer (" << name << " transport): " << rate << " MB/s " << rate * 8 << " Mbit/s " << elapsed.total_milliseconds() << "ms");
+	}
 
 	char *in = new char[spamMax * world.size()];
 	char *out = new char[spamMax * world.size()];
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+FR=../apps/FilterReads
+CS=../apps/CompareSpectrums
+
+TMP=$(mktemp testXXXXXX)
+export TMPDIR=/tmp
+if [ ! -f "$TMP" ]
+then
+  exit 1
+fi
+rm $TMP
+KEEP=${KEEP:=0}
+clean()
+{
+  [ X$KEEP != X0 ] || rm -rf $TMP*
+}
+trap clean 0 1 2 3 15
+
+# save the spectrums of 1000.fastq and of its two halves, which have half as many buckets
+head -2000 1000.fastq > $TMP-a.fastq
+tail -n +2001 1000.fastq > $TMP-b.fastq
+cp 1000.fastq $TMP-all.fastq
+for set in a b all
+do
+  echo "Executing: $FR --kmer-size 21 --min-depth 1 --save-kmer-mmap 1 --output-file $TMP-$set --input-file $TMP-$set.fastq"
+  if ! $FR --kmer-size 21 --min-depth 1 --save-kmer-mmap 1 --output-file $TMP-$set --input-file $TMP-$set.fastq > /dev/null 2>&1
+  then
+    echo "FAILED with exit status $?: $FR --kmer-size 21 --min-depth 1 --save-kmer-mmap 1 --output-file $TMP-$set --input-file $TMP-$set.fastq"
+    exit 1
+  fi
+done
+
+# the summary row of the saved spectrums is the same as the one built from the reads
+check()
+{
+  ref=$1
+  in=$2
+  thread=$3
+  echo "Executing: $CS --thread $thread --kmer-size 21 --reference-kmer-mmap $TMP-$ref-mmap --input-kmer-mmap $TMP-$in-mmap"
+  good=$($CS --thread $thread --kmer-size 21 --reference-file $TMP-$ref.fastq --input-file $TMP-$in.fastq 2>/dev/null | sed -n 3p)
+  saved=$($CS --thread $thread --kmer-size 21 --reference-kmer-mmap $TMP-$ref-mmap --input-kmer-mmap $TMP-$in-mmap 2>/dev/null | sed -n 3p)
+  if [ -z "$good" ] || [ "$good" != "$saved" ]
+  then
+    echo "FAILED $CS --thread $thread --kmer-size 21 --reference-kmer-mmap $TMP-$ref-mmap --input-kmer-mmap $TMP-$in-mmap"
+    echo "expected: $good"
+    echo "got:      $saved"
+    exit 1
+  fi
+}
+
+for thread in 1 4
+do
+  check a b $thread
+  check all a $thread
+  check b all $thread
+done
@@ -2,7 +2,7 @@
 
 FR=../apps/FilterReads
 FRP=../apps/FilterReads-P
-procs=$(($(lscpu -p | tail -1 | awk -F, '{print $2}')+1) || echo 2)
+procs=${PROCS:-$(($(lscpu -p | tail -1 | awk -F, '{print $2}')+1) || echo 2)}
 
 TMP=$(mktemp testXXXXXX)
 export TMPDIR=/tmp
@@ -20,6 +20,19 @@ trap clean 0 1 2 3 15
 
 IN=
 GOOD=
+OUT=MinDepth2
+UNORDERED=0
+
+# the fastq records of a file, sorted if the output order is not deterministic
+records()
+{
+  if [ X$UNORDERED != X0 ]
+  then
+    paste - - - - < $1 | sort
+  else
+    cat $1
+  fi
+}
 
 check()
 {
@@ -27,11 +40,11 @@ check()
   echo "Executing: $@ $opts"
   if $@ $opts
   then
-    if ! diff -w -q $TMP-MinDepth2-$IN $GOOD
+    if ! diff -w -q <(records $TMP-$OUT-$IN) <(records $GOOD)
     then
        echo "FAILED $@ --out $TMP 31 $IN"
-       wc $TMP-MinDepth2-$IN $GOOD
-       diff -w $TMP-MinDepth2-$IN $GOOD | head -50
+       wc $TMP-$OUT-$IN $GOOD
+       diff -w <(records $TMP-$OUT-$IN) <(records $GOOD) | head -50
        exit 1
     fi
   else
@@ -40,6 +53,13 @@ check()
   fi
 }
 
+# 1000.fastq followed by copies of the first 50 read 1s, each with one substituted base, for --correct-reads
+errors()
+{
+  awk 'NR<=400 && NR%8>=1 && NR%8<=4 { if (NR%8==1) sub(/\/1$/,"err/1"); if (NR%8==2) { b=substr($0,40,1); $0=substr($0,1,39) (b=="A"?"C":"A") substr($0,41) } print }' 1000.fastq > $TMP-err
+  cat 1000.fastq $TMP-err > $TMP-errors.fastq
+}
+
 // make sure base quality conversions work fine
 IN=1000.fastq
 GOOD=1000-Filtered-0.85.std.fastq
@@ -75,6 +95,84 @@ do
   rm -f $TMP*
 done
 
+# a spectrum built in parts, from the reads or from disk kmer bins, is the same as one built at once
+for thread in 1 3
+do
+  check $FR --fastq-output-base-quality 64 --min-read-length 25 --thread $thread --build-partitions 4
+  check $FR --fastq-output-base-quality 64 --min-read-length 25 --thread $thread --build-partitions 4 --build-external 1
+  for parts in "" "--build-partitions 2"
+  do
+    check $FR --fastq-output-base-quality 64 --min-read-length 25 --thread $thread $parts --max-memory 1
+    check $FR --fastq-output-base-quality 64 --min-read-length 25 --thread $thread $parts --max-memory 1 --build-external 1
+  done
+  rm -f $TMP*
+done
+
+# the kmers of 1000.fastq fit in 1 MB, so plan and split the parts of the ~4 MB spectrum of reads tiling a random 150 kb genome:
+# --max-memory 1 plans 5 parts, and with --build-partitions 2 the first part is too big and the rest are split by 4
+awk 'BEGIN { srand(49); for(i=0;i<150000;i++) g=g substr("ACGT",int(rand()*4)+1,1); q=sprintf("%76s",""); gsub(/ /,"h",q);
+  for(i=0;i+76<=150000;i+=20) print "@g" i "\n" substr(g,i+1,76) "\n+\n" q }' > $TMP-genome.fastq
+IN=$TMP-genome.fastq
+$FR --fastq-output-base-quality 64 --min-read-length 25 --kmer-scoring-type MEDIAN --mask-simple-repeats 0 --artifact-edit-distance 1 --out $TMP-whole 31 $IN || exit 1
+mv $TMP-whole-$OUT-$IN $TMP-genome-Filtered.fastq
+GOOD=$TMP-genome-Filtered.fastq
+for thread in 1 3
+do
+  for parts in "" "--build-partitions 2"
+  do
+    check $FR --fastq-output-base-quality 64 --min-read-length 25 --thread $thread $parts --max-memory 1
+    check $FR --fastq-output-base-quality 64 --min-read-length 25 --thread $thread $parts --max-memory 1 --build-external 1
+  done
+done
+rm -f $TMP*
+IN=1000.fastq
+GOOD=1000-Filtered.fastq
+
+# OPTIMAL normalization picks the same reads with any number of threads
+GOOD=1000-Filtered-optimal.fastq
+OUT=MinDepth2-MaxDepth3
+for thread in {1..3}
+do
+  check $FR --fastq-output-base-quality 64 --min-read-length 25 --thread $thread --max-kmer-output-depth 3 --normalization-method OPTIMAL
+  rm -f $TMP*
+done
+OUT=MinDepth2
+
+# --dedup-sort keeps the pair with the highest total quality: append lower quality copies of 50 pairs,
+# named so their read 2 comes before their read 1, and only the originals remain
+awk 'NR<=400 { r[(NR-1)%8]=$0; if (NR%8==0) { sub(/\/1$/,"dup/1",r[0]); sub(/\/2$/,"dup/2",r[4]); gsub(/./,"K",r[3]); gsub(/./,"h",r[7]);
+  print r[4] "\n" r[5] "\n" r[6] "\n" r[7] > "'$TMP'-dups2"; print r[0] "\n" r[1] "\n" r[2] "\n" r[3] > "'$TMP'-dups1" } }' 1000.fastq
+IN=$TMP-dups.fastq
+cat 1000.fastq $TMP-dups2 $TMP-dups1 > $IN
+GOOD=1000-Filtered.fastq
+check $FR --fastq-output-base-quality 64 --min-read-length 25 --dedup-mode 1 --dedup-consensus 0 --dedup-sort 1
+rm -f $TMP*
+IN=1000.fastq
+
+# STREAMING keeps the same reads from interleaved pairs and from separate read 1 and read 2 files
+GOOD=1000-Filtered-streaming.fastq
+OUT=MaxDepth3
+streaming="--fastq-output-base-quality 64 --min-read-length 25 --max-kmer-output-depth 3 --normalization-method STREAMING --streaming-sketch-mb 1"
+check $FR $streaming
+paste - - - - - - - - < $IN | awk -F'\t' '{ print $1 "\n" $2 "\n" $3 "\n" $4 > "'$TMP'-r1.fastq"; print $5 "\n" $6 "\n" $7 "\n" $8 > "'$TMP'-r2.fastq" }'
+echo "Executing: $FR $streaming --out $TMP-split 31 $TMP-r1.fastq $TMP-r2.fastq"
+if ! $FR $streaming --out $TMP-split 31 $TMP-r1.fastq $TMP-r2.fastq || \
+   ! diff -w -q <(cat $TMP-split-$OUT-$TMP-r1.fastq $TMP-split-$OUT-$TMP-r2.fastq | paste - - - - | sort) <(paste - - - - < $GOOD | sort)
+then
+  echo "FAILED $FR $streaming --out $TMP-split 31 $TMP-r1.fastq $TMP-r2.fastq"
+  exit 1
+fi
+rm -f $TMP*
+OUT=MinDepth2
+
+# --correct-reads restores the substituted bases
+errors
+IN=$TMP-errors.fastq
+GOOD=1000-Filtered-corrected.fastq
+check $FR --fastq-output-base-quality 64 --min-read-length 25 --correct-reads 1
+rm -f $TMP*
+IN=1000.fastq
+
 MPI=""
 MPI_OPTS=""
 
@@ -114,6 +212,18 @@ then
     rm -f $TMP*
     check $MPI $MPI_OPTS $mpi $FRP --fastq-output-base-quality 64 --min-read-length 25
     rm -f $TMP*
+
+    check $MPI $MPI_OPTS $mpi $FRP --fastq-output-base-quality 64 --min-read-length 25 --checkpoint-reads 100
+    check $MPI $MPI_OPTS $mpi $FRP --fastq-output-base-quality 64 --min-read-length 25 --resume-from $TMP-checkpoint
+    rm -f $TMP*
+
+    errors
+    IN=$TMP-errors.fastq
+    GOOD=1000-Filtered-corrected.fastq
+    check $MPI $MPI_OPTS $mpi $FRP --fastq-output-base-quality 64 --min-read-length 25 --correct-reads 1
+    rm -f $TMP*
+    IN=1000.fastq
+    GOOD=1000-Filtered.fastq
     
     # TODO restore save/load kmer map in MPI version...
     #check $MPI $MPI_OPTS $mpi $FRP --fastq-output-base-quality 64 --min-read-length 25 --thread 1 --save-kmer-mmap 1
@@ -125,6 +235,15 @@ then
     mv $TMP-mmap $TMP-mmap-saved
     check $MPI $MPI_OPTS $mpi $FRP --fastq-output-base-quality 64 --min-read-length 25 --load-kmer-mmap $TMP-mmap-saved
     rm -f $TMP*
+
+    # OPTIMAL picks the same reads as the serial version, but writes them in rank order
+    GOOD=1000-Filtered-optimal.fastq
+    OUT=MinDepth2-MaxDepth3
+    UNORDERED=1
+    check $MPI $MPI_OPTS $mpi $FRP --fastq-output-base-quality 64 --min-read-length 25 --max-kmer-output-depth 3 --normalization-method OPTIMAL
+    rm -f $TMP*
+    OUT=MinDepth2
+    UNORDERED=0
   done
 fi
 
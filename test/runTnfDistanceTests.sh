@@ -0,0 +1,62 @@
+#!/bin/bash
+
+TD=../apps/TnfDistance
+
+TMP=$(mktemp testXXXXXX)
+export TMPDIR=/tmp
+if [ ! -f "$TMP" ]
+then
+  exit 1
+fi
+rm $TMP
+KEEP=${KEEP:=0}
+clean()
+{
+  [ X$KEEP != X0 ] || rm -rf $TMP*
+}
+trap clean 0 1 2 3 15
+
+# 20 random 5 kb contigs from each of 3 genomes with 20%, 50% and 80% GC
+awk 'BEGIN { srand(39); split("0.2 0.5 0.8", gc, " ");
+  for (g = 1; g <= 3; g++) for (c = 0; c < 20; c++) {
+    s = ""; for (i = 0; i < 5000; i++) { r = rand(); s = s (rand() < gc[g] ? (r < 0.5 ? "G" : "C") : (r < 0.5 ? "A" : "T")) }
+    print ">g" g "c" c; print s } }' > $TMP.fa
+IN=$TMP.fa
+
+# the clusters of a cluster file, in a canonical order
+clusters()
+{
+  awk '{ $1 = $1; for (i = 2; i <= NF; i++) for (j = i; j > 1 && $(j-1) > $j; j--) { t = $j; $j = $(j-1); $(j-1) = t } print }' $1 | sort
+}
+
+# the approximate LSH clusters are the same as the exact ones
+check()
+{
+  echo "Executing: $TD $@ --cluster-file $TMP-lsh.cl --output-file /dev/null $IN"
+  if ! $TD "$@" --cluster-file $TMP-lsh.cl --output-file /dev/null $IN > /dev/null 2>&1
+  then
+    echo "FAILED with exit status $?: $TD $@ --cluster-file $TMP-lsh.cl --output-file /dev/null $IN"
+    exit 1
+  fi
+  if ! diff -q <(clusters $TMP-exact.cl) <(clusters $TMP-lsh.cl) > /dev/null
+  then
+    echo "FAILED $TD $@ --cluster-file $TMP-lsh.cl --output-file /dev/null $IN"
+    diff <(clusters $TMP-exact.cl) <(clusters $TMP-lsh.cl) | head -50
+    exit 1
+  fi
+}
+
+for formula in "--distance-formula 0" "--distance-formula 1 --cluster-threshold-distance 0.05"
+do
+  echo "Executing: $TD $formula --cluster-file $TMP-exact.cl --output-file /dev/null $IN"
+  if ! $TD $formula --cluster-file $TMP-exact.cl --output-file /dev/null $IN > /dev/null 2>&1
+  then
+    echo "FAILED with exit status $?: $TD $formula --cluster-file $TMP-exact.cl --output-file /dev/null $IN"
+    exit 1
+  fi
+  for thread in 1 3
+  do
+    check $formula --thread $thread --cluster-lsh-tables 4
+    check $formula --thread $thread --cluster-lsh-tables 8
+  done
+done